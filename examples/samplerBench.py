@@ -0,0 +1,40 @@
+import numpy as np
+import time as time
+import argparse as argparse
+
+import kali.carma
+
+parser = argparse.ArgumentParser()
+parser.add_argument('-nthreads', '--nthreads', type=int, default=None, help=r'Number of threads to use')
+parser.add_argument('-nwalkers', '--nwalkers', type=int, default=160, help=r'Number of walkers')
+parser.add_argument('-nsteps', '--nsteps', type=int, default=250, help=r'Number of steps per walker')
+parser.add_argument('-T', '--T', type=float, default=1000.0, help=r'Duration of mock light curve')
+args = parser.parse_args()
+
+p = 3
+q = 1
+dt = 0.02
+Rho = np.array([-1.0/1.5, -1.0/62.0, -1.0/140.0, -1.0/0.1725, 1.0])
+Theta = kali.carma.coeffs(p, q, Rho)
+
+if args.nthreads is None:
+    newTask = kali.carma.CARMATask(p, q, nwalkers=args.nwalkers, nsteps=args.nsteps)
+else:
+    newTask = kali.carma.CARMATask(p, q, nthreads=args.nthreads, nwalkers=args.nwalkers, nsteps=args.nsteps)
+newTask.set(dt, Theta)
+newLC = newTask.simulate(args.T, fracNoiseToSignal=1.0e-3)
+newTask.observe(newLC)
+
+print 'CARMA(%d,%d); %d walkers; %d steps; %d threads'%(p, q, args.nwalkers, args.nsteps, newTask.nthreads)
+wallTime, utilization = dict(), dict()
+for sampler in ['ensemble', 'async']:
+    startTime = time.time()
+    newTask.fit(newLC, zSSeed=384789247, walkerSeed=738472981, moveSeed=131343786, xSeed=2348713647,
+                sampler=sampler)
+    stopTime = time.time()
+    wallTime[sampler] = stopTime - startTime
+    utilization[sampler] = newTask.samplerUtilization
+    print '%8s: wall time %8.3f s; core utilization %5.1f%%; DIC %e'%(sampler, wallTime[sampler],
+                                                                      100.0*utilization[sampler], newTask.dic)
+print 'async/ensemble: speedup %5.2fx; utilization %+5.1f points'%(
+    wallTime['ensemble']/wallTime['async'], 100.0*(utilization['async'] - utilization['ensemble']))
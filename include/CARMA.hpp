@@ -22,6 +22,14 @@ double calcLnPosterior(double* walkerPos, void* vdPtr2LnLikeArgs, double & LnPri
 
 void getSigma(int numR, int numP, int numQ, double *Theta, double *SigmaOut);
 
+/*!
+Versions of the random-number layout used by the CARMA simulators. A given seed reproduces the same light curve only within one version.
+*/
+enum RNGMode {
+	RNG_PER_CADENCE = 1, /*!< One VSL call per cadence (the original layout, and the default). */
+	RNG_BLOCK = 2 /*!< One VSL call per run of cadences with a common time step, followed by a batched multiply by the Cholesky factor of Q. */
+	};
+
 struct LnLikeData {
 	int numCadences;
 	int cadenceNum;
@@ -58,6 +66,7 @@ private:
 	int pSq;
 	int qSq;
 	double dt; // This is the last used step time to compute F, D and Q.
+	int rngMode; // kali::RNGMode used by the simulators.
 	// ilo, ihi and abnrm are arrays of size 1 so they can be re-used by everything. No need to make multiple copies for A, CAR and CMA
 	lapack_int *ilo; // len 1
 	lapack_int *ihi; // len 1
@@ -107,6 +116,8 @@ public:
 	double get_dt();
 	void set_dt(double new_dt);
 	int get_allocated();
+	int get_rngMode();
+	void set_rngMode(int mode);
 
 	void printX();
 	void getX(double *newX);
@@ -153,6 +164,7 @@ public:
 	void burnSystem(int numBurn, unsigned int burnSeed, double* burnRand);
 	void simulateSystem(LnLikeData *ptr2LnLikeData, unsigned int distSeed, double *distRand);
 	void extendSystem(LnLikeData *ptr2Data, unsigned int distSeed, double *distRand);
+	void simulateBlocks(int firstCadence, int numCadences, double tolIR, double *t, double *x, VSLStreamStatePtr distStream, double *distRand);
 	double getMeanFlux(LnLikeData *ptr2Data);
 	void observeNoise(LnLikeData *ptr2LnLikeData, unsigned int noiseSeed, double* noiseRand);
 	void extendObserveNoise(LnLikeData *ptr2Data, unsigned int noiseSeed, double* noiseRand);
@@ -160,6 +172,7 @@ public:
 	double updateLnLikelihood(LnLikeData *ptr2LnLikeData);
 	double computeLnPrior(LnLikeData *ptr2LnLikeData);
 	void computeACVF(int numLags, double *Lags, double* ACVF);
+	int simulateCirculant(LnLikeData *ptr2Data, unsigned int distSeed);
 	int RTSSmoother(LnLikeData *ptr2Data, double *XSmooth, double *PSmooth);
 	};
 
@@ -169,6 +182,26 @@ struct LnLikeArgs {
 	LnLikeData *Data;
 	};
 
+/*!
+Model policy for BasicEnsembleSampler (see MCMC.hpp). evaluator(threadNum) returns an Evaluator bound to Systems[threadNum], so the sampler calls the posterior directly on each thread instead of going through calcLnPosterior, the void* argument block and omp_get_thread_num().
+*/
+class CARMAPosterior {
+private:
+	CARMA *Systems;
+	LnLikeData *Data;
+public:
+	class Evaluator {
+	private:
+		CARMA *System;
+		LnLikeData *Data;
+	public:
+		Evaluator(CARMA *system, LnLikeData *data);
+		double operator()(double *walkerPos, double &LnPrior, double &LnLikelihood);
+		};
+	CARMAPosterior(CARMA *systems, LnLikeData *data);
+	Evaluator evaluator(int threadNum);
+	};
+
 void zeroMatrix(int nRows, int nCols, int* mat);
 
 void zeroMatrix(int nRows, int nCols, double* mat);
@@ -8,6 +8,7 @@
 #include <mkl.h>
 
 #include "CARMA.hpp"
+#include "MCMC.hpp"
 #include "Constants.hpp"
 
 using namespace std;
@@ -21,6 +22,11 @@ private:
     static int r;
 	int numThreads;
 	int numBurn;
+	double samplerUtilization, lnEvidence, lnEvidenceErr;
+	bool nestConverged;
+	double moveWeights[kali::NUM_MOVE_TYPES], moveAcceptance[kali::NUM_MOVE_TYPES];
+	long numSurrogateEvals, numExactEvals, numOptimizerEvals;
+	int numModes;
 	kali::CARMA *Systems;
 	bool *setSystemsVec;
 	double *ThetaVec;
@@ -31,8 +37,19 @@ public:
 	int reset_CARMATask(int pGiven, int qGiven, int numBurn);
 	int get_numBurn();
 	void set_numBurn(int numBurn);
+	double get_samplerUtilization();
+	double get_lnEvidence();
+	double get_lnEvidenceErr();
+	bool get_nestConverged();
+	void get_moveStats(double *Weights, double *Acceptance);
+	long get_numSurrogateEvals();
+	long get_numExactEvals();
+	long get_numOptimizerEvals();
+	int get_numModes();
 	int check_Theta(double *Theta, int threadNum);
 	double get_dt(int threadNum);
+	int get_rngMode();
+	int set_rngMode(int mode);
 	void get_Theta(double *Theta, int threadNum);
 	int set_System(double dt, double *Theta, int threadNum);
 	int reset_System(int threadNum);
@@ -47,9 +64,11 @@ public:
 	int set_P(double *newP, int threadNum);
 
 	int make_IntrinsicLC(int numCadences, double tolIR, double fracIntrinsicVar, double fracNoiseToSignal, double *t, double *x, double *y, double *yerr, double *mask, double *lcX, double *lcP, unsigned int burnSeed, unsigned int distSeed, int threadNum);
+	int make_CirculantLC(int numCadences, double tolIR, double *t, double *x, double *y, double *yerr, double *mask, unsigned int distSeed, int threadNum);
 	int extend_IntrinsicLC(int numCadences, int cadenceNum, double tolIR, double fracIntrinsicVar, double fracNoiseToSignal, double *t, double *x, double *y, double *yerr, double *mask, double *lcX, double *lcP, unsigned int distSeed, int threadNum);
 	double get_meanFlux(double fracIntrinsicVar, int threadNum);
 	int  make_ObservedLC(int numCadences, double tolIR, double fracIntrinsicVar, double fracNoiseToSignal, double *t, double *x, double *y, double *yerr, double *mask, unsigned int burnSeed, unsigned int distSeed, unsigned int noiseSeed, int threadNum);
+	int make_ObservedLCBatch(int numLCs, int *cadenceOffsets, double tolIR, double *Theta, double *fracIntrinsicVar, double *fracNoiseToSignal, double *t, double *x, double *y, double *yerr, double *mask, unsigned int *burnSeeds, unsigned int *distSeeds, unsigned int *noiseSeeds, int *Status);
 	int add_ObservationNoise(int numCadences, double tolIR, double fracIntrinsicVar, double fracNoiseToSignal, double *t, double *x, double *y, double *yerr, double *mask, unsigned int noiseSeed, int threadNum);
 	int extend_ObservationNoise(int numCadences, int cadenceNum, double tolIR, double fracIntrinsicVar, double fracNoiseToSignal, double *t, double *x, double *y, double *yerr, double *mask, unsigned int noiseSeed, int threadNum);
 
@@ -64,11 +83,15 @@ public:
 
 	void compute_ACVF(int numLags, double *Lags, double *ACVF, int threadNum);
 
-	int fit_CARMAModel(double dt, int numCadences, double tolIR, double maxSigma, double minTimescale, double maxTimescale, double *t, double *x, double *y, double *yerr, double *mask, int nwalkers, int nsteps, int maxEvals, double xTol, double mcmcA, unsigned int zSSeed, unsigned int walkerSeed, unsigned int moveSeed, unsigned int xSeed, double* xStart, double *Chain, double *LnPrior, double *LnLikelihood, bool Bp);
+	int fit_CARMAModel(double dt, int numCadences, double tolIR, double maxSigma, double minTimescale, double maxTimescale, double *t, double *x, double *y, double *yerr, double *mask, int nwalkers, int nsteps, int maxEvals, double xTol, double mcmcA, unsigned int zSSeed, unsigned int walkerSeed, unsigned int moveSeed, unsigned int xSeed, double* xStart, double *Chain, double *LnPrior, double *LnLikelihood, bool Bp, int samplerType, double *MoveWeights, int numAdaptSteps, int surrogateBin, int numOptStarts);
+	int nest_CARMAModel(double dt, int numCadences, double tolIR, double maxSigma, double minTimescale, double maxTimescale, double *t, double *x, double *y, double *yerr, double *mask, int numLive, double lnZTol, int maxIter, unsigned int nestSeed, int numStart, double *xStart, int maxSamples, double *Samples, double *LnPrior, double *LnLikelihood, double *LnWeight);
+	int laplace_CARMAModel(int numLCs, int *cadenceOffsets, double tolIR, double *maxSigma, double *minTimescale, double *maxTimescale, double *t, double *x, double *y, double *yerr, double *mask, int numStarts, double *xStart, int maxEvals, double xTol, double *MAP, double *Cov, double *LnPosteriorMAP, double *LnLaplace, int *Status);
 
 	int smooth_RTS(int numCadences, int cadenceNum, double tolIR, double *t, double *x, double *y, double *yerr, double *mask, double *lcX, double *lcP, double *XSmooth, double *PSmooth, int threadNum);
 	};
 
+int searchCARMAOrders(int numOrders, int *pVals, int *qVals, int numThreads, int numCadences, double tolIR, double maxSigma, double minTimescale, double maxTimescale, double *t, double *x, double *y, double *yerr, double *mask, int minGapRun, int numStarts, unsigned int startSeed, int maxEvals, double xTol, double *MAP, double *Cov, double *LnPosteriorMAP, double *BIC, int *Status);
+
 } //namespace kali
 
 #endif
@@ -0,0 +1,19 @@
+#ifndef CADENCE_HPP
+#define CADENCE_HPP
+
+using namespace std;
+
+namespace kali {
+
+/*!
+Survey sampling patterns applied to a time grid t (sorted) and its mask. Each function only clears mask entries, so they can be chained to build up a cadence, e.g. seasons, then nights, then weather, then visits. All return the number of cadences left unmasked, or -1 if the pattern parameters are invalid (the mask is then left unchanged). Random patterns draw from one VSL stream seeded with the given seed and are reproducible for a given grid.
+*/
+int maskWindows(int numCadences, double *t, double *mask, double period, double openLength, double phase);
+int maskWeather(int numCadences, double *t, double *mask, double blockLength, double lossFraction, double persistence, unsigned int weatherSeed);
+int maskVisits(int numCadences, double *t, double *mask, double blockLength, int visitsPerBlock, unsigned int visitSeed);
+int maskThrusterFires(int numCadences, double *t, double *mask, double firePeriod, double fireWidth, double jitter, unsigned int fireSeed);
+int maskRolling(int numCadences, double *t, double *mask, double seasonPeriod, int numStripes, int stripe, double backgroundFraction, unsigned int rollSeed);
+
+} // namespace kali
+
+#endif
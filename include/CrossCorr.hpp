@@ -0,0 +1,29 @@
+#ifndef CROSSCORR_HPP
+#define CROSSCORR_HPP
+
+using namespace std;
+
+namespace kali {
+
+enum CrossCorrMethod {
+	CCF_DCF = 0,
+	CCF_ZDCF = 1,
+	CCF_ICCF = 2
+	};
+
+/*!
+Cross-correlation of two irregularly sampled light curves (t1, y1) and (t2, y2), both sorted in time. Cadences with mask = 0 are ignored. A positive lag means that the second light curve follows the first, i.e. the pairs binned at lag tau have t2 - t1 = tau. All functions return -1 for invalid arguments.
+
+dcf: Edelson & Krolik 1988 discrete correlation function in numBins (>= 2) bins centred on the sorted lagVals, with edges midway between them. dcfErrVals follows EK 1988 and numPairVals holds the number of pairs per bin.
+zdcf: z-transformed DCF of Alexander 1997. Pairs with minLag <= tau <= maxLag are sorted by lag and taken into bins of minPairs (>= 4) pairs, a pair being skipped if either of its cadences is already in the bin. Each bin holds the Pearson coefficient of its pairs with the errors from the bias-corrected Fisher z transform. Returns the number of bins filled, at most maxBins.
+iccf: interpolated CCF of Gaskell & Peterson 1987, the mean of the coefficients from interpolating the second light curve at t1 + tau and the first at t2 - tau, with the means and variances taken over the overlapping points only (White & Peterson 1994).
+crossCorrMC: lag uncertainties by flux randomization and random subset selection (Peterson et al. 1998, 2004). Each of numRealizations realizations draws its own subset of each light curve (with replacement, duplicates kept once with errors reduced by the square root of their multiplicity) and/or perturbs the fluxes by their errors, computes the CCF of the chosen method on lagVals (for CCF_ZDCF, between lagVals[0] and lagVals[numLags - 1] in bins of minPairs pairs), and records the lag of the peak, the centroid of the contiguous region around the peak above threshold times the peak value, and the peak value itself (NaN if the realization has no valid CCF). Realization k draws from VSL_BRNG_MT2203 stream k, so the results depend on mcSeed but not on the number of threads.
+*/
+int dcf(int numCadences1, double *t1, double *y1, double *yerr1, double *mask1, int numCadences2, double *t2, double *y2, double *yerr2, double *mask2, int numBins, double *lagVals, double *dcfVals, double *dcfErrVals, double *numPairVals);
+int zdcf(int numCadences1, double *t1, double *y1, double *mask1, int numCadences2, double *t2, double *y2, double *mask2, double minLag, double maxLag, int minPairs, int maxBins, double *lagVals, double *zdcfVals, double *zdcfErrLowVals, double *zdcfErrHighVals, double *numPairVals);
+int iccf(int numCadences1, double *t1, double *y1, double *mask1, int numCadences2, double *t2, double *y2, double *mask2, int numLags, double *lagVals, double *iccfVals);
+int crossCorrMC(int method, int numCadences1, double *t1, double *y1, double *yerr1, double *mask1, int numCadences2, double *t2, double *y2, double *yerr2, double *mask2, int numLags, double *lagVals, int minPairs, double threshold, int numRealizations, int fluxRandomization, int subsetSelection, unsigned int mcSeed, double *peakLagVals, double *centroidLagVals, double *peakVals);
+
+} // namespace kali
+
+#endif
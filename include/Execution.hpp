@@ -0,0 +1,78 @@
+#ifndef EXECUTION_HPP
+#define EXECUTION_HPP
+
+#include <omp.h>
+#include <mutex>
+#include <condition_variable>
+
+using namespace std;
+
+namespace kali {
+
+/*!
+Task classes that draw threads from the shared ExecutionContext. Each kind has its own concurrency limit and usage counters.
+*/
+enum TaskKind {
+	CARMA_TASK = 0,
+	MBHB_TASK = 1,
+	MBHBCARMA_TASK = 2,
+	LC_TASK = 3,
+	NUM_TASK_KINDS = 4
+	};
+
+/*!
+Process-wide thread budget shared by CARMATask, MBHBTask, MBHBCARMATask and the light curve statistics of LC.hpp.
+
+Every parallel entry point (fit_*Model, nest_*Model, laplace_*Model, make_*, the likelihood members and the LC statistics) leases threads from the context for its duration through ThreadLease instead of calling omp_set_num_threads(numThreads) on its own, so several tasks running at once (e.g. from Python threads) share maxThreads cores rather than oversubscribing them. A lease is granted min(requested, free threads, free threads of its task kind) threads and blocks only when that is zero. The likelihood and posterior members run a serial Kalman filter and lease a single thread; the LC statistics ask for maxThreads. The OpenMP runtime keeps its own persistent worker threads; the context only decides how many of them each region may use.
+
+Each compiled module (CARMATask_cython, MBHBTask_cython, ...) links its own copy of this code, so the context itself lives in the Execution_cython module and the task modules are pointed at it with attach_ExecutionContext when they are imported. Without an attached context get_ExecutionContext returns a module-local one sized to omp_get_num_procs().
+*/
+class ExecutionContext {
+private:
+	int maxThreads, activeThreads, peakThreads;
+	int taskLimit[kali::NUM_TASK_KINDS], taskActive[kali::NUM_TASK_KINDS], taskPeak[kali::NUM_TASK_KINDS];
+	long taskLeases[kali::NUM_TASK_KINDS], taskClipped[kali::NUM_TASK_KINDS], taskWaits[kali::NUM_TASK_KINDS];
+	double taskThreadSeconds[kali::NUM_TASK_KINDS], taskWaitSeconds[kali::NUM_TASK_KINDS];
+	double startTime;
+	mutex lock;
+	condition_variable released;
+	int available(int taskKind);
+public:
+	ExecutionContext() = delete;
+	ExecutionContext(int maxThreadsGiven);
+	int get_maxThreads();
+	void set_maxThreads(int maxThreadsGiven);
+	int get_taskLimit(int taskKind);
+	void set_taskLimit(int taskKind, int limit);
+	int get_activeThreads();
+	int acquire(int taskKind, int requested);
+	void release(int taskKind, int granted, double seconds);
+	void get_Stats(long *Leases, long *Clipped, long *Waits, int *Peak, double *ThreadSeconds, double *WaitSeconds, int &peakThreadsOut, double &elapsed);
+	void reset_Stats();
+	};
+
+kali::ExecutionContext* get_ExecutionContext();
+void attach_ExecutionContext(kali::ExecutionContext *context);
+
+/*!
+Scoped lease of threads from the shared ExecutionContext. The constructor blocks until at least one thread is free, calls omp_set_num_threads with the grant and limits MKL on the calling thread to the grant with mkl_set_num_threads_local; the destructor restores the OpenMP and MKL limits of the caller, returns the threads and records the thread-seconds used.
+
+A lease taken while the calling thread already holds one, e.g. fit_CARMAModel calling into the LC statistics, or inside a parallel region, e.g. kali::batchStats calling kali::dacf per object, is nested: it does not touch the context and is granted min(requested, outer grant) threads, or 1 inside a parallel region, so a thread never waits on threads it holds itself.
+*/
+class ThreadLease {
+private:
+	int taskKind, numThreads, outerThreads, prevMKLThreads, prevOMPThreads;
+	bool nested;
+	double startTime;
+public:
+	ThreadLease() = delete;
+	ThreadLease(const ThreadLease&) = delete;
+	ThreadLease& operator=(const ThreadLease&) = delete;
+	ThreadLease(int taskKindGiven, int requested);
+	~ThreadLease();
+	int get_numThreads();
+	};
+
+} // namespace kali
+
+#endif
@@ -5,10 +5,25 @@ using namespace std;
 
 namespace kali {
 
-int acvf(int numCadences, double dt, double *tIn, double *xIn, double *yIn, double *yerrIn, double *maskIn, double *lagVals, double *acvfVals, double *acvfErrVals);
-int acf(int numCadences, double dt, double *tIn, double *xIn, double *yIn, double *yerrIn, double *maskIn, double *lagVals, double *acvfVals, double *acvfErrVals);
-int sf(int numCadences, double dt, double *tIn, double *xIn, double *yIn, double *yerrIn, double *maskIn, double *lagVals, double *sfVals, double * sfErrVals);
-int dacf(int numCadences, double dt, double *tIn, double *xIn, double *yIn, double *yerrIn, double *maskIn, int numBins, double *lagVals, double *dacvfVals, double *dacvfErrVals);
+enum BatchStat {
+	STAT_MOMENTS = 1,
+	STAT_ACVF = 2,
+	STAT_SF = 4,
+	STAT_SFBINNED = 8,
+	STAT_DACF = 16,
+	STAT_PERIODOGRAM = 32
+	};
+
+const int numMoments = 5; // Number of unmasked cadences, mean, mean error, std, std of the errors
+
+int acvf(int numCadences, double dt, double *tIn, double *xIn, double *yIn, double *yerrIn, double *maskIn, double *lagVals, double *acvfVals, double *acvfErrVals, int bruteForce);
+int acf(int numCadences, double dt, double *tIn, double *xIn, double *yIn, double *yerrIn, double *maskIn, double *lagVals, double *acvfVals, double *acvfErrVals, int bruteForce);
+int sf(int numCadences, double dt, double *tIn, double *xIn, double *yIn, double *yerrIn, double *maskIn, double *lagVals, double *sfVals, double * sfErrVals, int bruteForce);
+int sfBinned(int numCadences, double *tIn, double *yIn, double *yerrIn, double *maskIn, int numBins, double *binEdges, double *lagVals, double *sfVals, double *sfErrVals, double *numPairVals);
+int dacf(int numCadences, double *tIn, double *xIn, double *yIn, double *yerrIn, double *maskIn, int numBins, double *lagVals, double *dacvfVals, double *dacvfErrVals);
+int lombScargle(int numCadences, double *tIn, double *yIn, double *yerrIn, double *maskIn, double freqMin, double freqStep, int numFreqs, int fitMean, int bruteForce, double *powerVals);
+int lombScargleBatch(int numLCs, int *cadenceOffsets, double *tIn, double *yIn, double *yerrIn, double *maskIn, double freqMin, double freqStep, int numFreqs, int fitMean, int bruteForce, double *powerVals);
+int batchStats(int numLCs, int *cadenceOffsets, double *tIn, double *yIn, double *yerrIn, double *maskIn, int statFlags, double *momentVals, double *acvfLags, double *acvfVals, double *acvfErrVals, double *sfLags, double *sfVals, double *sfErrVals, int numSFBins, double *sfBinEdges, double *sfBinLags, double *sfBinVals, double *sfBinErrVals, double *sfBinPairs, int numDACFBins, double *dacfLags, double *dacfVals, double *dacfErrVals, double freqMin, double freqStep, int numFreqs, int fitMean, double *powerVals);
 
 } // namespace kali
 
@@ -21,6 +21,7 @@ private:
     static int r;
 	int numThreads;
 	int numBurn;
+	double samplerUtilization, lnEvidence, lnEvidenceErr;
 	kali::MBHBCARMA *Systems;
 	bool *setSystemsVec;
 	double *ThetaVec;
@@ -31,6 +32,9 @@ public:
 	int reset_MBHBCARMATask(int pGiven, int qGiven, int numBurn);
 	int get_numBurn();
 	void set_numBurn(int numBurn);
+	double get_samplerUtilization();
+	double get_lnEvidence();
+	double get_lnEvidenceErr();
 	int check_Theta(double *Theta, int threadNum);
 	double get_dt(int threadNum);
 	void get_Theta(double *Theta, int threadNum);
@@ -108,7 +112,7 @@ public:
 
 	//void compute_ACVF(int numLags, double *Lags, double *ACVF, int threadNum);
 
-	int fit_MBHBCARMAModel(double dt, int numCadences, double meandt, double tolIR, double maxSigma, double minTimescale, double maxTimescale, double lowestFlux, double highestFlux, double startT, double *t, double *x, double *y, double *yerr, double *mask, int nwalkers, int nsteps, int maxEvals, double xTol, double mcmcA, unsigned int zSSeed, unsigned int walkerSeed, unsigned int moveSeed, unsigned int xSeed, double* xStart, double *Chain, double *LnPrior, double *LnLikelihood, double periodCenter, double periodWidth, double fluxCenter, double fluxWidth);
+	int fit_MBHBCARMAModel(double dt, int numCadences, double meandt, double tolIR, double maxSigma, double minTimescale, double maxTimescale, double lowestFlux, double highestFlux, double startT, double *t, double *x, double *y, double *yerr, double *mask, int nwalkers, int nsteps, int maxEvals, double xTol, double mcmcA, unsigned int zSSeed, unsigned int walkerSeed, unsigned int moveSeed, unsigned int xSeed, double* xStart, double *Chain, double *LnPrior, double *LnLikelihood, double periodCenter, double periodWidth, double fluxCenter, double fluxWidth, int samplerType, int numTemps, double maxTemp);
 
 	int smooth_RTS(int numCadences, int cadenceNum, double tolIR, double startT, double *t, double *x, double *y, double *yerr, double *mask, double *lcX, double *lcP, double *XSmooth, double *PSmooth, double *xSmooth, double *xerrSmooth, int threadNum);
 	};
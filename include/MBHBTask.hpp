@@ -17,6 +17,7 @@ namespace kali {
 class MBHBTask {
 private:
 	int numThreads;
+	double samplerUtilization, lnEvidence, lnEvidenceErr;
 	kali::MBHB *Systems;
 	bool *setSystemsVec;
 	double *ThetaVec;
@@ -24,6 +25,9 @@ public:
 	MBHBTask() = delete;
 	MBHBTask(int numThreadsGiven);
 	~MBHBTask();
+	double get_samplerUtilization();
+	double get_lnEvidence();
+	double get_lnEvidenceErr();
 	int check_Theta(double *Theta, int threadNum);
 	void get_Theta(double *Theta, int threadNum);
 	int set_System(double *Theta, int threadNum);
@@ -90,7 +94,9 @@ public:
 
 	//void compute_ACVF(int numLags, double *Lags, double *ACVF, int threadNum);
 
-	int fit_MBHBModel(int numCadences, double dt, double startT, double lowestFlux, double highestFlux, double *t, double *x, double *y, double *yerr, double *mask, int nwalkers, int nsteps, int maxEvals, double xTol, double mcmcA, unsigned int zSSeed, unsigned int walkerSeed, unsigned int moveSeed, unsigned int xSeed, double* xStart, double *Chain, double *LnPrior, double *LnLikelihood, double periodCenter, double periodWidth, double fluxCenter, double fluxWidth);
+	int fit_MBHBModel(int numCadences, double dt, double startT, double lowestFlux, double highestFlux, double *t, double *x, double *y, double *yerr, double *mask, int nwalkers, int nsteps, int maxEvals, double xTol, double mcmcA, unsigned int zSSeed, unsigned int walkerSeed, unsigned int moveSeed, unsigned int xSeed, double* xStart, double *Chain, double *LnPrior, double *LnLikelihood, double periodCenter, double periodWidth, double fluxCenter, double fluxWidth, int samplerType, int numTemps, double maxTemp);
+
+	int laplace_MBHBModel(int numLCs, int *cadenceOffsets, double *dt, double *startT, double *lowestFlux, double *highestFlux, double *t, double *x, double *y, double *yerr, double *mask, double *periodCenter, double *periodWidth, double *fluxCenter, double *fluxWidth, int numStarts, double *xStart, int maxEvals, double xTol, double *MAP, double *Cov, double *LnPosteriorMAP, double *LnLaplace, int *Status);
 
 	int smooth_Lightcurve(int numCadences, double *t, double *xSmooth, int threadNum);
 	};
@@ -1,33 +1,993 @@
 #ifndef MCMC_HPP
 #define MCMC_HPP
 
+#ifdef __INTEL_COMPILER
+    #include <mathimf.h>
+    #if defined __APPLE__ && defined __MACH__
+        #include <malloc/malloc.h>
+    #else
+        #include <malloc.h>
+    #endif
+#else
+    #include <math.h>
+    #include <mm_malloc.h>
+#endif
+#include <mkl_vsl.h>
+#include <omp.h>
+#include <algorithm>
+#include <type_traits>
 //#include <string>
 //#include "Kalman.hpp"
+#include <vector>
 
 using namespace std;
 
 namespace kali {
 
-class EnsembleSampler {
+/*!
+Sampler selectors understood by the fit_*Model entry points of the task classes.
+*/
+enum SamplerType {
+	ENSEMBLE_SAMPLER = 0, /*!< Synchronous two half-ensemble stretch move (EnsembleSampler). */
+	ASYNC_ENSEMBLE_SAMPLER = 1, /*!< Barrier-free dataflow stretch move (AsyncEnsembleSampler). */
+	PT_ENSEMBLE_SAMPLER = 2, /*!< Parallel-tempered stretch move with an adaptive temperature ladder (PTEnsembleSampler). */
+	NUTS_SAMPLER = 3, /*!< Independent No-U-Turn chains with a diagonal mass matrix (NUTSSampler). */
+	NUTS_DENSE_SAMPLER = 4 /*!< Independent No-U-Turn chains with a dense mass matrix (NUTSSampler). */
+	};
+
+/*!
+Proposal moves that BasicEnsembleSampler can mix, see BasicEnsembleSampler::setMoves.
+*/
+enum MoveType {
+	STRETCH_MOVE = 0, /*!< Goodman & Weare (2010) stretch move. */
+	DE_MOVE = 1, /*!< Differential-evolution move (ter Braak 2006). */
+	DE_SNOOKER_MOVE = 2, /*!< Differential-evolution snooker move (ter Braak & Vrugt 2008). */
+	KDE_MOVE = 3, /*!< Independence proposal from a Gaussian KDE of the complementary ensemble. */
+	NUM_MOVE_TYPES = 4
+	};
+
+/*!
+Detects whether a model policy provides evaluateBatch(numPoints, x, LnPriorVals, LnLikelihoodVals, LnPosteriorVals).
+*/
+template <typename Model> class hasEvaluateBatch {
 private:
+	template <typename M> static char test(decltype(&M::evaluateBatch));
+	template <typename M> static long test(...);
+public:
+	static const bool value = (sizeof(test<Model>(nullptr)) == sizeof(char));
+	};
+
+/*!
+Affine-invariant stretch-move ensemble sampler (Goodman & Weare 2010) templated on a model policy.
+
+A model policy must provide a nested type Evaluator with
+
+	double operator()(double *x, double &LnPriorVal, double &LnLikelihoodVal);
+
+and a method Evaluator evaluator(int threadNum). One evaluator is made per thread at the start of runMCMC and owns whatever per-thread state the model needs (e.g. its CARMA system), so the posterior is called directly and can be inlined. If the policy also provides
+
+	void evaluateBatch(int numPoints, double *x, double *LnPriorVals, double *LnLikelihoodVals, double *LnPosteriorVals);
+
+it is called once per half-step with the proposals of the whole half-ensemble, laid out as x[dimNum + walkerNum*numDims], and is responsible for its own parallelism.
+
+setSurrogate switches on delayed acceptance (Christen & Fox 2005): a second instance of the model, e.g. the same likelihood on a binned light curve, screens every proposal and only the survivors are passed to the exact posterior.
+*/
+template <typename Model> class BasicEnsembleSampler {
+protected:
 	int numDims, numWalkers, numSteps, numThreads;
 	unsigned int ZSeed, BernoulliSeed, WalkerSeed;
-	double A;//, newLnLike, oldLnLike, pAccept;
-	//VSLStreamStatePtr ZStream, WalkerStream, *BernoulliStream;
-	double *Chain, *Zs, *LnPrior, *LnLike;
-	//double *currSubSetOld, *compSubSetOld, *currSubSetNew;
-	//double **compWalkerOldPos, **currWalkerOldPos, **currWalkerNewPos;
-	int *WalkerChoice, *MoveYesNo;
+	double A;
+	double *Chain, *LnPrior, *LnLike;
+	bool ownsOutput;
+	Model Posterior;
+	vector<typename Model::Evaluator> Evaluators;
+	double WallTime, *BusyTime;
+	int numAdaptSteps;
+	double MoveBaseWeights[NUM_MOVE_TYPES], MoveWeights[NUM_MOVE_TYPES], MoveLnScales[NUM_MOVE_TYPES];
+	long MoveProposed[NUM_MOVE_TYPES], MoveAccepted[NUM_MOVE_TYPES];
+	Model Surrogate;
+	vector<typename Model::Evaluator> SurrogateEvaluators;
+	bool useSurrogate;
+	long SurrogateEvals, ExactEvals;
+	void evaluateSurrogate(int numPoints, double *x, double *LnPosteriorVals);
+	void evaluateHalf(int numPoints, double *x, double *LnPriorVals, double *LnLikelihoodVals, double *LnPosteriorVals, std::true_type);
+	void evaluateHalf(int numPoints, double *x, double *LnPriorVals, double *LnLikelihoodVals, double *LnPosteriorVals, std::false_type);
+	void whitenComplement(const double *compSubSet, int numComp, double *cholFactor, double *whitened);
+	double lnKDE(const double *x, const double *cholFactor, const double *whitened, int numComp, double bandwidth, double *work);
+public:
+	BasicEnsembleSampler(int ndims, int nwalkers, int nsteps, int nthreads, double a, const Model &posterior, unsigned int zSeed, unsigned int bernoulliSeed, unsigned int walkerSeed);
+	~BasicEnsembleSampler();
+	void setMoves(double *weights, int nAdaptSteps);
+	void setSurrogate(const Model &surrogate);
+	void setOutput(double *ChainPtr, double *LnPriorPtr, double *LnLikePtr);
+	void runMCMC(double* initPos);
+	void getChain(double *ChainPtr);
+	void getChainVals(double *LnPriorPtr, double *LnLikePtr);
+	void getMoveStats(double *WeightsPtr, double *AcceptancePtr, long *ProposedPtr);
+	void getEvalCounts(long &numSurrogateEvals, long &numExactEvals);
+	double getUtilization();
+	};
+
+/*!
+Model policy that wraps the plain callback interface, double func(double *x, void *funcArgs, double &LnPriorVal, double &LnLikelihoodVal).
+*/
+class FunctionPosterior {
+private:
 	double (*Func)(double* x, void* FuncArgs, double &LnPriorVal, double &LnLikelihoodVal);
 	void* FuncArgs;
+public:
+	class Evaluator {
+	private:
+		double (*Func)(double* x, void* FuncArgs, double &LnPriorVal, double &LnLikelihoodVal);
+		void* FuncArgs;
+	public:
+		Evaluator(double (*func)(double* x, void* funcArgs, double &LnPriorVal, double &LnLikelihoodVal), void* funcArgs);
+		double operator()(double *x, double &LnPriorVal, double &LnLikelihoodVal);
+		};
+	FunctionPosterior(double (*func)(double* x, void* funcArgs, double &LnPriorVal, double &LnLikelihoodVal), void* funcArgs);
+	Evaluator evaluator(int threadNum);
+	};
+
+/*!
+The original function-pointer interface, kept as a thin adapter over BasicEnsembleSampler.
+*/
+class EnsembleSampler : public BasicEnsembleSampler<FunctionPosterior> {
 public:
 	EnsembleSampler(int ndims, int nwalkers, int nsteps, int nthreads, double a, double (*func)(double* x, void* funcArgs, double &LnPriorVal, double &LnLikelihoodVal), void* funcArgs, unsigned int zSeed, unsigned int bernoulliSeed, unsigned int walkerSeed);
-	~EnsembleSampler();
+	};
+
+class AsyncEnsembleSampler {
+private:
+	int numDims, numWalkers, numSteps, numThreads;
+	unsigned int ZSeed, BernoulliSeed, WalkerSeed;
+	double A;
+	double *Chain, *LnPrior, *LnLike;
+	bool ownsOutput;
+	double (*Func)(double* x, void* FuncArgs, double &LnPriorVal, double &LnLikelihoodVal);
+	void* FuncArgs;
+	double WallTime, *BusyTime;
+public:
+	AsyncEnsembleSampler(int ndims, int nwalkers, int nsteps, int nthreads, double a, double (*func)(double* x, void* funcArgs, double &LnPriorVal, double &LnLikelihoodVal), void* funcArgs, unsigned int zSeed, unsigned int bernoulliSeed, unsigned int walkerSeed);
+	~AsyncEnsembleSampler();
+	void setOutput(double *ChainPtr, double *LnPriorPtr, double *LnLikePtr);
+	void runMCMC(double* initPos);
+	void getChain(double *ChainPtr);
+	void getChainVals(double *LnPriorPtr, double *LnLikePtr);
+	double getUtilization();
+	};
+
+class PTEnsembleSampler {
+private:
+	int numDims, numWalkers, numTemps, numSteps, numThreads, numAdaptSteps;
+	unsigned int ZSeed, BernoulliSeed, WalkerSeed;
+	double A, MaxTemp;
+	double *Chain, *LnPrior, *LnLike;
+	double *Pos, *PosLnPrior, *PosLnLike;
+	double *Betas, *MeanLnLike;
+	double *Zs, *Us, *SwapUs;
+	int *WalkerChoice, *SwapOffset;
+	long *SwapsProposed, *SwapsAccepted;
+	double (*Func)(double* x, void* FuncArgs, double &LnPriorVal, double &LnLikelihoodVal);
+	void* FuncArgs;
+	double WallTime, *BusyTime;
+	void adaptLadder(int stepNum, double *swapFrac);
+public:
+	PTEnsembleSampler(int ndims, int nwalkers, int ntemps, int nsteps, int nthreads, double a, double maxTemp, double (*func)(double* x, void* funcArgs, double &LnPriorVal, double &LnLikelihoodVal), void* funcArgs, unsigned int zSeed, unsigned int bernoulliSeed, unsigned int walkerSeed);
+	~PTEnsembleSampler();
 	void runMCMC(double* initPos);
 	void getChain(double *ChainPtr);
 	void getChainVals(double *LnPriorPtr, double *LnLikePtr);
+	void getBetas(double *BetasPtr);
+	void getMeanLnLike(double *MeanLnLikePtr);
+	void getSwapAcceptance(double *SwapAcceptancePtr);
+	double getLnEvidence(double &LnEvidenceErr);
+	double getUtilization();
 	};
 
+/*!
+No-U-Turn sampler (Hoffman & Gelman 2014) run as nchains independent chains, one per walker of the fit entry points, so Chain, LnPrior and LnLike keep the EnsembleSampler layout. Without gradFunc the gradient of the log posterior is taken by central finite differences of func. The step size is tuned by dual averaging towards targetAccept (0.8 in the fit entry points) and the diagonal or, with dense, full mass matrix is adapted over the first half of the run.
+*/
+class NUTSSampler {
+private:
+	int numDims, numChains, numSteps, numThreads, numAdaptSteps, maxTreeDepth;
+	bool denseMass;
+	unsigned int Seed;
+	double TargetAccept;
+	double *Chain, *LnPrior, *LnLike, *StepSizes, *InvMetric, *AcceptStat;
+	int *NumDivergent, *TreeDepth;
+	long *NumEvals;
+	double (*Func)(double* x, void* FuncArgs, double &LnPriorVal, double &LnLikelihoodVal);
+	double (*GradFunc)(double* x, void* FuncArgs, double &LnPriorVal, double &LnLikelihoodVal, double *GradLnPosterior);
+	void* FuncArgs;
+	double WallTime, *BusyTime;
+public:
+	NUTSSampler(int ndims, int nchains, int nsteps, int nthreads, double targetAccept, bool dense, double (*func)(double* x, void* funcArgs, double &LnPriorVal, double &LnLikelihoodVal), void* funcArgs, unsigned int seed);
+	NUTSSampler(int ndims, int nchains, int nsteps, int nthreads, double targetAccept, bool dense, double (*func)(double* x, void* funcArgs, double &LnPriorVal, double &LnLikelihoodVal), double (*gradFunc)(double* x, void* funcArgs, double &LnPriorVal, double &LnLikelihoodVal, double *GradLnPosterior), void* funcArgs, unsigned int seed);
+	~NUTSSampler();
+	double evalGrad(double *x, double *invMetric, double &LnPriorVal, double &LnLikelihoodVal, double *GradLnPosterior, long &numEvals);
+	void runMCMC(double* initPos);
+	void getChain(double *ChainPtr);
+	void getChainVals(double *LnPriorPtr, double *LnLikePtr);
+	void getStepSizes(double *StepSizesPtr);
+	void getDiagnostics(double *AcceptStatPtr, int *TreeDepthPtr, int *NumDivergentPtr);
+	long getNumEvals();
+	double getUtilization();
+	};
+
+class NestedSampler {
+private:
+	int numDims, numLive, numThreads, maxIter, numRepeats;
+	unsigned int Seed;
+	double LnZTol, LnEvidence, LnEvidenceErr, Information;
+	long NumEvals;
+	bool Converged;
+	vector<double> LiveTheta, LiveLnPrior, LiveLnLike;
+	vector<double> DeadTheta, DeadLnPrior, DeadLnLike, DeadLnWeight;
+	double (*Func)(double* x, void* FuncArgs, double &LnPriorVal, double &LnLikelihoodVal);
+	void* FuncArgs;
+	bool computeScale(const double *thetas, int numPoints, double *cholFactor);
+	int sliceStep(double *x, double &lnPriorVal, double &lnLikeVal, double lnLikeMin, const double *cholFactor, void *stream, long &numEvals);
+public:
+	NestedSampler(int ndims, int nlive, int nthreads, double lnZTol, int maxiter, double (*func)(double* x, void* funcArgs, double &LnPriorVal, double &LnLikelihoodVal), void* funcArgs, unsigned int seed);
+	int runNestedSampling(double *initPos, int numInit);
+	int getNumSamples();
+	void getSamples(double *SamplesPtr, double *LnPriorPtr, double *LnLikePtr, double *LnWeightPtr);
+	double getLnEvidence(double &LnEvidenceErr);
+	double getInformation();
+	long getNumEvals();
+	bool getConverged();
+	};
+
+/*!
+Laplace approximation of the posterior func around its mode xMAP (e.g. found by nlopt). The Hessian of the log posterior is computed by central finite differences with steps of 1e-4|x_i|, shrunk tenfold up to three times if the stencil leaves the support. Cov receives the inverse of the negative Hessian (ndims*ndims, symmetric), LnPosteriorMAP the log posterior at xMAP and LnLaplace the log Laplace integral ln p(xMAP) + (ndims/2) ln(2 pi) + (1/2) ln det Cov. This is only an evidence if func uses a normalized prior; with the unnormalized 0/-inf support indicators of the C-ARMA and MBHB priors it has no prior-volume term and depends on the units of x, so it may be compared between modes of one model but neither across models nor with the lnZ of NestedSampler. numEvals receives the number of posterior evaluations. Returns 0 on success and -1 if the posterior is not finite around xMAP or the negative Hessian is not positive definite.
+*/
+int laplaceApproximation(int ndims, double *xMAP, double (*func)(double* x, void* funcArgs, double &LnPriorVal, double &LnLikelihoodVal), void* funcArgs, double *Cov, double &LnPosteriorMAP, double &LnLaplace, long &numEvals);
+
+/*!
+Analytic target for checking the samplers: an independent Gaussian likelihood N(Mu_i, Sigma_i^2) in every dimension under a uniform prior on the box [Lower_i, Upper_i]. Its evidence is prod_i (Phi((Upper_i - Mu_i)/Sigma_i) - Phi((Lower_i - Mu_i)/Sigma_i))/(Upper_i - Lower_i).
+*/
+struct GaussianTarget {
+	int numDims;
+	double *Mu, *Sigma, *Lower, *Upper;
+	};
+
+double calcGaussianLnPosterior(double *x, void *funcArgs, double &LnPriorVal, double &LnLikelihoodVal);
+
+/*!
+Model policy for a GaussianTarget that evaluates whole half-ensembles at once through evaluateBatch, for checking the batched path of BasicEnsembleSampler against the callback interface.
+*/
+class GaussianPosterior {
+private:
+	GaussianTarget *Target;
+	int numThreads;
+public:
+	class Evaluator {
+	private:
+		GaussianTarget *Target;
+	public:
+		Evaluator(GaussianTarget *target);
+		double operator()(double *x, double &LnPriorVal, double &LnLikelihoodVal);
+		};
+	GaussianPosterior(GaussianTarget *target, int nthreads);
+	Evaluator evaluator(int threadNum);
+	void evaluateBatch(int numPoints, double *x, double *LnPriorVals, double *LnLikelihoodVals, double *LnPosteriorVals);
+	};
+
+/*!
+Run the sampler selected by samplerType (ENSEMBLE_SAMPLER or PT_ENSEMBLE_SAMPLER, with ntemps temperatures up to maxTemp) on a GaussianTarget from initPos. With batched set, ENSEMBLE_SAMPLER runs BasicEnsembleSampler<GaussianPosterior> instead of EnsembleSampler, which must give the same chain for the same seeds. Chain, LnPrior and LnLikelihood have the usual EnsembleSampler layout. LnEvidence receives the thermodynamic-integration evidence and its error for PT_ENSEMBLE_SAMPLER and zeros otherwise. Returns -1 for an unknown samplerType.
+*/
+int sampleGaussianTarget(int samplerType, int batched, int ndims, double *mu, double *sigma, double *lower, double *upper, int nwalkers, int ntemps, int nsteps, int nthreads, double a, double maxTemp, unsigned int zSeed, unsigned int walkerSeed, unsigned int moveSeed, double *initPos, double *Chain, double *LnPrior, double *LnLikelihood, double *LnEvidence);
+
+/*!
+Sampler dispatch shared by the fit_*Model entry points of the task classes. Runs the sampler selected by samplerType from initPos and writes its chain to Chain, LnPrior and LnLikelihood in the EnsembleSampler layout.
+
+NUTS_SAMPLER, NUTS_DENSE_SAMPLER, PT_ENSEMBLE_SAMPLER (numTemps temperatures up to maxTemp) and ASYNC_ENSEMBLE_SAMPLER call func with funcArgs. Any other samplerType runs BasicEnsembleSampler<Model> on posterior, with the move mixture MoveWeights adapted over numAdaptSteps steps unless MoveWeights is null, and with delayed acceptance on surrogate unless surrogate is null. Pass FunctionPosterior(func, funcArgs) as posterior to get EnsembleSampler.
+
+Utilization receives the sampler utilization. LnEvidence and LnEvidenceErr receive the thermodynamic-integration evidence for PT_ENSEMBLE_SAMPLER and zeros otherwise. For the synchronous ensemble sampler the final move weights and acceptance rates are written to MoveWeightsOut and MoveAcceptanceOut if both are given, and the surrogate and exact evaluation counts to EvalCounts[0] and EvalCounts[1] if EvalCounts is given.
+*/
+template <typename Model> void runSampler(int samplerType, int ndims, int nwalkers, int nsteps, int nthreads, double a, int numTemps, double maxTemp, double (*func)(double* x, void* funcArgs, double &LnPriorVal, double &LnLikelihoodVal), void* funcArgs, const Model &posterior, const Model *surrogate, double *MoveWeights, int numAdaptSteps, unsigned int zSeed, unsigned int walkerSeed, unsigned int moveSeed, double *initPos, double *Chain, double *LnPrior, double *LnLikelihood, double &Utilization, double &LnEvidence, double &LnEvidenceErr, double *MoveWeightsOut, double *MoveAcceptanceOut, long *EvalCounts);
+
 } // namespace kali
 
+template <typename Model> kali::BasicEnsembleSampler<Model>::BasicEnsembleSampler(int ndims, int nwalkers, int nsteps, int nthreads, double a, const Model &posterior, unsigned int zSeed, unsigned int bernoulliSeed, unsigned int walkerSeed) : Posterior(posterior), Surrogate(posterior) {
+	numDims = ndims;
+	numWalkers = nwalkers;
+	numSteps = nsteps;
+	numThreads = nthreads;
+	A = a;
+	ZSeed = zSeed;
+	WalkerSeed = walkerSeed;
+	BernoulliSeed = bernoulliSeed;
+
+	/*!
+	We will store the MCMC result in Chain. Chain is laid out as follows - for each step, we store each dimension of each walker. Chain[dimNum + walkerNum*numDims + stepNum*numDims*numWalkers] contains the value of dimension dimNum of walker walkerNum at step stepNum. We calculate the size of the Chain required, sizeChain = numDims*numWalkers*numSteps, and then allocate space to hold Chain.
+	*/
+	int sizeChain = numDims*numWalkers*numSteps;
+	int numChoices = numWalkers*numSteps;
+
+	Chain = static_cast<double*>(_mm_malloc(sizeChain*sizeof(double),64));
+	LnPrior = static_cast<double*>(_mm_malloc(numChoices*sizeof(double),64));
+	LnLike = static_cast<double*>(_mm_malloc(numChoices*sizeof(double),64));
+	ownsOutput = true;
+
+	/*!
+	The stretch factors, walker choices and acceptance draws are generated step by step inside runMCMC, so the only run-length allocations are the outputs, Chain, LnPrior and LnLike. These are written in full by runMCMC and are not zero-filled here, so construction is cheap and the pages are first touched by the thread that writes them.
+
+	BusyTime[threadNum] accumulates the wall-clock time thread threadNum spends evaluating the posterior during runMCMC. Together with WallTime it gives the fraction of the available core time that was spent doing useful work.
+	*/
+	WallTime = 0.0;
+	BusyTime = static_cast<double*>(_mm_malloc(numThreads*sizeof(double),64));
+	for (int threadNum = 0; threadNum < numThreads; ++threadNum) {
+		BusyTime[threadNum] = 0.0;
+		}
+
+	numAdaptSteps = 0;
+	for (int moveNum = 0; moveNum < NUM_MOVE_TYPES; ++moveNum) {
+		MoveBaseWeights[moveNum] = (moveNum == STRETCH_MOVE) ? 1.0 : 0.0;
+		MoveWeights[moveNum] = MoveBaseWeights[moveNum];
+		MoveLnScales[moveNum] = 0.0;
+		MoveProposed[moveNum] = 0;
+		MoveAccepted[moveNum] = 0;
+		}
+
+	useSurrogate = false;
+	SurrogateEvals = 0;
+	ExactEvals = 0;
+	}
+
+template <typename Model> kali::BasicEnsembleSampler<Model>::~BasicEnsembleSampler() {
+	if (ownsOutput) {
+		_mm_free(Chain);
+		_mm_free(LnPrior);
+		_mm_free(LnLike);
+		}
+	Chain = nullptr;
+	LnPrior = nullptr;
+	LnLike = nullptr;
+
+	if (BusyTime) {
+		_mm_free(BusyTime);
+		BusyTime = nullptr;
+		}
+	}
+
+template <typename Model> void kali::BasicEnsembleSampler<Model>::evaluateHalf(int numPoints, double *x, double *LnPriorVals, double *LnLikelihoodVals, double *LnPosteriorVals, std::true_type) {
+	/*!
+	The batch call owns every thread for its duration, so its wall time is credited to all of them.
+	*/
+	double funcStart = omp_get_wtime();
+	Posterior.evaluateBatch(numPoints, x, LnPriorVals, LnLikelihoodVals, LnPosteriorVals);
+	double funcTime = omp_get_wtime() - funcStart;
+	for (int threadNum = 0; threadNum < numThreads; ++threadNum) {
+		BusyTime[threadNum] += funcTime;
+		}
+	}
+
+template <typename Model> void kali::BasicEnsembleSampler<Model>::evaluateHalf(int numPoints, double *x, double *LnPriorVals, double *LnLikelihoodVals, double *LnPosteriorVals, std::false_type) {
+	int ndims = numDims;
+	int nthreads = numThreads;
+	#pragma omp parallel for default(none) shared(numPoints,ndims,x,LnPriorVals,LnLikelihoodVals,LnPosteriorVals) num_threads(nthreads)
+	for (int pointNum = 0; pointNum < numPoints; ++pointNum) {
+		int threadNum = omp_get_thread_num();
+		double funcStart = omp_get_wtime();
+		LnPosteriorVals[pointNum] = Evaluators[threadNum](&x[pointNum*ndims], LnPriorVals[pointNum], LnLikelihoodVals[pointNum]);
+		BusyTime[threadNum] += omp_get_wtime() - funcStart;
+		}
+	}
+
+template <typename Model> void kali::BasicEnsembleSampler<Model>::evaluateSurrogate(int numPoints, double *x, double *LnPosteriorVals) {
+	int ndims = numDims;
+	int nthreads = numThreads;
+	#pragma omp parallel for default(none) shared(numPoints,ndims,x,LnPosteriorVals) num_threads(nthreads)
+	for (int pointNum = 0; pointNum < numPoints; ++pointNum) {
+		int threadNum = omp_get_thread_num();
+		double funcStart = omp_get_wtime();
+		double surrLnPrior = 0.0, surrLnLike = 0.0;
+		LnPosteriorVals[pointNum] = SurrogateEvaluators[threadNum](&x[pointNum*ndims], surrLnPrior, surrLnLike);
+		BusyTime[threadNum] += omp_get_wtime() - funcStart;
+		}
+	}
+
+template <typename Model> void kali::BasicEnsembleSampler<Model>::setSurrogate(const Model &surrogate) {
+	/*!
+	Use surrogate as a cheap approximation of the posterior for delayed acceptance. A proposal Y from X first passes a screening step with probability min(1, q s(Y)/s(X)), where s is the surrogate and q the Hastings factor of the move, and only then is the exact posterior p evaluated and Y accepted with probability min(1, p(Y)s(X)/(p(X)s(Y))). The product of the two stages satisfies detailed balance with respect to p, so the chain samples the exact posterior whatever the quality of the surrogate; a poor surrogate only lowers the acceptance rate. The surrogate must be finite wherever the posterior is, which holds when it shares the prior of the exact model. Surrogate evaluators are always called one point at a time, never through evaluateBatch.
+	*/
+	Surrogate = surrogate;
+	useSurrogate = true;
+	}
+
+template <typename Model> void kali::BasicEnsembleSampler<Model>::setMoves(double *weights, int nAdaptSteps) {
+	/*!
+	Set the relative weights of the NUM_MOVE_TYPES moves (indexed by MoveType) and the number of initial steps, nAdaptSteps, during which the weights and move scales adapt. Negative weights are treated as zero and if every weight is zero only the stretch move is used. The default is the pure stretch move with no adaptation, which reproduces the plain Goodman & Weare sampler.
+
+	During adaptation the log scale of the stretch, DE and snooker moves follows a Robbins-Monro recursion towards an acceptance rate of 0.25. Every numAdaptSteps/10 steps (at least 10) the weights are reset to 10% of the requested weights plus 90% in proportion to the expected squared jump distance of each move, measured in units of the ensemble spread, so that moves yielding more movement per likelihood evaluation are used more often. Moves with zero requested weight stay off. Both freeze after nAdaptSteps, so the chain from then on is a proper Markov chain and the adaptation steps should be discarded as burn-in.
+	*/
+	double totalWeight = 0.0;
+	for (int moveNum = 0; moveNum < NUM_MOVE_TYPES; ++moveNum) {
+		MoveBaseWeights[moveNum] = (weights[moveNum] > 0.0) ? weights[moveNum] : 0.0;
+		totalWeight += MoveBaseWeights[moveNum];
+		}
+	if (not (totalWeight > 0.0)) {
+		MoveBaseWeights[STRETCH_MOVE] = 1.0;
+		totalWeight = 1.0;
+		}
+	for (int moveNum = 0; moveNum < NUM_MOVE_TYPES; ++moveNum) {
+		MoveBaseWeights[moveNum] /= totalWeight;
+		MoveWeights[moveNum] = MoveBaseWeights[moveNum];
+		MoveLnScales[moveNum] = 0.0;
+		}
+	numAdaptSteps = (nAdaptSteps > 0) ? nAdaptSteps : 0;
+	}
+
+template <typename Model> void kali::BasicEnsembleSampler<Model>::whitenComplement(const double *compSubSet, int numComp, double *cholFactor, double *whitened) {
+	/*!
+	cholFactor receives the row-major lower Cholesky factor L of the covariance of the complementary walkers, and whitened[dimNum + walkerNum*numDims] the complementary walkers mapped through L^{-1}. If the covariance is not positive definite only its diagonal is used.
+	*/
+	int ndims = numDims;
+	vector<double> mean(ndims, 0.0), cov(ndims*ndims, 0.0);
+	for (int walkerNum = 0; walkerNum < numComp; ++walkerNum) {
+		for (int dimNum = 0; dimNum < ndims; ++dimNum) {
+			mean[dimNum] += compSubSet[dimNum + walkerNum*ndims]/numComp;
+			}
+		}
+	for (int walkerNum = 0; walkerNum < numComp; ++walkerNum) {
+		for (int i = 0; i < ndims; ++i) {
+			for (int j = 0; j <= i; ++j) {
+				cov[j + i*ndims] += (compSubSet[i + walkerNum*ndims] - mean[i])*(compSubSet[j + walkerNum*ndims] - mean[j])/max(numComp - 1, 1);
+				}
+			}
+		}
+	for (int i = 0; i < ndims; ++i) {
+		if (not (cov[i + i*ndims] > 0.0)) {
+			cov[i + i*ndims] = (fabs(mean[i]) > 0.0) ? pow(1.0e-3*fabs(mean[i]), 2.0) : 1.0e-6;
+			}
+		}
+	bool positiveDefinite = true;
+	for (int i = 0; (i < ndims) and positiveDefinite; ++i) {
+		for (int j = 0; j <= i; ++j) {
+			double sum = cov[j + i*ndims];
+			for (int k = 0; k < j; ++k) {
+				sum -= cholFactor[k + i*ndims]*cholFactor[k + j*ndims];
+				}
+			if (i == j) {
+				if (not (sum > 0.0)) {
+					positiveDefinite = false;
+					break;
+					}
+				cholFactor[i + i*ndims] = sqrt(sum);
+				} else {
+				cholFactor[j + i*ndims] = sum/cholFactor[j + j*ndims];
+				}
+			}
+		for (int j = i + 1; j < ndims; ++j) {
+			cholFactor[j + i*ndims] = 0.0;
+			}
+		}
+	if (not positiveDefinite) {
+		for (int i = 0; i < ndims; ++i) {
+			for (int j = 0; j < ndims; ++j) {
+				cholFactor[j + i*ndims] = (i == j) ? sqrt(cov[i + i*ndims]) : 0.0;
+				}
+			}
+		}
+	for (int walkerNum = 0; walkerNum < numComp; ++walkerNum) {
+		for (int i = 0; i < ndims; ++i) {
+			double sum = compSubSet[i + walkerNum*ndims];
+			for (int j = 0; j < i; ++j) {
+				sum -= cholFactor[j + i*ndims]*whitened[j + walkerNum*ndims];
+				}
+			whitened[i + walkerNum*ndims] = sum/cholFactor[i + i*ndims];
+			}
+		}
+	}
+
+template <typename Model> double kali::BasicEnsembleSampler<Model>::lnKDE(const double *x, const double *cholFactor, const double *whitened, int numComp, double bandwidth, double *work) {
+	/*!
+	Log of the Gaussian KDE of the complementary walkers with kernel covariance bandwidth^2 C, up to a constant that cancels in the Hastings ratio.
+	*/
+	int ndims = numDims;
+	for (int i = 0; i < ndims; ++i) {
+		double sum = x[i];
+		for (int j = 0; j < i; ++j) {
+			sum -= cholFactor[j + i*ndims]*work[j];
+			}
+		work[i] = sum/cholFactor[i + i*ndims];
+		}
+	double maxTerm = -HUGE_VAL, sumTerm = 0.0;
+	for (int walkerNum = 0; walkerNum < numComp; ++walkerNum) {
+		double distSq = 0.0;
+		for (int i = 0; i < ndims; ++i) {
+			distSq += pow(work[i] - whitened[i + walkerNum*ndims], 2.0);
+			}
+		double term = -0.5*distSq/(bandwidth*bandwidth);
+		if (term > maxTerm) {
+			sumTerm = sumTerm*exp(maxTerm - term) + 1.0;
+			maxTerm = term;
+			} else {
+			sumTerm += exp(term - maxTerm);
+			}
+		}
+	return maxTerm + log(sumTerm);
+	}
+
+template <typename Model> void kali::BasicEnsembleSampler<Model>::runMCMC(double* initPos) {
+	/*!
+	We begin by making one evaluator per thread and computing the LnPrior and LnLike values for our initial walker positions.
+	*/
+	int nwalkers = numWalkers;
+	int ndims = numDims;
+	int nthreads = numThreads;
+	int sizeStep = numDims*numWalkers;
+	int sizeHalfStep = numDims*numWalkers/2;
+	int halfNumWalkers = numWalkers/2;
+	double startTime = omp_get_wtime();
+	std::integral_constant<bool, kali::hasEvaluateBatch<Model>::value> useBatch;
+
+	Evaluators.clear();
+	SurrogateEvaluators.clear();
+	for (int threadNum = 0; threadNum < numThreads; ++threadNum) {
+		Evaluators.push_back(Posterior.evaluator(threadNum));
+		if (useSurrogate) {
+			SurrogateEvaluators.push_back(Surrogate.evaluator(threadNum));
+			}
+		}
+
+	for (int walkerNum = 0; walkerNum < numWalkers; ++walkerNum) {
+		for (int dimNum = 0; dimNum < numDims; ++dimNum) {
+			Chain[dimNum + walkerNum*numDims] = initPos[dimNum + walkerNum*numDims];
+			}
+		}
+	vector<double> newLnPrior(numWalkers), newLnLike(numWalkers), newLnPost(numWalkers);
+	evaluateHalf(numWalkers, Chain, LnPrior, LnLike, &newLnPost[0], useBatch);
+	ExactEvals = numWalkers;
+	SurrogateEvals = 0;
+
+	/*!
+	With delayed acceptance we also keep the surrogate log posterior at the current position of every walker, currSurrLnPost, and make room for the proposals that survive screening, which are packed contiguously before the exact evaluation.
+	*/
+	vector<double> currSurrLnPost, newSurrLnPost, stepScreenUs, survivorPos, survivorLnPrior, survivorLnLike, survivorLnPost;
+	vector<int> stepSurvive, survivorWalker;
+	if (useSurrogate) {
+		currSurrLnPost.resize(numWalkers);
+		evaluateSurrogate(numWalkers, Chain, &currSurrLnPost[0]);
+		SurrogateEvals = numWalkers;
+		newSurrLnPost.resize(halfNumWalkers);
+		stepScreenUs.resize(halfNumWalkers);
+		stepSurvive.resize(halfNumWalkers);
+		survivorWalker.resize(halfNumWalkers);
+		survivorPos.resize(sizeHalfStep);
+		survivorLnPrior.resize(halfNumWalkers);
+		survivorLnLike.resize(halfNumWalkers);
+		survivorLnPost.resize(halfNumWalkers);
+		}
+
+	double *currSubSetOld = nullptr, *compSubSetOld = nullptr, *currSubSetNew = nullptr;
+
+	/*!
+	Every walker owns three streams, VSL_BRNG_MT2203 stream walkerNum%6024 seeded with ZSeed, WalkerSeed and BernoulliSeed plus walkerNum/6024, for the continuous move variables, the choice of complementary walkers and the acceptance test. A walker draws its numbers for a step from its own streams, whichever thread moves it, so no whole-run random tables are needed and the chain depends on the seeds but not on the number of threads. For the stretch move Z = ((a - 1)U + 1)^2/a with U uniform on [0, 1) follows g(z) ~ 1/sqrt(z) on [1/a, a] (Goodman & Weare 2010), and a walker moves if a uniform deviate falls below the acceptance probability. With the default pure stretch move no other random numbers are drawn.
+	*/
+	vector<VSLStreamStatePtr> ZStream(nwalkers), WalkerStream(nwalkers), AcceptStream(nwalkers);
+	for (int walkerNum = 0; walkerNum < nwalkers; ++walkerNum) {
+		vslNewStream(&ZStream[walkerNum], VSL_BRNG_MT2203 + (walkerNum%6024), ZSeed + walkerNum/6024);
+		vslNewStream(&WalkerStream[walkerNum], VSL_BRNG_MT2203 + (walkerNum%6024), WalkerSeed + walkerNum/6024);
+		vslNewStream(&AcceptStream[walkerNum], VSL_BRNG_MT2203 + (walkerNum%6024), BernoulliSeed + walkerNum/6024);
+		}
+	vector<double> stepUs(halfNumWalkers), stepMoveUs(halfNumWalkers), stepLnQ(halfNumWalkers), stepJump(halfNumWalkers);
+	vector<int> stepChoice(halfNumWalkers), stepMove(halfNumWalkers), stepAccept(halfNumWalkers);
+	vector<double> cholFactor(ndims*ndims, 0.0), whitened(sizeHalfStep, 0.0), work(nthreads*2*ndims, 0.0);
+	vector<double> windowJump(NUM_MOVE_TYPES, 0.0);
+	vector<long> windowProposed(NUM_MOVE_TYPES, 0), stepProposed(NUM_MOVE_TYPES, 0), stepAccepted(NUM_MOVE_TYPES, 0);
+	int adaptWindow = max(10, numAdaptSteps/10);
+	double a = A;
+	double kdeBandwidth = pow(static_cast<double>(max(halfNumWalkers, 2)), -1.0/(ndims + 4.0));
+	for (int moveNum = 0; moveNum < NUM_MOVE_TYPES; ++moveNum) {
+		MoveProposed[moveNum] = 0;
+		MoveAccepted[moveNum] = 0;
+		}
+	bool pureStretch = (MoveWeights[STRETCH_MOVE] == 1.0);
+
+	/*! We first run a loop over all the steps. Recall that the 0th step is the starting step and we don't want to do anything for that step.
+	*/
+	for (int stepNum = 1; stepNum < numSteps; stepNum++) {
+		bool adapting = (stepNum <= numAdaptSteps);
+		for (int moveNum = 0; moveNum < NUM_MOVE_TYPES; ++moveNum) {
+			stepProposed[moveNum] = 0;
+			stepAccepted[moveNum] = 0;
+			}
+
+		/*! To enable parallelization, we split our walkers into two subsets indexed by 0 and 1. We move all the walkers in the current subset, currSubSet, based on randomly chosen walkers in the complimentary subset, compSubSet.
+		*/
+		for (int subSetNum = 0; subSetNum < 2; subSetNum++) {
+			currSubSetOld = &Chain[(stepNum-1)*sizeStep + subSetNum*sizeHalfStep];
+			compSubSetOld = &Chain[(stepNum-1)*sizeStep + ((subSetNum+1)%2)*sizeHalfStep];
+			currSubSetNew = &Chain[stepNum*sizeStep + subSetNum*sizeHalfStep];
+
+			/*!
+			The DE, snooker and KDE moves and the jump diagnostics need the shape of the complementary ensemble. It is fixed while the current subset moves, which keeps every move a valid Metropolis-Hastings update.
+			*/
+			if ((not pureStretch) or adapting) {
+				whitenComplement(compSubSetOld, halfNumWalkers, &cholFactor[0], &whitened[0]);
+				}
+
+			/*!
+			Write the proposal of every walker in the current subset to its slot in the new step and record the log of its Hastings factor in stepLnQ.
+			*/
+			#pragma omp parallel default(none) shared(subSetNum,ndims,halfNumWalkers,currSubSetOld,compSubSetOld,currSubSetNew,ZStream,WalkerStream,stepUs,stepMoveUs,stepChoice,stepMove,stepLnQ,cholFactor,whitened,work,a,kdeBandwidth,pureStretch) num_threads(nthreads)
+			{
+			int threadNum = omp_get_thread_num();
+			int blockSize = (halfNumWalkers + omp_get_num_threads() - 1)/omp_get_num_threads();
+			int firstWalker = min(threadNum*blockSize, halfNumWalkers);
+			int numBlock = min(blockSize, halfNumWalkers - firstWalker);
+			double *threadWork = &work[threadNum*2*ndims];
+			for (int walkerNum = firstWalker; walkerNum < firstWalker + numBlock; walkerNum++) {
+				VSLStreamStatePtr walkerZStream = ZStream[walkerNum + subSetNum*halfNumWalkers];
+				VSLStreamStatePtr walkerChoiceStream = WalkerStream[walkerNum + subSetNum*halfNumWalkers];
+				vdRngUniform(VSL_RNG_METHOD_UNIFORM_STD, walkerZStream, 1, &stepUs[walkerNum], 0.0, 1.0);
+				viRngUniform(VSL_RNG_METHOD_UNIFORM_STD, walkerChoiceStream, 1, &stepChoice[walkerNum], 0, halfNumWalkers);
+				if (not pureStretch) {
+					vdRngUniform(VSL_RNG_METHOD_UNIFORM_STD, walkerZStream, 1, &stepMoveUs[walkerNum], 0.0, 1.0);
+					}
+				double *currWalkerOldPos = &currSubSetOld[walkerNum*ndims];
+				double *compWalkerOldPos = &compSubSetOld[stepChoice[walkerNum]*ndims];
+				double *currWalkerNewPos = &currSubSetNew[walkerNum*ndims];
+				int move = STRETCH_MOVE;
+				if (not pureStretch) {
+					double cumWeight = 0.0;
+					for (move = 0; move < NUM_MOVE_TYPES - 1; ++move) {
+						cumWeight += MoveWeights[move];
+						if (stepMoveUs[walkerNum] < cumWeight) {
+							break;
+							}
+						}
+					}
+				stepMove[walkerNum] = move;
+				if (move == STRETCH_MOVE) {
+					double aEff = 1.0 + (a - 1.0)*exp(MoveLnScales[STRETCH_MOVE]);
+					double Z = pow((aEff - 1.0)*stepUs[walkerNum] + 1.0, 2.0)/aEff;
+					for (int dimNum = 0; dimNum < ndims; dimNum++) {
+						currWalkerNewPos[dimNum] = compWalkerOldPos[dimNum] + Z*(currWalkerOldPos[dimNum] - compWalkerOldPos[dimNum]);
+						}
+					stepLnQ[walkerNum] = (ndims - 1)*log(Z);
+					} else if ((move == DE_MOVE) or (move == DE_SNOOKER_MOVE)) {
+					/*!
+					Both DE moves use a second complementary walker distinct from the first. The DE move jumps by gamma times their difference, with gamma = 2.38/sqrt(2 ndims) scaled by the adapted factor, and gamma = 1 in 10% of the moves to allow jumps between modes. A tiny Gaussian jitter keeps the move irreducible. The snooker move projects the difference onto the line through the current walker and a third complementary walker.
+					*/
+					int secondNum = 0, anchorNum = 0;
+					viRngUniform(VSL_RNG_METHOD_UNIFORM_STD, walkerChoiceStream, 1, &secondNum, 0, halfNumWalkers - 1);
+					secondNum += (secondNum >= stepChoice[walkerNum]) ? 1 : 0;
+					double *secondWalkerOldPos = &compSubSetOld[secondNum*ndims];
+					if (move == DE_MOVE) {
+						double gamma = (stepUs[walkerNum] < 0.1) ? 1.0 : 2.38/sqrt(2.0*ndims)*exp(MoveLnScales[DE_MOVE]);
+						vdRngGaussian(VSL_RNG_METHOD_GAUSSIAN_ICDF, walkerZStream, ndims, threadWork, 0.0, 1.0e-4);
+						for (int dimNum = 0; dimNum < ndims; dimNum++) {
+							currWalkerNewPos[dimNum] = currWalkerOldPos[dimNum] + gamma*(compWalkerOldPos[dimNum] - secondWalkerOldPos[dimNum]) + threadWork[dimNum]*cholFactor[dimNum + dimNum*ndims];
+							}
+						stepLnQ[walkerNum] = 0.0;
+						} else {
+						viRngUniform(VSL_RNG_METHOD_UNIFORM_STD, walkerChoiceStream, 1, &anchorNum, 0, halfNumWalkers);
+						double *anchorPos = &compSubSetOld[anchorNum*ndims];
+						double gamma = 1.7*exp(MoveLnScales[DE_SNOOKER_MOVE]);
+						double normSq = 0.0, proj = 0.0;
+						for (int dimNum = 0; dimNum < ndims; dimNum++) {
+							double u = currWalkerOldPos[dimNum] - anchorPos[dimNum];
+							normSq += u*u;
+							proj += u*(compWalkerOldPos[dimNum] - secondWalkerOldPos[dimNum]);
+							}
+						if (normSq > 0.0) {
+							double newNormSq = 0.0;
+							for (int dimNum = 0; dimNum < ndims; dimNum++) {
+								currWalkerNewPos[dimNum] = currWalkerOldPos[dimNum] + gamma*(proj/normSq)*(currWalkerOldPos[dimNum] - anchorPos[dimNum]);
+								newNormSq += pow(currWalkerNewPos[dimNum] - anchorPos[dimNum], 2.0);
+								}
+							stepLnQ[walkerNum] = 0.5*(ndims - 1)*(log(newNormSq) - log(normSq));
+							} else {
+							for (int dimNum = 0; dimNum < ndims; dimNum++) {
+								currWalkerNewPos[dimNum] = currWalkerOldPos[dimNum];
+								}
+							stepLnQ[walkerNum] = 0.0;
+							}
+						}
+					} else {
+					/*!
+					KDE move: draw a complementary walker and add Gaussian noise with covariance (h s)^2 C, where C is the complementary covariance, h = n^(-1/(ndims + 4)) is Scott's bandwidth and s the adapted scale. This is an independence proposal, so the Hastings factor is the ratio of the KDE densities at the old and new positions.
+					*/
+					double bandwidth = kdeBandwidth*exp(MoveLnScales[KDE_MOVE]);
+					vdRngGaussian(VSL_RNG_METHOD_GAUSSIAN_ICDF, walkerZStream, ndims, threadWork, 0.0, bandwidth);
+					for (int i = 0; i < ndims; i++) {
+						currWalkerNewPos[i] = compWalkerOldPos[i];
+						for (int j = 0; j <= i; j++) {
+							currWalkerNewPos[i] += cholFactor[j + i*ndims]*threadWork[j];
+							}
+						}
+					stepLnQ[walkerNum] = lnKDE(currWalkerOldPos, &cholFactor[0], &whitened[0], halfNumWalkers, bandwidth, &threadWork[ndims]) - lnKDE(currWalkerNewPos, &cholFactor[0], &whitened[0], halfNumWalkers, bandwidth, &threadWork[ndims]);
+					}
+				}
+			}
+
+			if (not useSurrogate) {
+				evaluateHalf(halfNumWalkers, currSubSetNew, &newLnPrior[0], &newLnLike[0], &newLnPost[0], useBatch);
+				ExactEvals += halfNumWalkers;
+				} else {
+				/*!
+				Delayed acceptance, first stage: screen each proposal with the surrogate, passing it with probability min(1, q s(Y)/s(X)). The survivors are packed into survivorPos so that the exact posterior, batched or not, only sees them.
+				*/
+				evaluateSurrogate(halfNumWalkers, currSubSetNew, &newSurrLnPost[0]);
+				SurrogateEvals += halfNumWalkers;
+				#pragma omp parallel default(none) shared(subSetNum,halfNumWalkers,AcceptStream,stepScreenUs,stepSurvive,stepLnQ,currSurrLnPost,newSurrLnPost) num_threads(nthreads)
+				{
+				int threadNum = omp_get_thread_num();
+				int blockSize = (halfNumWalkers + omp_get_num_threads() - 1)/omp_get_num_threads();
+				int firstWalker = min(threadNum*blockSize, halfNumWalkers);
+				int numBlock = min(blockSize, halfNumWalkers - firstWalker);
+				for (int walkerNum = firstWalker; walkerNum < firstWalker + numBlock; walkerNum++) {
+					vdRngUniform(VSL_RNG_METHOD_UNIFORM_STD, AcceptStream[walkerNum + subSetNum*halfNumWalkers], 1, &stepScreenUs[walkerNum], 0.0, 1.0);
+					double oldSurrLnPost = currSurrLnPost[walkerNum + subSetNum*halfNumWalkers];
+					double newSurrLnPostVal = newSurrLnPost[walkerNum];
+					double pScreen = 0.0;
+					if ((oldSurrLnPost != -HUGE_VAL) and (newSurrLnPostVal != -HUGE_VAL)) {
+						pScreen = exp(min(0.0, stepLnQ[walkerNum] + newSurrLnPostVal - oldSurrLnPost));
+						} else if (newSurrLnPostVal != -HUGE_VAL) {
+						pScreen = 1.0;
+						}
+					stepSurvive[walkerNum] = (stepScreenUs[walkerNum] < pScreen) ? 1 : 0;
+					}
+				}
+				int numSurvivors = 0;
+				for (int walkerNum = 0; walkerNum < halfNumWalkers; walkerNum++) {
+					if (stepSurvive[walkerNum] == 1) {
+						for (int dimNum = 0; dimNum < ndims; dimNum++) {
+							survivorPos[numSurvivors*ndims + dimNum] = currSubSetNew[walkerNum*ndims + dimNum];
+							}
+						survivorWalker[numSurvivors] = walkerNum;
+						numSurvivors += 1;
+						} else {
+						newLnPrior[walkerNum] = -HUGE_VAL;
+						newLnLike[walkerNum] = -HUGE_VAL;
+						newLnPost[walkerNum] = -HUGE_VAL;
+						}
+					}
+				if (numSurvivors > 0) {
+					evaluateHalf(numSurvivors, &survivorPos[0], &survivorLnPrior[0], &survivorLnLike[0], &survivorLnPost[0], useBatch);
+					ExactEvals += numSurvivors;
+					}
+				for (int survivorNum = 0; survivorNum < numSurvivors; survivorNum++) {
+					newLnPrior[survivorWalker[survivorNum]] = survivorLnPrior[survivorNum];
+					newLnLike[survivorWalker[survivorNum]] = survivorLnLike[survivorNum];
+					newLnPost[survivorWalker[survivorNum]] = survivorLnPost[survivorNum];
+					}
+				}
+
+			/*!
+			Accept or reject each proposal with probability min(1, q p(Y)/p(X)), where q is the Hastings factor of its move, recording the LnPrior and LnLike of wherever the walker ends up. With delayed acceptance a screened-out proposal is rejected and a survivor is accepted with probability min(1, p(Y)s(X)/(p(X)s(Y))), in which q has cancelled against the first stage.
+			*/
+			#pragma omp parallel default(none) shared(stepNum,subSetNum,nwalkers,ndims,halfNumWalkers,currSubSetOld,currSubSetNew,newLnPrior,newLnLike,newLnPost,AcceptStream,stepUs,stepLnQ,stepAccept,stepJump,cholFactor,stepSurvive,currSurrLnPost,newSurrLnPost) num_threads(nthreads)
+			{
+			int threadNum = omp_get_thread_num();
+			int blockSize = (halfNumWalkers + omp_get_num_threads() - 1)/omp_get_num_threads();
+			int firstWalker = min(threadNum*blockSize, halfNumWalkers);
+			int numBlock = min(blockSize, halfNumWalkers - firstWalker);
+			for (int walkerNum = firstWalker; walkerNum < firstWalker + numBlock; walkerNum++) {
+				vdRngUniform(VSL_RNG_METHOD_UNIFORM_STD, AcceptStream[walkerNum + subSetNum*halfNumWalkers], 1, &stepUs[walkerNum], 0.0, 1.0);
+				double pAccept = 0.0;
+				int oldIndex = walkerNum + subSetNum*halfNumWalkers + (stepNum-1)*nwalkers;
+				int newIndex = walkerNum + subSetNum*halfNumWalkers + stepNum*nwalkers;
+				double oldLnPrior = LnPrior[oldIndex], oldLnLike = LnLike[oldIndex];
+				double oldLnPost = oldLnPrior + oldLnLike;
+				double newLnPostVal = newLnPost[walkerNum];
+				double lnCorrection = stepLnQ[walkerNum];
+				if (useSurrogate) {
+					double oldSurrLnPost = currSurrLnPost[walkerNum + subSetNum*halfNumWalkers];
+					lnCorrection = (oldSurrLnPost != -HUGE_VAL) ? oldSurrLnPost - newSurrLnPost[walkerNum] : stepLnQ[walkerNum];
+					}
+				if ((oldLnPost != -HUGE_VAL) and (newLnPostVal != -HUGE_VAL)) {
+					pAccept = exp(min(0.0, lnCorrection + newLnPostVal - oldLnPost));
+					} else if ((oldLnPost == -HUGE_VAL) and (newLnPostVal != -HUGE_VAL)) {
+					pAccept = 1.0;
+					} else {
+					pAccept = 0.0;
+					}
+				stepJump[walkerNum] = 0.0;
+				if (stepUs[walkerNum] < pAccept) {
+					stepAccept[walkerNum] = 1;
+					if (useSurrogate) {
+						currSurrLnPost[walkerNum + subSetNum*halfNumWalkers] = newSurrLnPost[walkerNum];
+						}
+					LnPrior[newIndex] = newLnPrior[walkerNum];
+					LnLike[newIndex] = newLnLike[walkerNum];
+					for (int dimNum = 0; dimNum < ndims; dimNum++) {
+						double scale = cholFactor[dimNum + dimNum*ndims];
+						if (scale > 0.0) {
+							stepJump[walkerNum] += pow((currSubSetNew[walkerNum*ndims + dimNum] - currSubSetOld[walkerNum*ndims + dimNum])/scale, 2.0);
+							}
+						}
+					} else {
+					stepAccept[walkerNum] = 0;
+					LnPrior[newIndex] = oldLnPrior;
+					LnLike[newIndex] = oldLnLike;
+					for (int dimNum = 0; dimNum < ndims; dimNum++) {
+						currSubSetNew[walkerNum*ndims + dimNum] = currSubSetOld[walkerNum*ndims + dimNum];
+						}
+					}
+				}
+			}
+
+			for (int walkerNum = 0; walkerNum < halfNumWalkers; walkerNum++) {
+				int move = pureStretch ? STRETCH_MOVE : stepMove[walkerNum];
+				stepProposed[move] += 1;
+				stepAccepted[move] += stepAccept[walkerNum];
+				if (adapting) {
+					windowProposed[move] += 1;
+					windowJump[move] += stepJump[walkerNum];
+					}
+				}
+			}
+
+		for (int moveNum = 0; moveNum < NUM_MOVE_TYPES; ++moveNum) {
+			MoveProposed[moveNum] += stepProposed[moveNum];
+			MoveAccepted[moveNum] += stepAccepted[moveNum];
+			}
+
+		/*!
+		Adapt the move scales every step and the move weights every adaptWindow steps until numAdaptSteps, see setMoves.
+		*/
+		if (adapting) {
+			for (int moveNum = 0; moveNum < KDE_MOVE; ++moveNum) {
+				if (stepProposed[moveNum] > 0) {
+					double acceptRate = static_cast<double>(stepAccepted[moveNum])/stepProposed[moveNum];
+					MoveLnScales[moveNum] += (acceptRate - 0.25)/sqrt(static_cast<double>(stepNum));
+					MoveLnScales[moveNum] = min(max(MoveLnScales[moveNum], -5.0), 5.0);
+					}
+				}
+			if ((stepNum%adaptWindow == 0) and (not pureStretch)) {
+				double totalESJD = 0.0;
+				vector<double> ESJD(NUM_MOVE_TYPES, 0.0);
+				for (int moveNum = 0; moveNum < NUM_MOVE_TYPES; ++moveNum) {
+					if ((MoveBaseWeights[moveNum] > 0.0) and (windowProposed[moveNum] > 0)) {
+						ESJD[moveNum] = windowJump[moveNum]/windowProposed[moveNum];
+						totalESJD += ESJD[moveNum];
+						}
+					}
+				if (totalESJD > 0.0) {
+					for (int moveNum = 0; moveNum < NUM_MOVE_TYPES; ++moveNum) {
+						MoveWeights[moveNum] = 0.1*MoveBaseWeights[moveNum] + 0.9*ESJD[moveNum]/totalESJD;
+						}
+					}
+				for (int moveNum = 0; moveNum < NUM_MOVE_TYPES; ++moveNum) {
+					windowJump[moveNum] = 0.0;
+					windowProposed[moveNum] = 0;
+					}
+				}
+			}
+		}
+
+	for (int walkerNum = 0; walkerNum < nwalkers; walkerNum++) {
+		vslDeleteStream(&ZStream[walkerNum]);
+		vslDeleteStream(&WalkerStream[walkerNum]);
+		vslDeleteStream(&AcceptStream[walkerNum]);
+		}
+	WallTime = omp_get_wtime() - startTime;
+	}
+
+template <typename Model> void kali::BasicEnsembleSampler<Model>::setOutput(double *ChainPtr, double *LnPriorPtr, double *LnLikePtr) {
+	/*!
+	Make runMCMC write the chain and its LnPrior and LnLike values straight into caller-owned buffers of numDims*numWalkers*numSteps and numWalkers*numSteps doubles, laid out as described in the constructor, instead of the sampler's own. The buffers must outlive the sampler; getChain and getChainVals with the same pointers then copy nothing.
+	*/
+	if (ownsOutput) {
+		_mm_free(Chain);
+		_mm_free(LnPrior);
+		_mm_free(LnLike);
+		ownsOutput = false;
+		}
+	Chain = ChainPtr;
+	LnPrior = LnPriorPtr;
+	LnLike = LnLikePtr;
+	}
+
+template <typename Model> void kali::BasicEnsembleSampler<Model>::getChain(double *ChainPtr) {
+	if (ChainPtr == Chain) {
+		return;
+		}
+	int sizeChain = numDims*numWalkers*numSteps;
+	double* Ptr2Chain = &Chain[0];
+	#pragma omp parallel for simd default(none) shared(sizeChain, ChainPtr, Ptr2Chain)
+	for (int i = 0; i < sizeChain; ++i) {
+		ChainPtr[i] = Ptr2Chain[i];
+		}
+	}
+
+template <typename Model> void kali::BasicEnsembleSampler<Model>::getChainVals(double *LnPriorPtr, double *LnLikePtr) {
+	if ((LnPriorPtr == LnPrior) and (LnLikePtr == LnLike)) {
+		return;
+		}
+	int sizeChain = numWalkers*numSteps;
+	double* Ptr2LnPrior = &LnPrior[0];
+	double* Ptr2LnLike = &LnLike[0];
+	#pragma omp parallel for simd default(none) shared(sizeChain, LnPriorPtr, LnLikePtr, Ptr2LnPrior, Ptr2LnLike)
+	for (int i = 0; i < sizeChain; ++i) {
+		LnPriorPtr[i] = Ptr2LnPrior[i];
+		LnLikePtr[i] = Ptr2LnLike[i];
+		}
+	}
+
+template <typename Model> void kali::BasicEnsembleSampler<Model>::getMoveStats(double *WeightsPtr, double *AcceptancePtr, long *ProposedPtr) {
+	/*!
+	Final weight, acceptance fraction and number of proposals of each move over the last runMCMC call, indexed by MoveType. The acceptance of a move that was never proposed is reported as 0.
+	*/
+	for (int moveNum = 0; moveNum < NUM_MOVE_TYPES; ++moveNum) {
+		WeightsPtr[moveNum] = MoveWeights[moveNum];
+		AcceptancePtr[moveNum] = (MoveProposed[moveNum] > 0) ? static_cast<double>(MoveAccepted[moveNum])/MoveProposed[moveNum] : 0.0;
+		ProposedPtr[moveNum] = MoveProposed[moveNum];
+		}
+	}
+
+template <typename Model> void kali::BasicEnsembleSampler<Model>::getEvalCounts(long &numSurrogateEvals, long &numExactEvals) {
+	/*!
+	Number of surrogate and exact posterior evaluations made by the last runMCMC call, including those of the initial positions. Without a surrogate numSurrogateEvals is 0.
+	*/
+	numSurrogateEvals = SurrogateEvals;
+	numExactEvals = ExactEvals;
+	}
+
+template <typename Model> double kali::BasicEnsembleSampler<Model>::getUtilization() {
+	/*!
+	Fraction of the core time available to the sampler during the last runMCMC call that was spent evaluating the posterior, i.e. sum(BusyTime)/(numThreads*WallTime).
+	*/
+	double totalBusy = 0.0;
+	for (int threadNum = 0; threadNum < numThreads; ++threadNum) {
+		totalBusy += BusyTime[threadNum];
+		}
+	if (WallTime > 0.0) {
+		return totalBusy/(numThreads*WallTime);
+		} else {
+		return 0.0;
+		}
+	}
+
+template <typename Model> void kali::runSampler(int samplerType, int ndims, int nwalkers, int nsteps, int nthreads, double a, int numTemps, double maxTemp, double (*func)(double* x, void* funcArgs, double &LnPriorVal, double &LnLikelihoodVal), void* funcArgs, const Model &posterior, const Model *surrogate, double *MoveWeights, int numAdaptSteps, unsigned int zSeed, unsigned int walkerSeed, unsigned int moveSeed, double *initPos, double *Chain, double *LnPrior, double *LnLikelihood, double &Utilization, double &LnEvidence, double &LnEvidenceErr, double *MoveWeightsOut, double *MoveAcceptanceOut, long *EvalCounts) {
+	LnEvidence = 0.0;
+	LnEvidenceErr = 0.0;
+	if ((samplerType == kali::NUTS_SAMPLER) or (samplerType == kali::NUTS_DENSE_SAMPLER)) {
+		// One NUTS chain per walker with finite-difference gradients, see kali::NUTSSampler.
+		kali::NUTSSampler newSampler(ndims, nwalkers, nsteps, nthreads, 0.8, samplerType == kali::NUTS_DENSE_SAMPLER, func, funcArgs, zSeed);
+		newSampler.runMCMC(initPos);
+		newSampler.getChain(Chain);
+		newSampler.getChainVals(LnPrior, LnLikelihood);
+		Utilization = newSampler.getUtilization();
+		} else if (samplerType == kali::PT_ENSEMBLE_SAMPLER) {
+		kali::PTEnsembleSampler newEnsemble(ndims, nwalkers, numTemps, nsteps, nthreads, a, maxTemp, func, funcArgs, zSeed, walkerSeed, moveSeed);
+		newEnsemble.runMCMC(initPos);
+		newEnsemble.getChain(Chain);
+		newEnsemble.getChainVals(LnPrior, LnLikelihood);
+		LnEvidence = newEnsemble.getLnEvidence(LnEvidenceErr);
+		Utilization = newEnsemble.getUtilization();
+		} else if (samplerType == kali::ASYNC_ENSEMBLE_SAMPLER) {
+		kali::AsyncEnsembleSampler newEnsemble(ndims, nwalkers, nsteps, nthreads, a, func, funcArgs, zSeed, walkerSeed, moveSeed);
+		newEnsemble.setOutput(Chain, LnPrior, LnLikelihood);
+		newEnsemble.runMCMC(initPos);
+		newEnsemble.getChain(Chain);
+		newEnsemble.getChainVals(LnPrior, LnLikelihood);
+		Utilization = newEnsemble.getUtilization();
+		} else {
+		kali::BasicEnsembleSampler<Model> newEnsemble(ndims, nwalkers, nsteps, nthreads, a, posterior, zSeed, walkerSeed, moveSeed);
+		if (MoveWeights) {
+			newEnsemble.setMoves(MoveWeights, numAdaptSteps);
+			}
+		if (surrogate) {
+			newEnsemble.setSurrogate(*surrogate);
+			}
+		newEnsemble.setOutput(Chain, LnPrior, LnLikelihood);
+		newEnsemble.runMCMC(initPos);
+		newEnsemble.getChain(Chain);
+		newEnsemble.getChainVals(LnPrior, LnLikelihood);
+		Utilization = newEnsemble.getUtilization();
+		if (MoveWeightsOut and MoveAcceptanceOut) {
+			long moveProposed[kali::NUM_MOVE_TYPES];
+			newEnsemble.getMoveStats(MoveWeightsOut, MoveAcceptanceOut, moveProposed);
+			}
+		if (EvalCounts) {
+			newEnsemble.getEvalCounts(EvalCounts[0], EvalCounts[1]);
+			}
+		}
+	}
+
 #endif
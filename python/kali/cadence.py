@@ -0,0 +1,178 @@
+#!/usr/bin/env python
+"""	Module to generate survey cadences for mock light curves.
+
+A cadence starts as a regular grid of times with every cadence unmasked. Sampling patterns (seasons, nights, weather,
+visits per night, K2 thruster firings, LSST-like rolling) are applied in C++ and only ever clear mask entries, so they
+chain:
+
+    sdss = kali.cadence.cadence(3000.0, 0.02).seasons(120.0).nights(0.3).weather(0.3, seed=1).visits(1, seed=2)
+    lc = task.simulate(tIn=sdss.tObserved)
+
+The presets sdss, k2 and lsst build typical patterns, and catalog packs many cadences into the (cadenceOffsets, t,
+mask) layout taken by kali.carma.CARMATask.simulateBatch.
+"""
+
+import sys
+import numpy as np
+
+try:
+    import rand
+    import LCTools_cython
+except ImportError:
+    print('kali is not setup. Setup kali by sourcing bin/setup.sh')
+    sys.exit(1)
+
+DaysInYear = 365.25
+K2LongCadence = 29.4244/(60.0*24.0)
+K2ThrusterPeriod = 5.885/24.0
+
+
+def _seed(seed):
+    if seed is None:
+        randSeed = np.zeros(1, dtype='uint32')
+        rand.rdrand(randSeed)
+        seed = randSeed[0]
+    return int(seed)
+
+
+class cadence(object):
+
+    def __init__(self, duration, dt, startT=0.0):
+        """!
+        \brief Regular grid of int(duration/dt) cadences spaced dt apart starting at startT, all unmasked.
+        """
+        numCadences = int(round(float(duration)/dt))
+        if numCadences < 1:
+            raise ValueError('duration must be at least dt')
+        self._dt = float(dt)
+        self._t = np.require(startT + dt*np.arange(numCadences), requirements=['C', 'A', 'W'])
+        self._mask = np.ones(numCadences)
+
+    @property
+    def dt(self):
+        return self._dt
+
+    @property
+    def numCadences(self):
+        return self._t.shape[0]
+
+    @property
+    def t(self):
+        return self._t
+
+    @property
+    def mask(self):
+        return self._mask
+
+    @property
+    def numObserved(self):
+        return int(np.count_nonzero(self._mask))
+
+    @property
+    def tObserved(self):
+        """!
+        \brief Times of the unmasked cadences, for simulate(tIn=...) and other irregular-sampling paths.
+        """
+        return self._t[self._mask != 0.0]
+
+    def _check(self, result, name):
+        if result < 0:
+            raise ValueError('Invalid parameters for %s'%(name))
+        return self
+
+    def windows(self, period, openLength, phase=0.0):
+        """!
+        \brief Keep only the cadences in [phase, phase + openLength) modulo period.
+        """
+        return self._check(LCTools_cython.mask_Windows(self._t, self._mask, period, openLength, phase), 'windows')
+
+    def seasons(self, length, period=DaysInYear, phase=None):
+        """!
+        \brief Observing seasons of the given length (days) once every period, by default starting at the first cadence.
+        """
+        if phase is None:
+            phase = self._t[0]
+        return self.windows(period, length, phase)
+
+    def nights(self, length, phase=None):
+        """!
+        \brief Keep the first length days of every day, i.e. the hours a field is observable each night.
+        """
+        if phase is None:
+            phase = self._t[0]
+        return self.windows(1.0, length, phase)
+
+    def weather(self, lossFraction, persistence=0.0, blockLength=1.0, seed=None):
+        """!
+        \brief Lose whole blocks (nights by default) with probability lossFraction and lag-one correlation persistence.
+        """
+        return self._check(LCTools_cython.mask_Weather(self._t, self._mask, blockLength, lossFraction, persistence,
+                                                       _seed(seed)), 'weather')
+
+    def visits(self, visitsPerBlock, blockLength=1.0, seed=None):
+        """!
+        \brief Keep at most visitsPerBlock randomly chosen cadences per block (per night by default).
+        """
+        return self._check(LCTools_cython.mask_Visits(self._t, self._mask, blockLength, int(visitsPerBlock),
+                                                      _seed(seed)), 'visits')
+
+    def thrusterFires(self, firePeriod=K2ThrusterPeriod, fireWidth=K2LongCadence, jitter=0.0, seed=None):
+        """!
+        \brief Mask the cadences within fireWidth/2 of K2 thruster firings every firePeriod, jittered by up to jitter.
+        """
+        return self._check(LCTools_cython.mask_ThrusterFires(self._t, self._mask, firePeriod, fireWidth, jitter,
+                                                             _seed(seed)), 'thrusterFires')
+
+    def rolling(self, numStripes, stripe, backgroundFraction, seasonPeriod=DaysInYear, seed=None):
+        """!
+        \brief LSST-like rolling cadence: stripe is fully sampled one season in numStripes and keeps backgroundFraction
+        of its cadences in the others.
+        """
+        return self._check(LCTools_cython.mask_Rolling(self._t, self._mask, seasonPeriod, int(numStripes),
+                                                       int(stripe), backgroundFraction, _seed(seed)), 'rolling')
+
+
+def sdss(duration=3000.0, dt=0.02, seasonLength=90.0, nightLength=0.3, lossFraction=0.4, persistence=0.3,
+         startT=0.0, seed=None):
+    """!
+    \brief Stripe 82-like cadence: short autumn seasons, at most one visit per night and correlated weather losses.
+    """
+    seed = _seed(seed)
+    return cadence(duration, dt, startT).seasons(seasonLength).nights(nightLength).weather(
+        lossFraction, persistence, seed=seed).visits(1, seed=seed + 1)
+
+
+def k2(campaignLength=80.0, startT=0.0, jitter=0.01, seed=None):
+    """!
+    \brief One K2 campaign at long cadence with the cadences around thruster firings masked.
+    """
+    return cadence(campaignLength, K2LongCadence, startT).thrusterFires(jitter=jitter, seed=seed)
+
+
+def lsst(duration=10.0*DaysInYear, dt=0.01, seasonLength=200.0, nightLength=0.35, visitsPerNight=2,
+         lossFraction=0.2, persistence=0.3, numStripes=2, stripe=0, backgroundFraction=0.25, startT=0.0,
+         seed=None):
+    """!
+    \brief LSST-like wide-fast-deep cadence with pairs of visits per night and a rolling cadence across the seasons.
+    """
+    seed = _seed(seed)
+    return cadence(duration, dt, startT).seasons(seasonLength).nights(nightLength).weather(
+        lossFraction, persistence, seed=seed).visits(visitsPerNight, seed=seed + 1).rolling(
+        numStripes, stripe, backgroundFraction, seed=seed + 2)
+
+
+def catalog(cadences, compact=True):
+    """!
+    \brief Pack cadences into the (cadenceOffsets, t, mask) layout of CARMATask.simulateBatch.
+
+    With compact=True only the unmasked times are kept (as for surveys with irregular visits) and the mask is all
+    ones; otherwise every light curve keeps its full grid with the cadence mask (as for K2).
+    """
+    if compact:
+        ts = [c.tObserved for c in cadences]
+        masks = [np.ones(t.shape[0]) for t in ts]
+    else:
+        ts = [c.t for c in cadences]
+        masks = [c.mask for c in cadences]
+    cadenceOffsets = np.concatenate(([0], np.cumsum([t.shape[0] for t in ts]))).astype(np.intc)
+    return cadenceOffsets, np.concatenate(ts), np.concatenate(masks)
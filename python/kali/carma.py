@@ -14,12 +14,18 @@ try:
     import rand
     import CARMATask_cython
     import kali.lc
+    import kali.util.buffers
     import kali.util.classproperty
     import kali.util.triangle
 except ImportError:
     print('kali is not setup. Setup kali by sourcing bin/setup.sh')
     sys.exit(1)
 
+try:
+    basestring
+except NameError:
+    basestring = str
+
 fhgt = 10
 fwid = 16
 COLORX = r'#984ea3'
@@ -182,6 +188,9 @@ class CARMATask(object):
                 np.zeros(self._nwalkers*self._nsteps), requirements=['F', 'A', 'W', 'O', 'E'])
             self._taskCython = CARMATask_cython.CARMATask_cython(self._p, self._q, self._nthreads,
                                                                  self._nburn)
+            self._scratch = dict()
+            self._ensemble = None
+            self._rngVersion = 1
             self._pDIC = None
             self._dic = None
             self._name = 'kali.CARMATask(%d, %d)'%(self.p, self.q)
@@ -194,6 +203,7 @@ class CARMATask(object):
         """
         state = copy.copy(self.__dict__)
         del state['_taskCython']
+        state.pop('_scratch', None)
         return state
 
     def __setstate__(self, state):
@@ -202,6 +212,10 @@ class CARMATask(object):
         """
         self.__dict__ = copy.copy(state)
         self._taskCython = CARMATask_cython.CARMATask_cython(self._p, self._q, self._nthreads, self._nburn)
+        self._scratch = dict()
+        self._ensemble = state.get('_ensemble')
+        self._rngVersion = state.get('_rngVersion', 1)
+        self._taskCython.set_rngMode(self._rngVersion)
 
     @kali.util.classproperty.ClassProperty
     @classmethod
@@ -261,6 +275,24 @@ class CARMATask(object):
     def nthreads(self):
         return self._nthreads
 
+    @property
+    def rngVersion(self):
+        """!
+        \brief Version of the scheme simulate, extend and observe use to turn seeds into random numbers.
+
+        1 (the default) draws the disturbances and the noise one cadence at a time, as kali always has, so existing
+        seeds reproduce the same light curves. 2 draws them for whole runs of equally spaced cadences in one call and
+        is much faster on long light curves. Both are reproducible for a given seed and agree up to rounding on the
+        disturbances; the observation noise of version 2 is drawn as standard normals and scaled afterwards.
+        """
+        return self._rngVersion
+
+    @rngVersion.setter
+    def rngVersion(self, value):
+        if self._taskCython.set_rngMode(int(value)) != 0:
+            raise ValueError('rngVersion must be 1 or 2')
+        self._rngVersion = int(value)
+
     @property
     def nburn(self):
         return self._nburn
@@ -412,6 +444,10 @@ class CARMATask(object):
     def dic(self):
         return self._dic
 
+    @property
+    def samplerUtilization(self):
+        return self._taskCython.get_samplerUtilization()
+
     def __repr__(self):
         return "kali.carma.CARMATask(%d, %d, %d, %d, %d, %d, %d, %f)"%(self._p, self._q, self._nthreads,
                                                                        self._nburn, self._nwalkers,
@@ -554,7 +590,17 @@ class CARMATask(object):
 
     def simulate(self, duration=None, tIn=None, tolIR=1.0e-3, fracIntrinsicVar=0.15, fracNoiseToSignal=0.001,
                  maxSigma=2.0, minTimescale=2.0, maxTimescale=0.5, burnSeed=None, distSeed=None,
-                 tnum=None):
+                 tnum=None, method='kalman'):
+        """!
+        \brief Simulate an intrinsic light curve either for duration at the task dt or at the times tIn.
+
+        method='kalman' (the default) burns the system in and runs the state-space recursion, which works for any
+        sampling. method='circulant' draws the light curve exactly from the stationary process by circulant
+        embedding of the ACVF in O(N log N) without burn-in (burnSeed is unused); the cadences must be regular to
+        within tolIR. A circulant light curve carries no Kalman state, so extend raises ValueError on it.
+        """
+        if method not in ('kalman', 'circulant'):
+            raise ValueError('method must be kalman or circulant')
         if tnum is None:
             tnum = 0
         if tIn is None and duration is not None:
@@ -581,16 +627,27 @@ class CARMATask(object):
         if distSeed is None:
             rand.rdrand(randSeed)
             distSeed = randSeed[0]
-        self._taskCython.make_IntrinsicLC(
-            intrinsicLC.numCadences, intrinsicLC.tolIR, intrinsicLC.fracIntrinsicVar,
-            intrinsicLC.fracNoiseToSignal, intrinsicLC.t, intrinsicLC.x, intrinsicLC.y, intrinsicLC.yerr,
-            intrinsicLC.mask, intrinsicLC.XSim, intrinsicLC.PSim, burnSeed, distSeed, threadNum=tnum)
-        intrinsicLC._simulatedCadenceNum = numCadences - 1
+        if method == 'circulant':
+            status = self._taskCython.make_CirculantLC(
+                intrinsicLC.numCadences, intrinsicLC.tolIR, intrinsicLC.t, intrinsicLC.x, intrinsicLC.y,
+                intrinsicLC.yerr, intrinsicLC.mask, distSeed, threadNum=tnum)
+            if status == -1:
+                raise ValueError('method circulant needs regularly sampled cadences')
+            elif status != 0:
+                raise ValueError('ACVF has no nonnegative circulant embedding')
+        else:
+            self._taskCython.make_IntrinsicLC(
+                intrinsicLC.numCadences, intrinsicLC.tolIR, intrinsicLC.fracIntrinsicVar,
+                intrinsicLC.fracNoiseToSignal, intrinsicLC.t, intrinsicLC.x, intrinsicLC.y, intrinsicLC.yerr,
+                intrinsicLC.mask, intrinsicLC.XSim, intrinsicLC.PSim, burnSeed, distSeed, threadNum=tnum)
+            intrinsicLC._simulatedCadenceNum = numCadences - 1
         intrinsicLC._T = intrinsicLC.t[-1] - intrinsicLC.t[0]
         return intrinsicLC
 
     def extend(
             self, intrinsicLC, duration=None, tIn=None, gap=None, distSeed=None, noiseSeed=None, tnum=None):
+        if intrinsicLC._simulatedCadenceNum < 0:
+            raise ValueError('Cannot extend a light curve that has no Kalman state (e.g. a circulant simulation)')
         if tnum is None:
             tnum = 0
         randSeed = np.zeros(1, dtype='uint32')
@@ -684,6 +741,72 @@ class CARMATask(object):
             intrinsicLC._observedCadenceNum = intrinsicLC._numCadences - 1
         intrinsicLC._statistics()
 
+    def simulateBatch(self, Thetas, cadenceOffsets, t, mask=None, tolIR=1.0e-3, fracIntrinsicVar=0.15,
+                      fracNoiseToSignal=0.001, burnSeeds=None, distSeeds=None, noiseSeeds=None, fileName=None,
+                      chunkSize=None):
+        """Simulate a catalog of mock light curves of this CARMA(p,q) model in one call.
+
+        Light curve i has parameters Thetas[i] (shape (numLCs, ndims)) and the cadences t[cadenceOffsets[i]:
+        cadenceOffsets[i + 1]] of the packed time array t. fracIntrinsicVar, fracNoiseToSignal and the seeds may be
+        scalars or arrays over light curves; missing seeds are drawn with rdrand. Light curve i equals
+        simulate(tIn=...) followed by observe() with the task set to Thetas[i] and the same seeds. The light curves
+        are simulated in parallel on nthreads threads, chunkSize (default all) at a time.
+
+        Returns (x, y, yerr, status): packed intrinsic flux, observed flux and error, and per light curve 0 on
+        success or -1 for an invalid Theta. With fileName the packed arrays are the rows of an (3, numCadences)
+        .npy memory map written chunk by chunk, so catalogs larger than memory stream straight to disk; reopen it
+        with numpy.load(fileName, mmap_mode='r').
+        """
+        Thetas = np.require(Thetas, dtype=np.float64, requirements=['C', 'A', 'W'])
+        numLCs = Thetas.shape[0]
+        if Thetas.shape != (numLCs, self.ndims):
+            raise ValueError('Thetas must have shape (numLCs, %d)'%(self.ndims))
+        cadenceOffsets = np.require(cadenceOffsets, dtype=np.intc, requirements=['C', 'A'])
+        if cadenceOffsets.shape[0] != numLCs + 1:
+            raise ValueError('cadenceOffsets must have numLCs + 1 entries')
+        t = kali.util.buffers.require(t)
+        numCadences = int(cadenceOffsets[-1])
+        if mask is None:
+            mask = np.ones(numCadences)
+        mask = kali.util.buffers.require(mask)
+        fracIntrinsicVar = np.require(np.broadcast_to(fracIntrinsicVar, (numLCs,)), dtype=np.float64,
+                                      requirements=['C', 'A', 'W'])
+        fracNoiseToSignal = np.require(np.broadcast_to(fracNoiseToSignal, (numLCs,)), dtype=np.float64,
+                                       requirements=['C', 'A', 'W'])
+        seeds = list()
+        for seed in (burnSeeds, distSeeds, noiseSeeds):
+            if seed is None:
+                seed = np.zeros(numLCs, dtype='uint32')
+                rand.rdrand(seed)
+            seeds.append(np.require(np.broadcast_to(seed, (numLCs,)), dtype=np.uint32, requirements=['C', 'A', 'W']))
+        if fileName is None:
+            out = np.zeros((3, numCadences))
+        else:
+            out = np.lib.format.open_memmap(fileName, mode='w+', dtype=np.float64, shape=(3, numCadences))
+        status = np.zeros(numLCs, dtype=np.intc)
+        if chunkSize is None:
+            chunkSize = numLCs
+        for first in range(0, numLCs, chunkSize):
+            last = min(first + chunkSize, numLCs)
+            start, stop = cadenceOffsets[first], cadenceOffsets[last]
+            self._taskCython.make_ObservedLCBatch(
+                cadenceOffsets[first:last + 1] - start, tolIR, Thetas[first:last].reshape(-1),
+                fracIntrinsicVar[first:last], fracNoiseToSignal[first:last], t[start:stop], out[0, start:stop],
+                out[1, start:stop], out[2, start:stop], mask[start:stop], seeds[0][first:last], seeds[1][first:last],
+                seeds[2][first:last], status[first:last])
+            if fileName is not None:
+                out.flush()
+        return out[0], out[1], out[2], status
+
+    def _centeredY(self, observedLC, tnum=0):
+        """!
+        \brief observedLC.y - observedLC.mean, written into a work array kept per thread number so that repeated
+        likelihood evaluations and fits do not allocate.
+        """
+        yCentered = kali.util.buffers.scratch(self._scratch, ('y', tnum), observedLC.numCadences)
+        np.subtract(observedLC.y, observedLC.mean, out=yCentered)
+        return yCentered
+
     def logPrior(self, observedLC, forced=True, tnum=None):
         if tnum is None:
             tnum = 0
@@ -692,7 +815,7 @@ class CARMATask(object):
                                                                 observedLC.minTimescale*observedLC.mindt,
                                                                 observedLC.maxTimescale*observedLC.T,
                                                                 observedLC.t, observedLC.x,
-                                                                observedLC.y - observedLC.mean,
+                                                                self._centeredY(observedLC, tnum),
                                                                 observedLC.yerr, observedLC.mask, tnum)
         return observedLC._logPrior
 
@@ -711,7 +834,7 @@ class CARMATask(object):
                     observedLC.PComp[rowCtr + observedLC.pComp*colCtr] = 0.0
             observedLC._logLikelihood = self._taskCython.compute_LnLikelihood(
                 observedLC.numCadences, observedLC._computedCadenceNum, observedLC.tolIR, observedLC.t,
-                observedLC.x, observedLC.y - observedLC.mean, observedLC.yerr, observedLC.mask,
+                observedLC.x, self._centeredY(observedLC, tnum), observedLC.yerr, observedLC.mask,
                 observedLC.XComp, observedLC.PComp, tnum)
             observedLC._logPosterior = observedLC._logPrior + observedLC._logLikelihood
             observedLC._computedCadenceNum = observedLC.numCadences - 1
@@ -720,7 +843,7 @@ class CARMATask(object):
         else:
             observedLC._logLikelihood = self._taskCython.update_LnLikelihood(
                 observedLC.numCadences, observedLC._computedCadenceNum, observedLC._logLikelihood,
-                observedLC.tolIR, observedLC.t, observedLC.x, observedLC.y - observedLC.mean, observedLC.yerr,
+                observedLC.tolIR, observedLC.t, observedLC.x, self._centeredY(observedLC, tnum), observedLC.yerr,
                 observedLC.mask, observedLC.XComp, observedLC.PComp, tnum)
             observedLC._logPosterior = observedLC._logPrior + observedLC._logLikelihood
             observedLC._computedCadenceNum = observedLC.numCadences - 1
@@ -971,30 +1094,14 @@ class CARMATask(object):
             plt.show(False)
         return newFig
 
-    def fit(self, observedLC, widthT=0.01, widthF=0.05,
-            zSSeed=None, walkerSeed=None, moveSeed=None, xSeed=None, Bp=True):
-        observedLC.pComp = self.p
-        observedLC.qComp = self.q
-        randSeed = np.zeros(1, dtype='uint32')
-        if zSSeed is None:
-            rand.rdrand(randSeed)
-            zSSeed = randSeed[0]
-        if walkerSeed is None:
-            rand.rdrand(randSeed)
-            walkerSeed = randSeed[0]
-        if moveSeed is None:
-            rand.rdrand(randSeed)
-            moveSeed = randSeed[0]
-        if xSeed is None:
-            rand.rdrand(randSeed)
-            xSeed = randSeed[0]
-        xStart = np.require(np.zeros(self.ndims*self.nwalkers), requirements=['F', 'A', 'W', 'O', 'E'])
+    def _startingPoints(self, observedLC, numPoints):
+        xStart = np.require(np.zeros(self.ndims*numPoints), requirements=['F', 'A', 'W', 'O', 'E'])
         minT = observedLC.mindt*observedLC.minTimescale
         maxT = observedLC.T*observedLC.maxTimescale
         minTLog10 = math.log10(minT)
         maxTLog10 = math.log10(maxT)
 
-        for walkerNum in range(self.nwalkers):
+        for walkerNum in range(numPoints):
             count = 0
             noSuccess = True
             sigmaFactor = 1.0e0
@@ -1017,20 +1124,213 @@ class CARMATask(object):
 
             for dimNum in range(self.ndims):
                 xStart[dimNum + walkerNum*self.ndims] = ThetaGuess[dimNum]
-        res = self._taskCython.fit_CARMAModel(
+        return xStart
+
+    def nest(self, observedLC, nlive=None, dlogz=0.1, maxiter=None, nestSeed=None):
+        """Compute the evidence for this CARMA(p,q) model by nested sampling.
+
+        Uses the same prior and likelihood as fit(). Returns (lnEvidence, lnEvidenceErr); the weighted
+        posterior samples are stored in nestSamples, nestLnPrior, nestLnLikelihood and nestLnWeight, with
+        sum(exp(nestLnWeight)) = 1. If maxiter runs out before the dlogz tolerance is met, nestConverged is
+        False and a RuntimeWarning is issued.
+        """
+        observedLC.pComp = self.p
+        observedLC.qComp = self.q
+        if nlive is None:
+            nlive = 25*self.ndims
+        if maxiter is None:
+            maxiter = 1000*nlive
+        if nestSeed is None:
+            randSeed = np.zeros(1, dtype='uint32')
+            rand.rdrand(randSeed)
+            nestSeed = randSeed[0]
+        numStart = min(nlive, self.nwalkers)
+        xStart = self._startingPoints(observedLC, numStart)
+        Samples = np.require(np.zeros(self.ndims*(nlive + maxiter)), requirements=['F', 'A', 'W', 'O', 'E'])
+        LnPrior = np.require(np.zeros(nlive + maxiter), requirements=['F', 'A', 'W', 'O', 'E'])
+        LnLikelihood = np.require(np.zeros(nlive + maxiter), requirements=['F', 'A', 'W', 'O', 'E'])
+        LnWeight = np.require(np.zeros(nlive + maxiter), requirements=['F', 'A', 'W', 'O', 'E'])
+        numSamples = self._taskCython.nest_CARMAModel(
             observedLC.dt, observedLC.numCadences, observedLC.tolIR, observedLC.maxSigma*observedLC.std,
             observedLC.minTimescale*observedLC.mindt, observedLC.maxTimescale*observedLC.T, observedLC.t,
-            observedLC.x, observedLC.y - observedLC.mean, observedLC.yerr, observedLC.mask, self.nwalkers,
-            self.nsteps, self.maxEvals, self.xTol, self.mcmcA, zSSeed, walkerSeed, moveSeed, xSeed, xStart,
-            self._Chain, self._LnPrior, self._LnLikelihood, Bp)
+            observedLC.x, self._centeredY(observedLC), observedLC.yerr, observedLC.mask, nlive, dlogz,
+            maxiter, nestSeed, numStart, xStart, Samples, LnPrior, LnLikelihood, LnWeight)
+        if numSamples < 0:
+            raise RuntimeError('Nested sampling failed to start from the initial guesses!')
+        self._nestSamples = np.reshape(Samples[:self.ndims*numSamples], newshape=(self.ndims, numSamples), order='F')
+        self._nestLnPrior = LnPrior[:numSamples]
+        self._nestLnLikelihood = LnLikelihood[:numSamples]
+        self._nestLnWeight = LnWeight[:numSamples]
+        if not self.nestConverged:
+            warnings.warn('Nested sampling reached maxiter = %d before dlogz = %g was met; lnEvidence is not '
+                          'converged' % (maxiter, dlogz), RuntimeWarning)
+        return self.lnEvidence, self.lnEvidenceErr
+
+    @property
+    def nestSamples(self):
+        return self._nestSamples
+
+    @property
+    def nestLnPrior(self):
+        return self._nestLnPrior
+
+    @property
+    def nestLnLikelihood(self):
+        return self._nestLnLikelihood
+
+    @property
+    def nestLnWeight(self):
+        return self._nestLnWeight
+
+    @property
+    def nestConverged(self):
+        return self._taskCython.get_nestConverged()
 
+    @property
+    def lnEvidence(self):
+        return self._taskCython.get_lnEvidence()
+
+    @property
+    def lnEvidenceErr(self):
+        return self._taskCython.get_lnEvidenceErr()
+
+    def laplace(self, observedLCs, numStarts=4):
+        """Fast fit of one or many light curves by the Laplace approximation.
+
+        For each light curve the posterior used by fit() is maximized from numStarts starting points and
+        approximated by a Gaussian at the best optimum. Returns (MAP, Cov, lnLaplace, status) with shapes
+        (numLCs, ndims), (numLCs, ndims, ndims), (numLCs,) and (numLCs,); status is 0 on success, -1 if
+        the Hessian at the MAP is not negative definite and -2 if no starting point was valid. lnLaplace is the
+        unnormalized log Laplace integral of the posterior: the prior is only an indicator of its support, so it
+        has no prior-volume term and is not comparable with the nested-sampling lnEvidence or across models. The light
+        curves are processed in parallel, one per thread, so pass them in large batches.
+        """
+        if not isinstance(observedLCs, (list, tuple)):
+            observedLCs = [observedLCs]
+        numLCs = len(observedLCs)
+        cadenceOffsets = np.require(np.zeros(numLCs + 1, dtype=np.intc), requirements=['F', 'A', 'W', 'O', 'E'])
+        maxSigma = np.require(np.zeros(numLCs), requirements=['F', 'A', 'W', 'O', 'E'])
+        minTimescale = np.require(np.zeros(numLCs), requirements=['F', 'A', 'W', 'O', 'E'])
+        maxTimescale = np.require(np.zeros(numLCs), requirements=['F', 'A', 'W', 'O', 'E'])
+        xStart = np.require(np.zeros(self.ndims*numStarts*numLCs), requirements=['F', 'A', 'W', 'O', 'E'])
+        for lcNum, observedLC in enumerate(observedLCs):
+            observedLC.pComp = self.p
+            observedLC.qComp = self.q
+            cadenceOffsets[lcNum + 1] = cadenceOffsets[lcNum] + observedLC.numCadences
+            maxSigma[lcNum] = observedLC.maxSigma*observedLC.std
+            minTimescale[lcNum] = observedLC.minTimescale*observedLC.mindt
+            maxTimescale[lcNum] = observedLC.maxTimescale*observedLC.T
+            xStart[lcNum*numStarts*self.ndims:(lcNum + 1)*numStarts*self.ndims] = self._startingPoints(
+                observedLC, numStarts)
+        pack = kali.util.buffers.concatenate
+        t = pack(self._scratch, ('laplace', 't'), [lc.t for lc in observedLCs])
+        x = pack(self._scratch, ('laplace', 'x'), [lc.x for lc in observedLCs])
+        y = pack(self._scratch, ('laplace', 'y'), [lc.y for lc in observedLCs], [lc.mean for lc in observedLCs])
+        yerr = pack(self._scratch, ('laplace', 'yerr'), [lc.yerr for lc in observedLCs])
+        mask = pack(self._scratch, ('laplace', 'mask'), [lc.mask for lc in observedLCs])
+        MAP = np.require(np.zeros(self.ndims*numLCs), requirements=['F', 'A', 'W', 'O', 'E'])
+        Cov = np.require(np.zeros(self.ndims*self.ndims*numLCs), requirements=['F', 'A', 'W', 'O', 'E'])
+        LnPosteriorMAP = np.require(np.zeros(numLCs), requirements=['F', 'A', 'W', 'O', 'E'])
+        LnLaplace = np.require(np.zeros(numLCs), requirements=['F', 'A', 'W', 'O', 'E'])
+        Status = np.require(np.zeros(numLCs, dtype=np.intc), requirements=['F', 'A', 'W', 'O', 'E'])
+        self._taskCython.laplace_CARMAModel(
+            cadenceOffsets, observedLCs[0].tolIR, maxSigma, minTimescale, maxTimescale, t, x, y, yerr, mask,
+            numStarts, xStart, self.maxEvals, self.xTol, MAP, Cov, LnPosteriorMAP, LnLaplace, Status)
+        return (np.reshape(MAP, newshape=(numLCs, self.ndims)),
+                np.reshape(Cov, newshape=(numLCs, self.ndims, self.ndims)), LnLaplace, Status)
+
+    def fit(self, observedLC, widthT=0.01, widthF=0.05,
+            zSSeed=None, walkerSeed=None, moveSeed=None, xSeed=None, Bp=True, sampler='ensemble',
+            moves=None, adaptSteps=None, surrogateBin=None, optStarts=None, warmStart=None, warmBurn=None):
+        """Sample the posterior of this CARMA(p,q) model given observedLC.
+
+        sampler picks the MCMC algorithm: 'ensemble' (the default) is the synchronous affine-invariant ensemble
+        sampler, 'async' its asynchronous variant that updates each walker as soon as a thread is free, and 'nuts'
+        or 'nuts_dense' run one No-U-Turn chain per walker with a diagonal or dense mass matrix. The chain has the
+        same shape (ndims, nwalkers, nsteps) for all of them.
+
+        moves is a dict of move weights, e.g. {'stretch': 0.5, 'de': 0.3, 'snooker': 0.1, 'kde': 0.1}, for the
+        ensemble sampler; the weights adapt to the acceptance of each move over the first adaptSteps steps (default
+        nsteps//2, or nsteps//10 with warmStart, and 0 without moves). surrogateBin > 1 screens every ensemble
+        proposal with the likelihood of the light curve binned by surrogateBin consecutive cadences before the exact
+        likelihood is computed (delayed acceptance); the chain still samples the exact posterior. moves, adaptSteps
+        and surrogateBin only apply to sampler='ensemble' and raise a ValueError with the other samplers.
+
+        optStarts is the number of optimizer runs (default max(4, 2*ndims)) from which the walkers are started
+        around the modes of the posterior when Bp is False; optStarts=0 optimizes every walker from its own
+        starting point instead.
+
+        warmStart seeds the walkers from an earlier fit instead of fresh random starting points: a CARMATask of the
+        same order, its ensemble dict, a file written by saveEnsemble, a chain of shape (ndims, nwalkers, nsteps) or
+        an ensemble of shape (ndims, numWalkers). The optimizer is skipped, walkers outside the prior are restarted
+        at walkers inside it, and only the first warmBurn steps (default nsteps//10 instead of nsteps//2) are
+        discarded as burn-in. The final ensemble of every fit is kept in ensemble and pickled with the task.
+        """
+        samplerTypes = {'ensemble': 0, 'async': 1, 'nuts': 3, 'nuts_dense': 4}
+        if sampler not in samplerTypes:
+            raise ValueError('Unknown sampler %s; choose one of %s'%(sampler, ', '.join(sorted(samplerTypes))))
+        if sampler != 'ensemble':
+            for name, value in (('moves', moves), ('adaptSteps', adaptSteps), ('surrogateBin', surrogateBin)):
+                if value is not None:
+                    raise ValueError('%s is only supported by the ensemble sampler, not by %s'%(name, sampler))
+        MoveWeights = np.require(np.zeros(len(self._moveTypes)), requirements=['F', 'A', 'W', 'O', 'E'])
+        if moves is None:
+            MoveWeights[0] = 1.0
+            if adaptSteps is None:
+                adaptSteps = 0
+        else:
+            for move, weight in moves.items():
+                if move not in self._moveTypes:
+                    raise ValueError('Unknown move %s; choose from %s'%(move, ', '.join(self._moveTypes)))
+                MoveWeights[self._moveTypes.index(move)] = weight
+            if adaptSteps is None:
+                adaptSteps = self.nsteps//2 if warmStart is None else self.nsteps//10
+        if surrogateBin is None:
+            surrogateBin = 0
+        if optStarts is None:
+            optStarts = max(4, 2*self.ndims)
+        observedLC.pComp = self.p
+        observedLC.qComp = self.q
+        randSeed = np.zeros(1, dtype='uint32')
+        if zSSeed is None:
+            rand.rdrand(randSeed)
+            zSSeed = randSeed[0]
+        if walkerSeed is None:
+            rand.rdrand(randSeed)
+            walkerSeed = randSeed[0]
+        if moveSeed is None:
+            rand.rdrand(randSeed)
+            moveSeed = randSeed[0]
+        if xSeed is None:
+            rand.rdrand(randSeed)
+            xSeed = randSeed[0]
+        if warmStart is None:
+            xStart = self._startingPoints(observedLC, self.nwalkers)
+            self._burnSteps = self.nsteps//2
+        else:
+            xStart = self._warmStartingPoints(warmStart, xSeed)
+            Bp = True
+            if warmBurn is None:
+                warmBurn = self.nsteps//10
+            self._burnSteps = min(max(warmBurn, 0), self.nsteps - 1)
+        res = self._taskCython.fit_CARMAModel(
+            observedLC.dt, observedLC.numCadences, observedLC.tolIR, observedLC.maxSigma*observedLC.std,
+            observedLC.minTimescale*observedLC.mindt, observedLC.maxTimescale*observedLC.T,
+            kali.util.buffers.require(observedLC.t), kali.util.buffers.require(observedLC.x),
+            self._centeredY(observedLC), kali.util.buffers.require(observedLC.yerr),
+            kali.util.buffers.require(observedLC.mask), self.nwalkers, self.nsteps, self.maxEvals, self.xTol,
+            self.mcmcA, zSSeed, walkerSeed, moveSeed, xSeed, xStart, self._Chain, self._LnPrior, self._LnLikelihood,
+            Bp, samplerTypes[sampler], MoveWeights, adaptSteps, surrogateBin, optStarts)
+
+        self._ensemble = {'p': self.p, 'q': self.q, 'Theta': np.copy(self.Chain[:, :, -1]),
+                          'LnPrior': np.copy(self.LnPrior[:, -1]), 'LnLikelihood': np.copy(self.LnLikelihood[:, -1])}
         meanTheta = list()
         for dimNum in range(self.ndims):
-            meanTheta.append(np.mean(self.Chain[dimNum, :, self.nsteps//2:]))
+            meanTheta.append(np.mean(self.Chain[dimNum, :, self.burnSteps:]))
         meanTheta = np.require(meanTheta, requirements=['F', 'A', 'W', 'O', 'E'])
         self.set(observedLC.dt, meanTheta)
         devianceThetaBar = -2.0*self.logLikelihood(observedLC)
-        barDeviance = np.mean(-2.0*self.LnLikelihood[:, self.nsteps//2:])
+        barDeviance = np.mean(-2.0*self.LnLikelihood[:, self.burnSteps:])
         self._pDIC = barDeviance - devianceThetaBar
         self._dic = devianceThetaBar + 2.0*self.pDIC
         self.rootChain
@@ -1040,6 +1340,87 @@ class CARMATask(object):
         self.bestTau
         return res
 
+    @property
+    def burnSteps(self):
+        """Number of initial steps of the chain that the last fit discarded as burn-in."""
+        return getattr(self, '_burnSteps', self.nsteps//2)
+
+    @property
+    def ensemble(self):
+        """Final ensemble of the last fit: a dict with 'p', 'q', 'Theta' (ndims, nwalkers), 'LnPrior' and
+        'LnLikelihood' (nwalkers,). Pass it (or the task itself) as warmStart to a later fit."""
+        return self._ensemble
+
+    def saveEnsemble(self, fileName):
+        """Write the final ensemble of the last fit to fileName with numpy.savez, e.g. next to the other results of
+        a run, so that a later session can warm start from it."""
+        np.savez(fileName, **self.ensemble)
+
+    def _warmStartingPoints(self, warmStart, xSeed):
+        """Walker positions for fit(warmStart=...): nwalkers walkers of the given ensemble, drawn without
+        replacement if it has enough and otherwise all of them plus jittered copies."""
+        if isinstance(warmStart, CARMATask):
+            if warmStart.ensemble is None:
+                raise ValueError('Cannot warm start from a CARMA(%d,%d) task that has not been fitted'%(
+                    warmStart.p, warmStart.q))
+            warmStart = warmStart.ensemble
+        elif isinstance(warmStart, basestring):
+            with np.load(warmStart) as stored:
+                warmStart = dict((key, stored[key]) for key in stored.files)
+        if isinstance(warmStart, dict):
+            if (int(warmStart.get('p', self.p)) != self.p) or (int(warmStart.get('q', self.q)) != self.q):
+                raise ValueError('Cannot warm start CARMA(%d,%d) from CARMA(%d,%d)'%(
+                    self.p, self.q, warmStart['p'], warmStart['q']))
+            warmStart = warmStart['Theta']
+        Theta = np.asarray(warmStart, dtype=np.float64)
+        if Theta.ndim == 3:
+            Theta = Theta[:, :, -1]
+        if Theta.ndim != 2 or Theta.shape[0] != self.ndims:
+            raise ValueError('warmStart must hold walkers with %d dimensions'%(self.ndims))
+        numWalkers = Theta.shape[1]
+        rng = np.random.RandomState(xSeed)
+        if numWalkers >= self.nwalkers:
+            walkers = Theta[:, rng.choice(numWalkers, self.nwalkers, replace=False)]
+        else:
+            extra = Theta[:, rng.randint(numWalkers, size=self.nwalkers - numWalkers)]
+            scale = 1.0e-3*np.std(Theta, axis=1)[:, np.newaxis] + 1.0e-10*np.abs(extra)
+            walkers = np.concatenate((Theta, extra + scale*rng.standard_normal(extra.shape)), axis=1)
+        xStart = np.require(np.zeros(self.ndims*self.nwalkers), requirements=['F', 'A', 'W', 'O', 'E'])
+        xStart[:] = walkers.reshape(-1, order='F')
+        return xStart
+
+    _moveTypes = ['stretch', 'de', 'snooker', 'kde']
+
+    def _moveStats(self):
+        Weights = np.require(np.zeros(len(self._moveTypes)), requirements=['F', 'A', 'W', 'O', 'E'])
+        Acceptance = np.require(np.zeros(len(self._moveTypes)), requirements=['F', 'A', 'W', 'O', 'E'])
+        self._taskCython.get_moveStats(Weights, Acceptance)
+        return Weights, Acceptance
+
+    @property
+    def moveWeights(self):
+        return dict(zip(self._moveTypes, self._moveStats()[0]))
+
+    @property
+    def moveAcceptance(self):
+        return dict(zip(self._moveTypes, self._moveStats()[1]))
+
+    @property
+    def numSurrogateEvals(self):
+        return self._taskCython.get_numSurrogateEvals()
+
+    @property
+    def numExactEvals(self):
+        return self._taskCython.get_numExactEvals()
+
+    @property
+    def numOptimizerEvals(self):
+        return self._taskCython.get_numOptimizerEvals()
+
+    @property
+    def numModes(self):
+        return self._taskCython.get_numModes()
+
     @property
     def bestTheta(self):
         if hasattr(self, '_bestTheta'):
@@ -1228,3 +1609,75 @@ class CARMATask(object):
         if doShow:
             plt.show(False)
         return newFig,
+
+
+def orderSearch(observedLC, pMin=1, pMax=1, qMin=0, qMax=-1, numCandidates=3, deltaBIC=10.0,
+                nthreads=psutil.cpu_count(logical=True), nwalkers=25*psutil.cpu_count(logical=True), nsteps=250,
+                maxEvals=10000, xTol=0.001, numStarts=4, minGapRun=16, startSeed=None, doFit=True, **fitArgs):
+    """Search the C-ARMA orders pMin <= p <= pMax, qMin <= q <= min(p - 1, qMax) of observedLC.
+
+    Every order is first fit by the Laplace approximation (MAP from numStarts starting points and a Gaussian at the
+    MAP), all orders at once on nthreads threads sharing one preprocessed copy of the cadences; interior runs of at
+    least minGapRun masked cadences are skipped (0 keeps them). The orders are ranked by the Bayesian information
+    criterion BIC = -2 ln L(MAP) + (p + q + 1) ln(number of observed cadences), lower being better. The Laplace
+    integral is not used: the C-ARMA prior is unnormalized, so it has no prior-volume penalty for higher orders.
+    Orders whose BIC is within deltaBIC of the best are candidates, at most numCandidates of them in order of
+    increasing BIC, and only the candidates are sampled with CARMATask.fit(observedLC, **fitArgs) if doFit is True.
+
+    Returns a dict with 'orders' (list of (p, q)), 'BIC', 'lnPosteriorMAP', 'status' (arrays over orders; see
+    CARMATask.laplace for status; BIC is inf for orders without a MAP), 'MAP' and 'Cov' (lists over orders),
+    'candidates' (list of (p, q)) and 'tasks' (dict from (p, q) to the fitted CARMATask of each candidate; empty if
+    doFit is False).
+    """
+    if qMax == -1:
+        qMax = pMax - 1
+    if pMin < 1:
+        raise ValueError('pMin must be greater than or equal to 1')
+    if qMin < 0:
+        raise ValueError('qMin must be greater than or equal to 0')
+    if qMax >= pMax:
+        raise ValueError('pMax must be greater than qMax')
+    orders = [(p, q) for p in range(pMin, pMax + 1) for q in range(qMin, min(p, qMax + 1))]
+    if not orders:
+        raise ValueError('No C-ARMA orders in the requested range')
+    if startSeed is None:
+        randSeed = np.zeros(1, dtype='uint32')
+        rand.rdrand(randSeed)
+        startSeed = randSeed[0]
+    pVals = np.array([order[0] for order in orders], dtype=np.intc)
+    qVals = np.array([order[1] for order in orders], dtype=np.intc)
+    sizes = pVals + qVals + 1
+    MAP = np.zeros(np.sum(sizes))
+    Cov = np.zeros(np.sum(sizes*sizes))
+    LnPosteriorMAP = np.zeros(len(orders))
+    BIC = np.zeros(len(orders))
+    Status = np.zeros(len(orders), dtype=np.intc)
+    yCentered = kali.util.buffers.scratch(kali.util.buffers.threadStore(), ('orderSearch', 'y'), observedLC.numCadences)
+    np.subtract(observedLC.y, observedLC.mean, out=yCentered)
+    CARMATask_cython.search_CARMAOrders(
+        pVals, qVals, nthreads, observedLC.tolIR, observedLC.maxSigma*observedLC.std,
+        observedLC.minTimescale*observedLC.mindt, observedLC.maxTimescale*observedLC.T,
+        kali.util.buffers.require(observedLC.t), kali.util.buffers.require(observedLC.x),
+        yCentered,
+        kali.util.buffers.require(observedLC.yerr), kali.util.buffers.require(observedLC.mask), minGapRun,
+        numStarts, startSeed, maxEvals, xTol, MAP, Cov, LnPosteriorMAP, BIC, Status)
+    MAPOffsets = np.concatenate(([0], np.cumsum(sizes)))
+    CovOffsets = np.concatenate(([0], np.cumsum(sizes*sizes)))
+    result = {'orders': orders, 'BIC': BIC, 'lnPosteriorMAP': LnPosteriorMAP, 'status': Status,
+              'MAP': [MAP[MAPOffsets[i]:MAPOffsets[i + 1]] for i in range(len(orders))],
+              'Cov': [np.reshape(Cov[CovOffsets[i]:CovOffsets[i + 1]], newshape=(sizes[i], sizes[i]))
+                      for i in range(len(orders))],
+              'candidates': list(), 'tasks': dict()}
+    # The BIC only needs the MAP, so orders whose Hessian is not negative definite there are ranked too.
+    valid = [i for i in range(len(orders)) if Status[i] in (0, -1) and np.isfinite(BIC[i])]
+    if valid:
+        bestBIC = min(BIC[i] for i in valid)
+        ranked = sorted(valid, key=lambda i: BIC[i])
+        result['candidates'] = [orders[i] for i in ranked if BIC[i] <= bestBIC + deltaBIC][:numCandidates]
+    if doFit:
+        for p, q in result['candidates']:
+            task = CARMATask(p, q, nthreads=nthreads, nwalkers=nwalkers, nsteps=nsteps, maxEvals=maxEvals,
+                             xTol=xTol)
+            task.fit(observedLC, **fitArgs)
+            result['tasks'][(p, q)] = task
+    return result
@@ -0,0 +1,111 @@
+#!/usr/bin/env python
+"""	Module to cross-correlate pairs of light curves, e.g. for reverberation-mapping lag searches between bands.
+
+Three estimators are provided, all computed in C++ on the unmasked cadences of two kali.lc objects:
+
+    lags = np.linspace(-50.0, 50.0, 101)
+    dcfVals, dcfErrs, numPairs = kali.crosscorr.dcf(continuumLC, lineLC, lags)
+    zdcfLags, zdcfVals, zdcfErrLow, zdcfErrHigh, numPairs = kali.crosscorr.zdcf(continuumLC, lineLC, -50.0, 50.0)
+    iccfVals = kali.crosscorr.iccf(continuumLC, lineLC, lags)
+    peakLags, centroidLags, peakVals = kali.crosscorr.lagErrors(continuumLC, lineLC, lags, numRealizations=5000)
+
+A positive lag means that the second light curve follows the first. The times are taken relative to the same origin
+(lc.t + lc.startT), so light curves that start at different times can be compared directly.
+"""
+
+import sys
+import numpy as np
+
+try:
+    import rand
+    import LCTools_cython
+    import kali.util.buffers
+except ImportError:
+    print('kali is not setup. Setup kali by sourcing bin/setup.sh')
+    sys.exit(1)
+
+Methods = {'dcf': 0, 'zdcf': 1, 'iccf': 2}
+
+
+def _arrays(lc):
+    require = kali.util.buffers.require
+    return require(lc.t + getattr(lc, 'startT', 0.0)), require(lc.y), require(lc.yerr), require(lc.mask)
+
+
+def _check(result, name):
+    if result < 0:
+        raise ValueError('Invalid arguments for %s'%(name))
+    return result
+
+
+def dcf(lc1, lc2, lags):
+    """!
+    \brief Edelson & Krolik discrete correlation function in bins centred on the sorted lags.
+
+    Returns the DCF, its error and the number of pairs in each bin; bins without pairs hold NaN.
+    """
+    t1, y1, yerr1, mask1 = _arrays(lc1)
+    t2, y2, yerr2, mask2 = _arrays(lc2)
+    lagVals = kali.util.buffers.require(lags)
+    dcfVals, dcfErrVals, numPairVals = np.zeros(lagVals.shape[0]), np.zeros(lagVals.shape[0]), np.zeros(
+        lagVals.shape[0])
+    _check(LCTools_cython.compute_DCF(t1, y1, yerr1, mask1, t2, y2, yerr2, mask2, lagVals, dcfVals, dcfErrVals,
+                                      numPairVals), 'dcf')
+    return dcfVals, dcfErrVals, numPairVals
+
+
+def zdcf(lc1, lc2, minLag, maxLag, minPairs=11, maxBins=None):
+    """!
+    \brief z-transformed DCF of Alexander (1997) with minPairs pairs per bin between minLag and maxLag.
+
+    Returns the mean lag, the correlation coefficient, its lower and upper errors and the number of pairs of each bin.
+    """
+    t1, y1, yerr1, mask1 = _arrays(lc1)
+    t2, y2, yerr2, mask2 = _arrays(lc2)
+    if maxBins is None:
+        maxBins = int(np.count_nonzero(mask1))*int(np.count_nonzero(mask2))//minPairs + 1
+    lagVals, zdcfVals, zdcfErrLowVals, zdcfErrHighVals, numPairVals = [np.zeros(maxBins) for i in range(5)]
+    numBins = _check(LCTools_cython.compute_ZDCF(t1, y1, mask1, t2, y2, mask2, minLag, maxLag, minPairs, lagVals,
+                                                 zdcfVals, zdcfErrLowVals, zdcfErrHighVals, numPairVals), 'zdcf')
+    return (lagVals[:numBins], zdcfVals[:numBins], zdcfErrLowVals[:numBins], zdcfErrHighVals[:numBins],
+            numPairVals[:numBins])
+
+
+def iccf(lc1, lc2, lags):
+    """!
+    \brief Interpolated cross-correlation function of Gaskell & Peterson (1987) at the given lags.
+    """
+    t1, y1, yerr1, mask1 = _arrays(lc1)
+    t2, y2, yerr2, mask2 = _arrays(lc2)
+    lagVals = kali.util.buffers.require(lags)
+    iccfVals = np.zeros(lagVals.shape[0])
+    _check(LCTools_cython.compute_ICCF(t1, y1, mask1, t2, y2, mask2, lagVals, iccfVals), 'iccf')
+    return iccfVals
+
+
+def lagErrors(lc1, lc2, lags, method='iccf', numRealizations=1000, threshold=0.8, fluxRandomization=True,
+              subsetSelection=True, minPairs=11, seed=None):
+    """!
+    \brief Distributions of the CCF peak and centroid lags by flux randomization and random subset selection.
+
+    Every realization perturbs the fluxes by their errors and/or resamples the cadences with replacement, computes
+    the CCF of method ('dcf', 'zdcf' or 'iccf') on lags (for 'zdcf', between lags[0] and lags[-1]) and records the
+    peak lag, the centroid of the CCF above threshold times its peak and the peak value. The realizations run in
+    parallel, each with its own random stream, so the results depend on seed but not on the number of threads.
+    Realizations without a positive CCF peak give NaN.
+    """
+    if method not in Methods:
+        raise ValueError('method must be one of %s'%(', '.join(sorted(Methods))))
+    if seed is None:
+        randSeed = np.zeros(1, dtype='uint32')
+        rand.rdrand(randSeed)
+        seed = randSeed[0]
+    t1, y1, yerr1, mask1 = _arrays(lc1)
+    t2, y2, yerr2, mask2 = _arrays(lc2)
+    lagVals = kali.util.buffers.require(lags)
+    peakLagVals, centroidLagVals, peakVals = np.zeros(numRealizations), np.zeros(numRealizations), np.zeros(
+        numRealizations)
+    _check(LCTools_cython.compute_CrossCorrMC(Methods[method], t1, y1, yerr1, mask1, t2, y2, yerr2, mask2, lagVals,
+                                              minPairs, threshold, fluxRandomization, subsetSelection, int(seed),
+                                              peakLagVals, centroidLagVals, peakVals), 'lagErrors')
+    return peakLagVals, centroidLagVals, peakVals
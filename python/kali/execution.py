@@ -0,0 +1,96 @@
+#!/usr/bin/env python
+"""	Module to configure the process-wide thread budget shared by kali.carma, kali.mbhb, kali.mbhbcarma and the light
+curve statistics of kali.lc.
+
+Every fit, nest, laplace, simulate and likelihood call of the task classes and every light curve statistic leases
+threads from one shared budget for its duration, so tasks run concurrently (e.g. from a thread pool) share the cores
+instead of oversubscribing them. A call is granted min(nthreads of its task, free threads, free threads of its task
+kind) threads and waits only if none are free. The light curve statistics ask for the whole budget.
+"""
+
+import sys
+import numpy as np
+
+try:
+    import Execution_cython
+except ImportError:
+    print('kali is not setup. Setup kali by sourcing bin/setup.sh')
+    sys.exit(1)
+
+_taskKinds = {'carma': Execution_cython.CARMA_TASK,
+              'mbhb': Execution_cython.MBHB_TASK,
+              'mbhbcarma': Execution_cython.MBHBCARMA_TASK,
+              'lc': Execution_cython.LC_TASK}
+
+
+def _taskKind(task):
+    try:
+        return _taskKinds[task]
+    except KeyError:
+        raise ValueError('Unknown task %r; expected one of %s'%(task, sorted(_taskKinds.keys())))
+
+
+def maxThreads():
+    """Total number of threads shared by all tasks."""
+    return Execution_cython.get_maxThreads()
+
+
+def setMaxThreads(numThreads):
+    """Set the total number of threads shared by all tasks. Running calls keep the threads they hold."""
+    if numThreads < 1:
+        raise ValueError('numThreads must be at least 1')
+    Execution_cython.set_maxThreads(int(numThreads))
+
+
+def taskLimit(task):
+    """Maximum number of threads all tasks of one kind ('carma', 'mbhb', 'mbhbcarma' or 'lc') may hold at once; 0
+    if unlimited."""
+    return Execution_cython.get_taskLimit(_taskKind(task))
+
+
+def setTaskLimit(task, limit):
+    """Cap the threads all tasks of one kind ('carma', 'mbhb', 'mbhbcarma' or 'lc') may hold at once; None or 0
+    removes the cap."""
+    if limit is None:
+        limit = 0
+    if limit < 0:
+        raise ValueError('limit must be non-negative')
+    Execution_cython.set_taskLimit(_taskKind(task), int(limit))
+
+
+def activeThreads():
+    """Number of threads currently leased."""
+    return Execution_cython.get_activeThreads()
+
+
+def stats():
+    """Usage counters since the last resetStats.
+
+    Returns a dict with the overall 'maxThreads', 'peakThreads', 'elapsed' (seconds) and 'utilization' (leased
+    thread-seconds of completed calls over maxThreads*elapsed), and per task kind a dict of 'leases', 'clipped'
+    (calls granted fewer threads than requested), 'waits', 'waitSeconds', 'peakThreads' and 'threadSeconds'.
+    """
+    numKinds = Execution_cython.NUM_TASK_KINDS
+    Leases = np.zeros(numKinds, dtype=np.int_)
+    Clipped = np.zeros(numKinds, dtype=np.int_)
+    Waits = np.zeros(numKinds, dtype=np.int_)
+    Peak = np.zeros(numKinds, dtype=np.intc)
+    ThreadSeconds = np.zeros(numKinds)
+    WaitSeconds = np.zeros(numKinds)
+    peakThreads, elapsed = Execution_cython.get_Stats(Leases, Clipped, Waits, Peak, ThreadSeconds, WaitSeconds)
+    numThreads = Execution_cython.get_maxThreads()
+    result = {'maxThreads': numThreads, 'peakThreads': peakThreads, 'elapsed': elapsed}
+    if elapsed > 0.0:
+        result['utilization'] = np.sum(ThreadSeconds)/(numThreads*elapsed)
+    else:
+        result['utilization'] = 0.0
+    for task, kindNum in _taskKinds.items():
+        result[task] = {'leases': int(Leases[kindNum]), 'clipped': int(Clipped[kindNum]),
+                        'waits': int(Waits[kindNum]), 'waitSeconds': WaitSeconds[kindNum],
+                        'peakThreads': int(Peak[kindNum]), 'threadSeconds': ThreadSeconds[kindNum]}
+    return result
+
+
+def resetStats():
+    """Zero the usage counters and restart the utilization clock."""
+    Execution_cython.reset_Stats()
@@ -6,9 +6,7 @@ import math, cmath, operator, sys, abc, psutil, types, os
 import warnings, reprlib, copy, pdb
 import scipy.stats as spstats
 from scipy.interpolate import UnivariateSpline
-import gatspy.periodic
 
-import gatspy.periodic
 from astropy import units
 from astropy.coordinates import SkyCoord
 
@@ -19,6 +17,7 @@ try:
     import LCTools_cython
     import kali.sampler
     import kali.kernel
+    import kali.util.buffers
 except ImportError:
     print('kali is not setup. Setup kali by sourcing bin/setup.sh')
     sys.exit(1)
@@ -31,6 +30,124 @@ COLORS = [r'#4daf4a', r'#ccebc5']
 ln10 = math.log(10)
 
 
+def frequencyGrid(T, meandt, oversampling=5):
+    """!
+    \brief (freqMin, freqStep, numFreqs) of the regular periodogram grid from 1/T up to the pseudo-Nyquist frequency
+    1/(2 meandt) with oversampling frequencies per 1/T.
+    """
+    freqMin = 1.0/T
+    freqStep = 1.0/(oversampling*T)
+    numFreqs = max(int((1.0/(2.0*meandt) - freqMin)/freqStep) + 1, 1)
+    return freqMin, freqStep, numFreqs
+
+
+def lombScargle(t, y, yerr, mask, freqMin, freqStep, numFreqs, fitMean=True, bruteForce=False):
+    """!
+    \brief Generalized Lomb-Scargle periodogram of one light curve on freqMin + freqStep*arange(numFreqs).
+
+    The power is 1 - chi^2/chi^2_0 of the best weighted (1/yerr^2) sinusoid, plus a constant if fitMean, and is
+    computed in C++ with the Press & Rybicki extirpolation/FFT scheme (bruteForce=True uses the direct sums).
+    Returns (freqs, power).
+    """
+    require = kali.util.buffers.require
+    powerVals = np.zeros(numFreqs)
+    if LCTools_cython.compute_LombScargle(require(t), require(y), require(yerr), require(mask), freqMin, freqStep,
+                                          powerVals, fitMean, bruteForce) < 0:
+        raise ValueError('Invalid frequency grid')
+    return freqMin + freqStep*np.arange(numFreqs), powerVals
+
+
+def lombScargleBatch(cadenceOffsets, t, y, yerr, mask, freqMin, freqStep, numFreqs, fitMean=True, bruteForce=False):
+    """!
+    \brief Periodograms of many light curves packed in the (cadenceOffsets, t, ...) layout of kali.cadence.catalog.
+
+    Light curve i occupies cadenceOffsets[i]:cadenceOffsets[i + 1] of the concatenated arrays. The light curves
+    are spread over the threads in C++ and share the frequency grid. Returns (freqs, power) where power has shape
+    (len(cadenceOffsets) - 1, numFreqs).
+    """
+    require = kali.util.buffers.require
+    offsets = require(cadenceOffsets, dtype=np.intc)
+    powerVals = np.zeros((offsets.shape[0] - 1)*numFreqs)
+    if LCTools_cython.compute_LombScargleBatch(offsets, require(t), require(y), require(yerr), require(mask),
+                                               freqMin, freqStep, numFreqs, powerVals, fitMean, bruteForce) < 0:
+        raise ValueError('Invalid frequency grid or cadence offsets')
+    return freqMin + freqStep*np.arange(numFreqs), powerVals.reshape((offsets.shape[0] - 1, numFreqs))
+
+
+BatchStats = {'moments': 1, 'acvf': 2, 'sf': 4, 'sfBinned': 8, 'dacf': 16, 'periodogram': 32}
+
+
+def batchStats(cadenceOffsets, t, y, yerr, mask, stats=('moments',), sfBinEdges=None, dacfLags=None, freqGrid=None,
+               fitMean=True):
+    """!
+    \brief Statistics of many light curves packed in the (cadenceOffsets, t, ...) layout of kali.cadence.catalog.
+
+    All the requested stats (any of the keys of BatchStats) are computed in one C++ call, with the light curves
+    spread over the threads, and returned in a dict of flat arrays:
+        'numObserved', 'mean', 'meanerr', 'std', 'stderr': one value per light curve, over the unmasked cadences.
+        'acvf', 'sf': (lags, vals, errs) at lags k*(t[1] - t[0]) of each light curve, in the cadence layout of t.
+        'sfBinned': (lags, vals, errs, numPairs) of shape (numLCs, len(sfBinEdges) - 1).
+        'dacf': (vals, errs) of shape (numLCs, len(dacfLags)).
+        'periodogram': (freqs, power) with power of shape (numLCs, numFreqs) on freqGrid = (freqMin, freqStep,
+            numFreqs), as from frequencyGrid.
+    """
+    unknown = [stat for stat in stats if stat not in BatchStats]
+    if unknown:
+        raise ValueError('Unknown stats %s; must be among %s'%(', '.join(unknown), ', '.join(sorted(BatchStats))))
+    require = kali.util.buffers.require
+    offsets = require(cadenceOffsets, dtype=np.intc)
+    t, y, yerr, mask = require(t), require(y), require(yerr), require(mask)
+    numLCs, numCadences = offsets.shape[0] - 1, t.shape[0]
+    statFlags = 0
+    for stat in stats:
+        statFlags |= BatchStats[stat]
+    args = dict()
+    if 'moments' in stats:
+        args['momentVals'] = np.zeros(5*numLCs)
+    for stat in ('acvf', 'sf'):
+        if stat in stats:
+            for suffix in ('Lags', 'Vals', 'ErrVals'):
+                args[stat + suffix] = np.zeros(numCadences)
+    if 'sfBinned' in stats:
+        if sfBinEdges is None:
+            raise ValueError('sfBinned needs sfBinEdges')
+        args['sfBinEdges'] = require(sfBinEdges)
+        for name in ('sfBinLags', 'sfBinVals', 'sfBinErrVals', 'sfBinPairs'):
+            args[name] = np.zeros(numLCs*(args['sfBinEdges'].shape[0] - 1))
+    if 'dacf' in stats:
+        if dacfLags is None:
+            raise ValueError('dacf needs dacfLags')
+        args['dacfLags'] = require(dacfLags)
+        args['dacfVals'] = np.zeros(numLCs*args['dacfLags'].shape[0])
+        args['dacfErrVals'] = np.zeros(numLCs*args['dacfLags'].shape[0])
+    if 'periodogram' in stats:
+        if freqGrid is None:
+            raise ValueError('periodogram needs freqGrid')
+        args['freqMin'], args['freqStep'], args['numFreqs'] = freqGrid
+        args['powerVals'] = np.zeros(numLCs*args['numFreqs'])
+    if LCTools_cython.compute_BatchStats(offsets, t, y, yerr, mask, statFlags, fitMean=fitMean, **args) < 0:
+        raise ValueError('Invalid cadence offsets or statistic grids')
+    results = dict()
+    if 'moments' in stats:
+        moments = args['momentVals'].reshape((numLCs, 5))
+        for column, name in enumerate(('numObserved', 'mean', 'meanerr', 'std', 'stderr')):
+            results[name] = moments[:, column]
+    for stat in ('acvf', 'sf'):
+        if stat in stats:
+            results[stat] = (args[stat + 'Lags'], args[stat + 'Vals'], args[stat + 'ErrVals'])
+    if 'sfBinned' in stats:
+        shape = (numLCs, args['sfBinEdges'].shape[0] - 1)
+        results['sfBinned'] = tuple(args[name].reshape(shape) for name in ('sfBinLags', 'sfBinVals', 'sfBinErrVals',
+                                                                           'sfBinPairs'))
+    if 'dacf' in stats:
+        shape = (numLCs, args['dacfLags'].shape[0])
+        results['dacf'] = (args['dacfVals'].reshape(shape), args['dacfErrVals'].reshape(shape))
+    if 'periodogram' in stats:
+        results['periodogram'] = (args['freqMin'] + args['freqStep']*np.arange(args['numFreqs']),
+                                  args['powerVals'].reshape((numLCs, args['numFreqs'])))
+    return results
+
+
 class epoch(object):
 
     """!
@@ -949,104 +1066,142 @@ class lc(object, metaclass=abc.ABCMeta):
     def sample(self, **kwargs):
         return self._sampler.sample(**kwargs)
 
-    def acvf(self, newdt=None):
-        if hasattr(self, '_acvflags') and hasattr(self, '_acvf') and hasattr(self, '_acvferr'):
+    def acvf(self, newdt=None, bruteForce=False):
+        """!
+        \brief Masked autocovariance function at lags k*dt of the (regularized) light curve.
+
+        Each lag is normalized by its number of unmasked pairs. Computed by FFT in O(N log N); bruteForce=True
+        recomputes it by summing over every pair in O(N^2) to validate the FFT.
+        """
+        if (not bruteForce) and hasattr(self, '_acvflags') and hasattr(self, '_acvf') and hasattr(self, '_acvferr'):
             return self._acvflags, self._acvf, self._acvferr
         else:
             if not self.isRegular:
                 useLC = self.regularize(newdt=newdt)
             else:
                 useLC = self
-            self._acvflags = np.require(np.zeros(useLC.numCadences), requirements=[
-                                        'F', 'A', 'W', 'O', 'E'])  # Numpy array of timestamps.
-            self._acvf = np.require(np.zeros(useLC.numCadences), requirements=[
-                                    'F', 'A', 'W', 'O', 'E'])  # Numpy array of intrinsic fluxes.
-            self._acvferr = np.require(np.zeros(useLC.numCadences), requirements=[
-                                       'F', 'A', 'W', 'O', 'E'])  # Numpy array of intrinsic fluxes.
-            LCTools_cython.compute_ACVF(useLC.numCadences, useLC.dt, useLC.t, useLC.x,
-                                        useLC.y, useLC.yerr, useLC.mask, self._acvflags, self._acvf,
-                                        self._acvferr)
+            require = kali.util.buffers.require
+            self._acvflags = np.zeros(useLC.numCadences)
+            self._acvf = np.zeros(useLC.numCadences)
+            self._acvferr = np.zeros(useLC.numCadences)
+            LCTools_cython.compute_ACVF(useLC.numCadences, useLC.dt, require(useLC.t), require(useLC.x),
+                                        require(useLC.y), require(useLC.yerr), require(useLC.mask), self._acvflags,
+                                        self._acvf, self._acvferr, bruteForce)
             return self._acvflags, self._acvf, self._acvferr
 
-    def acf(self, newdt=None):
-        if hasattr(self, '_acflags') and hasattr(self, '_acf') and hasattr(self, '_acferr'):
+    def acf(self, newdt=None, bruteForce=False):
+        """!
+        \brief Masked autocorrelation function at lags k*dt of the (regularized) light curve.
+
+        Each lag is normalized by its number of unmasked pairs. Computed by FFT in O(N log N); bruteForce=True
+        recomputes it by summing over every pair in O(N^2) to validate the FFT.
+        """
+        if (not bruteForce) and hasattr(self, '_acflags') and hasattr(self, '_acf') and hasattr(self, '_acferr'):
             return self._acflags, self._acf, self._acferr
         else:
             if not self.isRegular:
                 useLC = self.regularize(newdt=newdt)
             else:
                 useLC = self
-            self._acflags = np.require(np.zeros(useLC.numCadences), requirements=[
-                                       'F', 'A', 'W', 'O', 'E'])  # Numpy array of timestamps.
-            self._acf = np.require(np.zeros(useLC.numCadences), requirements=[
-                                   'F', 'A', 'W', 'O', 'E'])  # Numpy array of intrinsic fluxes.
-            self._acferr = np.require(np.zeros(useLC.numCadences), requirements=[
-                                      'F', 'A', 'W', 'O', 'E'])  # Numpy array of intrinsic fluxes.
-            LCTools_cython.compute_ACF(useLC.numCadences, useLC.dt, useLC.t, useLC.x,
-                                       useLC.y, useLC.yerr, useLC.mask, self._acflags, self._acf,
-                                       self._acferr)
+            require = kali.util.buffers.require
+            self._acflags = np.zeros(useLC.numCadences)
+            self._acf = np.zeros(useLC.numCadences)
+            self._acferr = np.zeros(useLC.numCadences)
+            LCTools_cython.compute_ACF(useLC.numCadences, useLC.dt, require(useLC.t), require(useLC.x),
+                                       require(useLC.y), require(useLC.yerr), require(useLC.mask), self._acflags,
+                                       self._acf, self._acferr, bruteForce)
             return self._acflags, self._acf, self._acferr
 
+    def sfBinned(self, binEdges=None, numBins=50):
+        """!
+        \brief Noise-bias-corrected structure function of the light curve as sampled, binned in lag.
+
+        No regularization is needed: every pair of unmasked cadences is put in the bin of its lag, by default one of
+        numBins log-spaced bins from the shortest lag between distinct times to T. Each pair contributes
+        (y_j - y_i)^2 - yerr_i^2 - yerr_j^2. Returns the mean lag, the structure function, its standard error and
+        the number of pairs of each bin; empty bins are zero.
+        """
+        if binEdges is None:
+            gaps = np.diff(self.t[self.mask != 0.0])
+            minLag = np.min(gaps[gaps > 0.0]) if np.any(gaps > 0.0) else self.T/numBins
+            binEdges = np.logspace(math.log10(minLag), math.log10(self.T), numBins + 1)
+            binEdges[-1] *= 1.0 + 1.0e-12
+        binEdges = kali.util.buffers.require(binEdges)
+        numBins = binEdges.shape[0] - 1
+        lagVals, sfVals, sfErrVals, numPairVals = [np.zeros(numBins) for i in range(4)]
+        if LCTools_cython.compute_SFBinned(kali.util.buffers.require(self.t), kali.util.buffers.require(self.y),
+                                           kali.util.buffers.require(self.yerr),
+                                           kali.util.buffers.require(self.mask), binEdges, lagVals, sfVals,
+                                           sfErrVals, numPairVals) < 0:
+            raise ValueError('binEdges must be non-negative and increasing')
+        return lagVals, sfVals, sfErrVals, numPairVals
+
     def dacf(self, nbins=None):
+        """!
+        \brief Edelson & Krolik discrete correlation function in nbins lag bins centred on linspace(0, T, nbins).
+
+        Every pair of cadences is binned once in C++ with per-thread histograms, so the cost is O(N^2) time and
+        O(nbins) memory.
+        """
         if hasattr(self, '_dacflags') and hasattr(self, '_dacf') and hasattr(self, '_dacferr'):
             return self._dacflags, self._dacf, self._dacferr
         else:
             if nbins is None:
                 nbins = int(self.numCadences/10)
-            self._dacflags = np.require(np.linspace(start=0.0, stop=self.T, num=nbins), requirements=[
-                                        'F', 'A', 'W', 'O', 'E'])  # Numpy array of timestamps.
-            self._dacf = np.require(np.zeros(self._dacflags.shape[0]), requirements=[
-                                    'F', 'A', 'W', 'O', 'E'])  # Numpy array of intrinsic fluxes.
-            self._dacferr = np.require(np.zeros(self._dacflags.shape[0]), requirements=[
-                                       'F', 'A', 'W', 'O', 'E'])  # Numpy array of intrinsic fluxes.
-            LCTools_cython.compute_DACF(self.numCadences, self.dt, self.t, self.x, self.y,
-                                        self.yerr, self.mask, nbins, self._dacflags, self._dacf,
+            require = kali.util.buffers.require
+            self._dacflags = np.linspace(start=0.0, stop=self.T, num=nbins)
+            self._dacf = np.zeros(self._dacflags.shape[0])
+            self._dacferr = np.zeros(self._dacflags.shape[0])
+            LCTools_cython.compute_DACF(self.numCadences, require(self.t), require(self.x), require(self.y),
+                                        require(self.yerr), require(self.mask), nbins, self._dacflags, self._dacf,
                                         self._dacferr)
             return self._dacflags, self._dacf, self._dacferr
 
-    def sf(self, newdt=None):
-        if hasattr(self, '_sflags') and hasattr(self, '_sf') and hasattr(self, '_sferr'):
+    def sf(self, newdt=None, bruteForce=False):
+        """!
+        \brief Masked structure function at lags k*dt of the (regularized) light curve.
+
+        Each lag is normalized by its number of unmasked pairs. Computed by FFT in O(N log N); bruteForce=True
+        recomputes it by summing over every pair in O(N^2) to validate the FFT. For irregularly sampled light curves
+        sfBinned works on the observed times without regularizing them.
+        """
+        if (not bruteForce) and hasattr(self, '_sflags') and hasattr(self, '_sf') and hasattr(self, '_sferr'):
             return self._sflags, self._sf, self._sferr
         else:
             if not self.isRegular:
                 useLC = self.regularize(newdt=newdt)
             else:
                 useLC = self
-            self._sflags = np.require(np.zeros(useLC.numCadences), requirements=[
-                                      'F', 'A', 'W', 'O', 'E'])  # Numpy array of timestamps.
-            self._sf = np.require(np.zeros(useLC.numCadences), requirements=[
-                                  'F', 'A', 'W', 'O', 'E'])  # Numpy array of intrinsic fluxes.
-            self._sferr = np.require(np.zeros(useLC.numCadences), requirements=[
-                                     'F', 'A', 'W', 'O', 'E'])  # Numpy array of intrinsic fluxes.
-            LCTools_cython.compute_SF(useLC.numCadences, useLC.dt, useLC.t, useLC.x,
-                                      useLC.y, useLC.yerr, useLC.mask, self._sflags, self._sf, self._sferr)
+            require = kali.util.buffers.require
+            self._sflags = np.zeros(useLC.numCadences)
+            self._sf = np.zeros(useLC.numCadences)
+            self._sferr = np.zeros(useLC.numCadences)
+            LCTools_cython.compute_SF(useLC.numCadences, useLC.dt, require(useLC.t), require(useLC.x),
+                                      require(useLC.y), require(useLC.yerr), require(useLC.mask), self._sflags,
+                                      self._sf, self._sferr, bruteForce)
             return self._sflags, self._sf, self._sferr
 
-    def periodogram(self):
-        if (hasattr(self, '_periodogramfreqs') and
+    def periodogram(self, fitMean=True, oversampling=5, bruteForce=False):
+        """!
+        \brief Generalized Lomb-Scargle periodogram on frequencyGrid(T, meandt, oversampling), computed natively.
+
+        Returns (freqs, power, powerErr); powerErr is zero and non-positive powers are set to NaN. The result for
+        the default arguments is cached.
+        """
+        useCache = fitMean and oversampling == 5 and not bruteForce
+        if (useCache and hasattr(self, '_periodogramfreqs') and
                 hasattr(self, '_periodogram') and
                 hasattr(self, '_periodogramerr')):
             return self._periodogramfreqs, self._periodogram, self._periodogramerr
         else:
-            if self.numCadences > 50:
-                model = gatspy.periodic.LombScargleFast()
-            else:
-                model = gatspy.periodic.LombScargle()
-            model.optimizer.set(quiet=True, period_range=(2.0*self.meandt, self.T))
-            model.fit(self.t,
-                      self.y,
-                      self.yerr)
-            periodogramlags, self._periodogram = model.periodogram_auto()
-            self._periodogramfreqs = np.require(1.0/np.array(periodogramlags),
-                                                requirements=['F', 'A', 'W', 'O', 'E'])
-            self._periodogram = np.require(np.array(self._periodogram),
-                                           requirements=['F', 'A', 'W', 'O', 'E'])
-            self._periodogramerr = np.require(np.array(self._periodogram.shape[0]*[0.0]),
-                                              requirements=['F', 'A', 'W', 'O', 'E'])
-            for i in range(self._periodogram.shape[0]):
-                if self._periodogram[i] <= 0.0:
-                    self._periodogram[i] = np.nan
-            return self._periodogramfreqs, self._periodogram, self._periodogramerr
+            freqs, power = lombScargle(self.t, self.y, self.yerr, self.mask,
+                                       *frequencyGrid(self.T, self.meandt, oversampling), fitMean=fitMean,
+                                       bruteForce=bruteForce)
+            power[power <= 0.0] = np.nan
+            powerErr = np.zeros(power.shape[0])
+            if useCache:
+                self._periodogramfreqs, self._periodogram, self._periodogramerr = freqs, power, powerErr
+            return freqs, power, powerErr
 
     def plot(self, fig=-1, doShow=False, clearFig=True, colorx=None, colory=None, colors=None,
              labelx=None, labely=None, alphax=None, alphay=None, alphas=None, labels=None):
@@ -1297,15 +1452,8 @@ class lc(object, metaclass=abc.ABCMeta):
         if hasattr(self, '_period'):
             return self._period
         else:
-            if self.numCadences > 50:
-                model = gatspy.periodic.LombScargleFast(
-                    optimizer_kwds={"quiet": True}).fit(self.t, self.y, self.yerr)
-            else:
-                model = gatspy.periodic.LombScargle(
-                    optimizer_kwds={"quiet": True}).fit(self.t, self.y, self.yerr)
-            periods, power = model.periodogram_auto(nyquist_factor=self.numCadences)
-            model.optimizer.period_range = (2.0*np.mean(self.t[1:] - self.t[:-1]), self.T)
-            self._period = model.best_period
+            freqs, power, powerErr = self.periodogram()
+            self._period = 1.0/freqs[np.nanargmax(power)]
             return self._period
 
     def fold(self, foldPeriod, tStart=None):
@@ -5,7 +5,6 @@
 import numpy as np
 import math as math
 import scipy.stats as spstats
-import scipy.signal.spectral
 from scipy.interpolate import UnivariateSpline
 import cmath as cmath
 import random
@@ -21,7 +20,6 @@ import matplotlib.pyplot as plt
 import pdb as pdb
 
 import multi_key_dict
-import gatspy.periodic
 from sklearn.cluster import KMeans
 from sklearn.cluster import DBSCAN
 
@@ -32,6 +30,7 @@ try:
     import rand as rand
     import MBHBTask_cython as MBHBTask_cython
     from .util.mpl_settings import set_plot_params
+    import kali.util.buffers
     import kali.util.classproperty
     import kali.util.triangle
 except ImportError:
@@ -127,6 +126,7 @@ class MBHBTask(object):
             self._LnLikelihood = np.require(
                 np.zeros(self._nwalkers*self._nsteps), requirements=['F', 'A', 'W', 'O', 'E'])
             self._taskCython = MBHBTask_cython.MBHBTask_cython(self._nthreads)
+            self._scratch = dict()
             self._pDIC = None
             self._dic = None
         except AssertionError as err:
@@ -138,6 +138,7 @@ class MBHBTask(object):
         """
         state = copy.copy(self.__dict__)
         del state['_taskCython']
+        state.pop('_scratch', None)
         return state
 
     def __setstate__(self, state):
@@ -146,6 +147,7 @@ class MBHBTask(object):
         """
         self.__dict__ = copy.copy(state)
         self._taskCython = MBHBTask_cython.MBHBTask_cython(self._nthreads)
+        self._scratch = dict()
 
     @kali.util.classproperty.ClassProperty
     @classmethod
@@ -299,6 +301,18 @@ class MBHBTask(object):
     def dic(self):
         return self._dic
 
+    @property
+    def samplerUtilization(self):
+        return self._taskCython.get_samplerUtilization()
+
+    @property
+    def lnEvidence(self):
+        return self._taskCython.get_lnEvidence()
+
+    @property
+    def lnEvidenceErr(self):
+        return self._taskCython.get_lnEvidenceErr()
+
     def __repr__(self):
         return "kali.mbhb.MBHBTask(%d, %d, %d, %d, %d, %d, %f)"%(self._p, self._q, self._nthreads,
                                                                  self._nwalkers, self._nsteps,
@@ -598,7 +612,7 @@ class MBHBTask(object):
             if deltaT is not None:
                 raise ValueError('deltaT cannot be supplied when tIn is provided')
             numCadences = tIn.shape[0]
-            t = np.require(np.array(tIn), requirements=['F', 'A', 'W', 'O', 'E'])
+            t = np.array(tIn, dtype=np.float64)
             intrinsicLC = kali.lc.mockLC(
                 name='', band='', tIn=t, fracNoiseToSignal=fracNoiseToSignal)
             for i in range(intrinsicLC.numCadences):
@@ -652,10 +666,11 @@ class MBHBTask(object):
         fluxEst, periodEst, eccentricityEst, omega1Est, tauEst, a2sinIncEst = self.estimate(observedLC)
         lowestFlux = np.min(observedLC.y[np.where(observedLC.mask == 1.0)])
         highestFlux = np.max(observedLC.y[np.where(observedLC.mask == 1.0)])
+        require = kali.util.buffers.require
         observedLC._logPrior = self._taskCython.compute_LnPrior(
             observedLC.numCadences, observedLC.dt, observedLC.startT, lowestFlux, highestFlux,
-            observedLC.t, observedLC.x,
-            observedLC.y, observedLC.yerr, observedLC.mask,
+            require(observedLC.t), require(observedLC.x),
+            require(observedLC.y), require(observedLC.yerr), require(observedLC.mask),
             periodEst, widthT*periodEst,
             fluxEst, widthF*fluxEst,
             tnum)
@@ -668,9 +683,11 @@ class MBHBTask(object):
         if forced is True:
             observedLC._computedCadenceNum = -1
         if observedLC._computedCadenceNum == -1:
+            require = kali.util.buffers.require
             observedLC._logLikelihood = self._taskCython.compute_LnLikelihood(
-                observedLC.numCadences, observedLC.dt, observedLC._computedCadenceNum, observedLC.t,
-                observedLC.x, observedLC.y, observedLC.yerr, observedLC.mask, tnum)
+                observedLC.numCadences, observedLC.dt, observedLC._computedCadenceNum, require(observedLC.t),
+                require(observedLC.x), require(observedLC.y), require(observedLC.yerr), require(observedLC.mask),
+                tnum)
             observedLC._logPosterior = observedLC._logPrior + observedLC._logLikelihood
             observedLC._computedCadenceNum = observedLC.numCadences - 1
         else:
@@ -693,22 +710,9 @@ class MBHBTask(object):
         Estimate intrinsicFlux, period, eccentricity, omega, tau, & a2sini
         """
         # fluxEst
-        if observedLC.numCadences > 50:
-            model = gatspy.periodic.LombScargleFast()
-        else:
-            model = gatspy.periodic.LombScargle()
-        model.optimizer.set(quiet=True, period_range=(2.0*observedLC.meandt, observedLC.T))
-        model.fit(observedLC.t,
-                  observedLC.y,
-                  observedLC.yerr)
-        periodEst = model.best_period
-        if periodEst < 2.0*observedLC.meandt or periodEst > observedLC.T:
-            scaled_y = (observedLC.y - observedLC.mean)/observedLC.std
-            angFreqs = np.logspace(math.log10((2.0*math.pi)/(observedLC.T)),
-                                   math.log10((2.0*math.pi)/(2.0*observedLC.meandt)),
-                                   10000)
-            periodogram = scipy.signal.spectral.lombscargle(observedLC.t, scaled_y, angFreqs)
-            periodEst = 2.0*math.pi/angFreqs[np.argmax(periodogram)]
+        freqs, power = kali.lc.lombScargle(observedLC.t, observedLC.y, observedLC.yerr, observedLC.mask,
+                                           *kali.lc.frequencyGrid(observedLC.T, observedLC.meandt))
+        periodEst = 1.0/freqs[np.argmax(power)]
 
         numIntrinsicFlux = 100
         lowestFlux = np.min(observedLC.y[np.where(observedLC.mask == 1.0)])
@@ -752,22 +756,9 @@ class MBHBTask(object):
             dopplerLC.yerr[i] = (1.0/3.44)*math.fabs(dopplerLC.y[i]*(beamedLC.yerr[i]/beamedLC.y[i]))
             dzdtLC.y[i] = 1.0 - (1.0/dopplerLC.y[i])
             dzdtLC.yerr[i] = math.fabs((-1.0*dopplerLC.yerr[i])/math.pow(dopplerLC.y[i], 2.0))
-        if observedLC.numCadences > 50:
-            model = gatspy.periodic.LombScargleFast()
-        else:
-            model = gatspy.periodic.LombScargle()
-        model.optimizer.set(quiet=True, period_range=(2.0*observedLC.meandt, observedLC.T))
-        model.fit(dzdtLC.t,
-                  dzdtLC.y,
-                  dzdtLC.yerr)
-        periodEst = model.best_period
-        if periodEst < 2.0*observedLC.meandt or periodEst > observedLC.T:
-            scaled_y = (dzdtLC.y - dzdtLC.mean)/dzdtLC.std
-            angFreqs = np.logspace(math.log10((2.0*math.pi)/(observedLC.T)),
-                                   math.log10((2.0*math.pi)/(2.0*observedLC.meandt)),
-                                   10000)
-            periodogram = scipy.signal.spectral.lombscargle(observedLC.t, scaled_y, angFreqs)
-            periodEst = 2.0*math.pi/angFreqs[np.argmax(periodogram)]
+        freqs, power = kali.lc.lombScargle(dzdtLC.t, dzdtLC.y, dzdtLC.yerr, dzdtLC.mask,
+                                           *kali.lc.frequencyGrid(observedLC.T, observedLC.meandt))
+        periodEst = 1.0/freqs[np.argmax(power)]
 
         # eccentricityEst & omega2Est
         # First find a full period going from rising to falling.
@@ -960,27 +951,13 @@ class MBHBTask(object):
         inclinationGuess = r2d(math.asin(a2SinInclinationEst/a2Guess))
         return a1Guess, a2Guess, inclinationGuess
 
-    def fit(self, observedLC, widthT=0.01, widthF=0.05,
-            zSSeed=None, walkerSeed=None, moveSeed=None, xSeed=None):
-        randSeed = np.zeros(1, dtype='uint32')
-        if zSSeed is None:
-            rand.rdrand(randSeed)
-            zSSeed = randSeed[0]
-        if walkerSeed is None:
-            rand.rdrand(randSeed)
-            walkerSeed = randSeed[0]
-        if moveSeed is None:
-            rand.rdrand(randSeed)
-            moveSeed = randSeed[0]
-        if xSeed is None:
-            rand.rdrand(randSeed)
-            xSeed = randSeed[0]
-        xStart = np.require(np.zeros(self.ndims*self.nwalkers), requirements=['F', 'A', 'W', 'O', 'E'])
+    def _startingPoints(self, observedLC, numPoints):
+        xStart = np.require(np.zeros(self.ndims*numPoints), requirements=['F', 'A', 'W', 'O', 'E'])
 
         fluxEst, periodEst, eccentricityEst, omega1Est, tauEst, a2sinInclinationEst = self.estimate(
             observedLC)
 
-        for walkerNum in range(self.nwalkers):
+        for walkerNum in range(numPoints):
             noSuccess = True
             while noSuccess:
                 a1Guess, a2Guess, inclinationGuess = self.guess(periodEst, a2sinInclinationEst)
@@ -993,17 +970,92 @@ class MBHBTask(object):
                     noSuccess = False
             for dimNum in range(self.ndims):
                 xStart[dimNum + walkerNum*self.ndims] = ThetaGuess[dimNum]
+        return xStart, fluxEst, periodEst
+
+    def laplace(self, observedLCs, numStarts=4, widthT=0.01, widthF=0.05):
+        """Fast fit of one or many light curves by the Laplace approximation.
+
+        For each light curve the posterior used by fit() is maximized from numStarts starting points and
+        approximated by a Gaussian at the best optimum. Returns (MAP, Cov, lnLaplace, status) with shapes
+        (numLCs, ndims), (numLCs, ndims, ndims), (numLCs,) and (numLCs,); status is 0 on success, -1 if
+        the Hessian at the MAP is not negative definite and -2 if no starting point was valid. lnLaplace is the
+        unnormalized log Laplace integral of the posterior: the prior is only an indicator of its support, so it
+        has no prior-volume term and is not comparable with the nested-sampling lnEvidence or across models. The light
+        curves are processed in parallel, one per thread.
+        """
+        if not isinstance(observedLCs, (list, tuple)):
+            observedLCs = [observedLCs]
+        numLCs = len(observedLCs)
+        cadenceOffsets = np.require(np.zeros(numLCs + 1, dtype=np.intc), requirements=['F', 'A', 'W', 'O', 'E'])
+        perLC = dict()
+        for key in ['dt', 'startT', 'lowestFlux', 'highestFlux', 'periodCenter', 'periodWidth', 'fluxCenter',
+                    'fluxWidth']:
+            perLC[key] = np.require(np.zeros(numLCs), requirements=['F', 'A', 'W', 'O', 'E'])
+        xStart = np.require(np.zeros(self.ndims*numStarts*numLCs), requirements=['F', 'A', 'W', 'O', 'E'])
+        for lcNum, observedLC in enumerate(observedLCs):
+            cadenceOffsets[lcNum + 1] = cadenceOffsets[lcNum] + observedLC.numCadences
+            xStart[lcNum*numStarts*self.ndims:(lcNum + 1)*numStarts*self.ndims], fluxEst, periodEst = \
+                self._startingPoints(observedLC, numStarts)
+            perLC['dt'][lcNum] = observedLC.dt
+            perLC['startT'][lcNum] = observedLC.startT
+            perLC['lowestFlux'][lcNum] = np.min(observedLC.y[np.where(observedLC.mask == 1.0)[0]])
+            perLC['highestFlux'][lcNum] = np.max(observedLC.y[np.where(observedLC.mask == 1.0)[0]])
+            perLC['periodCenter'][lcNum] = periodEst
+            perLC['periodWidth'][lcNum] = widthT*periodEst
+            perLC['fluxCenter'][lcNum] = fluxEst
+            perLC['fluxWidth'][lcNum] = widthF*fluxEst
+        pack = kali.util.buffers.concatenate
+        t = pack(self._scratch, ('laplace', 't'), [lc.t for lc in observedLCs])
+        x = pack(self._scratch, ('laplace', 'x'), [lc.x for lc in observedLCs])
+        y = pack(self._scratch, ('laplace', 'y'), [lc.y for lc in observedLCs])
+        yerr = pack(self._scratch, ('laplace', 'yerr'), [lc.yerr for lc in observedLCs])
+        mask = pack(self._scratch, ('laplace', 'mask'), [lc.mask for lc in observedLCs])
+        MAP = np.require(np.zeros(self.ndims*numLCs), requirements=['F', 'A', 'W', 'O', 'E'])
+        Cov = np.require(np.zeros(self.ndims*self.ndims*numLCs), requirements=['F', 'A', 'W', 'O', 'E'])
+        LnPosteriorMAP = np.require(np.zeros(numLCs), requirements=['F', 'A', 'W', 'O', 'E'])
+        LnLaplace = np.require(np.zeros(numLCs), requirements=['F', 'A', 'W', 'O', 'E'])
+        Status = np.require(np.zeros(numLCs, dtype=np.intc), requirements=['F', 'A', 'W', 'O', 'E'])
+        self._taskCython.laplace_MBHBModel(
+            cadenceOffsets, perLC['dt'], perLC['startT'], perLC['lowestFlux'], perLC['highestFlux'], t, x, y,
+            yerr, mask, perLC['periodCenter'], perLC['periodWidth'], perLC['fluxCenter'], perLC['fluxWidth'],
+            numStarts, xStart, self.maxEvals, self.xTol, MAP, Cov, LnPosteriorMAP, LnLaplace, Status)
+        return (np.reshape(MAP, newshape=(numLCs, self.ndims)),
+                np.reshape(Cov, newshape=(numLCs, self.ndims, self.ndims)), LnLaplace, Status)
+
+    def fit(self, observedLC, widthT=0.01, widthF=0.05,
+            zSSeed=None, walkerSeed=None, moveSeed=None, xSeed=None,
+            sampler='ensemble', ntemps=10, maxTemp=1.0e4):
+        samplerTypes = {'ensemble': 0, 'async': 1, 'pt': 2, 'nuts': 3, 'nuts_dense': 4}
+        if sampler not in samplerTypes:
+            raise ValueError('Unknown sampler %s; choose one of %s'%(sampler, ', '.join(sorted(samplerTypes))))
+        if sampler != 'pt':
+            ntemps = 1
+        randSeed = np.zeros(1, dtype='uint32')
+        if zSSeed is None:
+            rand.rdrand(randSeed)
+            zSSeed = randSeed[0]
+        if walkerSeed is None:
+            rand.rdrand(randSeed)
+            walkerSeed = randSeed[0]
+        if moveSeed is None:
+            rand.rdrand(randSeed)
+            moveSeed = randSeed[0]
+        if xSeed is None:
+            rand.rdrand(randSeed)
+            xSeed = randSeed[0]
+        xStart, fluxEst, periodEst = self._startingPoints(observedLC, self.nwalkers)
 
         lowestFlux = np.min(observedLC.y[np.where(observedLC.mask == 1.0)[0]])
         highestFlux = np.max(observedLC.y[np.where(observedLC.mask == 1.0)[0]])
+        require = kali.util.buffers.require
         res = self._taskCython.fit_MBHBModel(
             observedLC.numCadences, observedLC.dt, observedLC.startT, lowestFlux, highestFlux,
-            observedLC.t, observedLC.x,
-            observedLC.y, observedLC.yerr, observedLC.mask, self.nwalkers, self.nsteps, self.maxEvals,
-            self.xTol, self.mcmcA, zSSeed, walkerSeed, moveSeed, xSeed, xStart, self._Chain,
+            require(observedLC.t), require(observedLC.x), require(observedLC.y), require(observedLC.yerr),
+            require(observedLC.mask), self.nwalkers, self.nsteps, self.maxEvals, self.xTol, self.mcmcA, zSSeed, walkerSeed, moveSeed, xSeed, xStart, self._Chain,
             self._LnPrior, self._LnLikelihood,
             periodEst, widthT*periodEst,
-            fluxEst, widthF*fluxEst)
+            fluxEst, widthF*fluxEst,
+            samplerTypes[sampler], ntemps, maxTemp)
 
         meanTheta = list()
         for dimNum in range(self.ndims):
@@ -15,7 +15,6 @@ import os as os
 import reprlib as reprlib
 import copy as copy
 from scipy.interpolate import UnivariateSpline
-import scipy.signal.spectral
 import warnings as warnings
 import matplotlib.pyplot as plt
 import random
@@ -24,13 +23,13 @@ import pdb as pdb
 from matplotlib import cm
 
 import multi_key_dict
-import gatspy.periodic
 
 try:
     import rand
     import MBHBCARMATask_cython as MBHBCARMATask_cython
     import kali.lc
     from kali.util.mpl_settings import set_plot_params
+    import kali.util.buffers
     import kali.util.classproperty
     import kali.util.triangle
 except ImportError:
@@ -471,6 +470,18 @@ class MBHBCARMATask(object):
     def dic(self):
         return self._dic
 
+    @property
+    def samplerUtilization(self):
+        return self._taskCython.get_samplerUtilization()
+
+    @property
+    def lnEvidence(self):
+        return self._taskCython.get_lnEvidence()
+
+    @property
+    def lnEvidenceErr(self):
+        return self._taskCython.get_lnEvidenceErr()
+
     def __repr__(self):
         return "kali.mbhbcarma.MBHBCARMATask(%d, %d, %d, %d, %d, %d, %d, %f)"%(self._p, self._q,
                                                                                self._nthreads, self._nburn,
@@ -1001,6 +1012,7 @@ class MBHBCARMATask(object):
         if tnum is None:
             tnum = 0
         periodEst = self.estimate(observedLC)
+        require = kali.util.buffers.require
         observedLC._logPrior = self._taskCython.compute_LnPrior(observedLC.numCadences, observedLC.meandt,
                                                                 observedLC.tolIR,
                                                                 observedLC.startT,
@@ -1008,9 +1020,9 @@ class MBHBCARMATask(object):
                                                                 observedLC.minTimescale*observedLC.mindt,
                                                                 observedLC.maxTimescale*observedLC.T,
                                                                 np.min(observedLC.y), np.max(observedLC.y),
-                                                                observedLC.t, observedLC.x,
-                                                                observedLC.y, observedLC.yerr,
-                                                                observedLC.mask,
+                                                                require(observedLC.t), require(observedLC.x),
+                                                                require(observedLC.y), require(observedLC.yerr),
+                                                                require(observedLC.mask),
                                                                 periodEst, widthT*periodEst,
                                                                 observedLC.mean, widthF*observedLC.mean,
                                                                 tnum)
@@ -1024,6 +1036,7 @@ class MBHBCARMATask(object):
         periodEst = self.estimate(observedLC)
         observedLC._logPrior = self.logPrior(observedLC, widthT=widthT, widthF=widthF,
                                              forced=forced, tnum=tnum)
+        require = kali.util.buffers.require
         if forced is True:
             observedLC._computedCadenceNum = -1
         if observedLC._computedCadenceNum == -1:
@@ -1033,7 +1046,8 @@ class MBHBCARMATask(object):
                     observedLC.PComp[rowCtr + observedLC.pComp*colCtr] = 0.0
             observedLC._logLikelihood = self._taskCython.compute_LnLikelihood(
                 observedLC.numCadences, observedLC._computedCadenceNum, observedLC.tolIR, observedLC.startT,
-                observedLC.t, observedLC.x, observedLC.y, observedLC.yerr, observedLC.mask,
+                require(observedLC.t), require(observedLC.x), require(observedLC.y), require(observedLC.yerr),
+                require(observedLC.mask),
                 observedLC.XComp, observedLC.PComp,
                 periodEst, widthT*periodEst,
                 observedLC.mean, widthF*observedLC.mean,
@@ -1045,8 +1059,8 @@ class MBHBCARMATask(object):
         '''else:
             observedLC._logLikelihood = self._taskCython.update_LnLikelihood(
                 observedLC.numCadences, observedLC._computedCadenceNum, observedLC._logLikelihood,
-                observedLC.tolIR, observedLC.t, observedLC.x, observedLC.y - observedLC.mean, observedLC.yerr,
-                observedLC.mask, observedLC.XComp, observedLC.PComp, tnum)
+                observedLC.tolIR, require(observedLC.t), require(observedLC.x), require(observedLC.y),
+                require(observedLC.yerr), require(observedLC.mask), observedLC.XComp, observedLC.PComp, tnum)
             observedLC._logPosterior = observedLC._logPrior + observedLC._logLikelihood
             observedLC._computedCadenceNum = observedLC.numCadences - 1'''
         return observedLC._logLikelihood
@@ -1287,24 +1301,11 @@ class MBHBCARMATask(object):
 
     def estimate(self, observedLC):
         """!
-        Estimate period using gatspy or scipy.spectral.periodogram
+        Estimate period from the peak of the Lomb-Scargle periodogram
         """
-        if observedLC.numCadences > 50:
-            model = gatspy.periodic.LombScargleFast()
-        else:
-            model = gatspy.periodic.LombScargle()
-        model.optimizer.set(quiet=True, period_range=(2.0*observedLC.meandt, observedLC.T))
-        model.fit(observedLC.t,
-                  observedLC.y,
-                  observedLC.yerr)
-        periodEst = model.best_period
-        if periodEst < 2.0*observedLC.meandt or periodEst > observedLC.T:
-            scaled_y = (observedLC.y - observedLC.mean)/observedLC.std
-            angFreqs = np.logspace(math.log10((2.0*math.pi)/(observedLC.T)),
-                                   math.log10((2.0*math.pi)/(2.0*observedLC.meandt)),
-                                   10000)
-            periodogram = scipy.signal.spectral.lombscargle(observedLC.t, scaled_y, angFreqs)
-            periodEst = 2.0*math.pi/angFreqs[np.argmax(periodogram)]
+        freqs, power = kali.lc.lombScargle(observedLC.t, observedLC.y, observedLC.yerr, observedLC.mask,
+                                           *kali.lc.frequencyGrid(observedLC.T, observedLC.meandt))
+        periodEst = 1.0/freqs[np.argmax(power)]
         return periodEst
 
     def guess(self, periodEst):
@@ -1328,7 +1329,13 @@ class MBHBCARMATask(object):
         return a1Guess, a2Guess, eccentricityGuess
 
     def fit(self, observedLC, widthT=0.01, widthF=0.05,
-            zSSeed=None, walkerSeed=None, moveSeed=None, xSeed=None):
+            zSSeed=None, walkerSeed=None, moveSeed=None, xSeed=None,
+            sampler='ensemble', ntemps=10, maxTemp=1.0e4):
+        samplerTypes = {'ensemble': 0, 'async': 1, 'pt': 2, 'nuts': 3, 'nuts_dense': 4}
+        if sampler not in samplerTypes:
+            raise ValueError('Unknown sampler %s; choose one of %s'%(sampler, ', '.join(sorted(samplerTypes))))
+        if sampler != 'pt':
+            ntemps = 1
         observedLC.pComp = self.p
         observedLC.qComp = self.q
         randSeed = np.zeros(1, dtype='uint32')
@@ -1374,15 +1381,18 @@ class MBHBCARMATask(object):
 
             for dimNum in range(self.ndims):
                 xStart[dimNum + walkerNum*self.ndims] = ThetaGuess[dimNum]
+        require = kali.util.buffers.require
         res = self._taskCython.fit_CARMAModel(
             observedLC.dt, observedLC.numCadences, observedLC.meandt, observedLC.tolIR,
             observedLC.maxSigma*observedLC.std, observedLC.minTimescale*observedLC.mindt,
             observedLC.maxTimescale*observedLC.T, np.min(observedLC.y), np.max(observedLC.y),
-            observedLC.startT, observedLC.t, observedLC.x, observedLC.y, observedLC.yerr, observedLC.mask,
+            observedLC.startT, require(observedLC.t), require(observedLC.x), require(observedLC.y),
+            require(observedLC.yerr), require(observedLC.mask),
             self.nwalkers, self.nsteps, self.maxEvals, self.xTol, self.mcmcA,
             zSSeed, walkerSeed, moveSeed, xSeed, xStart, self._Chain, self._LnPrior, self._LnLikelihood,
             periodEst, widthT*periodEst,
-            observedLC.mean, widthF*observedLC.mean)
+            observedLC.mean, widthF*observedLC.mean,
+            samplerTypes[sampler], ntemps, maxTemp)
 
         meanTheta = list()
         for dimNum in range(self.ndims):
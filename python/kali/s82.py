@@ -98,7 +98,8 @@ class sdssLC(kali.lc.lc):
                  print "Cannot Load from Server in Offline Mode"
                  return None
 
-    def fit(self, pMin=1, pMax=1, qMin=-1, qMax=-1, nwalkers=200, nsteps=1000, xTol=0.001, maxEvals=10000, doShow = True):
+    def fit(self, pMin=1, pMax=1, qMin=-1, qMax=-1, nwalkers=200, nsteps=1000, xTol=0.001, maxEvals=10000, doShow = True,
+            numCandidates=3, deltaBIC=10.0):
         self.taskDict = dict()
         self.DICDict = dict()
         self.totalTime = 0.0
@@ -117,30 +118,49 @@ class sdssLC(kali.lc.lc):
         self.qMax = qMax
         self.qMin = qMin
 
-        for p in xrange(pMin, pMax + 1):
-            for q in xrange(qMin, min(p, qMax + 1)):
-                nt = kali.carma.CARMATask(
-                    p, q, nwalkers=nwalkers, nsteps=nsteps, xTol=xTol, maxEvals=maxEvals)
-
-                print 'Starting carma fitting for p = %d and q = %d...'%(p, q)
-                startLCARMA = time.time()
-                nt.fit(self)
-                stopLCARMA = time.time()
-                timeLCARMA = stopLCARMA - startLCARMA
-                print 'carma took %4.3f s = %4.3f min = %4.3f hrs'%(timeLCARMA,
-                                                                    timeLCARMA/60.0, timeLCARMA/3600.0)
-                self.totalTime += timeLCARMA
-
-                Deviances = copy.copy(nt.LnPosterior[:, nsteps/2:]).reshape((-1))
-                DIC = 0.5*math.pow(np.nanstd(-2.0*Deviances), 2.0) + np.nanmean(-2.0*Deviances)
-                print 'C-ARMA(%d,%d) DIC: %+4.3e'%(p, q, DIC)
-                self.DICDict['%d %d'%(p, q)] = DIC
-                self.taskDict['%d %d'%(p, q)] = nt
+        print 'Searching carma orders %d <= p <= %d, %d <= q <= %d...'%(pMin, pMax, qMin, qMax)
+        startSearch = time.time()
+        search = kali.carma.orderSearch(self, pMin=pMin, pMax=pMax, qMin=qMin, qMax=qMax,
+                                        numCandidates=numCandidates, deltaBIC=deltaBIC,
+                                        nwalkers=nwalkers, nsteps=nsteps, maxEvals=maxEvals, xTol=xTol,
+                                        doFit=False)
+        stopSearch = time.time()
+        self.totalTime += stopSearch - startSearch
+        self.BICDict = dict()
+        for (p, q), BIC in zip(search['orders'], search['BIC']):
+            self.BICDict['%d %d'%(p, q)] = BIC
+        candidates = search['candidates']
+        if not candidates:
+            # No order has a MAP; sample the whole grid and let the DIC decide.
+            candidates = search['orders']
+        print 'Order search took %4.3f s; sampling C-ARMA orders %s'%(
+            stopSearch - startSearch, ', '.join('(%d,%d)'%(p, q) for p, q in candidates))
+
+        for p, q in candidates:
+            nt = kali.carma.CARMATask(
+                p, q, nwalkers=nwalkers, nsteps=nsteps, xTol=xTol, maxEvals=maxEvals)
+
+            print 'Starting carma fitting for p = %d and q = %d...'%(p, q)
+            startLCARMA = time.time()
+            nt.fit(self)
+            stopLCARMA = time.time()
+            timeLCARMA = stopLCARMA - startLCARMA
+            print 'carma took %4.3f s = %4.3f min = %4.3f hrs'%(timeLCARMA,
+                                                                timeLCARMA/60.0, timeLCARMA/3600.0)
+            self.totalTime += timeLCARMA
+
+            Deviances = copy.copy(nt.LnPosterior[:, nsteps/2:]).reshape((-1))
+            DIC = 0.5*math.pow(np.nanstd(-2.0*Deviances), 2.0) + np.nanmean(-2.0*Deviances)
+            print 'C-ARMA(%d,%d) DIC: %+4.3e'%(p, q, DIC)
+            self.DICDict['%d %d'%(p, q)] = DIC
+            self.taskDict['%d %d'%(p, q)] = nt
         print 'Total time taken by carma is %4.3f s = %4.3f min = %4.3f hrs'%(self.totalTime,
                                                                               self.totalTime/60.0,
                                                                               self.totalTime/3600.0)
 
         sortedDICVals = sorted(self.DICDict.items(), key=operator.itemgetter(1))
+        if not sortedDICVals:
+            raise ValueError('No C-ARMA order with %d <= p <= %d, %d <= q <= %d was fitted'%(pMin, pMax, qMin, qMax))
         self.pBest = int(sortedDICVals[0][0].split()[0])
         self.qBest = int(sortedDICVals[0][0].split()[1])
         print 'Best model is C-ARMA(%d,%d)'%(self.pBest, self.qBest)
@@ -180,6 +200,9 @@ class sdssLC(kali.lc.lc):
                     qView = int(raw_input('C-MA model order:'))
                 except ValueError:
                     print 'Bad input: integer required!'
+            if '%d %d'%(pView, qView) not in self.taskDict:
+                print 'C-ARMA(%d,%d) was pruned by the order search and not sampled'%(pView, qView)
+                continue
 
             if whatToView == 0:
                 figTitle = 'CARMA(%d,%d); DIC: %+4.3e'%(pView, qView, self.DICDict['%d %d'%(pView, qView)])
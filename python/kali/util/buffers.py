@@ -0,0 +1,75 @@
+"""!
+\brief Helpers to hand numpy arrays to the C++ tasks without copying them.
+
+The Cython wrappers take typed memoryviews (double[::1], int[::1]), which accept any writable C-contiguous array of
+the right dtype as is. require() converts only arrays that are not already in that layout, and scratch() keeps one
+reusable work array per key so that derived inputs such as the mean-subtracted flux do not allocate on every call;
+concatenate() packs many light curves into such work arrays and threadStore() holds them for module-level functions.
+require() and scratch() count what they copy and allocate so that tests can check that the hot paths stay copy-free.
+"""
+
+import threading
+
+import numpy as np
+
+_counts = {'copies': 0, 'allocations': 0}
+_local = threading.local()
+
+
+def require(arr, dtype=np.float64):
+    """!
+    \brief Return arr as a writable C-contiguous array of dtype, copying only if it is not one already.
+    """
+    out = np.require(arr, dtype=dtype, requirements=['C', 'A', 'W'])
+    if out is not arr:
+        _counts['copies'] += 1
+    return out
+
+
+def scratch(store, key, size, dtype=np.float64):
+    """!
+    \brief Return the work array store[key], (re)allocating it only if it does not hold size elements of dtype.
+    """
+    buf = store.get(key)
+    if buf is None or buf.shape[0] != size or buf.dtype != dtype:
+        buf = np.zeros(size, dtype=dtype)
+        store[key] = buf
+        _counts['allocations'] += 1
+    return buf
+
+
+def concatenate(store, key, arrays, shifts=None):
+    """!
+    \brief Concatenate arrays into the work array store[key], subtracting shifts[i] from arrays[i] if shifts is given.
+    """
+    buf = scratch(store, key, sum(arr.shape[0] for arr in arrays))
+    start = 0
+    for arrNum, arr in enumerate(arrays):
+        stop = start + arr.shape[0]
+        if shifts is None:
+            buf[start:stop] = arr
+        else:
+            np.subtract(arr, shifts[arrNum], out=buf[start:stop])
+        start = stop
+    return buf
+
+
+def threadStore():
+    """!
+    \brief Work array store of the calling thread, for functions that have no task object to keep one on.
+    """
+    if not hasattr(_local, 'store'):
+        _local.store = dict()
+    return _local.store
+
+
+def counts():
+    """!
+    \brief Number of copies made by require and arrays allocated by scratch since the last resetCounts.
+    """
+    return dict(_counts)
+
+
+def resetCounts():
+    for key in _counts:
+        _counts[key] = 0
@@ -79,7 +79,7 @@ rand_ext = Extension(
     include_dirs=[INCLUDE, np.get_include()], extra_link_args=MKLLIBS + OMPLIBS + NLOPTLIBS,
     library_dirs=[MKLDIR], runtime_library_dirs=[MKLDIR])
 
-LCTools_sourceList = ['LCTools_cython.pyx', 'LC.cpp']
+LCTools_sourceList = ['LCTools_cython.pyx', 'Execution.cpp', 'LC.cpp', 'Cadence.cpp', 'CrossCorr.cpp']
 LCTools_List = [os.path.join(os.environ['PWD'], 'src', srcFile) for srcFile in LCTools_sourceList]
 
 LCTools_ext = Extension(
@@ -88,8 +88,17 @@ LCTools_ext = Extension(
     include_dirs=[INCLUDE, np.get_include()], extra_link_args=MKLLIBS + OMPLIBS + NLOPTLIBS,
     library_dirs=[MKLDIR], runtime_library_dirs=[MKLDIR])
 
-CARMATask_sourceList = ['rdrand.cpp', 'Constants.cpp', 'MCMC.cpp', 'CARMA.cpp', 'CARMATask.cpp',
-                        'CARMATask_cython.pyx']
+Execution_sourceList = ['Execution_cython.pyx', 'Execution.cpp']
+Execution_List = [os.path.join(os.environ['PWD'], 'src', srcFile) for srcFile in Execution_sourceList]
+
+Execution_ext = Extension(
+    name='Execution_cython', sources=Execution_List, language='c++',
+    extra_compile_args=CPPFLAGS + VERFLAGS + ALIGHFLAGS + MKLFLAGS + OMPFLAGS,
+    include_dirs=[INCLUDE, np.get_include()], extra_link_args=MKLLIBS + OMPLIBS,
+    library_dirs=[MKLDIR], runtime_library_dirs=[MKLDIR])
+
+CARMATask_sourceList = ['rdrand.cpp', 'Constants.cpp', 'MCMC.cpp', 'Execution.cpp', 'CARMA.cpp',
+                        'CARMATask.cpp', 'CARMATask_cython.pyx']
 CARMATask_List = [os.path.join(os.environ['PWD'], 'src', srcFile) for srcFile in CARMATask_sourceList]
 
 CARMATask_ext = Extension(
@@ -98,8 +107,8 @@ CARMATask_ext = Extension(
     include_dirs=[INCLUDE, np.get_include()], extra_link_args=OMPLIBS + MKLLIBS + NLOPTLIBS,
     library_dirs=[MKLDIR], runtime_library_dirs=[MKLDIR])
 
-MBHBTask_sourceList = ['rdrand.cpp', 'Constants.cpp', 'MCMC.cpp', 'MBHB.cpp', 'MBHBTask.cpp',
-                       'MBHBTask_cython.pyx']
+MBHBTask_sourceList = ['rdrand.cpp', 'Constants.cpp', 'MCMC.cpp', 'Execution.cpp', 'MBHB.cpp',
+                       'MBHBTask.cpp', 'MBHBTask_cython.pyx']
 MBHBTask_List = [os.path.join(os.environ['PWD'], 'src', srcFile) for srcFile in MBHBTask_sourceList]
 
 MBHBTask_ext = Extension(
@@ -108,8 +117,8 @@ MBHBTask_ext = Extension(
     include_dirs=[INCLUDE, np.get_include()], extra_link_args=OMPLIBS + MKLLIBS + NLOPTLIBS,
     library_dirs=[MKLDIR], runtime_library_dirs=[MKLDIR])
 
-MBHBCARMATask_sourceList = ['rdrand.cpp', 'Constants.cpp', 'MCMC.cpp', 'MBHBCARMA.cpp', 'MBHBCARMATask.cpp',
-                            'MBHBCARMATask_cython.pyx']
+MBHBCARMATask_sourceList = ['rdrand.cpp', 'Constants.cpp', 'MCMC.cpp', 'Execution.cpp', 'MBHBCARMA.cpp',
+                            'MBHBCARMATask.cpp', 'MBHBCARMATask_cython.pyx']
 MBHBCARMATask_List = [os.path.join(os.environ['PWD'], 'src', srcFile) for srcFile in MBHBCARMATask_sourceList]
 
 MBHBCARMATask_ext = Extension(
@@ -133,5 +142,5 @@ setup(
     classifiers=['AGN', 'C-ARMA', 'stochastic', 'MBHBs'],
     platforms=['Linux', 'Mac OSX'],
     license='GNU GENERAL PUBLIC LICENSE, Version 2, June 1991',
-    ext_modules=cythonize([rand_ext, LCTools_ext, CARMATask_ext, MBHBTask_ext, MBHBCARMATask_ext], compiler_directives={'language_level': 3})
+    ext_modules=cythonize([rand_ext, LCTools_ext, Execution_ext, CARMATask_ext, MBHBTask_ext, MBHBCARMATask_ext], compiler_directives={'language_level': 3})
 )
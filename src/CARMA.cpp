@@ -248,86 +248,110 @@ double kali::calcLnPosterior(double *walkerPos, void *func_args, double &LnPrior
 	kali::LnLikeArgs *ptr2Args = reinterpret_cast<kali::LnLikeArgs*>(func_args);
 	kali::LnLikeArgs Args = *ptr2Args;
 
-	kali::LnLikeData *Data = Args.Data;
-	kali::CARMA *Systems = Args.Systems;
+	kali::CARMAPosterior::Evaluator Eval(&Args.Systems[threadNum], Args.Data);
+	return Eval(walkerPos, LnPrior, LnLikelihood);
+	}
+
+kali::CARMAPosterior::CARMAPosterior(CARMA *systems, LnLikeData *data) {
+	Systems = systems;
+	Data = data;
+	}
+
+kali::CARMAPosterior::Evaluator kali::CARMAPosterior::evaluator(int threadNum) {
+	return Evaluator(&Systems[threadNum], Data);
+	}
+
+kali::CARMAPosterior::Evaluator::Evaluator(CARMA *system, LnLikeData *data) {
+	System = system;
+	Data = data;
+	}
+
+double kali::CARMAPosterior::Evaluator::operator()(double *walkerPos, double &LnPrior, double &LnLikelihood) {
+	/*!
+	Same computation as calcLnPosterior, but on the CARMA system this evaluator is bound to. The system is modified and then restored to its original dt, so each thread must use its own evaluator.
+	*/
+	#ifdef DEBUG_CALCLNPOSTERIOR
+	int threadNum = omp_get_thread_num();
+	#endif
+
 	kali::LnLikeData *ptr2Data = Data;
 	double LnPosterior = 0.0, old_dt = 0.0;
 
-	if (Systems[threadNum].checkCARMAParams(walkerPos) == 1) {
-		old_dt = Systems[threadNum].get_dt();
-		Systems[threadNum].setCARMA(walkerPos);
-		Systems[threadNum].solveCARMA();
-		Systems[threadNum].resetState();
-		LnPrior = Systems[threadNum].computeLnPrior(ptr2Data);
+	if (System->checkCARMAParams(walkerPos) == 1) {
+		old_dt = System->get_dt();
+		System->setCARMA(walkerPos);
+		System->solveCARMA();
+		System->resetState();
+		LnPrior = System->computeLnPrior(ptr2Data);
 
 		#ifdef DEBUG_CALCLNPOSTERIOR
 			printf("calcLnPosterior - threadNum: %d; walkerPos: ",threadNum);
-			for (int dimNum = 0; dimNum < Systems[threadNum].get_p() + Systems[threadNum].get_q() + 1; dimNum++) {
+			for (int dimNum = 0; dimNum < System->get_p() + System->get_q() + 1; dimNum++) {
 				printf("%+17.16e ", walkerPos[dimNum]);
 				}
 			printf("\n");
 			printf("calcLnPosterior - threadNum: %d; System good!\n",threadNum);
-			printf("calcLnPosterior - threadNum: %d; dt: %e\n",threadNum, Systems[threadNum].get_dt());
+			printf("calcLnPosterior - threadNum: %d; dt: %e\n",threadNum, System->get_dt());
 			printf("\n");
 			printf("calcLnPosterior - threadNum: %d; A\n",threadNum);
-			Systems[threadNum].printA();
+			System->printA();
 			printf("\n");
 			printf("calcLnPosterior - threadNum: %d; w\n",threadNum);
-			Systems[threadNum].printw();
+			System->printw();
 			printf("\n");
 			printf("calcLnPosterior - threadNum: %d; expw\n",threadNum);
-			Systems[threadNum].printexpw();
+			System->printexpw();
 			printf("\n");
 			printf("calcLnPosterior - threadNum: %d; vr\n",threadNum);
-			Systems[threadNum].printvr();
+			System->printvr();
 			printf("\n");
 			printf("calcLnPosterior - threadNum: %d; vrInv\n",threadNum);
-			Systems[threadNum].printvrInv();
+			System->printvrInv();
 			printf("\n");
 			printf("calcLnPosterior - threadNum: %d; B\n",threadNum);
-			Systems[threadNum].printB();
+			System->printB();
 			printf("\n");
 			printf("calcLnPosterior - threadNum: %d; C\n",threadNum);
-			Systems[threadNum].printC();
+			System->printC();
 			printf("\n");
 			printf("calcLnPosterior - threadNum: %d; F\n",threadNum);
-			Systems[threadNum].printF();
+			System->printF();
 			printf("\n");
 			printf("calcLnPosterior - threadNum: %d; Q\n",threadNum);
-			Systems[threadNum].printQ();
+			System->printQ();
 			printf("\n");
 			printf("calcLnPosterior - threadNum: %d; Sigma\n",threadNum);
-			Systems[threadNum].printSigma();
+			System->printSigma();
 			printf("\n");
 			printf("calcLnPosterior - threadNum: %d; X\n",threadNum);
-			Systems[threadNum].printX();
+			System->printX();
 			printf("\n");
 			printf("calcLnPosterior - threadNum: %d; P\n",threadNum);
-			Systems[threadNum].printP();
+			System->printP();
 			printf("\n");
             printf("calcLnPosterior - threadNum: %d; LnPrior: %e\n",threadNum, LnPrior);
 			printf("\n");
 			fflush(0);
 		#endif
 
-        LnLikelihood = Systems[threadNum].computeLnLikelihood(ptr2Data);
+        LnLikelihood = System->computeLnLikelihood(ptr2Data);
 		LnPosterior = LnLikelihood + LnPrior;
 
-		Systems[threadNum].set_dt(old_dt);
-		Systems[threadNum].solveCARMA();
-		//Systems[threadNum].resetState();
+		System->set_dt(old_dt);
+		System->solveCARMA();
+		//System->resetState();
 
 		#ifdef DEBUG_CALCLNPOSTERIOR
 			printf("calcLnPosterior - threadNum: %d; walkerPos: ", threadNum);
-			for (int dimNum = 0; dimNum < Systems[threadNum].get_p() + Systems[threadNum].get_q() + 1; dimNum++) {
+			for (int dimNum = 0; dimNum < System->get_p() + System->get_q() + 1; dimNum++) {
 				printf("%+17.16e ", walkerPos[dimNum]);
 				}
 			printf("\n");
 			printf("calcLnPosterior - threadNum: %d; X\n", threadNum);
-			Systems[threadNum].printX();
+			System->printX();
 			printf("\n");
 			printf("calcLnPosterior - threadNum: %d; P\n", threadNum);
-			Systems[threadNum].printP();
+			System->printP();
 			printf("\n");
 			printf("calcLnLike - threadNum: %d; LnPosterior: %f\n", threadNum, LnPosterior);
 			printf("\n");
@@ -622,6 +646,7 @@ kali::CARMA::CARMA() {
 	q = 0;
 	pSq = 0;
 	dt = 0.0;
+	rngMode = kali::RNG_PER_CADENCE;
 
 	ilo = nullptr; // len 1
 	ihi = nullptr; // len 1
@@ -1281,6 +1306,14 @@ int kali::CARMA::get_allocated() {
 	return allocated;
 	}
 
+int kali::CARMA::get_rngMode() {
+	return rngMode;
+	}
+
+void kali::CARMA::set_rngMode(int mode) {
+	rngMode = (mode == kali::RNG_BLOCK) ? kali::RNG_BLOCK : kali::RNG_PER_CADENCE;
+	}
+
 void kali::CARMA::getCARRoots(complex<double>*& CARRoots) {
 	CARRoots = CARw;
 	}
@@ -2144,6 +2177,12 @@ void kali::CARMA::simulateSystem(LnLikeData *ptr2Data, unsigned int distSeed, do
 	VSLStreamStatePtr distStream __attribute__((aligned(64)));
 	vslNewStream(&distStream, VSL_BRNG_SFMT19937, distSeed);
 
+	if (rngMode == kali::RNG_BLOCK) {
+		simulateBlocks(0, numCadences, tolIR, t, x, distStream, distRand);
+		vslDeleteStream(&distStream);
+		return;
+		}
+
 	double t_incr = 0.0, fracChange = 0.0;
 
 	#pragma omp simd
@@ -2207,6 +2246,13 @@ void kali::CARMA::extendSystem(LnLikeData *ptr2Data, unsigned int distSeed, doub
 	double t_incr = 0.0, fracChange = 0.0;
 	int startCadence = cadenceNum + 1;
 
+	if (rngMode == kali::RNG_BLOCK) {
+		simulateBlocks(startCadence, numCadences, tolIR, t, x, distStream, distRand);
+		vslDeleteStream(&distStream);
+		Data.cadenceNum = numCadences - 1;
+		return;
+		}
+
 	#pragma omp simd
 	for (int rowCtr = 0; rowCtr < p; ++rowCtr) {
 		VScratch[rowCtr] = 0.0;
@@ -2244,6 +2290,41 @@ void kali::CARMA::extendSystem(LnLikeData *ptr2Data, unsigned int distSeed, doub
 	Data.cadenceNum = numCadences - 1;
 	}
 
+void kali::CARMA::simulateBlocks(int firstCadence, int numCadences, double tolIR, double *t, double *x, VSLStreamStatePtr distStream, double *distRand) {
+	/*!
+	kali::RNG_BLOCK version of the simulation loop of simulateSystem and extendSystem for cadences firstCadence to numCadences - 1, with distRand holding (numCadences - firstCadence)*p values. The cadences are cut into runs over which dt, and hence F and Q, stay fixed. The disturbances of a whole run are drawn as standard normals in one VSL call and then multiplied in one dtrmm by the transposed upper Cholesky factor held in T, which gives them covariance Q. The normals are consumed in the same order as by the per-cadence vdRngGaussianMV calls, so both versions agree up to rounding.
+	*/
+	int runStart = firstCadence;
+	while (runStart < numCadences) {
+		if (runStart > firstCadence) {
+			double t_incr = t[runStart] - t[runStart - 1];
+			if (abs((t_incr - dt)/((t_incr + dt)/2.0)) > tolIR) {
+				dt = t_incr;
+				solveCARMA();
+				}
+			}
+		int runEnd = runStart + 1;
+		while (runEnd < numCadences) {
+			double t_incr = t[runEnd] - t[runEnd - 1];
+			if (abs((t_incr - dt)/((t_incr + dt)/2.0)) > tolIR) {
+				break;
+				}
+			++runEnd;
+			}
+		int runLength = runEnd - runStart;
+		double *runRand = &distRand[(runStart - firstCadence)*p];
+		vdRngGaussian(VSL_RNG_METHOD_GAUSSIAN_ICDF, distStream, runLength*p, runRand, 0.0, 1.0);
+		cblas_dtrmm(CblasColMajor, CblasLeft, CblasUpper, CblasTrans, CblasNonUnit, p, runLength, 1.0, T, p, runRand, p); // w = T^T*z, so that Cov(w) = Q
+		for (int i = runStart; i < runEnd; ++i) {
+			cblas_dgemv(CblasColMajor, CblasNoTrans, p, p, 1.0, F, p, X, 1, 0.0, VScratch, 1); // VScratch = F*X
+			cblas_dcopy(p, VScratch, 1, X, 1); // X = VScratch
+			cblas_daxpy(p, 1.0, &runRand[(i - runStart)*p], 1, X, 1); // X = w + X
+			x[i] = X[0];
+			}
+		runStart = runEnd;
+		}
+	}
+
 double kali::CARMA::getIntrinsicVar() {
 	return sqrt(Sigma[0]);
 	}
@@ -2276,6 +2357,19 @@ void kali::CARMA::observeNoise(LnLikeData *ptr2Data, unsigned int noiseSeed, dou
 	double absIntrinsicVar = sqrt(Sigma[0]);
 	double absMeanFlux = absIntrinsicVar/fracIntrinsicVar;
 	double absFlux = 0.0, noiseLvl = 0.0;
+	if (rngMode == kali::RNG_BLOCK) {
+		/*!
+		Draw all standard normals at once and scale each by the noise level of its cadence.
+		*/
+		vdRngGaussian(VSL_RNG_METHOD_GAUSSIAN_ICDF, noiseStream, numCadences, noiseRand, 0.0, 1.0);
+		#pragma omp simd
+		for (int i = 0; i < numCadences; ++i) {
+			yerr[i] = fracNoiseToSignal*(absMeanFlux + x[i]);
+			y[i] = absMeanFlux + x[i] + yerr[i]*noiseRand[i];
+			}
+		vslDeleteStream(&noiseStream);
+		return;
+		}
 	for (int i = 0; i < numCadences; ++i) {
 		absFlux = absMeanFlux + x[i];
 		noiseLvl = fracNoiseToSignal*absFlux;
@@ -2307,6 +2401,17 @@ void kali::CARMA::extendObserveNoise(LnLikeData *ptr2Data, unsigned int noiseSee
 	double absMeanFlux = absIntrinsicVar/fracIntrinsicVar;
 	double absFlux = 0.0, noiseLvl = 0.0;
 	int startCadence = cadenceNum + 1;
+	if (rngMode == kali::RNG_BLOCK) {
+		vdRngGaussian(VSL_RNG_METHOD_GAUSSIAN_ICDF, noiseStream, numCadences - startCadence, noiseRand, 0.0, 1.0);
+		#pragma omp simd
+		for (int i = startCadence; i < numCadences; ++i) {
+			yerr[i] = fracNoiseToSignal*(absMeanFlux + x[i]);
+			y[i] = absMeanFlux + x[i] + yerr[i]*noiseRand[i - startCadence];
+			}
+		vslDeleteStream(&noiseStream);
+		Data.cadenceNum = numCadences - 1;
+		return;
+		}
 	for (int i = startCadence; i < numCadences; ++i) {
 		absFlux = absMeanFlux + x[i];
 		noiseLvl = fracNoiseToSignal*absFlux;
@@ -2886,6 +2991,83 @@ void kali::CARMA::computeACVF(int numLags, double *Lags, double* ACVF) {
 		}
 	}
 
+int kali::CARMA::simulateCirculant(LnLikeData *ptr2Data, unsigned int distSeed) {
+	/*!
+	Exact simulation of the stationary process on a regular grid by circulant embedding (Davies & Harte 1987; Dietrich & Newsam 1997). The ACVF at lags 0, dt, ..., M*dt with M >= numCadences - 1 is wrapped into the first row c of a circulant matrix of size L = 2M whose eigenvalues are the DFT of c. Scaling L complex standard normals by sqrt(eigenvalue/L) and transforming them gives a complex vector whose real part has exactly the ACVF at its first M + 1 points, at the cost of two DFTs of length L and without burn-in. M is doubled while the embedding has negative eigenvalues; eigenvalues that are negative only by rounding are set to zero.
+
+	Returns 0 on success, -1 if the cadences are not regular to within tolIR and -2 if no nonnegative embedding was found. The state is reset to the stationary prior, so extendSystem does not continue from the end of a light curve made this way.
+	*/
+	int numCadences = ptr2Data->numCadences;
+	double tolIR = ptr2Data->tolIR;
+	double *t = ptr2Data->t;
+	double *x = ptr2Data->x;
+	if (numCadences < 2) {
+		return -1;
+		}
+	double gridStep = t[1] - t[0];
+	for (int i = 1; i < numCadences; ++i) {
+		double t_incr = t[i] - t[i - 1];
+		if (abs((t_incr - gridStep)/((t_incr + gridStep)/2.0)) > tolIR) {
+			return -1;
+			}
+		}
+	resetState();
+	mkl_domain_set_num_threads(1, MKL_DOMAIN_ALL);
+
+	int halfLength = 1;
+	while (halfLength < numCadences - 1) {
+		halfLength *= 2;
+		}
+	int retVal = -2;
+	for (int tryNum = 0; (tryNum < 8) and (retVal != 0); ++tryNum, halfLength *= 2) {
+		int circLength = 2*halfLength;
+		double *Lags = static_cast<double*>(_mm_malloc((halfLength + 1)*sizeof(double), 64));
+		double *circACVF = static_cast<double*>(_mm_malloc((halfLength + 1)*sizeof(double), 64));
+		complex<double> *eig = static_cast<complex<double>*>(_mm_malloc(circLength*sizeof(complex<double>), 64));
+		#pragma omp simd
+		for (int lagNum = 0; lagNum <= halfLength; ++lagNum) {
+			Lags[lagNum] = lagNum*gridStep;
+			}
+		computeACVF(halfLength + 1, Lags, circACVF);
+		for (int i = 0; i < circLength; ++i) {
+			eig[i] = complex<double>(circACVF[(i <= halfLength) ? i : circLength - i], 0.0); // c = [g_0, ..., g_M, g_(M-1), ..., g_1]
+			}
+		_mm_free(Lags);
+		_mm_free(circACVF);
+
+		DFTI_DESCRIPTOR_HANDLE fftHandle;
+		DftiCreateDescriptor(&fftHandle, DFTI_DOUBLE, DFTI_COMPLEX, 1, static_cast<MKL_LONG>(circLength));
+		DftiSetValue(fftHandle, DFTI_THREAD_LIMIT, 1);
+		DftiCommitDescriptor(fftHandle);
+		DftiComputeForward(fftHandle, eig); // eig = DFT(c), real since c is symmetric
+
+		double maxEig = 0.0, minEig = 0.0;
+		for (int i = 0; i < circLength; ++i) {
+			maxEig = max(maxEig, eig[i].real());
+			minEig = min(minEig, eig[i].real());
+			}
+		if ((maxEig > 0.0) and (minEig >= -1.0e-10*maxEig)) {
+			complex<double> *Z = static_cast<complex<double>*>(_mm_malloc(circLength*sizeof(complex<double>), 64));
+			VSLStreamStatePtr distStream __attribute__((aligned(64)));
+			vslNewStream(&distStream, VSL_BRNG_SFMT19937, distSeed);
+			vdRngGaussian(VSL_RNG_METHOD_GAUSSIAN_ICDF, distStream, 2*circLength, reinterpret_cast<double*>(Z), 0.0, 1.0);
+			vslDeleteStream(&distStream);
+			for (int i = 0; i < circLength; ++i) {
+				Z[i] *= sqrt(max(eig[i].real(), 0.0)/circLength);
+				}
+			DftiComputeForward(fftHandle, Z);
+			for (int i = 0; i < numCadences; ++i) {
+				x[i] = Z[i].real();
+				}
+			_mm_free(Z);
+			retVal = 0;
+			}
+		DftiFreeDescriptor(&fftHandle);
+		_mm_free(eig);
+		}
+	return retVal;
+	}
+
 int kali::CARMA::RTSSmoother(LnLikeData *ptr2Data, double *XSmooth, double *PSmooth) {
 	kali::LnLikeData Data = *ptr2Data;
 
@@ -14,15 +14,18 @@
 #include <mkl_types.h>
 #include <omp.h>
 #include <limits>
+#include <algorithm>
 #include <nlopt.hpp>
 #include <stdio.h>
 #include "CARMA.hpp"
 #include "MCMC.hpp"
 #include "Constants.hpp"
+#include "Execution.hpp"
 #include "CARMATask.hpp"
 
 //#define DEBUG_COMPUTELNLIKELIHOOD
 //#define DEBUG_FIT_CARMAMODEL
+//#define DEBUG_SEARCHCARMAORDERS
 
 using namespace std;
 
@@ -33,6 +36,18 @@ kali::CARMATask::CARMATask(int pGiven, int qGiven, int numThreadsGiven, int numB
 	q = qGiven;
 	numThreads = numThreadsGiven;
 	numBurn = numBurnGiven;
+	samplerUtilization = 0.0;
+	lnEvidence = 0.0;
+	lnEvidenceErr = 0.0;
+	nestConverged = false;
+	for (int moveNum = 0; moveNum < kali::NUM_MOVE_TYPES; ++moveNum) {
+		moveWeights[moveNum] = 0.0;
+		moveAcceptance[moveNum] = 0.0;
+		}
+	numSurrogateEvals = 0;
+	numExactEvals = 0;
+	numOptimizerEvals = 0;
+	numModes = 0;
 	Systems = new kali::CARMA[numThreads];
 	setSystemsVec = static_cast<bool*>(_mm_malloc(numThreads*sizeof(double),64));
 	ThetaVec = static_cast<double*>(_mm_malloc(numThreads*(kali::CARMATask::r + p + q + 1)*sizeof(double),64));
@@ -86,6 +101,28 @@ int kali::CARMATask::reset_CARMATask(int pGiven, int qGiven, int numBurn) {
 
 int kali::CARMATask::get_numBurn() {return numBurn;}
 void kali::CARMATask::set_numBurn(int numBurn) {numBurn = numBurn;}
+double kali::CARMATask::get_samplerUtilization() {return samplerUtilization;}
+
+double kali::CARMATask::get_lnEvidence() {return lnEvidence;}
+
+double kali::CARMATask::get_lnEvidenceErr() {return lnEvidenceErr;}
+
+bool kali::CARMATask::get_nestConverged() {return nestConverged;}
+
+void kali::CARMATask::get_moveStats(double *Weights, double *Acceptance) {
+	for (int moveNum = 0; moveNum < kali::NUM_MOVE_TYPES; ++moveNum) {
+		Weights[moveNum] = moveWeights[moveNum];
+		Acceptance[moveNum] = moveAcceptance[moveNum];
+		}
+	}
+
+long kali::CARMATask::get_numSurrogateEvals() {return numSurrogateEvals;}
+
+long kali::CARMATask::get_numExactEvals() {return numExactEvals;}
+
+long kali::CARMATask::get_numOptimizerEvals() {return numOptimizerEvals;}
+
+int kali::CARMATask::get_numModes() {return numModes;}
 
 int kali::CARMATask::check_Theta(double *Theta, int threadNum) {
 	return Systems[threadNum].checkCARMAParams(Theta);
@@ -93,6 +130,21 @@ int kali::CARMATask::check_Theta(double *Theta, int threadNum) {
 
 double kali::CARMATask::get_dt(int threadNum) {return Systems[threadNum].get_dt();}
 
+int kali::CARMATask::get_rngMode() {return Systems[0].get_rngMode();}
+
+int kali::CARMATask::set_rngMode(int mode) {
+	/*!
+	Select how the simulators draw their random numbers (see kali::RNGMode) on every thread. Returns -1 and leaves the mode unchanged if mode is unknown.
+	*/
+	if ((mode != kali::RNG_PER_CADENCE) and (mode != kali::RNG_BLOCK)) {
+		return -1;
+		}
+	for (int threadNum = 0; threadNum < numThreads; ++threadNum) {
+		Systems[threadNum].set_rngMode(mode);
+		}
+	return 0;
+	}
+
 void kali::CARMATask::get_Theta(double *Theta, int threadNum) {
 	for (int i = 0; i < (kali::CARMATask::r + p + q + 1); ++i) {
 		Theta[i] = ThetaVec[i + threadNum*(kali::CARMATask::r + p + q + 1)];
@@ -246,6 +298,7 @@ int kali::CARMATask::set_P(double *newP, int threadNum) {
 	}
 
 int kali::CARMATask::make_IntrinsicLC(int numCadences, double tolIR, double fracIntrinsicVar, double fracNoiseToSignal, double *t, double *x, double *y, double *yerr, double *mask, double *lcX, double *lcP, unsigned int burnSeed, unsigned int distSeed, int threadNum) {
+	kali::ThreadLease lease(kali::CARMA_TASK, 1);
 	int retVal = 0;
 	Systems[threadNum].resetState();
 	double old_dt = Systems[threadNum].get_dt();
@@ -277,7 +330,26 @@ int kali::CARMATask::make_IntrinsicLC(int numCadences, double tolIR, double frac
 	return retVal;
 	}
 
+int kali::CARMATask::make_CirculantLC(int numCadences, double tolIR, double *t, double *x, double *y, double *yerr, double *mask, unsigned int distSeed, int threadNum) {
+	/*!
+	Same as make_IntrinsicLC for regularly sampled cadences, but drawn exactly from the stationary process by CARMA::simulateCirculant instead of by burning in and running the Kalman recursion. The draw leaves no Kalman state behind, so a circulant light curve cannot be continued with extend_IntrinsicLC. Returns the status of simulateCirculant.
+	*/
+	kali::ThreadLease lease(kali::CARMA_TASK, numThreads);
+	kali::LnLikeData Data;
+	Data.numCadences = numCadences;
+	Data.tolIR = tolIR;
+	Data.t = t;
+	Data.x = x;
+	Data.y = y;
+	Data.yerr = yerr;
+	Data.mask = mask;
+	kali::LnLikeData *ptr2Data = &Data;
+	int retVal = Systems[threadNum].simulateCirculant(ptr2Data, distSeed);
+	return retVal;
+	}
+
 int kali::CARMATask::extend_IntrinsicLC(int numCadences, int cadenceNum, double tolIR, double fracIntrinsicVar, double fracNoiseToSignal, double *t, double *x, double *y, double *yerr, double *mask, double *lcX, double *lcP, unsigned int distSeed, int threadNum) {
+	kali::ThreadLease lease(kali::CARMA_TASK, 1);
 	int retVal = 0;
 	double old_dt = Systems[threadNum].get_dt();
 	double* distRand = static_cast<double*>(_mm_malloc((numCadences - cadenceNum - 1)*p*sizeof(double),64));
@@ -315,6 +387,7 @@ double kali::CARMATask::get_meanFlux(double fracIntrinsicVar, int threadNum) {
 	}
 
 int kali::CARMATask::make_ObservedLC(int numCadences, double tolIR, double fracIntrinsicVar, double fracNoiseToSignal, double *t, double *x, double *y, double *yerr, double *mask, unsigned int burnSeed, unsigned int distSeed, unsigned int noiseSeed, int threadNum) {
+	kali::ThreadLease lease(kali::CARMA_TASK, 1);
 	int retVal = 0;
 	double old_dt = Systems[threadNum].get_dt();
 	double* burnRand = static_cast<double*>(_mm_malloc(numBurn*p*sizeof(double),64));
@@ -349,7 +422,74 @@ int kali::CARMATask::make_ObservedLC(int numCadences, double tolIR, double fracI
 	return retVal;
 	}
 
+int kali::CARMATask::make_ObservedLCBatch(int numLCs, int *cadenceOffsets, double tolIR, double *Theta, double *fracIntrinsicVar, double *fracNoiseToSignal, double *t, double *x, double *y, double *yerr, double *mask, unsigned int *burnSeeds, unsigned int *distSeeds, unsigned int *noiseSeeds, int *Status) {
+	/*!
+	Simulate numLCs mock light curves packed end to end: light curve lcNum has parameters Theta[lcNum*(p + q + 1)] to Theta[(lcNum + 1)*(p + q + 1) - 1] and occupies cadences cadenceOffsets[lcNum] to cadenceOffsets[lcNum + 1] - 1 of t, x, y, yerr and mask. x receives the intrinsic flux and y and yerr the observed flux and its error, exactly as make_IntrinsicLC followed by add_ObservationNoise would produce them with the seeds burnSeeds[lcNum], distSeeds[lcNum] and noiseSeeds[lcNum], so every light curve has its own random streams and the result does not depend on the number of threads. Status[lcNum] is 0 on success and -1 if Theta is not a valid C-ARMA model or the light curve has fewer than two cadences (its x, y and yerr are then zero). The light curves are spread over the threads, each thread using its own scratch CARMA system and reusing one set of random-number buffers for all of its light curves; the task's own systems, and any Theta or state set on them with set_System, are left untouched. Returns the number of light curves simulated.
+	*/
+	kali::ThreadLease lease(kali::CARMA_TASK, numThreads);
+	int leasedThreads = lease.get_numThreads();
+	int nthreads = leasedThreads;
+	int ndims = p + q + 1;
+	int maxCadences = 0;
+	for (int lcNum = 0; lcNum < numLCs; ++lcNum) {
+		maxCadences = max(maxCadences, cadenceOffsets[lcNum + 1] - cadenceOffsets[lcNum]);
+		}
+	double *burnRand = static_cast<double*>(_mm_malloc(leasedThreads*numBurn*p*sizeof(double),64));
+	double *distRand = static_cast<double*>(_mm_malloc(leasedThreads*maxCadences*p*sizeof(double),64));
+	double *noiseRand = static_cast<double*>(_mm_malloc(leasedThreads*maxCadences*sizeof(double),64));
+	kali::CARMA *BatchSystems = new kali::CARMA[leasedThreads];
+	for (int threadNum = 0; threadNum < leasedThreads; ++threadNum) {
+		BatchSystems[threadNum].allocCARMA(p, q);
+		}
+	int numSuccess = 0;
+	#pragma omp parallel for schedule(dynamic) default(none) shared(numLCs, cadenceOffsets, tolIR, Theta, fracIntrinsicVar, fracNoiseToSignal, t, x, y, yerr, mask, burnSeeds, distSeeds, noiseSeeds, Status, ndims, maxCadences, burnRand, distRand, noiseRand, BatchSystems) reduction(+:numSuccess) num_threads(nthreads)
+	for (int lcNum = 0; lcNum < numLCs; ++lcNum) {
+		int threadNum = omp_get_thread_num();
+		int offset = cadenceOffsets[lcNum];
+		int numCadences = cadenceOffsets[lcNum + 1] - offset;
+		kali::CARMA &System = BatchSystems[threadNum];
+		if ((numCadences < 2) or (System.checkCARMAParams(&Theta[lcNum*ndims]) != 1)) {
+			for (int cadenceNum = offset; cadenceNum < offset + numCadences; ++cadenceNum) {
+				x[cadenceNum] = 0.0;
+				y[cadenceNum] = 0.0;
+				yerr[cadenceNum] = 0.0;
+				}
+			Status[lcNum] = -1;
+			continue;
+			}
+		System.set_dt(t[offset + 1] - t[offset]);
+		System.setCARMA(&Theta[lcNum*ndims]);
+		System.solveCARMA();
+		System.resetState();
+		System.burnSystem(numBurn, burnSeeds[lcNum], &burnRand[threadNum*numBurn*p]);
+		kali::LnLikeData Data;
+		Data.numCadences = numCadences;
+		Data.tolIR = tolIR;
+		Data.t = &t[offset];
+		Data.x = &x[offset];
+		Data.y = &y[offset];
+		Data.yerr = &yerr[offset];
+		Data.mask = &mask[offset];
+		Data.fracIntrinsicVar = fracIntrinsicVar[lcNum];
+		Data.fracNoiseToSignal = fracNoiseToSignal[lcNum];
+		kali::LnLikeData *ptr2Data = &Data;
+		System.simulateSystem(ptr2Data, distSeeds[lcNum], &distRand[threadNum*maxCadences*p]);
+		System.observeNoise(ptr2Data, noiseSeeds[lcNum], &noiseRand[threadNum*maxCadences]);
+		Status[lcNum] = 0;
+		numSuccess += 1;
+		}
+	_mm_free(burnRand);
+	_mm_free(distRand);
+	_mm_free(noiseRand);
+	for (int threadNum = 0; threadNum < leasedThreads; ++threadNum) {
+		BatchSystems[threadNum].deallocCARMA();
+		}
+	delete[] BatchSystems;
+	return numSuccess;
+	}
+
 int kali::CARMATask::add_ObservationNoise(int numCadences, double tolIR, double fracIntrinsicVar, double fracNoiseToSignal, double *t, double *x, double *y, double *yerr, double *mask, unsigned int noiseSeed, int threadNum) {
+	kali::ThreadLease lease(kali::CARMA_TASK, 1);
 	int retVal = 0;
 	kali::LnLikeData Data;
 	Data.numCadences = numCadences;
@@ -372,6 +512,7 @@ int kali::CARMATask::add_ObservationNoise(int numCadences, double tolIR, double
 	}
 
 int kali::CARMATask::extend_ObservationNoise(int numCadences, int cadenceNum, double tolIR, double fracIntrinsicVar, double fracNoiseToSignal, double *t, double *x, double *y, double *yerr, double *mask, unsigned int noiseSeed, int threadNum) {
+	kali::ThreadLease lease(kali::CARMA_TASK, 1);
 	int retVal = 0;
 	kali::LnLikeData Data;
 	Data.numCadences = numCadences;
@@ -432,6 +573,7 @@ double kali::CARMATask::update_LnPrior(int numCadences, int cadenceNum, double t
 	}
 
 double kali::CARMATask::compute_LnLikelihood(int numCadences, int cadenceNum, double tolIR, double *t, double *x, double *y, double *yerr, double *mask, double *lcX, double *lcP, int threadNum) {
+	kali::ThreadLease lease(kali::CARMA_TASK, 1);
 	double LnLikelihood = 0.0;
 	kali::LnLikeData Data;
 	Data.numCadences = numCadences;
@@ -460,6 +602,7 @@ double kali::CARMATask::compute_LnLikelihood(int numCadences, int cadenceNum, do
 	}
 
 double kali::CARMATask::update_LnLikelihood(int numCadences, int cadenceNum, double currentLnLikelihood, double tolIR, double *t, double *x, double *y, double *yerr, double *mask, double *lcX, double *lcP, int threadNum) {
+	kali::ThreadLease lease(kali::CARMA_TASK, 1);
 	double LnLikelihood = 0.0;
 	kali::LnLikeData Data;
 	Data.numCadences = numCadences;
@@ -491,6 +634,7 @@ double kali::CARMATask::update_LnLikelihood(int numCadences, int cadenceNum, dou
 	}
 
 double kali::CARMATask::compute_LnPosterior(int numCadences, int cadenceNum, double tolIR, double maxSigma, double minTimescale, double maxTimescale, double *t, double *x, double *y, double *yerr, double *mask, double *lcX, double *lcP, int threadNum) {
+	kali::ThreadLease lease(kali::CARMA_TASK, 1);
 	double LnPrior = 0.0, LnLikelihood = 0.0, LnPosterior = 0.0;
 	kali::LnLikeData Data;
 	Data.numCadences = numCadences;
@@ -522,6 +666,7 @@ double kali::CARMATask::compute_LnPosterior(int numCadences, int cadenceNum, dou
 	}
 
 double kali::CARMATask::update_LnPosterior(int numCadences, int cadenceNum, double currentLnLikelihood, double tolIR, double maxSigma, double minTimescale, double maxTimescale, double *t, double *x, double *y, double *yerr, double *mask, double *lcX, double *lcP, int threadNum) {
+	kali::ThreadLease lease(kali::CARMA_TASK, 1);
 	double LnPrior = 0.0, LnLikelihood = 0.0, LnPosterior = 0.0;
 	kali::LnLikeData Data;
 	Data.numCadences = numCadences;
@@ -560,8 +705,9 @@ void kali::CARMATask::compute_ACVF(int numLags, double *Lags, double *ACVF, int
 	Systems[threadNum].computeACVF(numLags, Lags, ACVF);
 	}
 
-int kali::CARMATask::fit_CARMAModel(double dt, int numCadences, double tolIR, double maxSigma, double minTimescale, double maxTimescale, double *t, double *x, double *y, double *yerr, double *mask, int nwalkers, int nsteps, int maxEvals, double xTol, double mcmcA, unsigned int zSSeed, unsigned int walkerSeed, unsigned int moveSeed, unsigned int xSeed, double* xStart, double *Chain, double *LnPrior, double *LnLikelihood, bool Bp) {
-	omp_set_num_threads(numThreads);
+int kali::CARMATask::fit_CARMAModel(double dt, int numCadences, double tolIR, double maxSigma, double minTimescale, double maxTimescale, double *t, double *x, double *y, double *yerr, double *mask, int nwalkers, int nsteps, int maxEvals, double xTol, double mcmcA, unsigned int zSSeed, unsigned int walkerSeed, unsigned int moveSeed, unsigned int xSeed, double* xStart, double *Chain, double *LnPrior, double *LnLikelihood, bool Bp, int samplerType, double *MoveWeights, int numAdaptSteps, int surrogateBin, int numOptStarts) {
+	kali::ThreadLease lease(kali::CARMA_TASK, numThreads);
+	int leasedThreads = lease.get_numThreads();
 	int ndims = p + q + 1;
 	int threadNum = omp_get_thread_num();
 	kali::LnLikeData Data;
@@ -585,7 +731,7 @@ int kali::CARMATask::fit_CARMAModel(double dt, int numCadences, double tolIR, do
 	#endif
 	kali::LnLikeData *ptr2Data = &Data;
 	kali::LnLikeArgs Args;
-	Args.numThreads = numThreads;
+	Args.numThreads = leasedThreads;
 	Args.Data = ptr2Data;
 	Args.Systems = nullptr;
 	void* p2Args = nullptr;
@@ -593,11 +739,11 @@ int kali::CARMATask::fit_CARMAModel(double dt, int numCadences, double tolIR, do
 	p2Args = &Args;
 	double LnLikeVal = 0.0;
 	double *initPos = nullptr, *offsetArr = nullptr;
-	vector<vector<double>> xVec (numThreads, vector<double>(ndims));
+	vector<vector<double>> xVec (leasedThreads, vector<double>(ndims));
 	initPos = static_cast<double*>(_mm_malloc(nwalkers*ndims*sizeof(double),64));
-	int nthreads = numThreads;
-	nlopt::opt *optArray[numThreads];
-	for (int i = 0; i < numThreads; ++i) {
+	int nthreads = leasedThreads;
+	nlopt::opt *optArray[leasedThreads];
+	for (int i = 0; i < leasedThreads; ++i) {
 		//optArray[i] = new nlopt::opt(nlopt::LN_BOBYQA, ndims); // Fastest
 		optArray[i] = new nlopt::opt(nlopt::LN_NELDERMEAD, ndims); // Slower
 		//optArray[i] = new nlopt::opt(nlopt::LN_COBYLA, ndims); // Slowest
@@ -606,67 +752,623 @@ int kali::CARMATask::fit_CARMAModel(double dt, int numCadences, double tolIR, do
 		optArray[i]->set_xtol_rel(xTol);
 		//optArray[i]->set_maxtime(60.0); // Timeout after 60 sec.
 		}
-	double *max_LnPosterior = static_cast<double*>(_mm_malloc(numThreads*sizeof(double),64));
+	double *max_LnPosterior = static_cast<double*>(_mm_malloc(leasedThreads*sizeof(double),64));
 	kali::CARMA *ptrToSystems = Systems;
-	#pragma omp parallel for default(none) shared(dt, nwalkers, ndims, optArray, initPos, xStart, t, ptrToSystems, xVec, max_LnPosterior, p2Args, Bp)
-	for (int walkerNum = 0; walkerNum < nwalkers; ++walkerNum) {
-		int threadNum = omp_get_thread_num();
-		max_LnPosterior[threadNum] = 0.0;
-		xVec[threadNum].clear();
-		set_System(t[1] - t[0], &xStart[walkerNum*ndims], threadNum);
-		for (int dimCtr = 0; dimCtr < ndims; ++dimCtr) {
-			xVec[threadNum].push_back(xStart[walkerNum*ndims + dimCtr]);
+	vector<long> optEvals(leasedThreads, 0);
+	numModes = 0;
+	if ((not Bp) and (numOptStarts > 0)) {
+		/*!
+		Rather than optimizing every walker, optimize from the first numStarts = min(numOptStarts, nwalkers) starting points in parallel and merge the optima that lie within a Mahalanobis distance of 3 of a mode already found, in order of decreasing posterior. Each new mode gets a Laplace approximation (kali::laplaceApproximation), falling back to independent Gaussians with a standard deviation of 1% of each coordinate if its Hessian is not negative definite. The walkers are then drawn from the resulting Gaussian mixture, each mode weighted by its Laplace integral (modes without one get the smallest Laplace integral of the others, or equal weights if no mode has one), redrawing any point that falls outside the prior, so the ensemble starts spread over the local curvature of every mode instead of collapsed onto a few points.
+		*/
+		int numStarts = min(numOptStarts, nwalkers);
+		double noPosterior = -kali::infiniteVal;
+		vector<double> optima(numStarts*ndims), optLnPost(numStarts, noPosterior);
+		#pragma omp parallel for schedule(dynamic) default(none) shared(numStarts, ndims, optArray, xStart, t, optima, optLnPost, optEvals)
+		for (int startNum = 0; startNum < numStarts; ++startNum) {
+			int threadNum = omp_get_thread_num();
+			vector<double> xOpt(&xStart[startNum*ndims], &xStart[(startNum + 1)*ndims]);
+			set_System(t[1] - t[0], &xStart[startNum*ndims], threadNum);
+			try {
+				optArray[threadNum]->optimize(xOpt, optLnPost[startNum]);
+				} catch (std::exception &e) {
+				/*!
+				nlopt reports roundoff-limited and similar early stops by throwing; xOpt and optLnPost[startNum] still hold the best point found.
+				*/
+				}
+			optEvals[threadNum] += optArray[threadNum]->get_numevals();
+			for (int dimNum = 0; dimNum < ndims; ++dimNum) {
+				optima[dimNum + startNum*ndims] = xOpt[dimNum];
+				}
 			}
-		#ifdef DEBUG_FIT_CARMAMODEL
-			#pragma omp critical
-			{
-			fflush(0);
-			printf("pre-opt xVec[%d][%d]: ", walkerNum, threadNum);
-			for (int dimNum = 0; dimNum < ndims - 1; ++dimNum) {
-				printf("%e, ", xVec[threadNum][dimNum]);
-				}
-			printf("%e", xVec[threadNum][ndims - 1]);
-			max_LnPosterior[threadNum] = kali::calcLnPosterior(&xStart[walkerNum*ndims], p2Args);
-			printf("; init_LnPosterior: %17.16e\n", max_LnPosterior[threadNum]);
-			fflush(0);
-			max_LnPosterior[threadNum] = 0.0;
+
+		vector<int> order(numStarts);
+		for (int startNum = 0; startNum < numStarts; ++startNum) {
+			order[startNum] = startNum;
+			}
+		sort(order.begin(), order.end(), [&optLnPost](int i, int j) {return optLnPost[i] > optLnPost[j];});
+		vector<double> modePos, modeChol, modeLnWeight, work(ndims);
+		vector<bool> modeHasLaplace;
+		for (int rank = 0; rank < numStarts; ++rank) {
+			double *xOpt = &optima[order[rank]*ndims];
+			if (not isfinite(optLnPost[order[rank]])) {
+				continue;
+				}
+			bool knownMode = false;
+			for (int modeNum = 0; (modeNum < numModes) and (not knownMode); ++modeNum) {
+				double *chol = &modeChol[modeNum*ndims*ndims], distSq = 0.0;
+				for (int i = 0; i < ndims; ++i) {
+					double sum = xOpt[i] - modePos[i + modeNum*ndims];
+					for (int j = 0; j < i; ++j) {
+						sum -= chol[j + i*ndims]*work[j];
+						}
+					work[i] = sum/chol[i + i*ndims];
+					distSq += work[i]*work[i];
+					}
+				knownMode = (distSq < 9.0);
+				}
+			if (knownMode) {
+				continue;
+				}
+			vector<double> cov(ndims*ndims, 0.0);
+			double lnPostMAP = 0.0, lnLaplace = 0.0;
+			long laplaceEvals = 0;
+			set_System(t[1] - t[0], xOpt, 0);
+			int laplaceStatus = kali::laplaceApproximation(ndims, xOpt, kali::calcLnPosterior, p2Args, &cov[0], lnPostMAP, lnLaplace, laplaceEvals);
+			optEvals[0] += laplaceEvals;
+			bool hasLaplace = (laplaceStatus == 0) and (LAPACKE_dpotrf(LAPACK_ROW_MAJOR, 'L', ndims, &cov[0], ndims) == 0);
+			if (not hasLaplace) {
+				for (int i = 0; i < ndims; ++i) {
+					for (int j = 0; j < ndims; ++j) {
+						cov[j + i*ndims] = (i == j) ? 1.0e-2*fabs(xOpt[i]) + 1.0e-10 : 0.0; // Cholesky factor, i.e. a 1% standard deviation
+						}
+					}
+				}
+			modePos.insert(modePos.end(), xOpt, xOpt + ndims);
+			modeChol.insert(modeChol.end(), cov.begin(), cov.end());
+			modeLnWeight.push_back(lnLaplace);
+			modeHasLaplace.push_back(hasLaplace);
+			numModes += 1;
+			}
+		double minLaplaceLnZ = 0.0;
+		bool anyLaplace = false;
+		for (int modeNum = 0; modeNum < numModes; ++modeNum) {
+			if (modeHasLaplace[modeNum] and ((not anyLaplace) or (modeLnWeight[modeNum] < minLaplaceLnZ))) {
+				minLaplaceLnZ = modeLnWeight[modeNum];
+				anyLaplace = true;
+				}
+			}
+		for (int modeNum = 0; modeNum < numModes; ++modeNum) {
+			if (not modeHasLaplace[modeNum]) {
+				modeLnWeight[modeNum] = minLaplaceLnZ;
+				}
 			}
-		#endif
 
-		//if Bp (bypass nplot) is false, then do nlopt optimization.
-		if(!Bp){
-			nlopt::result yesno = optArray[threadNum]->optimize(xVec[threadNum], max_LnPosterior[threadNum]);
-		}
+		if (numModes == 0) {
+			for (int i = 0; i < nwalkers*ndims; ++i) {
+				initPos[i] = xStart[i];
+				}
+			} else {
+			double maxLnWeight = *max_element(modeLnWeight.begin(), modeLnWeight.end()), totalWeight = 0.0;
+			for (int modeNum = 0; modeNum < numModes; ++modeNum) {
+				totalWeight += exp(modeLnWeight[modeNum] - maxLnWeight);
+				}
+			VSLStreamStatePtr xStream;
+			vslNewStream(&xStream, VSL_BRNG_SFMT19937, xSeed);
+			vector<double> z(ndims);
+			for (int walkerNum = 0; walkerNum < nwalkers; ++walkerNum) {
+				double u = 0.0, cumWeight = 0.0;
+				vdRngUniform(VSL_RNG_METHOD_UNIFORM_STD, xStream, 1, &u, 0.0, totalWeight);
+				int modeNum = 0;
+				for (modeNum = 0; modeNum < numModes - 1; ++modeNum) {
+					cumWeight += exp(modeLnWeight[modeNum] - maxLnWeight);
+					if (u < cumWeight) {
+						break;
+						}
+					}
+				double *mode = &modePos[modeNum*ndims], *chol = &modeChol[modeNum*ndims*ndims], *walkerPos = &initPos[walkerNum*ndims];
+				double walkerLnPrior = 0.0, walkerLnLike = 0.0;
+				bool inPrior = false;
+				for (int attempt = 0; (attempt < 100) and (not inPrior); ++attempt) {
+					vdRngGaussian(VSL_RNG_METHOD_GAUSSIAN_ICDF, xStream, ndims, &z[0], 0.0, 1.0);
+					for (int i = 0; i < ndims; ++i) {
+						walkerPos[i] = mode[i];
+						for (int j = 0; j <= i; ++j) {
+							walkerPos[i] += chol[j + i*ndims]*z[j];
+							}
+						}
+					inPrior = isfinite(kali::calcLnPosterior(walkerPos, p2Args, walkerLnPrior, walkerLnLike));
+					}
+				if (not inPrior) {
+					for (int i = 0; i < ndims; ++i) {
+						walkerPos[i] = mode[i];
+						}
+					}
+				}
+			vslDeleteStream(&xStream);
+			}
+		} else {
+		#pragma omp parallel for default(none) shared(dt, nwalkers, ndims, optArray, initPos, xStart, t, ptrToSystems, xVec, max_LnPosterior, p2Args, Bp, optEvals)
+		for (int walkerNum = 0; walkerNum < nwalkers; ++walkerNum) {
+			int threadNum = omp_get_thread_num();
+			max_LnPosterior[threadNum] = 0.0;
+			xVec[threadNum].clear();
+			set_System(t[1] - t[0], &xStart[walkerNum*ndims], threadNum);
+			for (int dimCtr = 0; dimCtr < ndims; ++dimCtr) {
+				xVec[threadNum].push_back(xStart[walkerNum*ndims + dimCtr]);
+				}
+			#ifdef DEBUG_FIT_CARMAMODEL
+				#pragma omp critical
+				{
+				fflush(0);
+				printf("pre-opt xVec[%d][%d]: ", walkerNum, threadNum);
+				for (int dimNum = 0; dimNum < ndims - 1; ++dimNum) {
+					printf("%e, ", xVec[threadNum][dimNum]);
+					}
+				printf("%e", xVec[threadNum][ndims - 1]);
+				max_LnPosterior[threadNum] = kali::calcLnPosterior(&xStart[walkerNum*ndims], p2Args);
+				printf("; init_LnPosterior: %17.16e\n", max_LnPosterior[threadNum]);
+				fflush(0);
+				max_LnPosterior[threadNum] = 0.0;
+				}
+			#endif
 
-		#ifdef DEBUG_FIT_CARMAMODEL
-			#pragma omp critical
-			{
-			fflush(0);
-			printf("post-opt xVec[%d][%d]: ", walkerNum, threadNum);
-			for (int dimNum = 0; dimNum < ndims - 1; ++dimNum) {
-				printf("%e, ", xVec[threadNum][dimNum]);
+			//if Bp (bypass nplot) is false, then do nlopt optimization.
+			if(!Bp){
+				nlopt::result yesno = optArray[threadNum]->optimize(xVec[threadNum], max_LnPosterior[threadNum]);
+				optEvals[threadNum] += optArray[threadNum]->get_numevals();
+			}
+
+			#ifdef DEBUG_FIT_CARMAMODEL
+				#pragma omp critical
+				{
+				fflush(0);
+				printf("post-opt xVec[%d][%d]: ", walkerNum, threadNum);
+				for (int dimNum = 0; dimNum < ndims - 1; ++dimNum) {
+					printf("%e, ", xVec[threadNum][dimNum]);
+					}
+				printf("%e", xVec[threadNum][ndims  - 1]);
+				printf("; max_LnPosterior: %17.16e\n", max_LnPosterior[threadNum]);
+				fflush(0);
+				}
+			#endif
+			for (int dimNum = 0; dimNum < ndims; ++dimNum) {
+				initPos[walkerNum*ndims + dimNum] = xVec[threadNum][dimNum];
 				}
-			printf("%e", xVec[threadNum][ndims  - 1]);
-			printf("; max_LnPosterior: %17.16e\n", max_LnPosterior[threadNum]);
-			fflush(0);
 			}
-		#endif
-		for (int dimNum = 0; dimNum < ndims; ++dimNum) {
-			initPos[walkerNum*ndims + dimNum] = xVec[threadNum][dimNum];
+		if (Bp) {
+			/*!
+			Without the optimizer the walkers start exactly at xStart. When xStart is the final ensemble of an earlier fit (a warm start) some walkers may lie outside the prior of this light curve, e.g. after the light curve was extended or the prior bounds changed. Each such walker is restarted at a randomly chosen walker that is inside the prior; the sampler separates the copies within a few steps.
+			*/
+			vector<int> walkerOK(nwalkers, 0);
+			#pragma omp parallel for default(none) shared(nwalkers, ndims, initPos, t, p2Args, walkerOK)
+			for (int walkerNum = 0; walkerNum < nwalkers; ++walkerNum) {
+				double walkerLnPrior = 0.0, walkerLnLike = 0.0;
+				Systems[omp_get_thread_num()].set_dt(t[1] - t[0]);
+				walkerOK[walkerNum] = isfinite(kali::calcLnPosterior(&initPos[walkerNum*ndims], p2Args, walkerLnPrior, walkerLnLike)) ? 1 : 0;
+				}
+			vector<int> validWalkers;
+			for (int walkerNum = 0; walkerNum < nwalkers; ++walkerNum) {
+				if (walkerOK[walkerNum] == 1) {
+					validWalkers.push_back(walkerNum);
+					}
+				}
+			int numValid = validWalkers.size();
+			if ((numValid > 0) and (numValid < nwalkers)) {
+				VSLStreamStatePtr xStream;
+				vslNewStream(&xStream, VSL_BRNG_SFMT19937, xSeed);
+				for (int walkerNum = 0; walkerNum < nwalkers; ++walkerNum) {
+					if (walkerOK[walkerNum] == 1) {
+						continue;
+						}
+					double u = 0.0;
+					vdRngUniform(VSL_RNG_METHOD_UNIFORM_STD, xStream, 1, &u, 0.0, numValid);
+					int source = validWalkers[min(static_cast<int>(u), numValid - 1)];
+					for (int dimNum = 0; dimNum < ndims; ++dimNum) {
+						initPos[walkerNum*ndims + dimNum] = initPos[source*ndims + dimNum];
+						}
+					}
+				vslDeleteStream(&xStream);
+				}
 			}
 		}
-	for (int i = 0; i < numThreads; ++i) {
+	for (int i = 0; i < leasedThreads; ++i) {
 		delete optArray[i];
 		}
 	_mm_free(max_LnPosterior);
-	kali::EnsembleSampler newEnsemble = kali::EnsembleSampler(ndims, nwalkers, nsteps, numThreads, mcmcA, kali::calcLnPosterior, p2Args, zSSeed, walkerSeed, moveSeed);
-	newEnsemble.runMCMC(initPos);
+	numOptimizerEvals = 0;
+	for (int i = 0; i < leasedThreads; ++i) {
+		numOptimizerEvals += optEvals[i];
+		}
+	/*!
+	The synchronous ensemble sampler calls a per-thread CARMAPosterior evaluator directly rather than going through calcLnPosterior. MoveWeights selects the mixture of stretch, DE, DE-snooker and KDE moves (indexed by kali::MoveType), which adapts over the first numAdaptSteps steps. The other samplers ignore MoveWeights, numAdaptSteps and surrogateBin. There is no tempered C-ARMA fit, so PT_ENSEMBLE_SAMPLER runs the synchronous ensemble sampler.
+
+	If surrogateBin > 1, proposals are first screened with the Kalman filter run on the light curve binned by surrogateBin consecutive cadences (delayed acceptance, see BasicEnsembleSampler::setSurrogate). Each bin holds the mean time and flux of its unmasked cadences with the error of that mean; a bin with no unmasked cadences is masked out. The surrogate shares the prior of the exact posterior and reuses the per-thread Systems, whose dt the filter resets as needed, so the chain still samples the exact posterior.
+	*/
+	kali::LnLikeData SurrogateData = Data;
+	int numBins = (surrogateBin > 1) ? (numCadences + surrogateBin - 1)/surrogateBin : 0;
+	vector<double> tBin(numBins), xBin(numBins), yBin(numBins), yerrBin(numBins), maskBin(numBins);
+	if (numBins > 1) {
+		for (int binNum = 0; binNum < numBins; ++binNum) {
+			int firstCadence = binNum*surrogateBin, lastCadence = min(numCadences, (binNum + 1)*surrogateBin);
+			double numIn = 0.0, tSum = 0.0, tAll = 0.0, xSum = 0.0, ySum = 0.0, yerrSqSum = 0.0, yerrSqAll = 0.0;
+			for (int cadenceNum = firstCadence; cadenceNum < lastCadence; ++cadenceNum) {
+				tAll += t[cadenceNum];
+				yerrSqAll += yerr[cadenceNum]*yerr[cadenceNum];
+				if (mask[cadenceNum] == 1.0) {
+					numIn += 1.0;
+					tSum += t[cadenceNum];
+					xSum += x[cadenceNum];
+					ySum += y[cadenceNum];
+					yerrSqSum += yerr[cadenceNum]*yerr[cadenceNum];
+					}
+				}
+			if (numIn > 0.0) {
+				tBin[binNum] = tSum/numIn;
+				xBin[binNum] = xSum/numIn;
+				yBin[binNum] = ySum/numIn;
+				yerrBin[binNum] = sqrt(yerrSqSum)/numIn;
+				maskBin[binNum] = 1.0;
+				} else {
+				tBin[binNum] = tAll/(lastCadence - firstCadence);
+				xBin[binNum] = 0.0;
+				yBin[binNum] = 0.0;
+				yerrBin[binNum] = sqrt(yerrSqAll/(lastCadence - firstCadence));
+				maskBin[binNum] = 0.0;
+				}
+			}
+		SurrogateData.numCadences = numBins;
+		SurrogateData.t = &tBin[0];
+		SurrogateData.x = &xBin[0];
+		SurrogateData.y = &yBin[0];
+		SurrogateData.yerr = &yerrBin[0];
+		SurrogateData.mask = &maskBin[0];
+		}
+	kali::CARMAPosterior Surrogate(Systems, &SurrogateData);
+	int runType = (samplerType == kali::PT_ENSEMBLE_SAMPLER) ? kali::ENSEMBLE_SAMPLER : samplerType;
+	double fitLnEvidence = 0.0, fitLnEvidenceErr = 0.0;
+	long evalCounts[2] = {0, 0};
+	kali::runSampler(runType, ndims, nwalkers, nsteps, leasedThreads, mcmcA, 1, 1.0, kali::calcLnPosterior, p2Args, kali::CARMAPosterior(Systems, ptr2Data), (numBins > 1) ? &Surrogate : nullptr, MoveWeights, numAdaptSteps, zSSeed, walkerSeed, moveSeed, initPos, Chain, LnPrior, LnLikelihood, samplerUtilization, fitLnEvidence, fitLnEvidenceErr, moveWeights, moveAcceptance, evalCounts);
+	numSurrogateEvals = evalCounts[0];
+	numExactEvals = evalCounts[1];
 	_mm_free(initPos);
-	newEnsemble.getChain(Chain);
-	newEnsemble.getChainVals(LnPrior, LnLikelihood);
 	return 0;
 	}
 
+int kali::CARMATask::nest_CARMAModel(double dt, int numCadences, double tolIR, double maxSigma, double minTimescale, double maxTimescale, double *t, double *x, double *y, double *yerr, double *mask, int numLive, double lnZTol, int maxIter, unsigned int nestSeed, int numStart, double *xStart, int maxSamples, double *Samples, double *LnPrior, double *LnLikelihood, double *LnWeight) {
+	/*!
+	Compute the evidence for the CARMA(p,q) model by nested sampling, using the same prior and likelihood as fit_CARMAModel. xStart holds numStart valid starting points; they only seed the live set and need not be drawn from the prior. At most numLive + maxIter weighted posterior samples are written to Samples (ndims per sample), LnPrior, LnLikelihood and LnWeight, which must hold maxSamples >= numLive + maxIter entries, where the weights are normalized so that sum(exp(LnWeight)) = 1. The evidence and its error are available afterwards from get_lnEvidence and get_lnEvidenceErr; get_nestConverged is false if maxIter ran out before the lnZTol criterion was met. Returns the number of samples, or -1 if a starting point lies outside the prior or the buffers are too small.
+	*/
+	kali::ThreadLease lease(kali::CARMA_TASK, numThreads);
+	int leasedThreads = lease.get_numThreads();
+	int ndims = p + q + 1;
+	kali::LnLikeData Data;
+	Data.numCadences = numCadences;
+	Data.tolIR = tolIR;
+	Data.t = t;
+	Data.x = x;
+	Data.y = y;
+	Data.yerr = yerr;
+	Data.mask = mask;
+	Data.maxSigma = maxSigma;
+	Data.minTimescale = minTimescale;
+	Data.maxTimescale = maxTimescale;
+	kali::LnLikeData *ptr2Data = &Data;
+	kali::LnLikeArgs Args;
+	Args.numThreads = leasedThreads;
+	Args.Data = ptr2Data;
+	Args.Systems = Systems;
+	void* p2Args = &Args;
+	for (int threadNum = 0; threadNum < leasedThreads; ++threadNum) {
+		set_System(dt, &xStart[(threadNum%numStart)*ndims], threadNum);
+		}
+	lnEvidence = 0.0;
+	lnEvidenceErr = 0.0;
+	nestConverged = false;
+	kali::NestedSampler newSampler = kali::NestedSampler(ndims, numLive, leasedThreads, lnZTol, maxIter, kali::calcLnPosterior, p2Args, nestSeed);
+	if (newSampler.runNestedSampling(xStart, numStart) != 0) {
+		return -1;
+		}
+	lnEvidence = newSampler.getLnEvidence(lnEvidenceErr);
+	nestConverged = newSampler.getConverged();
+	int numSamples = newSampler.getNumSamples();
+	if (numSamples > maxSamples) {
+		return -1;
+		}
+	newSampler.getSamples(Samples, LnPrior, LnLikelihood, LnWeight);
+	return numSamples;
+	}
+
+int kali::CARMATask::laplace_CARMAModel(int numLCs, int *cadenceOffsets, double tolIR, double *maxSigma, double *minTimescale, double *maxTimescale, double *t, double *x, double *y, double *yerr, double *mask, int numStarts, double *xStart, int maxEvals, double xTol, double *MAP, double *Cov, double *LnPosteriorMAP, double *LnLaplace, int *Status) {
+	/*!
+	Fast Laplace-approximation fit of numLCs light curves packed end to end: light curve lcNum occupies cadences cadenceOffsets[lcNum] to cadenceOffsets[lcNum + 1] - 1 of t, x, y, yerr and mask, and has its own prior bounds maxSigma[lcNum], minTimescale[lcNum] and maxTimescale[lcNum]. For each light curve nlopt maximizes calcLnPosterior from the numStarts starting points xStart[(startNum + lcNum*numStarts)*ndims], and kali::laplaceApproximation is applied at the best optimum. MAP (ndims per light curve), Cov (ndims*ndims per light curve), LnPosteriorMAP and LnLaplace (the unnormalized log Laplace integral of kali::laplaceApproximation, not an evidence) receive the results, and Status[lcNum] is 0 on success, -1 if the Hessian at the MAP is not negative definite (MAP is still set) and -2 if no starting point was valid. The work is parallel over light curves, each thread using its own CARMA system, optimizer and copy of the data description, so numLCs should be large compared to the number of threads. Returns the number of successful fits.
+	*/
+	kali::ThreadLease lease(kali::CARMA_TASK, numThreads);
+	int leasedThreads = lease.get_numThreads();
+	int ndims = p + q + 1;
+	int nthreads = leasedThreads;
+	vector<kali::LnLikeData> DataVec(leasedThreads);
+	vector<kali::LnLikeArgs> ArgsVec(leasedThreads);
+	nlopt::opt *optArray[leasedThreads];
+	for (int i = 0; i < leasedThreads; ++i) {
+		DataVec[i].tolIR = tolIR;
+		ArgsVec[i].numThreads = leasedThreads;
+		ArgsVec[i].Systems = Systems;
+		ArgsVec[i].Data = &DataVec[i];
+		optArray[i] = new nlopt::opt(nlopt::LN_NELDERMEAD, ndims);
+		optArray[i]->set_max_objective(kali::calcLnPosterior, &ArgsVec[i]);
+		optArray[i]->set_maxeval(maxEvals);
+		optArray[i]->set_xtol_rel(xTol);
+		}
+	int numSuccess = 0;
+	double noPosterior = -kali::infiniteVal;
+	#pragma omp parallel for schedule(dynamic) default(none) shared(numLCs, cadenceOffsets, maxSigma, minTimescale, maxTimescale, t, x, y, yerr, mask, numStarts, xStart, ndims, DataVec, ArgsVec, optArray, noPosterior, MAP, Cov, LnPosteriorMAP, LnLaplace, Status) reduction(+:numSuccess) num_threads(nthreads)
+	for (int lcNum = 0; lcNum < numLCs; ++lcNum) {
+		int threadNum = omp_get_thread_num();
+		int offset = cadenceOffsets[lcNum];
+		kali::LnLikeData &Data = DataVec[threadNum];
+		Data.numCadences = cadenceOffsets[lcNum + 1] - offset;
+		Data.t = &t[offset];
+		Data.x = &x[offset];
+		Data.y = &y[offset];
+		Data.yerr = &yerr[offset];
+		Data.mask = &mask[offset];
+		Data.maxSigma = maxSigma[lcNum];
+		Data.minTimescale = minTimescale[lcNum];
+		Data.maxTimescale = maxTimescale[lcNum];
+		vector<double> xVec(ndims), xBest(ndims);
+		double bestLnPosterior = noPosterior;
+		for (int startNum = 0; startNum < numStarts; ++startNum) {
+			double *start = &xStart[(startNum + lcNum*numStarts)*ndims];
+			if (set_System(t[offset + 1] - t[offset], start, threadNum) != 0) {
+				continue;
+				}
+			xVec.assign(start, start + ndims);
+			double maxLnPosterior = noPosterior;
+			try {
+				optArray[threadNum]->optimize(xVec, maxLnPosterior);
+				} catch (std::exception &e) {
+				/*!
+				nlopt reports roundoff-limited and similar early stops by throwing; xVec and maxLnPosterior still hold the best point found.
+				*/
+				}
+			if (maxLnPosterior > bestLnPosterior) {
+				bestLnPosterior = maxLnPosterior;
+				xBest = xVec;
+				}
+			}
+		for (int dimNum = 0; dimNum < ndims; ++dimNum) {
+			MAP[dimNum + lcNum*ndims] = xBest[dimNum];
+			}
+		if (bestLnPosterior == noPosterior) {
+			for (int i = 0; i < ndims*ndims; ++i) {
+				Cov[i + lcNum*ndims*ndims] = 0.0;
+				}
+			LnPosteriorMAP[lcNum] = noPosterior;
+			LnLaplace[lcNum] = noPosterior;
+			Status[lcNum] = -2;
+			} else {
+			long numEvals = 0;
+			Status[lcNum] = kali::laplaceApproximation(ndims, &MAP[lcNum*ndims], kali::calcLnPosterior, &ArgsVec[threadNum], &Cov[lcNum*ndims*ndims], LnPosteriorMAP[lcNum], LnLaplace[lcNum], numEvals);
+			numSuccess += (Status[lcNum] == 0) ? 1 : 0;
+			}
+		}
+	for (int i = 0; i < leasedThreads; ++i) {
+		delete optArray[i];
+		}
+	return numSuccess;
+	}
+
+int kali::searchCARMAOrders(int numOrders, int *pVals, int *qVals, int numThreads, int numCadences, double tolIR, double maxSigma, double minTimescale, double maxTimescale, double *t, double *x, double *y, double *yerr, double *mask, int minGapRun, int numStarts, unsigned int startSeed, int maxEvals, double xTol, double *MAP, double *Cov, double *LnPosteriorMAP, double *BIC, int *Status) {
+	/*!
+	Model-order search: MAP, Laplace covariance and Bayesian information criterion of one light curve (y already mean subtracted, absolute prior bounds) for each of the numOrders C-ARMA orders (pVals[orderNum], qVals[orderNum]). The results are packed in order: MAP holds p + q + 1 values and Cov (p + q + 1)^2 values per order, so the offsets of an order are the sums of those sizes over the preceding orders. Status[orderNum] is 0 on success, -1 if the Hessian at the MAP is not negative definite (MAP and BIC are still set), -2 if no starting point was valid and -3 if the order itself is invalid. Returns the number of successful orders.
+
+	The orders are meant to be ranked by BIC[orderNum] = -2 ln L(MAP) + (p + q + 1) ln(numObserved), lower being better, which is +infinity for orders without a MAP. The Laplace integral is not used for ranking: the C-ARMA prior is an unnormalized indicator of its support, so that integral has no prior-volume term, does not penalize higher orders and changes with the units of the parameters.
+
+	The cadences are preprocessed once and shared read-only by all orders. Leading and trailing runs of masked cadences are dropped and interior runs of at least minGapRun masked cadences (0 keeps them all) are collapsed into the gap between the unmasked cadences around them. This leaves the likelihood unchanged, since a masked cadence only propagates the state and F(dt1)F(dt2) = F(dt1 + dt2), but saves one Kalman step per dropped cadence at the cost of re-solving the system across the gap.
+
+	The orders are spread over the threads of one lease, largest first, each order being optimized by one thread with its own CARMA system. The numStarts starting points of order orderNum are drawn from VSL_BRNG_MT2203 stream orderNum, as in CARMATask.fit: log-uniform real roots between minTimescale and maxTimescale and a variance that starts at the data variance and is reduced until the prior is satisfied, so the results depend on startSeed but not on the number of threads.
+	*/
+	kali::ThreadLease lease(kali::CARMA_TASK, numThreads);
+	numThreads = lease.get_numThreads();
+	int nthreads = numThreads;
+	int r = 0;
+	double noPosterior = -kali::infiniteVal, noBIC = kali::infiniteVal;
+
+	vector<int> MAPOffsets(numOrders + 1, 0), CovOffsets(numOrders + 1, 0), Orders(numOrders);
+	for (int orderNum = 0; orderNum < numOrders; ++orderNum) {
+		int ndims = pVals[orderNum] + qVals[orderNum] + 1;
+		MAPOffsets[orderNum + 1] = MAPOffsets[orderNum] + ndims;
+		CovOffsets[orderNum + 1] = CovOffsets[orderNum] + ndims*ndims;
+		Orders[orderNum] = orderNum;
+		}
+	stable_sort(Orders.begin(), Orders.end(), [pVals, qVals](int a, int b) {return (pVals[a] > pVals[b]) or ((pVals[a] == pVals[b]) and (qVals[a] > qVals[b]));});
+
+	int first = 0, last = numCadences - 1;
+	while ((first < numCadences) and (mask[first] == 0.0)) {
+		++first;
+		}
+	while ((last > first) and (mask[last] == 0.0)) {
+		--last;
+		}
+	vector<double> tShared, xShared, yShared, yerrShared, maskShared;
+	double ySum = 0.0, ySqSum = 0.0, numObserved = 0.0;
+	int cadenceNum = first;
+	while (cadenceNum <= last) {
+		int runEnd = cadenceNum;
+		while ((runEnd <= last) and (mask[runEnd] == 0.0)) {
+			++runEnd;
+			}
+		if ((runEnd > cadenceNum) and (minGapRun > 0) and (runEnd - cadenceNum >= minGapRun)) {
+			cadenceNum = runEnd;
+			continue;
+			}
+		tShared.push_back(t[cadenceNum]);
+		xShared.push_back(x[cadenceNum]);
+		yShared.push_back(y[cadenceNum]);
+		yerrShared.push_back(yerr[cadenceNum]);
+		maskShared.push_back(mask[cadenceNum]);
+		ySum += mask[cadenceNum]*y[cadenceNum];
+		ySqSum += mask[cadenceNum]*y[cadenceNum]*y[cadenceNum];
+		numObserved += mask[cadenceNum];
+		++cadenceNum;
+		}
+	int numShared = tShared.size();
+	if (numShared < 2) {
+		for (int orderNum = 0; orderNum < numOrders; ++orderNum) {
+			LnPosteriorMAP[orderNum] = noPosterior;
+			BIC[orderNum] = noBIC;
+			Status[orderNum] = -2;
+			}
+		return 0;
+		}
+	double yStd = sqrt(max(ySqSum/numObserved - (ySum/numObserved)*(ySum/numObserved), 0.0));
+	double dtStart = tShared[1] - tShared[0];
+
+	#ifdef DEBUG_SEARCHCARMAORDERS
+		printf("searchCARMAOrders - numCadences: %d; numShared: %d; yStd: %e\n", numCadences, numShared, yStd);
+	#endif
+
+	vector<kali::LnLikeData> DataVec(numThreads);
+	vector<kali::LnLikeArgs> ArgsVec(numThreads);
+	kali::CARMA *OrderSystems = new kali::CARMA[numThreads];
+	for (int i = 0; i < numThreads; ++i) {
+		DataVec[i].numCadences = numShared;
+		DataVec[i].cadenceNum = -1;
+		DataVec[i].tolIR = tolIR;
+		DataVec[i].maxSigma = maxSigma;
+		DataVec[i].minTimescale = minTimescale;
+		DataVec[i].maxTimescale = maxTimescale;
+		DataVec[i].t = &tShared[0];
+		DataVec[i].x = &xShared[0];
+		DataVec[i].y = &yShared[0];
+		DataVec[i].yerr = &yerrShared[0];
+		DataVec[i].mask = &maskShared[0];
+		ArgsVec[i].numThreads = numThreads;
+		ArgsVec[i].Systems = OrderSystems;
+		ArgsVec[i].Data = &DataVec[i];
+		}
+	double minTLog10 = log10(minTimescale), maxTLog10 = log10(maxTimescale);
+
+	int numSuccess = 0;
+	#pragma omp parallel for schedule(dynamic) default(none) shared(numOrders, Orders, pVals, qVals, MAPOffsets, CovOffsets, OrderSystems, ArgsVec, dtStart, yStd, numObserved, minTLog10, maxTLog10, numStarts, startSeed, maxEvals, xTol, r, noPosterior, noBIC, MAP, Cov, LnPosteriorMAP, BIC, Status) reduction(+:numSuccess) num_threads(nthreads)
+	for (int rank = 0; rank < numOrders; ++rank) {
+		int threadNum = omp_get_thread_num();
+		int orderNum = Orders[rank];
+		int p = pVals[orderNum], q = qVals[orderNum], ndims = p + q + 1;
+		double *orderMAP = &MAP[MAPOffsets[orderNum]];
+		double *orderCov = &Cov[CovOffsets[orderNum]];
+		for (int i = 0; i < ndims*ndims; ++i) {
+			orderCov[i] = 0.0;
+			}
+		LnPosteriorMAP[orderNum] = noPosterior;
+		BIC[orderNum] = noBIC;
+		if ((p < 1) or (q < 0) or (q >= p)) {
+			Status[orderNum] = -3;
+			continue;
+			}
+		kali::CARMA &System = OrderSystems[threadNum];
+		System.deallocCARMA();
+		System.allocCARMA(p, q);
+		System.set_dt(dtStart);
+
+		VSLStreamStatePtr startStream __attribute__((aligned(64)));
+		vslNewStream(&startStream, VSL_BRNG_MT2203 + (orderNum%6024), startSeed + orderNum/6024);
+		vector<double> exponents(p + q), ARPoly(p + 1), MAPoly(q + 1), SigmaPrime(p*p), Theta(ndims), xVec(ndims), xBest(ndims, 0.0);
+		nlopt::opt optimizer(nlopt::LN_NELDERMEAD, ndims);
+		optimizer.set_max_objective(kali::calcLnPosterior, &ArgsVec[threadNum]);
+		optimizer.set_maxeval(maxEvals);
+		optimizer.set_xtol_rel(xTol);
+		double bestLnPosterior = noPosterior;
+		for (int startNum = 0; startNum < numStarts; ++startNum) {
+			vdRngUniform(VSL_RNG_METHOD_UNIFORM_STD, startStream, p + q, &exponents[0], minTLog10, maxTLog10);
+			/*!
+			Expand prod(z - rho) for the AR roots and the MA roots rho = -1/10^exponent into monic polynomials, highest power first, as numpy.poly does in carma.coeffs.
+			*/
+			ARPoly.assign(p + 1, 0.0);
+			ARPoly[0] = 1.0;
+			for (int rootNum = 0; rootNum < p; ++rootNum) {
+				double rho = -1.0/pow(10.0, exponents[rootNum]);
+				for (int i = rootNum + 1; i > 0; --i) {
+					ARPoly[i] -= rho*ARPoly[i - 1];
+					}
+				}
+			MAPoly.assign(q + 1, 0.0);
+			MAPoly[0] = 1.0;
+			for (int rootNum = 0; rootNum < q; ++rootNum) {
+				double rho = -1.0/pow(10.0, exponents[p + rootNum]);
+				for (int i = rootNum + 1; i > 0; --i) {
+					MAPoly[i] -= rho*MAPoly[i - 1];
+					}
+				}
+			for (int i = 0; i < p; ++i) {
+				Theta[i] = ARPoly[i + 1];
+				}
+			for (int i = 0; i <= q; ++i) {
+				Theta[p + i] = MAPoly[q - i];
+				}
+			kali::getSigma(r, p, q, &Theta[0], &SigmaPrime[0]);
+			bool found = false;
+			double sigmaFactor = 1.0, LnPrior = 0.0, LnLikelihood = 0.0;
+			for (int trialNum = 0; (trialNum < 500) and (not found); ++trialNum) {
+				double bQ = (SigmaPrime[0] > 0.0) ? sigmaFactor*yStd/sqrt(SigmaPrime[0]) : 1.0;
+				for (int i = 0; i <= q; ++i) {
+					xVec[p + i] = bQ*Theta[p + i];
+					}
+				for (int i = 0; i < p; ++i) {
+					xVec[i] = Theta[i];
+					}
+				double LnPosterior = kali::calcLnPosterior(&xVec[0], &ArgsVec[threadNum], LnPrior, LnLikelihood);
+				if ((LnPosterior > noPosterior) and (LnPrior == 0.0)) {
+					found = true;
+					} else {
+					sigmaFactor *= 0.31622776601; // sqrt(0.1)
+					}
+				}
+			if (not found) {
+				continue;
+				}
+			double maxLnPosterior = noPosterior;
+			try {
+				optimizer.optimize(xVec, maxLnPosterior);
+				} catch (std::exception &e) {
+				/*!
+				nlopt reports roundoff-limited and similar early stops by throwing; xVec and maxLnPosterior still hold the best point found.
+				*/
+				}
+			if (maxLnPosterior > bestLnPosterior) {
+				bestLnPosterior = maxLnPosterior;
+				xBest = xVec;
+				}
+			}
+		vslDeleteStream(&startStream);
+		for (int dimNum = 0; dimNum < ndims; ++dimNum) {
+			orderMAP[dimNum] = xBest[dimNum];
+			}
+		if (bestLnPosterior == noPosterior) {
+			Status[orderNum] = -2;
+			} else {
+			long numEvals = 0;
+			double lnLaplace = noPosterior, LnPrior = 0.0, LnLikelihood = 0.0;
+			Status[orderNum] = kali::laplaceApproximation(ndims, orderMAP, kali::calcLnPosterior, &ArgsVec[threadNum], orderCov, LnPosteriorMAP[orderNum], lnLaplace, numEvals);
+			kali::calcLnPosterior(orderMAP, &ArgsVec[threadNum], LnPrior, LnLikelihood);
+			if (isfinite(LnLikelihood)) {
+				BIC[orderNum] = -2.0*LnLikelihood + ndims*log(numObserved);
+				}
+			numSuccess += (Status[orderNum] == 0) ? 1 : 0;
+			}
+
+		#ifdef DEBUG_SEARCHCARMAORDERS
+			printf("searchCARMAOrders - threadNum: %d; CARMA(%d,%d); Status: %d; BIC: %e\n", threadNum, p, q, Status[orderNum], BIC[orderNum]);
+		#endif
+
+		}
+	for (int i = 0; i < numThreads; ++i) {
+		OrderSystems[i].deallocCARMA();
+		}
+	delete[] OrderSystems;
+	return numSuccess;
+	}
+
 int kali::CARMATask::smooth_RTS(int numCadences, int cadenceNum, double tolIR, double *t, double *x, double *y, double *yerr, double *mask, double *lcX, double *lcP, double *XSmooth, double *PSmooth, int threadNum) {
 	int successYN = -1;
 	kali::LnLikeData Data;
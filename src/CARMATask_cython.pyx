@@ -5,20 +5,43 @@ import numpy as np
 import psutil
 cimport numpy as np
 from libcpp cimport bool
+from cpython.pycapsule cimport PyCapsule_GetPointer
+import Execution_cython
 
 
 cdef extern from 'CARMA.hpp' namespace "kali":
 	void getSigma(int numR, int numP, int numQ, double *Theta, double *SigmaOut)
 
 
-cdef extern from 'CARMATask.hpp' namespace "kali":
+cdef extern from 'Execution.hpp' namespace "kali":
+	cdef cppclass ExecutionContext:
+		pass
+	void attach_ExecutionContext(ExecutionContext *context)
+
+attach_ExecutionContext(<ExecutionContext*>PyCapsule_GetPointer(Execution_cython.context_capsule(), 'kali.ExecutionContext'))
+
+cdef extern from 'MCMC.hpp' namespace "kali" nogil:
+	int sampleGaussianTarget(int samplerType, int batched, int ndims, double *mu, double *sigma, double *lower, double *upper, int nwalkers, int ntemps, int nsteps, int nthreads, double a, double maxTemp, unsigned int zSeed, unsigned int walkerSeed, unsigned int moveSeed, double *initPos, double *Chain, double *LnPrior, double *LnLikelihood, double *LnEvidence)
+
+cdef extern from 'CARMATask.hpp' namespace "kali" nogil:
 	cdef cppclass CARMATask:
 		CARMATask(int p, int q, int numThreads, int numBurn) except+
 		int reset_CARMATask(int pGiven, int qGiven, int numBurn) except+
 		int get_numBurn()
 		void set_numBurn(int numBurn)
+		double get_samplerUtilization()
+		double get_lnEvidence()
+		double get_lnEvidenceErr()
+		bool get_nestConverged()
+		void get_moveStats(double *Weights, double *Acceptance)
+		long get_numSurrogateEvals()
+		long get_numExactEvals()
+		long get_numOptimizerEvals()
+		int get_numModes()
 		int check_Theta(double *Theta, int threadNum)
 		double get_dt(int threadNum)
+		int get_rngMode()
+		int set_rngMode(int mode)
 		void get_Theta(double *Theta, int threadNum)
 		int set_System(double dt, double *Theta, int threadNum)
 		int reset_System(int threadNum);
@@ -33,9 +56,11 @@ cdef extern from 'CARMATask.hpp' namespace "kali":
 		int set_P(double *newP, int threadNum)
 
 		int make_IntrinsicLC(int numCadences, double tolIR, double fracIntrinsicVar, double fracNoiseToSignal, double *t, double *x, double *y, double *yerr, double *mask, double *lcX, double *lcP, unsigned int burnSeed, unsigned int distSeed, int threadNum)
+		int make_CirculantLC(int numCadences, double tolIR, double *t, double *x, double *y, double *yerr, double *mask, unsigned int distSeed, int threadNum)
 		double get_meanFlux(double fracIntrinsicVar, int threadNum)
 		int extend_IntrinsicLC(int numCadences, int cadenceNum, double tolIR, double fracIntrinsicVar, double fracNoiseToSignal, double *t, double *x, double *y, double *yerr, double *mask, double *lcX, double *lcP, unsigned int distSeed, int threadNum)
 		int make_ObservedLC(int numCadences, double tolIR, double fracIntrinsicVar, double fracNoiseToSignal, double *t, double *x, double *y, double *yerr, double *mask, unsigned int burnSeed, unsigned int distSeed, unsigned int noiseSeed, int threadNum)
+		int make_ObservedLCBatch(int numLCs, int *cadenceOffsets, double tolIR, double *Theta, double *fracIntrinsicVar, double *fracNoiseToSignal, double *t, double *x, double *y, double *yerr, double *mask, unsigned int *burnSeeds, unsigned int *distSeeds, unsigned int *noiseSeeds, int *Status)
 		int add_ObservationNoise(int numCadences, double tolIR, double fracIntrinsicVar, double fracNoiseToSignal, double *t, double *x, double *y, double *yerr, double *mask, unsigned int noiseSeed, int threadNum)
 		int extend_ObservationNoise(int numCadences, int cadenceNum, double tolIR, double fracIntrinsicVar, double fracNoiseToSignal, double *t, double *x, double *y, double *yerr, double *mask, unsigned int noiseSeed, int threadNum);
 
@@ -50,18 +75,56 @@ cdef extern from 'CARMATask.hpp' namespace "kali":
 
 		void compute_ACVF(int numLags, double *Lags, double *ACVF, int threadNum)
 
-		int fit_CARMAModel(double dt, int numCadences, double tolIR, double maxSigma, double minTimescale, double maxTimescale, double *t, double *x, double *y, double *yerr, double *mask, int nwalkers, int nsteps, int maxEvals, double xTol, double mcmcA, unsigned int zSSeed, unsigned int walkerSeed, unsigned int moveSeed, unsigned int xSeed, double* xStart, double *Chain, double *LnPrior, double *LnLikelihood, bool Bp)
+		int fit_CARMAModel(double dt, int numCadences, double tolIR, double maxSigma, double minTimescale, double maxTimescale, double *t, double *x, double *y, double *yerr, double *mask, int nwalkers, int nsteps, int maxEvals, double xTol, double mcmcA, unsigned int zSSeed, unsigned int walkerSeed, unsigned int moveSeed, unsigned int xSeed, double* xStart, double *Chain, double *LnPrior, double *LnLikelihood, bool Bp, int samplerType, double *MoveWeights, int numAdaptSteps, int surrogateBin, int numOptStarts)
+		int nest_CARMAModel(double dt, int numCadences, double tolIR, double maxSigma, double minTimescale, double maxTimescale, double *t, double *x, double *y, double *yerr, double *mask, int numLive, double lnZTol, int maxIter, unsigned int nestSeed, int numStart, double *xStart, int maxSamples, double *Samples, double *LnPrior, double *LnLikelihood, double *LnWeight)
+		int laplace_CARMAModel(int numLCs, int *cadenceOffsets, double tolIR, double *maxSigma, double *minTimescale, double *maxTimescale, double *t, double *x, double *y, double *yerr, double *mask, int numStarts, double *xStart, int maxEvals, double xTol, double *MAP, double *Cov, double *LnPosteriorMAP, double *LnLaplace, int *Status)
 
 		int smooth_RTS(int numCadences, int cadenceNum, double tolIR, double *t, double *x, double *y, double *yerr, double *mask, double *lcX, double *lcP, double *XSmooth, double *PSmooth, int threadNum)
 
+	int searchCARMAOrders(int numOrders, int *pVals, int *qVals, int numThreads, int numCadences, double tolIR, double maxSigma, double minTimescale, double maxTimescale, double *t, double *x, double *y, double *yerr, double *mask, int minGapRun, int numStarts, unsigned int startSeed, int maxEvals, double xTol, double *MAP, double *Cov, double *LnPosteriorMAP, double *BIC, int *Status)
+
 
 @cython.boundscheck(False)
 @cython.wraparound(False)
-def get_Sigma(rNum, pNum, qNum, np.ndarray[double, ndim=1, mode='c'] Theta not None, np.ndarray[double, ndim=1, mode='c'] Sigma not None):
+def get_Sigma(rNum, pNum, qNum, double[::1] Theta not None, double[::1] Sigma not None):
 	getSigma(rNum, pNum, qNum, &Theta[0], &Sigma[0])
 
+@cython.boundscheck(False)
+@cython.wraparound(False)
+def search_CARMAOrders(int[::1] pVals not None, int[::1] qVals not None, int numThreads, double tolIR, double maxSigma, double minTimescale, double maxTimescale, double[::1] t not None, double[::1] x not None, double[::1] y not None, double[::1] yerr not None, double[::1] mask not None, int minGapRun, int numStarts, unsigned int startSeed, int maxEvals, double xTol, double[::1] MAP not None, double[::1] Cov not None, double[::1] LnPosteriorMAP not None, double[::1] BIC not None, int[::1] Status not None):
+	"""MAP, Laplace covariance and BIC of one light curve for each order (pVals[i], qVals[i]), computed concurrently; see kali::searchCARMAOrders. Releases the GIL."""
+	cdef int numOrders = pVals.shape[0]
+	cdef int numCadences = t.shape[0]
+	cdef int result
+	with nogil:
+		result = searchCARMAOrders(numOrders, &pVals[0], &qVals[0], numThreads, numCadences, tolIR, maxSigma, minTimescale, maxTimescale, &t[0], &x[0], &y[0], &yerr[0], &mask[0], minGapRun, numStarts, startSeed, maxEvals, xTol, &MAP[0], &Cov[0], &LnPosteriorMAP[0], &BIC[0], &Status[0])
+	return result
+
+@cython.boundscheck(False)
+@cython.wraparound(False)
+def sample_GaussianTarget(int samplerType, bint batched, double[::1] mu not None, double[::1] sigma not None, double[::1] lower not None, double[::1] upper not None, int nwalkers, int ntemps, int nsteps, int nthreads, double a, double maxTemp, unsigned int zSeed, unsigned int walkerSeed, unsigned int moveSeed, double[::1] initPos not None, double[::1] Chain not None, double[::1] LnPrior not None, double[::1] LnLikelihood not None, double[::1] LnEvidence not None):
+	"""Run a sampler on the analytic Gaussian target of kali::sampleGaussianTarget, for checking samplers and evidence estimates. Releases the GIL."""
+	cdef int result
+	with nogil:
+		result = sampleGaussianTarget(samplerType, batched, mu.shape[0], &mu[0], &sigma[0], &lower[0], &upper[0], nwalkers, ntemps, nsteps, nthreads, a, maxTemp, zSeed, walkerSeed, moveSeed, &initPos[0], &Chain[0], &LnPrior[0], &LnLikelihood[0], &LnEvidence[0])
+	return result
+
 
 cdef class CARMATask_cython:
+	"""Wrapper around kali::CARMATask.
+
+	The long-running methods (make_*, add_/extend_ObservationNoise, compute_/update_Ln*, compute_ACVF, fit_*, nest_*,
+	laplace_* and smooth_*) release the GIL while the C++ code runs, so Python threads can drive several task objects
+	at once, e.g. one task per worker of a concurrent.futures.ThreadPoolExecutor.
+
+	Thread safety: distinct task objects may be used concurrently from any number of threads; the threads they use
+	are drawn from the shared budget in kali.execution. A single task object is not thread safe: its systems, the
+	state set by set_System and the statistics of the last fit are shared by all of its methods, so calls on the same
+	object must be serialized by the caller. The exception is the per-system methods taking threadNum, which may run
+	concurrently on one object as long as every caller uses its own threadNum and no fit_*, nest_* or laplace_* call
+	is in progress. numpy arrays passed in must not be resized or freed by other threads during a call.
+	"""
+
 	cdef CARMATask *thisptr
 
 	def __cinit__(self, p, q, numThreads = None, numBurn = None):
@@ -81,7 +144,52 @@ cdef class CARMATask_cython:
 
 	@cython.boundscheck(False)
 	@cython.wraparound(False)
-	def check_Theta(self, np.ndarray[double, ndim=1, mode='c'] Theta not None, threadNum = None):
+	def get_samplerUtilization(self):
+		return self.thisptr.get_samplerUtilization()
+
+	@cython.boundscheck(False)
+	@cython.wraparound(False)
+	def get_lnEvidence(self):
+		return self.thisptr.get_lnEvidence()
+
+	@cython.boundscheck(False)
+	@cython.wraparound(False)
+	def get_lnEvidenceErr(self):
+		return self.thisptr.get_lnEvidenceErr()
+
+	@cython.boundscheck(False)
+	@cython.wraparound(False)
+	def get_nestConverged(self):
+		return self.thisptr.get_nestConverged()
+
+	@cython.boundscheck(False)
+	@cython.wraparound(False)
+	def get_moveStats(self, double[::1] Weights not None, double[::1] Acceptance not None):
+		self.thisptr.get_moveStats(&Weights[0], &Acceptance[0])
+
+	@cython.boundscheck(False)
+	@cython.wraparound(False)
+	def get_numSurrogateEvals(self):
+		return self.thisptr.get_numSurrogateEvals()
+
+	@cython.boundscheck(False)
+	@cython.wraparound(False)
+	def get_numExactEvals(self):
+		return self.thisptr.get_numExactEvals()
+
+	@cython.boundscheck(False)
+	@cython.wraparound(False)
+	def get_numOptimizerEvals(self):
+		return self.thisptr.get_numOptimizerEvals()
+
+	@cython.boundscheck(False)
+	@cython.wraparound(False)
+	def get_numModes(self):
+		return self.thisptr.get_numModes()
+
+	@cython.boundscheck(False)
+	@cython.wraparound(False)
+	def check_Theta(self, double[::1] Theta not None, threadNum = None):
 		if threadNum == None:
 			threadNum = 0
 		return self.thisptr.check_Theta(&Theta[0], threadNum)
@@ -91,16 +199,22 @@ cdef class CARMATask_cython:
 			threadNum = 0
 		return self.thisptr.get_dt(threadNum)
 
+	def get_rngMode(self):
+		return self.thisptr.get_rngMode()
+
+	def set_rngMode(self, mode):
+		return self.thisptr.set_rngMode(mode)
+
 	@cython.boundscheck(False)
 	@cython.wraparound(False)
-	def get_Theta(self, np.ndarray[double, ndim=1, mode='c'] Theta not None, threadNum = None):
+	def get_Theta(self, double[::1] Theta not None, threadNum = None):
 		if threadNum == None:
 			threadNum = 0
 		self.thisptr.get_Theta(&Theta[0], threadNum)
 
 	@cython.boundscheck(False)
 	@cython.wraparound(False)
-	def set_System(self, dt, np.ndarray[double, ndim=1, mode='c'] Theta not None, threadNum = None):
+	def set_System(self, dt, double[::1] Theta not None, threadNum = None):
 		if threadNum == None:
 			threadNum = 0
 		return self.thisptr.set_System(dt, &Theta[0], threadNum)
@@ -112,7 +226,7 @@ cdef class CARMATask_cython:
 
 	@cython.boundscheck(False)
 	@cython.wraparound(False)
-	def get_setSystemsVec(self, np.ndarray[int, ndim=1, mode='c'] setSystems not None):
+	def get_setSystemsVec(self, int[::1] setSystems not None):
 		self.thisptr.get_setSystemsVec(&setSystems[0])
 
 	def print_System(self, threadNum = None):
@@ -122,66 +236,76 @@ cdef class CARMATask_cython:
 
 	'''@cython.boundscheck(False)
 	@cython.wraparound(False)
-	def get_A(self, dt, np.ndarray[double, ndim=1, mode='c'] Theta not None, np.ndarray[np.complex128, ndim=1, mode='c'] A not None, threadNum = None):
+	def get_A(self, dt, double[::1] Theta not None, np.ndarray[np.complex128, ndim=1, mode='c'] A not None, threadNum = None):
 		if threadNum == None:
 			threadNum = 0
 		return self.thisptr.get_A(dt, &Theta[0], &A[0], threadNum)
 
 	@cython.boundscheck(False)
 	@cython.wraparound(False)
-	def get_B(self, dt, np.ndarray[double, ndim=1, mode='c'] Theta not None, np.ndarray[np.complex128, ndim=1, mode='c'] B not None, threadNum = None):
+	def get_B(self, dt, double[::1] Theta not None, np.ndarray[np.complex128, ndim=1, mode='c'] B not None, threadNum = None):
 		if threadNum == None:
 			threadNum = 0
 		return self.thisptr.get_B(dt, &Theta[0], &B[0], threadNum)'''
 
 	@cython.boundscheck(False)
 	@cython.wraparound(False)
-	def get_Sigma(self, np.ndarray[double, ndim=1, mode='c'] Sigma not None, threadNum = None):
+	def get_Sigma(self, double[::1] Sigma not None, threadNum = None):
 		if threadNum == None:
 			threadNum = 0
 		return self.thisptr.get_Sigma(&Sigma[0], threadNum)
 
 	@cython.boundscheck(False)
 	@cython.wraparound(False)
-	def get_X(self, np.ndarray[double, ndim=1, mode='c'] newX not None, threadNum = None):
+	def get_X(self, double[::1] newX not None, threadNum = None):
 		if threadNum == None:
 			threadNum = 0
 		return self.thisptr.get_X(&newX[0], threadNum)
 
 	@cython.boundscheck(False)
 	@cython.wraparound(False)
-	def set_X(self, np.ndarray[double, ndim=1, mode='c'] newX not None, threadNum = None):
+	def set_X(self, double[::1] newX not None, threadNum = None):
 		if threadNum == None:
 			threadNum = 0
 		return self.thisptr.set_X(&newX[0], threadNum)
 
 	@cython.boundscheck(False)
 	@cython.wraparound(False)
-	def get_P(self, np.ndarray[double, ndim=1, mode='c'] newP not None, threadNum = None):
+	def get_P(self, double[::1] newP not None, threadNum = None):
 		if threadNum == None:
 			threadNum = 0
 		return self.thisptr.get_P(&newP[0], threadNum)
 
 	@cython.boundscheck(False)
 	@cython.wraparound(False)
-	def set_P(self, np.ndarray[double, ndim=1, mode='c'] newP not None, threadNum = None):
+	def set_P(self, double[::1] newP not None, threadNum = None):
 		if threadNum == None:
 			threadNum = 0
 		return self.thisptr.set_P(&newP[0], threadNum)
 
 	@cython.boundscheck(False)
 	@cython.wraparound(False)
-	def make_IntrinsicLC(self, numCadences, tolIR, fracIntrinsicVar, fracNoiseToSignal, np.ndarray[double, ndim=1, mode='c'] t not None, np.ndarray[double, ndim=1, mode='c'] x not None, np.ndarray[double, ndim=1, mode='c'] y not None, np.ndarray[double, ndim=1, mode='c'] yerr not None, np.ndarray[double, ndim=1, mode='c'] mask not None, np.ndarray[double, ndim=1, mode='c'] lcX not None, np.ndarray[double, ndim=1, mode='c'] lcP not None, burnSeed, distSeed, threadNum = None):
-		if threadNum == None:
-			threadNum = 0
-		return self.thisptr.make_IntrinsicLC(numCadences, tolIR, fracIntrinsicVar, fracNoiseToSignal, &t[0], &x[0], &y[0], &yerr[0], &mask[0], &lcX[0], &lcP[0], burnSeed, distSeed, threadNum)
+	def make_IntrinsicLC(self, int numCadences, double tolIR, double fracIntrinsicVar, double fracNoiseToSignal, double[::1] t not None, double[::1] x not None, double[::1] y not None, double[::1] yerr not None, double[::1] mask not None, double[::1] lcX not None, double[::1] lcP not None, unsigned int burnSeed, unsigned int distSeed, int threadNum = 0):
+		cdef int result
+		with nogil:
+			result = self.thisptr.make_IntrinsicLC(numCadences, tolIR, fracIntrinsicVar, fracNoiseToSignal, &t[0], &x[0], &y[0], &yerr[0], &mask[0], &lcX[0], &lcP[0], burnSeed, distSeed, threadNum)
+		return result
 
 	@cython.boundscheck(False)
 	@cython.wraparound(False)
-	def extend_IntrinsicLC(self, numCadences, cadenceNum, tolIR, fracIntrinsicVar, fracNoiseToSignal, np.ndarray[double, ndim=1, mode='c'] t not None, np.ndarray[double, ndim=1, mode='c'] x not None, np.ndarray[double, ndim=1, mode='c'] y not None, np.ndarray[double, ndim=1, mode='c'] yerr not None, np.ndarray[double, ndim=1, mode='c'] mask not None, np.ndarray[double, ndim=1, mode='c'] lcX not None, np.ndarray[double, ndim=1, mode='c'] lcP not None, distSeed, noiseSeed, threadNum = None):
-		if threadNum == None:
-			threadNum = 0
-		return self.thisptr.extend_IntrinsicLC(numCadences, cadenceNum, tolIR, fracIntrinsicVar, fracNoiseToSignal, &t[0], &x[0], &y[0], &yerr[0], &mask[0], &lcX[0], &lcP[0], distSeed, threadNum)
+	def make_CirculantLC(self, int numCadences, double tolIR, double[::1] t not None, double[::1] x not None, double[::1] y not None, double[::1] yerr not None, double[::1] mask not None, unsigned int distSeed, int threadNum = 0):
+		cdef int result
+		with nogil:
+			result = self.thisptr.make_CirculantLC(numCadences, tolIR, &t[0], &x[0], &y[0], &yerr[0], &mask[0], distSeed, threadNum)
+		return result
+
+	@cython.boundscheck(False)
+	@cython.wraparound(False)
+	def extend_IntrinsicLC(self, int numCadences, int cadenceNum, double tolIR, double fracIntrinsicVar, double fracNoiseToSignal, double[::1] t not None, double[::1] x not None, double[::1] y not None, double[::1] yerr not None, double[::1] mask not None, double[::1] lcX not None, double[::1] lcP not None, unsigned int distSeed, noiseSeed, int threadNum = 0):
+		cdef int result
+		with nogil:
+			result = self.thisptr.extend_IntrinsicLC(numCadences, cadenceNum, tolIR, fracIntrinsicVar, fracNoiseToSignal, &t[0], &x[0], &y[0], &yerr[0], &mask[0], &lcX[0], &lcP[0], distSeed, threadNum)
+		return result
 
 	@cython.boundscheck(False)
 	@cython.wraparound(False)
@@ -192,82 +316,123 @@ cdef class CARMATask_cython:
 
 	@cython.boundscheck(False)
 	@cython.wraparound(False)
-	def make_ObservedLC(self, numCadences, tolIR, fracIntrinsicVar, fracNoiseToSignal, np.ndarray[double, ndim=1, mode='c'] t not None, np.ndarray[double, ndim=1, mode='c'] x not None, np.ndarray[double, ndim=1, mode='c'] y not None, np.ndarray[double, ndim=1, mode='c'] yerr not None, np.ndarray[double, ndim=1, mode='c'] mask not None, burnSeed, distSeed, noiseSeed, threadNum = None):
-		if threadNum == None:
-			threadNum = 0
-		return self.thisptr.make_ObservedLC(numCadences, tolIR, fracIntrinsicVar, fracNoiseToSignal, &t[0], &x[0], &y[0], &yerr[0], &mask[0], burnSeed, distSeed, noiseSeed, threadNum)
+	def make_ObservedLC(self, int numCadences, double tolIR, double fracIntrinsicVar, double fracNoiseToSignal, double[::1] t not None, double[::1] x not None, double[::1] y not None, double[::1] yerr not None, double[::1] mask not None, unsigned int burnSeed, unsigned int distSeed, unsigned int noiseSeed, int threadNum = 0):
+		cdef int result
+		with nogil:
+			result = self.thisptr.make_ObservedLC(numCadences, tolIR, fracIntrinsicVar, fracNoiseToSignal, &t[0], &x[0], &y[0], &yerr[0], &mask[0], burnSeed, distSeed, noiseSeed, threadNum)
+		return result
 
 	@cython.boundscheck(False)
 	@cython.wraparound(False)
-	def add_ObservationNoise(self, numCadences, tolIR, fracIntrinsicVar, fracNoiseToSignal, np.ndarray[double, ndim=1, mode='c'] t not None, np.ndarray[double, ndim=1, mode='c'] x not None, np.ndarray[double, ndim=1, mode='c'] y not None, np.ndarray[double, ndim=1, mode='c'] yerr not None, np.ndarray[double, ndim=1, mode='c'] mask not None, noiseSeed, threadNum = None):
-		if threadNum == None:
-			threadNum = 0
-		return self.thisptr.add_ObservationNoise(numCadences, tolIR, fracIntrinsicVar, fracNoiseToSignal, &t[0], &x[0], &y[0], &yerr[0], &mask[0], noiseSeed, threadNum)
+	def make_ObservedLCBatch(self, int[::1] cadenceOffsets not None, double tolIR, double[::1] Theta not None, double[::1] fracIntrinsicVar not None, double[::1] fracNoiseToSignal not None, double[::1] t not None, double[::1] x not None, double[::1] y not None, double[::1] yerr not None, double[::1] mask not None, unsigned int[::1] burnSeeds not None, unsigned int[::1] distSeeds not None, unsigned int[::1] noiseSeeds not None, int[::1] Status not None):
+		cdef int numLCs = cadenceOffsets.shape[0] - 1
+		cdef int result
+		with nogil:
+			result = self.thisptr.make_ObservedLCBatch(numLCs, &cadenceOffsets[0], tolIR, &Theta[0], &fracIntrinsicVar[0], &fracNoiseToSignal[0], &t[0], &x[0], &y[0], &yerr[0], &mask[0], &burnSeeds[0], &distSeeds[0], &noiseSeeds[0], &Status[0])
+		return result
 
 	@cython.boundscheck(False)
 	@cython.wraparound(False)
-	def extend_ObservationNoise(self, numCadences, cadenceNum, tolIR, fracIntrinsicVar, fracNoiseToSignal, np.ndarray[double, ndim=1, mode='c'] t not None, np.ndarray[double, ndim=1, mode='c'] x not None, np.ndarray[double, ndim=1, mode='c'] y not None, np.ndarray[double, ndim=1, mode='c'] yerr not None, np.ndarray[double, ndim=1, mode='c'] mask not None, noiseSeed, threadNum = None):
-		if threadNum == None:
-			threadNum = 0
-		return self.thisptr.extend_ObservationNoise(numCadences, cadenceNum, tolIR, fracIntrinsicVar, fracNoiseToSignal, &t[0], &x[0], &y[0], &yerr[0], &mask[0], noiseSeed, threadNum)
+	def add_ObservationNoise(self, int numCadences, double tolIR, double fracIntrinsicVar, double fracNoiseToSignal, double[::1] t not None, double[::1] x not None, double[::1] y not None, double[::1] yerr not None, double[::1] mask not None, unsigned int noiseSeed, int threadNum = 0):
+		cdef int result
+		with nogil:
+			result = self.thisptr.add_ObservationNoise(numCadences, tolIR, fracIntrinsicVar, fracNoiseToSignal, &t[0], &x[0], &y[0], &yerr[0], &mask[0], noiseSeed, threadNum)
+		return result
 
 	@cython.boundscheck(False)
 	@cython.wraparound(False)
-	def compute_LnPrior(self, numCadences, tolIR, maxSigma, minTimescale, maxTimescale, np.ndarray[double, ndim=1, mode='c'] t not None, np.ndarray[double, ndim=1, mode='c'] x not None, np.ndarray[double, ndim=1, mode='c'] y not None, np.ndarray[double, ndim=1, mode='c'] yerr not None, np.ndarray[double, ndim=1, mode='c'] mask not None, threadNum = None):
-		if threadNum == None:
-			threadNum = 0
-		return self.thisptr.compute_LnPrior(numCadences, tolIR, maxSigma, minTimescale, maxTimescale, &t[0], &x[0], &y[0], &yerr[0], &mask[0], threadNum)
+	def extend_ObservationNoise(self, int numCadences, int cadenceNum, double tolIR, double fracIntrinsicVar, double fracNoiseToSignal, double[::1] t not None, double[::1] x not None, double[::1] y not None, double[::1] yerr not None, double[::1] mask not None, unsigned int noiseSeed, int threadNum = 0):
+		cdef int result
+		with nogil:
+			result = self.thisptr.extend_ObservationNoise(numCadences, cadenceNum, tolIR, fracIntrinsicVar, fracNoiseToSignal, &t[0], &x[0], &y[0], &yerr[0], &mask[0], noiseSeed, threadNum)
+		return result
 
 	@cython.boundscheck(False)
 	@cython.wraparound(False)
-	def update_LnPrior(self, numCadences, cadenceNum, tolIR, maxSigma, minTimescale, maxTimescale, np.ndarray[double, ndim=1, mode='c'] t not None, np.ndarray[double, ndim=1, mode='c'] x not None, np.ndarray[double, ndim=1, mode='c'] y not None, np.ndarray[double, ndim=1, mode='c'] yerr not None, np.ndarray[double, ndim=1, mode='c'] mask not None, threadNum = None):
-		if threadNum == None:
-			threadNum = 0
-		return self.thisptr.update_LnPrior(numCadences, cadenceNum, tolIR, maxSigma, minTimescale, maxTimescale, &t[0], &x[0], &y[0], &yerr[0], &mask[0], threadNum)
+	def compute_LnPrior(self, int numCadences, double tolIR, double maxSigma, double minTimescale, double maxTimescale, double[::1] t not None, double[::1] x not None, double[::1] y not None, double[::1] yerr not None, double[::1] mask not None, int threadNum = 0):
+		cdef double result
+		with nogil:
+			result = self.thisptr.compute_LnPrior(numCadences, tolIR, maxSigma, minTimescale, maxTimescale, &t[0], &x[0], &y[0], &yerr[0], &mask[0], threadNum)
+		return result
 
 	@cython.boundscheck(False)
 	@cython.wraparound(False)
-	def compute_LnLikelihood(self, numCadences, cadenceNum, tolIR, np.ndarray[double, ndim=1, mode='c'] t not None, np.ndarray[double, ndim=1, mode='c'] x not None, np.ndarray[double, ndim=1, mode='c'] y not None, np.ndarray[double, ndim=1, mode='c'] yerr not None, np.ndarray[double, ndim=1, mode='c'] mask not None, np.ndarray[double, ndim=1, mode='c'] X not None, np.ndarray[double, ndim=1, mode='c'] P not None, threadNum = None):
-		if threadNum == None:
-			threadNum = 0
-		return self.thisptr.compute_LnLikelihood(numCadences, cadenceNum, tolIR, &t[0], &x[0], &y[0], &yerr[0], &mask[0], &X[0], &P[0], threadNum)
+	def update_LnPrior(self, int numCadences, int cadenceNum, double tolIR, double maxSigma, double minTimescale, double maxTimescale, double[::1] t not None, double[::1] x not None, double[::1] y not None, double[::1] yerr not None, double[::1] mask not None, int threadNum = 0):
+		cdef double result
+		with nogil:
+			result = self.thisptr.update_LnPrior(numCadences, cadenceNum, tolIR, maxSigma, minTimescale, maxTimescale, &t[0], &x[0], &y[0], &yerr[0], &mask[0], threadNum)
+		return result
 
 	@cython.boundscheck(False)
 	@cython.wraparound(False)
-	def update_LnLikelihood(self, numCadences, cadenceNum, currentLnLikelihood, tolIR, np.ndarray[double, ndim=1, mode='c'] t not None, np.ndarray[double, ndim=1, mode='c'] x not None, np.ndarray[double, ndim=1, mode='c'] y not None, np.ndarray[double, ndim=1, mode='c'] yerr not None, np.ndarray[double, ndim=1, mode='c'] mask not None, np.ndarray[double, ndim=1, mode='c'] X not None, np.ndarray[double, ndim=1, mode='c'] P not None, threadNum = None):
-		if threadNum == None:
-			threadNum = 0
-		return self.thisptr.update_LnLikelihood(numCadences, cadenceNum, currentLnLikelihood, tolIR, &t[0], &x[0], &y[0], &yerr[0], &mask[0], &X[0], &P[0], threadNum)
+	def compute_LnLikelihood(self, int numCadences, int cadenceNum, double tolIR, double[::1] t not None, double[::1] x not None, double[::1] y not None, double[::1] yerr not None, double[::1] mask not None, double[::1] X not None, double[::1] P not None, int threadNum = 0):
+		cdef double result
+		with nogil:
+			result = self.thisptr.compute_LnLikelihood(numCadences, cadenceNum, tolIR, &t[0], &x[0], &y[0], &yerr[0], &mask[0], &X[0], &P[0], threadNum)
+		return result
 
 	@cython.boundscheck(False)
 	@cython.wraparound(False)
-	def compute_LnPosterior(self, numCadences, cadenceNum, tolIR, maxSigma, minTimescale, maxTimescale, np.ndarray[double, ndim=1, mode='c'] t not None, np.ndarray[double, ndim=1, mode='c'] x not None, np.ndarray[double, ndim=1, mode='c'] y not None, np.ndarray[double, ndim=1, mode='c'] yerr not None, np.ndarray[double, ndim=1, mode='c'] mask not None, np.ndarray[double, ndim=1, mode='c'] X not None, np.ndarray[double, ndim=1, mode='c'] P not None, threadNum = None):
-		if threadNum == None:
-			threadNum = 0
-		return self.thisptr.compute_LnPosterior(numCadences, cadenceNum, tolIR, maxSigma, minTimescale, maxTimescale, &t[0], &x[0], &y[0], &yerr[0], &mask[0], &X[0], &P[0], threadNum)
+	def update_LnLikelihood(self, int numCadences, int cadenceNum, double currentLnLikelihood, double tolIR, double[::1] t not None, double[::1] x not None, double[::1] y not None, double[::1] yerr not None, double[::1] mask not None, double[::1] X not None, double[::1] P not None, int threadNum = 0):
+		cdef double result
+		with nogil:
+			result = self.thisptr.update_LnLikelihood(numCadences, cadenceNum, currentLnLikelihood, tolIR, &t[0], &x[0], &y[0], &yerr[0], &mask[0], &X[0], &P[0], threadNum)
+		return result
 
 	@cython.boundscheck(False)
 	@cython.wraparound(False)
-	def update_LnPosterior(self, numCadences, cadenceNum, currentLnLikelihood, tolIR, maxSigma, minTimescale, maxTimescale, np.ndarray[double, ndim=1, mode='c'] t not None, np.ndarray[double, ndim=1, mode='c'] x not None, np.ndarray[double, ndim=1, mode='c'] y not None, np.ndarray[double, ndim=1, mode='c'] yerr not None, np.ndarray[double, ndim=1, mode='c'] mask not None, np.ndarray[double, ndim=1, mode='c'] X not None, np.ndarray[double, ndim=1, mode='c'] P not None, threadNum = None):
-		if threadNum == None:
-			threadNum = 0
-		return self.thisptr.update_LnPosterior(numCadences, cadenceNum, currentLnLikelihood, tolIR, maxSigma, minTimescale, maxTimescale, &t[0], &x[0], &y[0], &yerr[0], &mask[0], &X[0], &P[0], threadNum)
+	def compute_LnPosterior(self, int numCadences, int cadenceNum, double tolIR, double maxSigma, double minTimescale, double maxTimescale, double[::1] t not None, double[::1] x not None, double[::1] y not None, double[::1] yerr not None, double[::1] mask not None, double[::1] X not None, double[::1] P not None, int threadNum = 0):
+		cdef double result
+		with nogil:
+			result = self.thisptr.compute_LnPosterior(numCadences, cadenceNum, tolIR, maxSigma, minTimescale, maxTimescale, &t[0], &x[0], &y[0], &yerr[0], &mask[0], &X[0], &P[0], threadNum)
+		return result
 
 	@cython.boundscheck(False)
 	@cython.wraparound(False)
-	def compute_ACVF(self, numLags, np.ndarray[double, ndim=1, mode='c'] Lags not None, np.ndarray[double, ndim=1, mode='c'] ACVF not None, threadNum = None):
-		if threadNum == None:
-			threadNum = 0
-		self.thisptr.compute_ACVF(numLags, &Lags[0], &ACVF[0], threadNum)
+	def update_LnPosterior(self, int numCadences, int cadenceNum, double currentLnLikelihood, double tolIR, double maxSigma, double minTimescale, double maxTimescale, double[::1] t not None, double[::1] x not None, double[::1] y not None, double[::1] yerr not None, double[::1] mask not None, double[::1] X not None, double[::1] P not None, int threadNum = 0):
+		cdef double result
+		with nogil:
+			result = self.thisptr.update_LnPosterior(numCadences, cadenceNum, currentLnLikelihood, tolIR, maxSigma, minTimescale, maxTimescale, &t[0], &x[0], &y[0], &yerr[0], &mask[0], &X[0], &P[0], threadNum)
+		return result
 
 	@cython.boundscheck(False)
 	@cython.wraparound(False)
-	def fit_CARMAModel(self, dt, numCadences, tolIR, maxSigma, minTimescale, maxTimescale, np.ndarray[double, ndim=1, mode='c'] t not None, np.ndarray[double, ndim=1, mode='c'] x not None, np.ndarray[double, ndim=1, mode='c'] y not None, np.ndarray[double, ndim=1, mode='c'] yerr not None, np.ndarray[double, ndim=1, mode='c'] mask not None, nwalkers, nsteps, maxEvals, xTol, mcmcA, zSSeed, walkerSeed, moveSeed, xSeed, np.ndarray[double, ndim=1, mode='c'] xStart not None, np.ndarray[double, ndim=1, mode='c'] Chain not None, np.ndarray[double, ndim=1, mode='c'] LnPrior not None, np.ndarray[double, ndim=1, mode='c'] LnLikelihood not None, Bp):
-		return self.thisptr.fit_CARMAModel(dt, numCadences, tolIR, maxSigma, minTimescale, maxTimescale, &t[0], &x[0], &y[0], &yerr[0], &mask[0], nwalkers, nsteps, maxEvals, xTol, mcmcA, zSSeed, walkerSeed, moveSeed, xSeed, &xStart[0], &Chain[0], &LnPrior[0], &LnLikelihood[0], Bp)
+	def compute_ACVF(self, int numLags, double[::1] Lags not None, double[::1] ACVF not None, int threadNum = 0):
+		with nogil:
+			self.thisptr.compute_ACVF(numLags, &Lags[0], &ACVF[0], threadNum)
 
 	@cython.boundscheck(False)
 	@cython.wraparound(False)
-	def smooth_RTS(self, numCadences, cadenceNum, tolIR, np.ndarray[double, ndim=1, mode='c'] t not None, np.ndarray[double, ndim=1, mode='c'] x not None, np.ndarray[double, ndim=1, mode='c'] y not None, np.ndarray[double, ndim=1, mode='c'] yerr not None, np.ndarray[double, ndim=1, mode='c'] mask not None, np.ndarray[double, ndim=1, mode='c'] X not None, np.ndarray[double, ndim=1, mode='c'] P not None, np.ndarray[double, ndim=1, mode='c'] XSmooth not None, np.ndarray[double, ndim=1, mode='c'] PSmooth not None, threadNum = None):
-		if threadNum == None:
-			threadNum = 0
-		return self.thisptr.smooth_RTS(numCadences, cadenceNum, tolIR, &t[0], &x[0], &y[0], &yerr[0], &mask[0], &X[0], &P[0], &XSmooth[0], &PSmooth[0], threadNum)
+	def fit_CARMAModel(self, double dt, int numCadences, double tolIR, double maxSigma, double minTimescale, double maxTimescale, double[::1] t not None, double[::1] x not None, double[::1] y not None, double[::1] yerr not None, double[::1] mask not None, int nwalkers, int nsteps, int maxEvals, double xTol, double mcmcA, unsigned int zSSeed, unsigned int walkerSeed, unsigned int moveSeed, unsigned int xSeed, double[::1] xStart not None, double[::1] Chain not None, double[::1] LnPrior not None, double[::1] LnLikelihood not None, bool Bp, int samplerType = 0, double[::1] MoveWeights = None, int numAdaptSteps = 0, int surrogateBin = 0, int numOptStarts = 0):
+		if MoveWeights is None:
+			MoveWeights = np.array([1.0, 0.0, 0.0, 0.0])
+		cdef int result
+		with nogil:
+			result = self.thisptr.fit_CARMAModel(dt, numCadences, tolIR, maxSigma, minTimescale, maxTimescale, &t[0], &x[0], &y[0], &yerr[0], &mask[0], nwalkers, nsteps, maxEvals, xTol, mcmcA, zSSeed, walkerSeed, moveSeed, xSeed, &xStart[0], &Chain[0], &LnPrior[0], &LnLikelihood[0], Bp, samplerType, &MoveWeights[0], numAdaptSteps, surrogateBin, numOptStarts)
+		return result
+
+	@cython.boundscheck(False)
+	@cython.wraparound(False)
+	def nest_CARMAModel(self, double dt, int numCadences, double tolIR, double maxSigma, double minTimescale, double maxTimescale, double[::1] t not None, double[::1] x not None, double[::1] y not None, double[::1] yerr not None, double[::1] mask not None, int numLive, double lnZTol, int maxIter, unsigned int nestSeed, int numStart, double[::1] xStart not None, double[::1] Samples not None, double[::1] LnPrior not None, double[::1] LnLikelihood not None, double[::1] LnWeight not None):
+		cdef int maxSamples = LnWeight.shape[0]
+		cdef int result
+		with nogil:
+			result = self.thisptr.nest_CARMAModel(dt, numCadences, tolIR, maxSigma, minTimescale, maxTimescale, &t[0], &x[0], &y[0], &yerr[0], &mask[0], numLive, lnZTol, maxIter, nestSeed, numStart, &xStart[0], maxSamples, &Samples[0], &LnPrior[0], &LnLikelihood[0], &LnWeight[0])
+		return result
+
+	@cython.boundscheck(False)
+	@cython.wraparound(False)
+	def laplace_CARMAModel(self, int[::1] cadenceOffsets not None, double tolIR, double[::1] maxSigma not None, double[::1] minTimescale not None, double[::1] maxTimescale not None, double[::1] t not None, double[::1] x not None, double[::1] y not None, double[::1] yerr not None, double[::1] mask not None, int numStarts, double[::1] xStart not None, int maxEvals, double xTol, double[::1] MAP not None, double[::1] Cov not None, double[::1] LnPosteriorMAP not None, double[::1] LnLaplace not None, int[::1] Status not None):
+		cdef int numLCs = cadenceOffsets.shape[0] - 1
+		cdef int result
+		with nogil:
+			result = self.thisptr.laplace_CARMAModel(numLCs, &cadenceOffsets[0], tolIR, &maxSigma[0], &minTimescale[0], &maxTimescale[0], &t[0], &x[0], &y[0], &yerr[0], &mask[0], numStarts, &xStart[0], maxEvals, xTol, &MAP[0], &Cov[0], &LnPosteriorMAP[0], &LnLaplace[0], &Status[0])
+		return result
+
+	@cython.boundscheck(False)
+	@cython.wraparound(False)
+	def smooth_RTS(self, int numCadences, int cadenceNum, double tolIR, double[::1] t not None, double[::1] x not None, double[::1] y not None, double[::1] yerr not None, double[::1] mask not None, double[::1] X not None, double[::1] P not None, double[::1] XSmooth not None, double[::1] PSmooth not None, int threadNum = 0):
+		cdef int result
+		with nogil:
+			result = self.thisptr.smooth_RTS(numCadences, cadenceNum, tolIR, &t[0], &x[0], &y[0], &yerr[0], &mask[0], &X[0], &P[0], &XSmooth[0], &PSmooth[0], threadNum)
+		return result
@@ -0,0 +1,190 @@
+#ifdef __INTEL_COMPILER
+    #include <mathimf.h>
+    #if defined __APPLE__ && defined __MACH__
+        #include <malloc/malloc.h>
+    #else
+        #include <malloc.h>
+    #endif
+#else
+    #include <math.h>
+    #include <mm_malloc.h>
+#endif
+#include <mkl.h>
+#include <mkl_types.h>
+#include <omp.h>
+#include <algorithm>
+#include <vector>
+#include "Cadence.hpp"
+#include "Execution.hpp"
+
+//#define DEBUG_MASKWEATHER
+
+#if defined DEBUG_MASKWEATHER
+	#include <cstdio>
+#endif
+
+using namespace std;
+
+static int countUnmasked(int numCadences, double *mask) {
+	int numUnmasked = 0;
+	#pragma omp simd reduction(+:numUnmasked)
+	for (int i = 0; i < numCadences; ++i) {
+		numUnmasked += (mask[i] != 0.0) ? 1 : 0;
+		}
+	return numUnmasked;
+	}
+
+static int blockOf(double t, double tStart, double blockLength) {
+	return static_cast<int>(floor((t - tStart)/blockLength));
+	}
+
+int kali::maskWindows(int numCadences, double *t, double *mask, double period, double openLength, double phase) {
+	/*!
+	Keep only the cadences that fall in [phase, phase + openLength) modulo period. With period ~ 365.25 d this models observing seasons, with period = 1 d the part of each night a field is above the horizon, and with the K2 thruster period it gives regularly spaced gaps.
+	*/
+	if ((numCadences < 1) or (period <= 0.0) or (openLength <= 0.0) or (openLength > period)) {
+		return -1;
+		}
+	#pragma omp simd
+	for (int i = 0; i < numCadences; ++i) {
+		double offset = t[i] - phase;
+		offset -= floor(offset/period)*period;
+		if (offset >= openLength) {
+			mask[i] = 0.0;
+			}
+		}
+	return countUnmasked(numCadences, mask);
+	}
+
+int kali::maskWeather(int numCadences, double *t, double *mask, double blockLength, double lossFraction, double persistence, unsigned int weatherSeed) {
+	/*!
+	Lose whole blocks (nights, for blockLength = 1 d) to weather. Bad weather is a two-state Markov chain over consecutive blocks with stationary loss probability lossFraction and lag-one correlation persistence, i.e. P(bad | good) = lossFraction*(1 - persistence) and P(bad | bad) = lossFraction + persistence*(1 - lossFraction). persistence = 0 loses each block independently.
+	*/
+	if ((numCadences < 1) or (blockLength <= 0.0) or (lossFraction < 0.0) or (lossFraction > 1.0) or (persistence < 0.0) or (persistence >= 1.0)) {
+		return -1;
+		}
+	double tStart = t[0];
+	int numBlocks = blockOf(t[numCadences - 1], tStart, blockLength) + 1;
+	double *blockRand = static_cast<double*>(_mm_malloc(numBlocks*sizeof(double), 64));
+	VSLStreamStatePtr weatherStream __attribute__((aligned(64)));
+	vslNewStream(&weatherStream, VSL_BRNG_SFMT19937, weatherSeed);
+	vdRngUniform(VSL_RNG_METHOD_UNIFORM_STD, weatherStream, numBlocks, blockRand, 0.0, 1.0);
+	vslDeleteStream(&weatherStream);
+	double badAfterGood = lossFraction*(1.0 - persistence), badAfterBad = lossFraction + persistence*(1.0 - lossFraction);
+	bool bad = blockRand[0] < lossFraction;
+	blockRand[0] = bad ? 0.0 : 1.0;
+	for (int blockNum = 1; blockNum < numBlocks; ++blockNum) {
+		bad = blockRand[blockNum] < (bad ? badAfterBad : badAfterGood);
+		blockRand[blockNum] = bad ? 0.0 : 1.0; // blockRand now holds the weather factor of each block
+		}
+	#ifdef DEBUG_MASKWEATHER
+		printf("maskWeather - numBlocks: %d\n", numBlocks);
+	#endif
+	#pragma omp simd
+	for (int i = 0; i < numCadences; ++i) {
+		mask[i] *= blockRand[blockOf(t[i], tStart, blockLength)];
+		}
+	_mm_free(blockRand);
+	return countUnmasked(numCadences, mask);
+	}
+
+int kali::maskVisits(int numCadences, double *t, double *mask, double blockLength, int visitsPerBlock, unsigned int visitSeed) {
+	/*!
+	Keep at most visitsPerBlock of the unmasked cadences in each block, chosen at random, e.g. the two visits a night a field gets from a survey that observes on a fine time grid. Every cadence gets one uniform key from a single draw and each block keeps its visitsPerBlock smallest keys, so the blocks can be handled in parallel.
+	*/
+	if ((numCadences < 1) or (blockLength <= 0.0) or (visitsPerBlock < 1)) {
+		return -1;
+		}
+	double tStart = t[0];
+	double *keys = static_cast<double*>(_mm_malloc(numCadences*sizeof(double), 64));
+	VSLStreamStatePtr visitStream __attribute__((aligned(64)));
+	vslNewStream(&visitStream, VSL_BRNG_SFMT19937, visitSeed);
+	vdRngUniform(VSL_RNG_METHOD_UNIFORM_STD, visitStream, numCadences, keys, 0.0, 1.0);
+	vslDeleteStream(&visitStream);
+	vector<int> blockStarts;
+	blockStarts.push_back(0);
+	for (int i = 1; i < numCadences; ++i) {
+		if (blockOf(t[i], tStart, blockLength) != blockOf(t[i - 1], tStart, blockLength)) {
+			blockStarts.push_back(i);
+			}
+		}
+	blockStarts.push_back(numCadences);
+	int numBlocks = static_cast<int>(blockStarts.size()) - 1;
+	kali::ThreadLease lease(kali::LC_TASK, kali::get_ExecutionContext()->get_maxThreads());
+	int numThreads = lease.get_numThreads();
+	#pragma omp parallel for schedule(dynamic, 64) num_threads(numThreads) default(none) shared(numBlocks, blockStarts, mask, keys, visitsPerBlock)
+	for (int blockNum = 0; blockNum < numBlocks; ++blockNum) {
+		vector<double> blockKeys;
+		for (int i = blockStarts[blockNum]; i < blockStarts[blockNum + 1]; ++i) {
+			if (mask[i] != 0.0) {
+				blockKeys.push_back(keys[i]);
+				}
+			}
+		if (static_cast<int>(blockKeys.size()) > visitsPerBlock) {
+			nth_element(blockKeys.begin(), blockKeys.begin() + visitsPerBlock - 1, blockKeys.end());
+			double maxKey = blockKeys[visitsPerBlock - 1];
+			for (int i = blockStarts[blockNum]; i < blockStarts[blockNum + 1]; ++i) {
+				if (keys[i] > maxKey) {
+					mask[i] = 0.0;
+					}
+				}
+			}
+		}
+	_mm_free(keys);
+	return countUnmasked(numCadences, mask);
+	}
+
+int kali::maskThrusterFires(int numCadences, double *t, double *mask, double firePeriod, double fireWidth, double jitter, unsigned int fireSeed) {
+	/*!
+	Mask the cadences within fireWidth/2 of a K2 thruster firing. Firing k happens at t[0] + (k + 1/2)*firePeriod plus a uniform offset in [-jitter, jitter], which must be less than half of firePeriod - fireWidth so that only the nearest firing can cover a cadence.
+	*/
+	if ((numCadences < 1) or (firePeriod <= 0.0) or (fireWidth < 0.0) or (jitter < 0.0) or (2.0*jitter + fireWidth >= firePeriod)) {
+		return -1;
+		}
+	double tStart = t[0];
+	int numFires = blockOf(t[numCadences - 1], tStart, firePeriod) + 1;
+	double *fireTimes = static_cast<double*>(_mm_malloc(numFires*sizeof(double), 64));
+	VSLStreamStatePtr fireStream __attribute__((aligned(64)));
+	vslNewStream(&fireStream, VSL_BRNG_SFMT19937, fireSeed);
+	vdRngUniform(VSL_RNG_METHOD_UNIFORM_STD, fireStream, numFires, fireTimes, -1.0, 1.0);
+	vslDeleteStream(&fireStream);
+	#pragma omp simd
+	for (int fireNum = 0; fireNum < numFires; ++fireNum) {
+		fireTimes[fireNum] = tStart + (fireNum + 0.5)*firePeriod + jitter*fireTimes[fireNum];
+		}
+	double halfWidth = fireWidth/2.0;
+	#pragma omp simd
+	for (int i = 0; i < numCadences; ++i) {
+		int fireNum = blockOf(t[i], tStart, firePeriod);
+		fireNum = (fireNum < numFires) ? fireNum : numFires - 1;
+		if (fabs(t[i] - fireTimes[fireNum]) <= halfWidth) {
+			mask[i] = 0.0;
+			}
+		}
+	_mm_free(fireTimes);
+	return countUnmasked(numCadences, mask);
+	}
+
+int kali::maskRolling(int numCadences, double *t, double *mask, double seasonPeriod, int numStripes, int stripe, double backgroundFraction, unsigned int rollSeed) {
+	/*!
+	LSST-like rolling cadence. The sky is split into numStripes declination stripes that take turns being active, one season each. A field in stripe keeps all its cadences in its active seasons and each of the others with probability backgroundFraction.
+	*/
+	if ((numCadences < 1) or (seasonPeriod <= 0.0) or (numStripes < 1) or (stripe < 0) or (stripe >= numStripes) or (backgroundFraction < 0.0) or (backgroundFraction > 1.0)) {
+		return -1;
+		}
+	double tStart = t[0];
+	double *keepRand = static_cast<double*>(_mm_malloc(numCadences*sizeof(double), 64));
+	VSLStreamStatePtr rollStream __attribute__((aligned(64)));
+	vslNewStream(&rollStream, VSL_BRNG_SFMT19937, rollSeed);
+	vdRngUniform(VSL_RNG_METHOD_UNIFORM_STD, rollStream, numCadences, keepRand, 0.0, 1.0);
+	vslDeleteStream(&rollStream);
+	#pragma omp simd
+	for (int i = 0; i < numCadences; ++i) {
+		bool active = (blockOf(t[i], tStart, seasonPeriod)%numStripes) == stripe;
+		if ((not active) and (keepRand[i] >= backgroundFraction)) {
+			mask[i] = 0.0;
+			}
+		}
+	_mm_free(keepRand);
+	return countUnmasked(numCadences, mask);
+	}
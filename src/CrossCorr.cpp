@@ -0,0 +1,418 @@
+#ifdef __INTEL_COMPILER
+    #include <mathimf.h>
+    #if defined __APPLE__ && defined __MACH__
+        #include <malloc/malloc.h>
+    #else
+        #include <malloc.h>
+    #endif
+#else
+    #include <math.h>
+    #include <mm_malloc.h>
+#endif
+#include <mkl.h>
+#include <mkl_types.h>
+#include <omp.h>
+#include <limits>
+#include <algorithm>
+#include <vector>
+#include "Execution.hpp"
+#include "CrossCorr.hpp"
+
+//#define DEBUG_ZDCF
+//#define DEBUG_CROSSCORRMC
+
+#if defined DEBUG_ZDCF || defined DEBUG_CROSSCORRMC
+	#include <cstdio>
+#endif
+
+using namespace std;
+
+struct Series {
+	vector<double> t, y, yerr;
+	int size() const {
+		return static_cast<int>(t.size());
+		}
+	};
+
+struct LagPair {
+	double lag;
+	int first, second;
+	bool operator<(const LagPair &other) const {
+		if (lag != other.lag) {
+			return lag < other.lag;
+			}
+		return (first != other.first) ? (first < other.first) : (second < other.second);
+		}
+	};
+
+static void compact(int numCadences, double *t, double *y, double *yerr, double *mask, Series &series) {
+	/*!
+	Copy the unmasked cadences into series. yerr may be nullptr, in which case the errors are set to zero.
+	*/
+	series.t.clear();
+	series.y.clear();
+	series.yerr.clear();
+	for (int i = 0; i < numCadences; ++i) {
+		if (mask[i] != 0.0) {
+			series.t.push_back(t[i]);
+			series.y.push_back(y[i]);
+			series.yerr.push_back((yerr != nullptr) ? yerr[i] : 0.0);
+			}
+		}
+	}
+
+static double correlationDenominator(int numCadences, const double *y, const double *yerr) {
+	/*!
+	Variance of y less the square of the mean error (EK 1988), falling back to the variance if the errors exceed it.
+	*/
+	double meanVal = 0.0, meanErrVal = 0.0, varVal = 0.0;
+	for (int i = 0; i < numCadences; ++i) {
+		meanVal += y[i];
+		meanErrVal += yerr[i];
+		}
+	meanVal /= numCadences;
+	meanErrVal /= numCadences;
+	for (int i = 0; i < numCadences; ++i) {
+		varVal += (y[i] - meanVal)*(y[i] - meanVal);
+		}
+	varVal /= numCadences;
+	return (varVal - meanErrVal*meanErrVal > 0.0) ? varVal - meanErrVal*meanErrVal : varVal;
+	}
+
+static void dcfCore(int numThreads, int n1, const double *t1, const double *y1, const double *yerr1, int n2, const double *t2, const double *y2, const double *yerr2, int numBins, const double *lagVals, double *dcfVals, double *dcfErrVals, double *numPairVals) {
+	/*!
+	Every pair is visited once, as in kali::dacf: the lags t2[j] - t1[i] of row i increase with j, so the row starts at the first cadence in the lowest bin and steps the bin forward. Each thread bins its rows into its own histogram of weights, sums and sums of squares.
+	*/
+	double nanVal = numeric_limits<double>::quiet_NaN();
+	for (int binCtr = 0; binCtr < numBins; ++binCtr) {
+		dcfVals[binCtr] = nanVal;
+		dcfErrVals[binCtr] = nanVal;
+		numPairVals[binCtr] = 0.0;
+		}
+	if ((n1 < 2) or (n2 < 2)) {
+		return;
+		}
+	vector<double> binEdges(numBins + 1);
+	binEdges[0] = lagVals[0] - 0.5*(lagVals[1] - lagVals[0]);
+	for (int binCtr = 1; binCtr < numBins; ++binCtr) {
+		binEdges[binCtr] = 0.5*(lagVals[binCtr - 1] + lagVals[binCtr]);
+		}
+	binEdges[numBins] = lagVals[numBins - 1] + 0.5*(lagVals[numBins - 1] - lagVals[numBins - 2]);
+	double mean1 = 0.0, mean2 = 0.0;
+	for (int i = 0; i < n1; ++i) {
+		mean1 += y1[i];
+		}
+	for (int j = 0; j < n2; ++j) {
+		mean2 += y2[j];
+		}
+	mean1 /= n1;
+	mean2 /= n2;
+	double denomVal = sqrt(correlationDenominator(n1, y1, yerr1)*correlationDenominator(n2, y2, yerr2));
+	if (denomVal <= 0.0) {
+		return;
+		}
+	int histStride = 8*((3*numBins + 7)/8);
+	vector<double> binHists(numThreads*histStride, 0.0);
+	double *hists = binHists.data(), *edges = binEdges.data();
+	#pragma omp parallel for schedule(dynamic, 16) num_threads(numThreads) default(none) shared(n1, t1, y1, n2, t2, y2, numBins, mean1, mean2, denomVal, hists, edges, histStride)
+	for (int i = 0; i < n1; ++i) {
+		double *binWeight = hists + omp_get_thread_num()*histStride, *binSum = binWeight + numBins, *binSumSq = binSum + numBins;
+		double first = (y1[i] - mean1)/denomVal;
+		int binCtr = 0;
+		for (int j = static_cast<int>(lower_bound(t2, t2 + n2, t1[i] + edges[0]) - t2); j < n2; ++j) {
+			double lag = t2[j] - t1[i];
+			if (lag >= edges[numBins]) {
+				break;
+				}
+			while (lag >= edges[binCtr + 1]) {
+				binCtr += 1;
+				}
+			double udcf = first*(y2[j] - mean2);
+			binWeight[binCtr] += 1.0;
+			binSum[binCtr] += udcf;
+			binSumSq[binCtr] += udcf*udcf;
+			}
+		}
+	for (int threadCtr = 1; threadCtr < numThreads; ++threadCtr) {
+		#pragma omp simd
+		for (int histCtr = 0; histCtr < 3*numBins; ++histCtr) {
+			hists[histCtr] += hists[threadCtr*histStride + histCtr];
+			}
+		}
+	for (int binCtr = 0; binCtr < numBins; ++binCtr) {
+		double numPairs = hists[binCtr], binSum = hists[numBins + binCtr], binSumSq = hists[2*numBins + binCtr];
+		numPairVals[binCtr] = numPairs;
+		if (numPairs > 0.0) {
+			dcfVals[binCtr] = binSum/numPairs;
+			}
+		if (numPairs > 1.0) {
+			double sumSqDev = binSumSq - binSum*dcfVals[binCtr];
+			dcfErrVals[binCtr] = sqrt((sumSqDev > 0.0) ? sumSqDev : 0.0)/(numPairs - 1.0);
+			}
+		}
+	}
+
+static int zdcfCore(int n1, const double *t1, const double *y1, int n2, const double *t2, const double *y2, double minLag, double maxLag, int minPairs, int maxBins, double *lagVals, double *zdcfVals, double *zdcfErrLowVals, double *zdcfErrHighVals, double *numPairVals) {
+	/*!
+	The pairs in [minLag, maxLag] are collected and sorted by lag, so this needs memory for all of them. Bins are then filled in lag order; used1 and used2 hold the last bin each cadence went into.
+	*/
+	vector<LagPair> pairs;
+	for (int i = 0; i < n1; ++i) {
+		for (int j = static_cast<int>(lower_bound(t2, t2 + n2, t1[i] + minLag) - t2); (j < n2) and (t2[j] - t1[i] <= maxLag); ++j) {
+			LagPair pair = {t2[j] - t1[i], i, j};
+			pairs.push_back(pair);
+			}
+		}
+	sort(pairs.begin(), pairs.end());
+	vector<int> used1(n1, -1), used2(n2, -1), members;
+	int numBins = 0;
+	for (int pairNum = 0; (pairNum < static_cast<int>(pairs.size())) and (numBins < maxBins); ++pairNum) {
+		const LagPair &pair = pairs[pairNum];
+		if ((used1[pair.first] == numBins) or (used2[pair.second] == numBins)) {
+			continue;
+			}
+		used1[pair.first] = numBins;
+		used2[pair.second] = numBins;
+		members.push_back(pairNum);
+		if (static_cast<int>(members.size()) < minPairs) {
+			continue;
+			}
+		double n = static_cast<double>(members.size()), meanLag = 0.0, mean1 = 0.0, mean2 = 0.0;
+		for (int memberNum = 0; memberNum < static_cast<int>(members.size()); ++memberNum) {
+			const LagPair &member = pairs[members[memberNum]];
+			meanLag += member.lag;
+			mean1 += y1[member.first];
+			mean2 += y2[member.second];
+			}
+		meanLag /= n;
+		mean1 /= n;
+		mean2 /= n;
+		double var1 = 0.0, var2 = 0.0, cov = 0.0;
+		for (int memberNum = 0; memberNum < static_cast<int>(members.size()); ++memberNum) {
+			const LagPair &member = pairs[members[memberNum]];
+			double dev1 = y1[member.first] - mean1, dev2 = y2[member.second] - mean2;
+			var1 += dev1*dev1;
+			var2 += dev2*dev2;
+			cov += dev1*dev2;
+			}
+		lagVals[numBins] = meanLag;
+		numPairVals[numBins] = n;
+		zdcfVals[numBins] = numeric_limits<double>::quiet_NaN();
+		zdcfErrLowVals[numBins] = numeric_limits<double>::quiet_NaN();
+		zdcfErrHighVals[numBins] = numeric_limits<double>::quiet_NaN();
+		if ((var1 > 0.0) and (var2 > 0.0)) {
+			// Bias-corrected Fisher z and its spread (Alexander 1997, eqs. 9 - 11)
+			double r = cov/sqrt(var1*var2);
+			r = (r > 1.0) ? 1.0 : ((r < -1.0) ? -1.0 : r);
+			double rSq = r*r, nm1 = n - 1.0;
+			double zBar = atanh(r) + (r/(2.0*nm1))*(1.0 + (5.0 + rSq)/(4.0*nm1) + (11.0 + 2.0*rSq + 3.0*rSq*rSq)/(8.0*nm1*nm1));
+			double sZ = sqrt((1.0 + (4.0 - rSq)/(2.0*nm1) + (22.0 - 6.0*rSq - 3.0*rSq*rSq)/(6.0*nm1*nm1))/nm1);
+			zdcfVals[numBins] = r;
+			zdcfErrLowVals[numBins] = r - tanh(zBar - sZ);
+			zdcfErrHighVals[numBins] = tanh(zBar + sZ) - r;
+			}
+		#ifdef DEBUG_ZDCF
+			printf("zdcf - bin: %d; lag: %e; numPairs: %e; zdcf: %e\n", numBins, lagVals[numBins], n, zdcfVals[numBins]);
+		#endif
+		members.clear();
+		numBins += 1;
+		}
+	return numBins;
+	}
+
+static double interpolatedCorrelation(int nA, const double *tA, const double *yA, int nB, const double *tB, const double *yB, double shift) {
+	/*!
+	Pearson coefficient of yA[i] and yB linearly interpolated at tA[i] + shift, over the i for which tA[i] + shift falls inside tB. The moments are updated one point at a time (Welford), so large mean fluxes do not cancel.
+	*/
+	double count = 0.0, meanA = 0.0, meanB = 0.0, varA = 0.0, varB = 0.0, cov = 0.0;
+	int k = 0;
+	for (int i = 0; i < nA; ++i) {
+		double tShift = tA[i] + shift;
+		if (tShift < tB[0]) {
+			continue;
+			}
+		if (tShift > tB[nB - 1]) {
+			break;
+			}
+		while ((k < nB - 2) and (tB[k + 1] < tShift)) {
+			k += 1;
+			}
+		double span = tB[k + 1] - tB[k];
+		double yInterp = (span > 0.0) ? yB[k] + (yB[k + 1] - yB[k])*(tShift - tB[k])/span : yB[k];
+		count += 1.0;
+		double devA = yA[i] - meanA, devB = yInterp - meanB;
+		meanA += devA/count;
+		meanB += devB/count;
+		varA += devA*(yA[i] - meanA);
+		varB += devB*(yInterp - meanB);
+		cov += devA*(yInterp - meanB);
+		}
+	if ((count < 3.0) or (varA <= 0.0) or (varB <= 0.0)) {
+		return numeric_limits<double>::quiet_NaN();
+		}
+	return cov/sqrt(varA*varB);
+	}
+
+static void iccfCore(int numThreads, int n1, const double *t1, const double *y1, int n2, const double *t2, const double *y2, int numLags, const double *lagVals, double *iccfVals) {
+	#pragma omp parallel for schedule(static) num_threads(numThreads) default(none) shared(n1, t1, y1, n2, t2, y2, numLags, lagVals, iccfVals)
+	for (int lagNum = 0; lagNum < numLags; ++lagNum) {
+		double nanVal = numeric_limits<double>::quiet_NaN();
+		if ((n1 < 2) or (n2 < 2)) {
+			iccfVals[lagNum] = nanVal;
+			continue;
+			}
+		double forward = interpolatedCorrelation(n1, t1, y1, n2, t2, y2, lagVals[lagNum]);
+		double backward = interpolatedCorrelation(n2, t2, y2, n1, t1, y1, -lagVals[lagNum]);
+		if (isnan(forward)) {
+			iccfVals[lagNum] = backward;
+			} else if (isnan(backward)) {
+			iccfVals[lagNum] = forward;
+			} else {
+			iccfVals[lagNum] = 0.5*(forward + backward);
+			}
+		}
+	}
+
+static void peakCentroid(int numLags, const double *lagVals, const double *ccfVals, double threshold, double &peakLag, double &centroidLag, double &peakVal) {
+	/*!
+	Peak of the CCF and the centroid of the contiguous run of lags around it with ccf >= threshold*peak.
+	*/
+	peakLag = centroidLag = peakVal = numeric_limits<double>::quiet_NaN();
+	int peakNum = -1;
+	for (int lagNum = 0; lagNum < numLags; ++lagNum) {
+		if ((not isnan(ccfVals[lagNum])) and ((peakNum < 0) or (ccfVals[lagNum] > ccfVals[peakNum]))) {
+			peakNum = lagNum;
+			}
+		}
+	if ((peakNum < 0) or (ccfVals[peakNum] <= 0.0)) {
+		return;
+		}
+	peakVal = ccfVals[peakNum];
+	peakLag = lagVals[peakNum];
+	double cut = threshold*peakVal, weightSum = 0.0, lagSum = 0.0;
+	int lagNum = peakNum;
+	while ((lagNum > 0) and (ccfVals[lagNum - 1] >= cut)) {
+		lagNum -= 1;
+		}
+	for (; (lagNum < numLags) and (ccfVals[lagNum] >= cut); ++lagNum) {
+		weightSum += ccfVals[lagNum];
+		lagSum += ccfVals[lagNum]*lagVals[lagNum];
+		}
+	centroidLag = lagSum/weightSum;
+	}
+
+static void realize(VSLStreamStatePtr stream, const Series &series, int fluxRandomization, int subsetSelection, int *draws, double *deviates, Series &out) {
+	/*!
+	One FR/RSS realization of series. The stream always advances by the same amount so that the draws of a realization do not depend on the options.
+	*/
+	int n = series.size();
+	viRngUniform(VSL_RNG_METHOD_UNIFORM_STD, stream, n, draws, 0, n);
+	vdRngGaussian(VSL_RNG_METHOD_GAUSSIAN_ICDF, stream, n, deviates, 0.0, 1.0);
+	vector<int> multiplicity(n, 1);
+	if (subsetSelection) {
+		fill(multiplicity.begin(), multiplicity.end(), 0);
+		for (int i = 0; i < n; ++i) {
+			multiplicity[draws[i]] += 1;
+			}
+		}
+	out.t.clear();
+	out.y.clear();
+	out.yerr.clear();
+	for (int i = 0; i < n; ++i) {
+		if (multiplicity[i] > 0) {
+			double err = series.yerr[i]/sqrt(static_cast<double>(multiplicity[i]));
+			out.t.push_back(series.t[i]);
+			out.y.push_back(series.y[i] + (fluxRandomization ? err*deviates[i] : 0.0));
+			out.yerr.push_back(err);
+			}
+		}
+	}
+
+int kali::dcf(int numCadences1, double *t1, double *y1, double *yerr1, double *mask1, int numCadences2, double *t2, double *y2, double *yerr2, double *mask2, int numBins, double *lagVals, double *dcfVals, double *dcfErrVals, double *numPairVals) {
+	if ((numCadences1 < 1) or (numCadences2 < 1) or (numBins < 2)) {
+		return -1;
+		}
+	Series series1, series2;
+	compact(numCadences1, t1, y1, yerr1, mask1, series1);
+	compact(numCadences2, t2, y2, yerr2, mask2, series2);
+	kali::ThreadLease lease(kali::LC_TASK, kali::get_ExecutionContext()->get_maxThreads());
+	dcfCore(lease.get_numThreads(), series1.size(), series1.t.data(), series1.y.data(), series1.yerr.data(), series2.size(), series2.t.data(), series2.y.data(), series2.yerr.data(), numBins, lagVals, dcfVals, dcfErrVals, numPairVals);
+	return 0;
+	}
+
+int kali::zdcf(int numCadences1, double *t1, double *y1, double *mask1, int numCadences2, double *t2, double *y2, double *mask2, double minLag, double maxLag, int minPairs, int maxBins, double *lagVals, double *zdcfVals, double *zdcfErrLowVals, double *zdcfErrHighVals, double *numPairVals) {
+	if ((numCadences1 < 1) or (numCadences2 < 1) or (minLag > maxLag) or (minPairs < 4) or (maxBins < 1)) {
+		return -1;
+		}
+	Series series1, series2;
+	compact(numCadences1, t1, y1, nullptr, mask1, series1);
+	compact(numCadences2, t2, y2, nullptr, mask2, series2);
+	kali::ThreadLease lease(kali::LC_TASK, 1); // zdcfCore is serial
+	return zdcfCore(series1.size(), series1.t.data(), series1.y.data(), series2.size(), series2.t.data(), series2.y.data(), minLag, maxLag, minPairs, maxBins, lagVals, zdcfVals, zdcfErrLowVals, zdcfErrHighVals, numPairVals);
+	}
+
+int kali::iccf(int numCadences1, double *t1, double *y1, double *mask1, int numCadences2, double *t2, double *y2, double *mask2, int numLags, double *lagVals, double *iccfVals) {
+	if ((numCadences1 < 1) or (numCadences2 < 1) or (numLags < 1)) {
+		return -1;
+		}
+	Series series1, series2;
+	compact(numCadences1, t1, y1, nullptr, mask1, series1);
+	compact(numCadences2, t2, y2, nullptr, mask2, series2);
+	kali::ThreadLease lease(kali::LC_TASK, kali::get_ExecutionContext()->get_maxThreads());
+	iccfCore(lease.get_numThreads(), series1.size(), series1.t.data(), series1.y.data(), series2.size(), series2.t.data(), series2.y.data(), numLags, lagVals, iccfVals);
+	return 0;
+	}
+
+int kali::crossCorrMC(int method, int numCadences1, double *t1, double *y1, double *yerr1, double *mask1, int numCadences2, double *t2, double *y2, double *yerr2, double *mask2, int numLags, double *lagVals, int minPairs, double threshold, int numRealizations, int fluxRandomization, int subsetSelection, unsigned int mcSeed, double *peakLagVals, double *centroidLagVals, double *peakVals) {
+	/*!
+	The realizations are independent and are spread over the leased threads with a dynamic schedule; each computes its CCF on one thread. Realization k uses VSL_BRNG_MT2203 stream k%6024 seeded with mcSeed + k/6024 and draws the subset and the flux deviates of the first light curve before those of the second.
+	*/
+	if ((method < CCF_DCF) or (method > CCF_ICCF) or (numCadences1 < 1) or (numCadences2 < 1) or (numLags < 2) or (numRealizations < 1) or ((method == CCF_ZDCF) and (minPairs < 4)) or (threshold < 0.0) or (threshold > 1.0)) {
+		return -1;
+		}
+	Series base1, base2;
+	compact(numCadences1, t1, y1, yerr1, mask1, base1);
+	compact(numCadences2, t2, y2, yerr2, mask2, base2);
+	int n1 = base1.size(), n2 = base2.size();
+	if ((n1 < 2) or (n2 < 2)) {
+		return -1;
+		}
+	int maxBins = numLags;
+	if (method == CCF_ZDCF) {
+		// A realization keeps a subset of the cadences, so it has no more pairs in [lagVals[0], lagVals[numLags - 1]] than base1 and base2; each bin holds at least minPairs of them
+		long numPairs = 0;
+		for (int i = 0; i < n1; ++i) {
+			numPairs += upper_bound(base2.t.begin(), base2.t.end(), base1.t[i] + lagVals[numLags - 1]) - lower_bound(base2.t.begin(), base2.t.end(), base1.t[i] + lagVals[0]);
+			}
+		maxBins = static_cast<int>(numPairs/minPairs + 1);
+		}
+	kali::ThreadLease lease(kali::LC_TASK, kali::get_ExecutionContext()->get_maxThreads());
+	int numThreads = lease.get_numThreads();
+	#pragma omp parallel for schedule(dynamic, 1) num_threads(numThreads) default(none) shared(method, base1, base2, n1, n2, numLags, lagVals, minPairs, maxBins, threshold, numRealizations, fluxRandomization, subsetSelection, mcSeed, peakLagVals, centroidLagVals, peakVals)
+	for (int realizationNum = 0; realizationNum < numRealizations; ++realizationNum) {
+		VSLStreamStatePtr mcStream __attribute__((aligned(64)));
+		vslNewStream(&mcStream, VSL_BRNG_MT2203 + (realizationNum%6024), mcSeed + realizationNum/6024);
+		vector<int> draws(max(n1, n2));
+		vector<double> deviates(max(n1, n2));
+		Series series1, series2;
+		realize(mcStream, base1, fluxRandomization, subsetSelection, draws.data(), deviates.data(), series1);
+		realize(mcStream, base2, fluxRandomization, subsetSelection, draws.data(), deviates.data(), series2);
+		vslDeleteStream(&mcStream);
+		vector<double> ccfLags(maxBins), ccfVals(maxBins), scratch1(maxBins), scratch2(maxBins), scratch3(maxBins);
+		int numVals = numLags;
+		if (method == CCF_DCF) {
+			copy(lagVals, lagVals + numLags, ccfLags.begin());
+			dcfCore(1, series1.size(), series1.t.data(), series1.y.data(), series1.yerr.data(), series2.size(), series2.t.data(), series2.y.data(), series2.yerr.data(), numLags, lagVals, ccfVals.data(), scratch1.data(), scratch2.data());
+			} else if (method == CCF_ZDCF) {
+			numVals = zdcfCore(series1.size(), series1.t.data(), series1.y.data(), series2.size(), series2.t.data(), series2.y.data(), lagVals[0], lagVals[numLags - 1], minPairs, maxBins, ccfLags.data(), ccfVals.data(), scratch1.data(), scratch2.data(), scratch3.data());
+			} else {
+			copy(lagVals, lagVals + numLags, ccfLags.begin());
+			iccfCore(1, series1.size(), series1.t.data(), series1.y.data(), series2.size(), series2.t.data(), series2.y.data(), numLags, lagVals, ccfVals.data());
+			}
+		peakCentroid(numVals, ccfLags.data(), ccfVals.data(), threshold, peakLagVals[realizationNum], centroidLagVals[realizationNum], peakVals[realizationNum]);
+		#ifdef DEBUG_CROSSCORRMC
+			printf("crossCorrMC - threadNum: %d; realization: %d; n1: %d; n2: %d; peakLag: %e; centroidLag: %e\n", omp_get_thread_num(), realizationNum, series1.size(), series2.size(), peakLagVals[realizationNum], centroidLagVals[realizationNum]);
+		#endif
+		}
+	return 0;
+	}
@@ -0,0 +1,196 @@
+#include <omp.h>
+#include <algorithm>
+#include <mutex>
+#include <condition_variable>
+#include <mkl.h>
+#include "Execution.hpp"
+
+//#define DEBUG_THREADLEASE
+
+#ifdef DEBUG_THREADLEASE
+#include <stdio.h>
+#endif
+
+using namespace std;
+
+static kali::ExecutionContext *attachedContext = nullptr;
+static thread_local int heldThreads = 0; // Grant of the innermost lease held by this thread, 0 if none
+
+kali::ExecutionContext* kali::get_ExecutionContext() {
+	/*!
+	The context attached with attach_ExecutionContext, or a module-local one created on first use.
+	*/
+	if (attachedContext == nullptr) {
+		static kali::ExecutionContext localContext(omp_get_num_procs());
+		attachedContext = &localContext;
+		}
+	return attachedContext;
+	}
+
+void kali::attach_ExecutionContext(kali::ExecutionContext *context) {
+	attachedContext = context;
+	}
+
+kali::ExecutionContext::ExecutionContext(int maxThreadsGiven) {
+	maxThreads = max(maxThreadsGiven, 1);
+	activeThreads = 0;
+	peakThreads = 0;
+	for (int kindNum = 0; kindNum < kali::NUM_TASK_KINDS; ++kindNum) {
+		taskLimit[kindNum] = 0;
+		taskActive[kindNum] = 0;
+		}
+	reset_Stats();
+	}
+
+int kali::ExecutionContext::available(int taskKind) {
+	/*!
+	Threads a new lease of taskKind could be granted right now. A task limit of 0 means the kind is only bounded by maxThreads. Must be called with lock held.
+	*/
+	int free = maxThreads - activeThreads;
+	if (taskLimit[taskKind] > 0) {
+		free = min(free, taskLimit[taskKind] - taskActive[taskKind]);
+		}
+	return free;
+	}
+
+int kali::ExecutionContext::get_maxThreads() {
+	lock_guard<mutex> guard(lock);
+	return maxThreads;
+	}
+
+void kali::ExecutionContext::set_maxThreads(int maxThreadsGiven) {
+	/*!
+	Resize the budget. Leases already granted keep their threads; a smaller budget only takes effect as they are released.
+	*/
+	{
+		lock_guard<mutex> guard(lock);
+		maxThreads = max(maxThreadsGiven, 1);
+	}
+	released.notify_all();
+	}
+
+int kali::ExecutionContext::get_taskLimit(int taskKind) {
+	lock_guard<mutex> guard(lock);
+	return taskLimit[taskKind];
+	}
+
+void kali::ExecutionContext::set_taskLimit(int taskKind, int limit) {
+	/*!
+	Cap the number of threads all tasks of taskKind may hold at once; 0 removes the cap.
+	*/
+	{
+		lock_guard<mutex> guard(lock);
+		taskLimit[taskKind] = max(limit, 0);
+	}
+	released.notify_all();
+	}
+
+int kali::ExecutionContext::get_activeThreads() {
+	lock_guard<mutex> guard(lock);
+	return activeThreads;
+	}
+
+int kali::ExecutionContext::acquire(int taskKind, int requested) {
+	/*!
+	Grant min(requested, available(taskKind)) threads to a task of taskKind, waiting for a release if none are available. Returns the number of threads granted, which is always at least 1.
+	*/
+	requested = max(requested, 1);
+	unique_lock<mutex> guard(lock);
+	if (available(taskKind) < 1) {
+		double waitStart = omp_get_wtime();
+		taskWaits[taskKind] += 1;
+		released.wait(guard, [this, taskKind]{return available(taskKind) > 0;});
+		taskWaitSeconds[taskKind] += omp_get_wtime() - waitStart;
+		}
+	int granted = min(requested, available(taskKind));
+	if (granted < requested) {
+		taskClipped[taskKind] += 1;
+		}
+	activeThreads += granted;
+	taskActive[taskKind] += granted;
+	peakThreads = max(peakThreads, activeThreads);
+	taskPeak[taskKind] = max(taskPeak[taskKind], taskActive[taskKind]);
+	taskLeases[taskKind] += 1;
+	#ifdef DEBUG_THREADLEASE
+		printf("acquire: kind %d requested %d granted %d active %d/%d\n", taskKind, requested, granted, activeThreads, maxThreads);
+	#endif
+	return granted;
+	}
+
+void kali::ExecutionContext::release(int taskKind, int granted, double seconds) {
+	{
+		lock_guard<mutex> guard(lock);
+		activeThreads -= granted;
+		taskActive[taskKind] -= granted;
+		taskThreadSeconds[taskKind] += granted*seconds;
+	}
+	released.notify_all();
+	}
+
+void kali::ExecutionContext::get_Stats(long *Leases, long *Clipped, long *Waits, int *Peak, double *ThreadSeconds, double *WaitSeconds, int &peakThreadsOut, double &elapsed) {
+	/*!
+	Per task kind: number of leases, leases granted fewer threads than requested, leases that had to wait, peak concurrent threads, thread-seconds of completed leases and seconds spent waiting. Also the overall peak and the wall time since the last reset_Stats, so that sum(ThreadSeconds)/(maxThreads*elapsed) is the utilization of the budget.
+	*/
+	lock_guard<mutex> guard(lock);
+	for (int kindNum = 0; kindNum < kali::NUM_TASK_KINDS; ++kindNum) {
+		Leases[kindNum] = taskLeases[kindNum];
+		Clipped[kindNum] = taskClipped[kindNum];
+		Waits[kindNum] = taskWaits[kindNum];
+		Peak[kindNum] = taskPeak[kindNum];
+		ThreadSeconds[kindNum] = taskThreadSeconds[kindNum];
+		WaitSeconds[kindNum] = taskWaitSeconds[kindNum];
+		}
+	peakThreadsOut = peakThreads;
+	elapsed = omp_get_wtime() - startTime;
+	}
+
+void kali::ExecutionContext::reset_Stats() {
+	/*!
+	Zero the counters. Threads currently leased are kept as the new peaks.
+	*/
+	lock_guard<mutex> guard(lock);
+	for (int kindNum = 0; kindNum < kali::NUM_TASK_KINDS; ++kindNum) {
+		taskLeases[kindNum] = 0;
+		taskClipped[kindNum] = 0;
+		taskWaits[kindNum] = 0;
+		taskPeak[kindNum] = taskActive[kindNum];
+		taskThreadSeconds[kindNum] = 0.0;
+		taskWaitSeconds[kindNum] = 0.0;
+		}
+	peakThreads = activeThreads;
+	startTime = omp_get_wtime();
+	}
+
+kali::ThreadLease::ThreadLease(int taskKindGiven, int requested) {
+	taskKind = taskKindGiven;
+	outerThreads = heldThreads;
+	nested = omp_in_parallel() or (outerThreads > 0);
+	prevOMPThreads = omp_get_max_threads();
+	if (omp_in_parallel()) {
+		numThreads = 1;
+		} else if (nested) {
+		numThreads = max(min(requested, outerThreads), 1);
+		omp_set_num_threads(numThreads);
+		} else {
+		numThreads = kali::get_ExecutionContext()->acquire(taskKind, requested);
+		omp_set_num_threads(numThreads);
+		}
+	heldThreads = numThreads;
+	prevMKLThreads = mkl_set_num_threads_local(numThreads);
+	startTime = omp_get_wtime();
+	}
+
+kali::ThreadLease::~ThreadLease() {
+	mkl_set_num_threads_local(prevMKLThreads);
+	heldThreads = outerThreads;
+	if (not omp_in_parallel()) {
+		omp_set_num_threads(prevOMPThreads);
+		}
+	if (not nested) {
+		kali::get_ExecutionContext()->release(taskKind, numThreads, omp_get_wtime() - startTime);
+		}
+	}
+
+int kali::ThreadLease::get_numThreads() {
+	return numThreads;
+	}
@@ -0,0 +1,54 @@
+# distutils: language = c++
+import cython
+import numpy as np
+cimport numpy as np
+from cpython.pycapsule cimport PyCapsule_New
+
+
+cdef extern from 'Execution.hpp' namespace "kali":
+	cdef cppclass ExecutionContext:
+		int get_maxThreads()
+		void set_maxThreads(int maxThreadsGiven)
+		int get_taskLimit(int taskKind)
+		void set_taskLimit(int taskKind, int limit)
+		int get_activeThreads()
+		void get_Stats(long *Leases, long *Clipped, long *Waits, int *Peak, double *ThreadSeconds, double *WaitSeconds, int &peakThreadsOut, double &elapsed)
+		void reset_Stats()
+	ExecutionContext* get_ExecutionContext()
+
+CARMA_TASK = 0
+MBHB_TASK = 1
+MBHBCARMA_TASK = 2
+LC_TASK = 3
+NUM_TASK_KINDS = 4
+
+
+def context_capsule():
+	"""Capsule holding the process-wide kali::ExecutionContext; the task modules attach to it on import."""
+	return PyCapsule_New(<void*>get_ExecutionContext(), 'kali.ExecutionContext', NULL)
+
+def get_maxThreads():
+	return get_ExecutionContext().get_maxThreads()
+
+def set_maxThreads(maxThreads):
+	get_ExecutionContext().set_maxThreads(maxThreads)
+
+def get_taskLimit(taskKind):
+	return get_ExecutionContext().get_taskLimit(taskKind)
+
+def set_taskLimit(taskKind, limit):
+	get_ExecutionContext().set_taskLimit(taskKind, limit)
+
+def get_activeThreads():
+	return get_ExecutionContext().get_activeThreads()
+
+def reset_Stats():
+	get_ExecutionContext().reset_Stats()
+
+@cython.boundscheck(False)
+@cython.wraparound(False)
+def get_Stats(np.ndarray[long, ndim=1, mode='c'] Leases not None, np.ndarray[long, ndim=1, mode='c'] Clipped not None, np.ndarray[long, ndim=1, mode='c'] Waits not None, np.ndarray[int, ndim=1, mode='c'] Peak not None, np.ndarray[double, ndim=1, mode='c'] ThreadSeconds not None, np.ndarray[double, ndim=1, mode='c'] WaitSeconds not None):
+	cdef int peakThreads = 0
+	cdef double elapsed = 0.0
+	get_ExecutionContext().get_Stats(&Leases[0], &Clipped[0], &Waits[0], &Peak[0], &ThreadSeconds[0], &WaitSeconds[0], peakThreads, elapsed)
+	return peakThreads, elapsed
@@ -14,6 +14,9 @@
 #include <mkl_types.h>
 #include <omp.h>
 #include <limits>
+#include <algorithm>
+#include <vector>
+#include "Execution.hpp"
 #include "LC.hpp"
 
 //#define DEBUG_SF
@@ -26,71 +29,177 @@
 
 using namespace std;
 
-int kali::acvf(int numCadences, double dt, double *tIn, double *xIn, double *yIn, double *yerrIn, double *maskIn, double *lagVals, double *acvfVals, double *acvfErrVals) {
-	double meanVal = 0.0;
-	double errInMean = 0.0, meanErr = 0.0, meanErrSq = 0.0;
-	double count = 0.0;
+static int correlationLength(int numCadences) {
+	/*!
+	Smallest power of two that holds numCadences points followed by at least as many zeros, so that the circular correlations computed by DFT equal the linear ones at every lag.
+	*/
+	int fftLength = 1;
+	while (fftLength < 2*numCadences) {
+		fftLength *= 2;
+		}
+	return fftLength;
+	}
+
+static DFTI_DESCRIPTOR_HANDLE correlationHandle(int fftLength) {
+	DFTI_DESCRIPTOR_HANDLE fftHandle;
+	DftiCreateDescriptor(&fftHandle, DFTI_DOUBLE, DFTI_REAL, 1, static_cast<MKL_LONG>(fftLength));
+	DftiSetValue(fftHandle, DFTI_PLACEMENT, DFTI_NOT_INPLACE);
+	DftiSetValue(fftHandle, DFTI_CONJUGATE_EVEN_STORAGE, DFTI_COMPLEX_COMPLEX);
+	DftiSetValue(fftHandle, DFTI_BACKWARD_SCALE, 1.0/fftLength);
+	DftiCommitDescriptor(fftHandle);
+	return fftHandle;
+	}
+
+static void forwardSpectrum(DFTI_DESCRIPTOR_HANDLE fftHandle, int numCadences, int fftLength, double *series, double *pad, complex<double> *spectrum) {
+	/*!
+	spectrum = DFT of series zero-padded to fftLength; pad is scratch of fftLength doubles.
+	*/
+	#pragma omp simd
+	for (int i = 0; i < numCadences; ++i) {
+		pad[i] = series[i];
+		}
+	#pragma omp simd
+	for (int i = numCadences; i < fftLength; ++i) {
+		pad[i] = 0.0;
+		}
+	DftiComputeForward(fftHandle, pad, spectrum);
+	}
+
+static void backwardCorrelation(DFTI_DESCRIPTOR_HANDLE fftHandle, int numCadences, double *pad, complex<double> *spectrum, double *lagSums) {
+	/*!
+	lagSums[k], k < numCadences, from the combined cross-spectrum in spectrum, which is used as scratch.
+	*/
+	DftiComputeBackward(fftHandle, spectrum, pad);
+	#pragma omp simd
+	for (int lagCad = 0; lagCad < numCadences; ++lagCad) {
+		lagSums[lagCad] = pad[lagCad];
+		}
+	}
+
+static void maskedMean(int numCadences, double *yIn, double *yerrIn, double *maskIn, double &meanVal, double &meanErrSq, double &count) {
+	double errInMean = 0.0, meanErr = 0.0;
+	meanVal = 0.0;
+	count = 0.0;
 	for (int i = 0; i < numCadences; ++i) {
 		meanVal += maskIn[i]*yIn[i];
-		errInMean += maskIn[i]*pow(yerrIn[i], 2.0);
+		errInMean += maskIn[i]*yerrIn[i]*yerrIn[i];
 		count += maskIn[i];
 		}
 	if (count > 0.0) {
 		meanVal /= count;
-	    meanErr = sqrt(errInMean)/count;
-        }
-    meanErrSq = pow(meanErr, 2.0);
-	#pragma omp parallel for default(none) shared(numCadences, dt, count, tIn, yIn, yerrIn, maskIn, lagVals, acvfVals, acvfErrVals, meanVal, meanErr, meanErrSq)
+		meanErr = sqrt(errInMean)/count;
+		}
+	meanErrSq = meanErr*meanErr;
+	}
+
+static void acvfBruteForce(int numCadences, double dt, double *yIn, double *yerrIn, double *maskIn, double *lagVals, double *acvfVals, double *acvfErrVals) {
+	/*!
+	Direct O(N^2) sum over every pair of cadences. Kept to validate acvfFFT, which gives the same values up to rounding.
+	*/
+	double meanVal = 0.0, meanErrSq = 0.0, count = 0.0;
+	maskedMean(numCadences, yIn, yerrIn, maskIn, meanVal, meanErrSq, count);
+	#pragma omp parallel for schedule(dynamic, 16) default(none) shared(numCadences, dt, yIn, yerrIn, maskIn, lagVals, acvfVals, acvfErrVals, meanVal, meanErrSq)
 	for (int lagCad = 0; lagCad < numCadences; ++lagCad) {
 		lagVals[lagCad] = lagCad*dt;
-		double fSq = 0.0, t1 = 0.0, t2 = 0.0, errSum = 0.0;
+		double acvfSum = 0.0, errSum = 0.0, numPairs = 0.0;
 		for (int pointNum = 0; pointNum < numCadences - lagCad; ++pointNum) {
-			acvfVals[lagCad] += maskIn[pointNum]*maskIn[pointNum + lagCad]*(yIn[pointNum] - meanVal)*(yIn[pointNum + lagCad] - meanVal);
-			fSq = pow((yIn[pointNum + lagCad] - meanVal)*(yIn[pointNum] - meanVal), 2.0);
-			t1 = (pow(yerrIn[pointNum + lagCad], 2.0) + meanErrSq)/pow(yIn[pointNum + lagCad] - meanVal, 2.0);
-			t2 = (pow(yerrIn[pointNum], 2.0) + meanErrSq)/pow(yIn[pointNum] - meanVal, 2.0);
-			errSum += maskIn[pointNum]*maskIn[pointNum + lagCad]*fSq*(t1 + t2);
+			double pairMask = maskIn[pointNum]*maskIn[pointNum + lagCad];
+			double first = yIn[pointNum] - meanVal, second = yIn[pointNum + lagCad] - meanVal;
+			acvfSum += pairMask*first*second;
+			errSum += pairMask*(first*first*(yerrIn[pointNum + lagCad]*yerrIn[pointNum + lagCad] + meanErrSq) + second*second*(yerrIn[pointNum]*yerrIn[pointNum] + meanErrSq));
+			numPairs += pairMask;
 			}
-		if (count > 0.0) {
-			acvfVals[lagCad] /= count;
-			acvfErrVals[lagCad] = sqrt(errSum/count);
+		acvfVals[lagCad] = 0.0;
+		acvfErrVals[lagCad] = 0.0;
+		if (numPairs > 0.5) {
+			acvfVals[lagCad] = acvfSum/numPairs;
+			acvfErrVals[lagCad] = sqrt(errSum/numPairs);
 			}
 		}
-	return 0;
 	}
 
-int kali::acf(int numCadences, double dt, double *tIn, double *xIn, double *yIn, double *yerrIn, double *maskIn, double *lagVals, double *acfVals, double *acfErrVals) {
-	double meanVal = 0.0;
-	double errInMean = 0.0, meanErr = 0.0, meanErrSq = 0.0;
-	double count = 0.0;
+static void acvfFFT(int numCadences, double dt, double *yIn, double *yerrIn, double *maskIn, double *lagVals, double *acvfVals, double *acvfErrVals) {
+	/*!
+	The lag sums of acvfBruteForce are correlations of mask-weighted series, so they all come from one real DFT per series and one inverse DFT per output: the ACVF sum is corr(m*d, m*d), the number of pairs is the mask autocorrelation corr(m, m), and the error sum is corr(m*d^2, m*e) + corr(m*e, m*d^2) with d = y - mean and e = yerr^2 + meanErr^2.
+	*/
+	double meanVal = 0.0, meanErrSq = 0.0, count = 0.0;
+	maskedMean(numCadences, yIn, yerrIn, maskIn, meanVal, meanErrSq, count);
+	int fftLength = correlationLength(numCadences), numFreqs = fftLength/2 + 1;
+	double *series = static_cast<double*>(_mm_malloc(numCadences*sizeof(double), 64));
+	double *pad = static_cast<double*>(_mm_malloc(fftLength*sizeof(double), 64));
+	double *numPairs = static_cast<double*>(_mm_malloc(numCadences*sizeof(double), 64));
+	complex<double> *maskSpec = static_cast<complex<double>*>(_mm_malloc(numFreqs*sizeof(complex<double>), 64));
+	complex<double> *devSpec = static_cast<complex<double>*>(_mm_malloc(numFreqs*sizeof(complex<double>), 64));
+	complex<double> *devSqSpec = static_cast<complex<double>*>(_mm_malloc(numFreqs*sizeof(complex<double>), 64));
+	complex<double> *errSpec = static_cast<complex<double>*>(_mm_malloc(numFreqs*sizeof(complex<double>), 64));
+	DFTI_DESCRIPTOR_HANDLE fftHandle = correlationHandle(fftLength);
+
+	forwardSpectrum(fftHandle, numCadences, fftLength, maskIn, pad, maskSpec);
+	#pragma omp simd
 	for (int i = 0; i < numCadences; ++i) {
-		meanVal += maskIn[i]*yIn[i];
-		errInMean += maskIn[i]*pow(yerrIn[i], 2.0);
-		count += maskIn[i];
+		series[i] = maskIn[i]*(yIn[i] - meanVal);
 		}
-	if (count > 0.0) {
-		meanVal /= count;
-	    meanErr = sqrt(errInMean)/count;
-        }
-	meanErrSq = pow(meanErr, 2.0);
-	#pragma omp parallel for default(none) shared(numCadences, dt, count, tIn, yIn, yerrIn, maskIn, lagVals, acfVals, acfErrVals, meanVal, meanErr, meanErrSq)
+	forwardSpectrum(fftHandle, numCadences, fftLength, series, pad, devSpec);
+	#pragma omp simd
+	for (int i = 0; i < numCadences; ++i) {
+		series[i] = maskIn[i]*(yIn[i] - meanVal)*(yIn[i] - meanVal);
+		}
+	forwardSpectrum(fftHandle, numCadences, fftLength, series, pad, devSqSpec);
+	#pragma omp simd
+	for (int i = 0; i < numCadences; ++i) {
+		series[i] = maskIn[i]*(yerrIn[i]*yerrIn[i] + meanErrSq);
+		}
+	forwardSpectrum(fftHandle, numCadences, fftLength, series, pad, errSpec);
+
+	for (int freqNum = 0; freqNum < numFreqs; ++freqNum) {
+		errSpec[freqNum] = 2.0*(conj(devSqSpec[freqNum])*errSpec[freqNum]).real();
+		maskSpec[freqNum] = norm(maskSpec[freqNum]);
+		devSpec[freqNum] = norm(devSpec[freqNum]);
+		}
+	backwardCorrelation(fftHandle, numCadences, pad, maskSpec, numPairs);
+	backwardCorrelation(fftHandle, numCadences, pad, devSpec, acvfVals);
+	backwardCorrelation(fftHandle, numCadences, pad, errSpec, acvfErrVals);
+	DftiFreeDescriptor(&fftHandle);
+
+	#pragma omp simd
 	for (int lagCad = 0; lagCad < numCadences; ++lagCad) {
 		lagVals[lagCad] = lagCad*dt;
-		double fSq = 0.0, t1 = 0.0, t2 = 0.0, errSum = 0.0;
-		for (int pointNum = 0; pointNum < numCadences - lagCad; ++pointNum) {
-			acfVals[lagCad] += maskIn[pointNum]*maskIn[pointNum + lagCad]*(yIn[pointNum] - meanVal)*(yIn[pointNum + lagCad] - meanVal);
-			fSq = pow((yIn[pointNum + lagCad] - meanVal)*(yIn[pointNum] - meanVal), 2.0);
-			t1 = (pow(yerrIn[pointNum + lagCad], 2.0) + meanErrSq)/pow(yIn[pointNum + lagCad] - meanVal, 2.0);
-			t2 = (pow(yerrIn[pointNum], 2.0) + meanErrSq)/pow(yIn[pointNum] - meanVal, 2.0);
-			errSum += maskIn[pointNum]*maskIn[pointNum + lagCad]*fSq*(t1 + t2);
-			}
-		if (count > 0.0) {
-			acfVals[lagCad] /= count;
-			acfErrVals[lagCad] = sqrt(errSum/count);
+		if (numPairs[lagCad] > 0.5) {
+			acvfVals[lagCad] /= numPairs[lagCad];
+			acvfErrVals[lagCad] = sqrt(max(acvfErrVals[lagCad], 0.0)/numPairs[lagCad]);
+			} else {
+			acvfVals[lagCad] = 0.0;
+			acvfErrVals[lagCad] = 0.0;
 			}
 		}
+	_mm_free(series);
+	_mm_free(pad);
+	_mm_free(numPairs);
+	_mm_free(maskSpec);
+	_mm_free(devSpec);
+	_mm_free(devSqSpec);
+	_mm_free(errSpec);
+	}
+
+int kali::acvf(int numCadences, double dt, double *tIn, double *xIn, double *yIn, double *yerrIn, double *maskIn, double *lagVals, double *acvfVals, double *acvfErrVals, int bruteForce) {
+	/*!
+	Masked ACVF of a regularly sampled light curve at lags k*dt. Each lag is normalized by its number of unmasked pairs, i.e. by the mask autocorrelation. Computed by FFT in O(N log N) unless bruteForce is set.
+	*/
+	kali::ThreadLease lease(kali::LC_TASK, kali::get_ExecutionContext()->get_maxThreads());
+	if (bruteForce) {
+		acvfBruteForce(numCadences, dt, yIn, yerrIn, maskIn, lagVals, acvfVals, acvfErrVals);
+		} else {
+		acvfFFT(numCadences, dt, yIn, yerrIn, maskIn, lagVals, acvfVals, acvfErrVals);
+		}
+	return 0;
+	}
+
+int kali::acf(int numCadences, double dt, double *tIn, double *xIn, double *yIn, double *yerrIn, double *maskIn, double *lagVals, double *acfVals, double *acfErrVals, int bruteForce) {
+	kali::ThreadLease lease(kali::LC_TASK, kali::get_ExecutionContext()->get_maxThreads());
+	int numThreads = lease.get_numThreads();
+	kali::acvf(numCadences, dt, tIn, xIn, yIn, yerrIn, maskIn, lagVals, acfVals, acfErrVals, bruteForce);
 	double acvfFirst = acfVals[0], constErr = pow(acfErrVals[0]/acfVals[0], 2.0);
-	#pragma omp parallel for default(none) shared(numCadences, dt, tIn, yIn, yerrIn, maskIn, lagVals, acfVals, acfErrVals, acvfFirst, constErr)
+	#pragma omp parallel for num_threads(numThreads) default(none) shared(numCadences, acfVals, acfErrVals, acvfFirst, constErr)
 	for (int lagCad = 0; lagCad < numCadences; ++lagCad) {
 		double acfHolder = acfVals[lagCad]/acvfFirst;
 		acfErrVals[lagCad] = (acfVals[lagCad]/acvfFirst)*sqrt(pow(acfErrVals[lagCad]/acfVals[lagCad], 2.0) + constErr);
@@ -99,73 +208,264 @@ int kali::acf(int numCadences, double dt, double *tIn, double *xIn, double *yIn,
 	return 0;
 	}
 
-int kali::sf(int numCadences, double dt, double *tIn, double *xIn, double *yIn, double *yerrIn, double *maskIn, double *lagVals, double *sfVals, double *sfErrVals) {
-	#ifdef DEBUG_SF
-		printf("numCadences: %d\n",numCadences);
-		printf("dt: %f\n",dt);
-	#endif
-    #pragma omp parallel for default(none) shared(numCadences, sfVals, sfErrVals)
-    for (int i = 0; i < numCadences; ++i) {
-        sfVals[i] = 0.0;
-        sfErrVals[i] = 0.0;
-    }
-    double count = 0.0;
-    #pragma omp parallel for default(none) shared(numCadences, dt, tIn, yIn, yerrIn, maskIn, lagVals, sfVals, sfErrVals, count)
+static void sfBruteForce(int numCadences, double dt, double *yIn, double *yerrIn, double *maskIn, double *lagVals, double *sfVals, double *sfErrVals) {
+	/*!
+	Direct O(N^2) sum over every pair of cadences. Kept to validate sfFFT, which gives the same values up to rounding.
+	*/
+	sfVals[0] = 0.0;
+	sfErrVals[0] = 0.0;
+	#pragma omp parallel for schedule(dynamic, 16) default(none) shared(numCadences, dt, yIn, yerrIn, maskIn, lagVals, sfVals, sfErrVals)
 	for (int lagCad = 1; lagCad < numCadences; ++lagCad) {
 		lagVals[lagCad] = lagCad*dt;
-		count = 0.0;
+		double sfSum = 0.0, errSum = 0.0, count = 0.0;
 		for (int pointNum = 0; pointNum < numCadences - lagCad; ++pointNum) {
-			sfVals[lagCad] = sfVals[lagCad] + maskIn[pointNum]*maskIn[pointNum + lagCad]*pow((yIn[pointNum + lagCad] - yIn[pointNum]), 2.0);
-			sfErrVals[lagCad] = sfErrVals[lagCad] + 2.0*maskIn[pointNum]*maskIn[pointNum + lagCad]*pow((yIn[pointNum + lagCad] - yIn[pointNum]), 2.0)*(pow(yIn[pointNum + lagCad], 2.0) + pow(yIn[pointNum], 2.0));
-			count = count + maskIn[pointNum]*maskIn[pointNum + lagCad];
-            #ifdef DEBUG_SF
-				if ((maskIn[pointNum] == 1.0) and (maskIn[pointNum + lagCad] == 1.0)) {
+			double pairMask = maskIn[pointNum]*maskIn[pointNum + lagCad];
+			double diffSq = (yIn[pointNum + lagCad] - yIn[pointNum])*(yIn[pointNum + lagCad] - yIn[pointNum]);
+			sfSum += pairMask*diffSq;
+			errSum += 2.0*pairMask*diffSq*(yIn[pointNum + lagCad]*yIn[pointNum + lagCad] + yIn[pointNum]*yIn[pointNum]);
+			count += pairMask;
+			#ifdef DEBUG_SF
+				if (pairMask == 1.0) {
 					printf("y[%d]: %e\n", pointNum + lagCad, yIn[pointNum + lagCad]);
-                    printf("mask[%d]: %e\n", pointNum + lagCad, maskIn[pointNum + lagCad]);
 					printf("y[%d]: %e\n", pointNum, yIn[pointNum]);
-                    printf("mask[%d]: %e\n", pointNum, maskIn[pointNum]);
-					printf("sfVals[%d]: %e\n", lagCad, sfVals[lagCad]);
-                    printf("sfErrVals[%d]: %e\n", lagCad, sfErrVals[lagCad]);
-                    printf("count: %f\n", count);
+					printf("sfSum: %e\n", sfSum);
+					printf("count: %f\n", count);
 					}
 			#endif
 			}
-		if (count > 0.0) {
-			sfVals[lagCad] = sfVals[lagCad]/count;
-			sfErrVals[lagCad] = sqrt(sfErrVals[lagCad])/count;
+		sfVals[lagCad] = 0.0;
+		sfErrVals[lagCad] = 0.0;
+		if (count > 0.5) {
+			sfVals[lagCad] = sfSum/count;
+			sfErrVals[lagCad] = sqrt(errSum)/count;
 			}
-        #ifdef DEBUG_SF
-            printf("\n");
-            printf("lagVals: %e\n", lagVals[lagCad]);
-			printf("count: %f\n", count);
+		#ifdef DEBUG_SF
+			printf("lagVals: %e\n", lagVals[lagCad]);
 			printf("sfVals[%d]: %e\n", lagCad, sfVals[lagCad]);
 			printf("sfErrVals[%d]: %e\n", lagCad, sfErrVals[lagCad]);
-            printf("\n");
 		#endif
 		}
+	}
+
+static void sfFFT(int numCadences, double dt, double *yIn, double *yerrIn, double *maskIn, double *lagVals, double *sfVals, double *sfErrVals) {
+	/*!
+	With d = y - mean and S_n = FFT(m*d^n), every lag sum of sfBruteForce is a combination of cross-spectra of the S_n, taken before a single inverse DFT per output. Working with d rather than y avoids the cancellation between the large y^2 terms:
+		sum (d_j - d_i)^2                 <- 2 Re(S_0* S_2) - 2 |S_1|^2
+		sum (d_j - d_i)^2 (d_i + d_j)     <- 2 Re(S_0* S_3) - 2 Re(S_1* S_2)
+		sum (d_j - d_i)^2 (d_i^2 + d_j^2) <- 2 Re(S_0* S_4) + 2 |S_2|^2 - 4 Re(S_1* S_3)
+	and y_i^2 + y_j^2 = 2 mean^2 + 2 mean (d_i + d_j) + d_i^2 + d_j^2 assembles the error sum.
+	*/
+	double meanVal = 0.0, meanErrSq = 0.0, count = 0.0;
+	maskedMean(numCadences, yIn, yerrIn, maskIn, meanVal, meanErrSq, count);
+	int fftLength = correlationLength(numCadences), numFreqs = fftLength/2 + 1, numPowers = 5;
+	double *series = static_cast<double*>(_mm_malloc(numCadences*sizeof(double), 64));
+	double *pad = static_cast<double*>(_mm_malloc(fftLength*sizeof(double), 64));
+	double *numPairs = static_cast<double*>(_mm_malloc(numCadences*sizeof(double), 64));
+	complex<double> *powerSpec = static_cast<complex<double>*>(_mm_malloc(numPowers*numFreqs*sizeof(complex<double>), 64));
+	complex<double> *pairSpec = static_cast<complex<double>*>(_mm_malloc(numFreqs*sizeof(complex<double>), 64));
+	complex<double> *sfSpec = static_cast<complex<double>*>(_mm_malloc(numFreqs*sizeof(complex<double>), 64));
+	complex<double> *errSpec = static_cast<complex<double>*>(_mm_malloc(numFreqs*sizeof(complex<double>), 64));
+	DFTI_DESCRIPTOR_HANDLE fftHandle = correlationHandle(fftLength);
+
+	#pragma omp simd
+	for (int i = 0; i < numCadences; ++i) {
+		series[i] = maskIn[i];
+		}
+	for (int power = 0; power < numPowers; ++power) {
+		forwardSpectrum(fftHandle, numCadences, fftLength, series, pad, &powerSpec[power*numFreqs]);
+		#pragma omp simd
+		for (int i = 0; i < numCadences; ++i) {
+			series[i] *= yIn[i] - meanVal;
+			}
+		}
+	complex<double> *S0 = &powerSpec[0], *S1 = &powerSpec[numFreqs], *S2 = &powerSpec[2*numFreqs], *S3 = &powerSpec[3*numFreqs], *S4 = &powerSpec[4*numFreqs];
+	for (int freqNum = 0; freqNum < numFreqs; ++freqNum) {
+		double sumSq = 2.0*(conj(S0[freqNum])*S2[freqNum]).real() - 2.0*norm(S1[freqNum]);
+		double sumSqLin = 2.0*(conj(S0[freqNum])*S3[freqNum]).real() - 2.0*(conj(S1[freqNum])*S2[freqNum]).real();
+		double sumSqQuad = 2.0*(conj(S0[freqNum])*S4[freqNum]).real() + 2.0*norm(S2[freqNum]) - 4.0*(conj(S1[freqNum])*S3[freqNum]).real();
+		pairSpec[freqNum] = norm(S0[freqNum]);
+		sfSpec[freqNum] = sumSq;
+		errSpec[freqNum] = 2.0*(2.0*meanVal*meanVal*sumSq + 2.0*meanVal*sumSqLin + sumSqQuad);
+		}
+	backwardCorrelation(fftHandle, numCadences, pad, pairSpec, numPairs);
+	backwardCorrelation(fftHandle, numCadences, pad, sfSpec, sfVals);
+	backwardCorrelation(fftHandle, numCadences, pad, errSpec, sfErrVals);
+	DftiFreeDescriptor(&fftHandle);
+
+	sfVals[0] = 0.0;
+	sfErrVals[0] = 0.0;
+	#pragma omp simd
+	for (int lagCad = 1; lagCad < numCadences; ++lagCad) {
+		lagVals[lagCad] = lagCad*dt;
+		if (numPairs[lagCad] > 0.5) {
+			sfVals[lagCad] = max(sfVals[lagCad], 0.0)/numPairs[lagCad];
+			sfErrVals[lagCad] = sqrt(max(sfErrVals[lagCad], 0.0))/numPairs[lagCad];
+			} else {
+			sfVals[lagCad] = 0.0;
+			sfErrVals[lagCad] = 0.0;
+			}
+		}
+	_mm_free(series);
+	_mm_free(pad);
+	_mm_free(numPairs);
+	_mm_free(powerSpec);
+	_mm_free(pairSpec);
+	_mm_free(sfSpec);
+	_mm_free(errSpec);
+	}
+
+int kali::sf(int numCadences, double dt, double *tIn, double *xIn, double *yIn, double *yerrIn, double *maskIn, double *lagVals, double *sfVals, double *sfErrVals, int bruteForce) {
+	/*!
+	Masked first-order structure function of a regularly sampled light curve at lags k*dt, normalized per lag by the number of unmasked pairs. Computed by FFT in O(N log N) unless bruteForce is set.
+	*/
+	#ifdef DEBUG_SF
+		printf("numCadences: %d\n",numCadences);
+		printf("dt: %f\n",dt);
+	#endif
+	kali::ThreadLease lease(kali::LC_TASK, kali::get_ExecutionContext()->get_maxThreads());
+	if (bruteForce) {
+		sfBruteForce(numCadences, dt, yIn, yerrIn, maskIn, lagVals, sfVals, sfErrVals);
+		} else {
+		sfFFT(numCadences, dt, yIn, yerrIn, maskIn, lagVals, sfVals, sfErrVals);
+		}
+	return 0;
+	}
+
+static const int sfBlockLength = 64; // Pairs per vectorized block in sfBinned
+
+int kali::sfBinned(int numCadences, double *tIn, double *yIn, double *yerrIn, double *maskIn, int numBins, double *binEdges, double *lagVals, double *sfVals, double *sfErrVals, double *numPairVals) {
+	/*!
+	Structure function of an irregularly sampled light curve, binned directly in lag. Bin b holds the pairs of unmasked cadences i < j with binEdges[b] <= t[j] - t[i] < binEdges[b + 1]; the edges must increase and are usually log-spaced. Each pair contributes (y[j] - y[i])^2 - yerr[i]^2 - yerr[j]^2, so the noise bias is removed pair by pair and sfVals may be negative at short lags. sfErrVals is the standard error of the mean in the bin, lagVals the mean lag of its pairs and numPairVals their number; empty bins are set to zero.
+
+	tIn is sorted, so the pairs of row i in [binEdges[0], binEdges[numBins]) form a contiguous range of j. The pair values of a row are computed in vectorized blocks of sfBlockLength and then added into a per-thread histogram, stepping the bin forward along the row. The rows are split into chunks holding equal numbers of pairs, which are handed out dynamically, so threads stay balanced whatever the sampling.
+	*/
+	if ((numCadences < 1) or (numBins < 1) or (binEdges[0] < 0.0)) {
+		return -1;
+		}
+	for (int binCtr = 0; binCtr < numBins; ++binCtr) {
+		if (binEdges[binCtr + 1] <= binEdges[binCtr]) {
+			return -1;
+			}
+		}
+	kali::ThreadLease lease(kali::LC_TASK, kali::get_ExecutionContext()->get_maxThreads());
+	double *t = static_cast<double*>(_mm_malloc(3*numCadences*sizeof(double), 64)), *y = t + numCadences, *errSq = y + numCadences;
+	int numPoints = 0;
+	for (int i = 0; i < numCadences; ++i) {
+		if (maskIn[i] != 0.0) {
+			t[numPoints] = tIn[i];
+			y[numPoints] = yIn[i];
+			errSq[numPoints] = yerrIn[i]*yerrIn[i];
+			numPoints += 1;
+			}
+		}
+	// Pair range of every row and the chunk boundaries that split the pairs evenly
+	int *rowStart = static_cast<int*>(_mm_malloc(2*(numPoints + 1)*sizeof(int), 64)), *rowEnd = rowStart + numPoints + 1;
+	long numPairs = 0;
+	for (int i = 0; i < numPoints; ++i) {
+		rowStart[i] = static_cast<int>(lower_bound(t + i + 1, t + numPoints, t[i] + binEdges[0]) - t);
+		rowEnd[i] = static_cast<int>(lower_bound(t + rowStart[i], t + numPoints, t[i] + binEdges[numBins]) - t);
+		numPairs += rowEnd[i] - rowStart[i];
+		}
+	int numThreads = lease.get_numThreads(), numChunks = 8*numThreads;
+	vector<int> chunkStarts(1, 0);
+	long pairsSoFar = 0;
+	for (int i = 0; i < numPoints; ++i) {
+		pairsSoFar += rowEnd[i] - rowStart[i];
+		if ((pairsSoFar*numChunks >= numPairs*static_cast<long>(chunkStarts.size())) and (i + 1 < numPoints)) {
+			chunkStarts.push_back(i + 1);
+			}
+		}
+	chunkStarts.push_back(numPoints);
+	numChunks = static_cast<int>(chunkStarts.size()) - 1;
+	// Thread-local histograms of the pair count, lag, value and squared value, padded to whole cache lines
+	int histStride = 8*((4*numBins + 7)/8);
+	double *binHists = static_cast<double*>(_mm_malloc(numThreads*histStride*sizeof(double), 64));
+	#pragma omp simd
+	for (int histCtr = 0; histCtr < numThreads*histStride; ++histCtr) {
+		binHists[histCtr] = 0.0;
+		}
+	#pragma omp parallel for schedule(dynamic, 1) num_threads(numThreads) default(none) shared(numChunks, chunkStarts, t, y, errSq, rowStart, rowEnd, numBins, binEdges, binHists, histStride)
+	for (int chunkNum = 0; chunkNum < numChunks; ++chunkNum) {
+		double *binCount = binHists + omp_get_thread_num()*histStride, *binLag = binCount + numBins, *binSum = binLag + numBins, *binSumSq = binSum + numBins;
+		double lagBlock[sfBlockLength] __attribute__((aligned(64)));
+		double valBlock[sfBlockLength] __attribute__((aligned(64)));
+		for (int i = chunkStarts[chunkNum]; i < chunkStarts[chunkNum + 1]; ++i) {
+			double tI = t[i], yI = y[i], errSqI = errSq[i];
+			int binCtr = 0;
+			for (int blockStart = rowStart[i]; blockStart < rowEnd[i]; blockStart += sfBlockLength) {
+				int blockSize = (rowEnd[i] - blockStart < sfBlockLength) ? rowEnd[i] - blockStart : sfBlockLength;
+				double *tJ = t + blockStart, *yJ = y + blockStart, *errSqJ = errSq + blockStart;
+				#pragma omp simd aligned(lagBlock, valBlock: 64)
+				for (int pairNum = 0; pairNum < blockSize; ++pairNum) {
+					double diff = yJ[pairNum] - yI;
+					lagBlock[pairNum] = tJ[pairNum] - tI;
+					valBlock[pairNum] = diff*diff - errSqI - errSqJ[pairNum];
+					}
+				for (int pairNum = 0; pairNum < blockSize; ++pairNum) {
+					while ((binCtr < numBins - 1) and (lagBlock[pairNum] >= binEdges[binCtr + 1])) {
+						binCtr += 1;
+						}
+					binCount[binCtr] += 1.0;
+					binLag[binCtr] += lagBlock[pairNum];
+					binSum[binCtr] += valBlock[pairNum];
+					binSumSq[binCtr] += valBlock[pairNum]*valBlock[pairNum];
+					}
+				}
+			}
+		}
+	for (int threadCtr = 1; threadCtr < numThreads; ++threadCtr) {
+		#pragma omp simd
+		for (int histCtr = 0; histCtr < 4*numBins; ++histCtr) {
+			binHists[histCtr] += binHists[threadCtr*histStride + histCtr];
+			}
+		}
+	for (int binCtr = 0; binCtr < numBins; ++binCtr) {
+		double count = binHists[binCtr], lagSum = binHists[numBins + binCtr], sum = binHists[2*numBins + binCtr], sumSq = binHists[3*numBins + binCtr];
+		numPairVals[binCtr] = count;
+		lagVals[binCtr] = 0.0;
+		sfVals[binCtr] = 0.0;
+		sfErrVals[binCtr] = 0.0;
+		if (count > 0.0) {
+			lagVals[binCtr] = lagSum/count;
+			sfVals[binCtr] = sum/count;
+			}
+		if (count > 1.0) {
+			double sumSqDev = sumSq - sum*sfVals[binCtr];
+			sfErrVals[binCtr] = sqrt(max(sumSqDev, 0.0)/(count*(count - 1.0)));
+			}
+		}
+	_mm_free(binHists);
+	_mm_free(rowStart);
+	_mm_free(t);
 	return 0;
 	}
 
-int kali::dacf(int numCadences, double dt, double *tIn, double *xIn, double *yIn, double *yerrIn, double *maskIn, int numBins, double *lagVals, double *dacfVals, double *dacfErrVals) {
+int kali::dacf(int numCadences, double *tIn, double *xIn, double *yIn, double *yerrIn, double *maskIn, int numBins, double *lagVals, double *dacfVals, double *dacfErrVals) {
 	/*!
 	DACF of Edelson Krolik 1988
+
+	Bin b holds the pairs i <= j with lag t[j] - t[i] in [edge[b], edge[b + 1]), where the edges sit midway between the (sorted) lagVals, edge[0] = 0 and the last bin is open ended. tIn is sorted, so the lags of row i increase with j and the bin of each pair is found by stepping the bin of the previous pair forward; every pair is visited once and nothing is stored per pair. Each thread adds the sum, sum of squares and weight of the UDCF of its rows into its own histogram and the histograms are summed at the end, so the work space is O(numBins*numThreads). The error in bin b is sqrt(sum (UDCF - DACF)^2)/(M - 1) for the M pairs in the bin.
 	*/
+	if ((numCadences < 1) or (numBins < 1)) {
+		return -1;
+		}
+	kali::ThreadLease lease(kali::LC_TASK, kali::get_ExecutionContext()->get_maxThreads());
 	// Compute the mean & the mean of the errors. Square the mean of the errors
 	double meanVal = 0.0, meanerrVal = 0.0, count = 0.0;
 	for (int i = 0; i < numCadences; ++i) {
-		meanVal = meanVal + maskIn[i]*yIn[i];
-		meanerrVal = meanerrVal + maskIn[i]*yerrIn[i];
-		count = count + maskIn[i];
+		meanVal += maskIn[i]*yIn[i];
+		meanerrVal += maskIn[i]*yerrIn[i];
+		count += maskIn[i];
 		}
 	if (count > 0.0) {
 		meanVal = meanVal/count;
 		meanerrVal = meanerrVal/count;
 		}
-	double meanerrValSq = pow(meanerrVal, 2.0);
+	double meanerrValSq = meanerrVal*meanerrVal;
 	// Compute the variance
 	double varVal = 0.0;
 	for (int i = 0; i < numCadences; ++i) {
-		varVal = varVal + pow(maskIn[i]*(yIn[i] - meanVal), 2.0);
+		varVal += maskIn[i]*(yIn[i] - meanVal)*(yIn[i] - meanVal);
 		}
 	if (count > 0.0) {
 		varVal = varVal/count;
@@ -176,108 +476,427 @@ int kali::dacf(int numCadences, double dt, double *tIn, double *xIn, double *yIn
 		} else {
 		denomVal = varVal;
 		}
+	if (denomVal <= 0.0) {
+		denomVal = 1.0;
+		}
 	#ifdef DEBUG_DACF
 		printf("meanVal: %e\n", meanVal);
 		printf("varVal: %e\n", varVal);
 	#endif
-	// Allocate array to hold all dacf pairs
-	double *tPair = static_cast<double*>(_mm_malloc((numCadences*(numCadences + 1)/2)*sizeof(double),64));
-	double *yPair = static_cast<double*>(_mm_malloc((numCadences*(numCadences + 1)/2)*sizeof(double),64));
-	double *maskPair = static_cast<double*>(_mm_malloc((numCadences*(numCadences + 1)/2)*sizeof(double),64));
-	// Compute UDCF for all pairs
-	//#pragma omp parallel for default(none) shared(numCadences, tIn, yIn, yerrIn, maskIn, meanVal, varVal, tPair, yPair, maskPair)
+	// Lower edge of every bin
+	double *binEdges = static_cast<double*>(_mm_malloc(numBins*sizeof(double), 64));
+	binEdges[0] = 0.0;
+	for (int binCtr = 1; binCtr < numBins; ++binCtr) {
+		binEdges[binCtr] = lagVals[binCtr] - 0.5*(lagVals[binCtr] - lagVals[binCtr - 1]);
+		}
+	// Thread-local histograms of the weight, sum and sum of squares of the UDCF, padded to whole cache lines
+	int numThreads = lease.get_numThreads();
+	int histStride = 8*((3*numBins + 7)/8);
+	double *binHists = static_cast<double*>(_mm_malloc(numThreads*histStride*sizeof(double), 64));
+	#pragma omp simd
+	for (int histCtr = 0; histCtr < numThreads*histStride; ++histCtr) {
+		binHists[histCtr] = 0.0;
+		}
+	#pragma omp parallel for schedule(dynamic, 16) num_threads(numThreads) default(none) shared(numCadences, numBins, tIn, yIn, maskIn, meanVal, denomVal, binEdges, binHists, histStride)
 	for (int i = 0; i < numCadences; ++i) {
-		#ifdef DEBUG_DACF
-			int threadNum = omp_get_thread_num();
-		#endif
-		//#pragma omp simd
-		for (int j = 0; j < numCadences - i; ++j) {
-			tPair[j + i*(numCadences - i)] = tIn[j] - tIn[i];
-			yPair[j + i*(numCadences - i)] = (maskIn[i]*maskIn[j]*(yIn[i] - meanVal)*(yIn[j] - meanVal))/denomVal;
-			maskPair[j + i*(numCadences - i)] = maskIn[i]*maskIn[j];
+		if (maskIn[i] == 0.0) {
+			continue;
+			}
+		double *binWeight = binHists + omp_get_thread_num()*histStride, *binSum = binWeight + numBins, *binSumSq = binSum + numBins;
+		double first = (yIn[i] - meanVal)/denomVal;
+		int binCtr = 0;
+		for (int j = i; j < numCadences; ++j) {
+			double lag = tIn[j] - tIn[i];
+			while ((binCtr < numBins - 1) and (lag >= binEdges[binCtr + 1])) {
+				binCtr += 1;
+				}
+			double udcf = first*(yIn[j] - meanVal), pairMask = maskIn[i]*maskIn[j];
 			#ifdef DEBUG_DACF_DEEP
-				printf("dacf - threadNum: %d; tIn[%d]: %e\n", threadNum, j, tIn[j]);
-				printf("dacf - threadNum: %d; tIn[%d]: %e\n", threadNum, i, tIn[i]);
-				printf("dacf - threadNum: %d; tPair[%d]: %e\n", threadNum, j + i*(numCadences - i), tPair[j + i*(numCadences - i)]);
-				printf("dacf - threadNum: %d; yIn[%d]: %e\n", threadNum, j, yIn[j]);
-				printf("dacf - threadNum: %d; yIn[%d]: %e\n", threadNum, i, yIn[i]);
-				printf("dacf - threadNum: %d; yerrIn[%d]: %e\n", threadNum, j, yerrIn[j]);
-				printf("dacf - threadNum: %d; yerrIn[%d]: %e\n", threadNum, i, yerrIn[i]);
-				printf("dacf - threadNum: %d; varVal - pow(yerrIn[%d], 2.0): %e\n", threadNum, i, varVal - pow(yerrIn[i], 2.0));
-				printf("dacf - threadNum: %d; varVal - pow(yerrIn[%d], 2.0): %e\n", threadNum, j, varVal - pow(yerrIn[j], 2.0));
-				printf("dacf - threadNum: %d; yPair[%d]: %e\n", threadNum, j + i*(numCadences - i), yPair[j + i*(numCadences - i)]);
-				printf("dacf - threadNum: %d; maskIn[%d]: %e\n", threadNum, j, maskIn[j]);
-				printf("dacf - threadNum: %d; maskIn[%d]: %e\n", threadNum, i, maskIn[i]);
-				printf("dacf - threadNum: %d; maskPair[%d]: %e\n", threadNum, j + i*(numCadences - i), maskPair[j + i*(numCadences - i)]);
+				printf("dacf - threadNum: %d; i: %d; j: %d; lag: %e; bin: %d; udcf: %e\n", omp_get_thread_num(), i, j, lag, binCtr, udcf);
 			#endif
+			binWeight[binCtr] += pairMask;
+			binSum[binCtr] += pairMask*udcf;
+			binSumSq[binCtr] += pairMask*udcf*udcf;
 			}
 		}
-	//Now loop through all the dacf bins
-	#if defined DEBUG_DACF
-		//#pragma omp parallel for default(none) shared(numCadences,  threadNum, dt, numBins, tIn, tPair, yPair, maskPair, lagVals, dacfVals, dacfErrVals)
-	#else
-		//#pragma omp parallel for default(none) shared(numCadences, dt, numBins, tIn, tPair, yPair, maskPair, lagVals, dacfVals, dacfErrVals)
-	#endif
+	// Reduce the histograms
+	for (int threadCtr = 1; threadCtr < numThreads; ++threadCtr) {
+		#pragma omp simd
+		for (int histCtr = 0; histCtr < 3*numBins; ++histCtr) {
+			binHists[histCtr] += binHists[threadCtr*histStride + histCtr];
+			}
+		}
+	double *binWeight = binHists, *binSum = binHists + numBins, *binSumSq = binHists + 2*numBins;
 	for (int binCtr = 0; binCtr < numBins; ++binCtr) {
-		#ifdef DEBUG_DACF
-			int threadNum = omp_get_thread_num();
-		#endif
-		double binStart = 0.0;
-		if (binCtr != 0) {
-			binStart = lagVals[binCtr] - (0.5*(lagVals[binCtr] - lagVals[binCtr-1]));
+		double numPairs = binWeight[binCtr];
+		dacfVals[binCtr] = 0.0;
+		dacfErrVals[binCtr] = 0.0;
+		if (numPairs > 0.0) {
+			dacfVals[binCtr] = binSum[binCtr]/numPairs;
 			}
-		int minSpacing = static_cast<int>(binStart/dt);
-		double binEnd = tIn[numCadences-1] - tIn[0];
-		if (binCtr != (numBins - 1)) {
-			binEnd = lagVals[binCtr] + (0.5*(lagVals[binCtr+1] - lagVals[binCtr]));
+		if (numPairs > 1.0) {
+			double sumSqDev = binSumSq[binCtr] - binSum[binCtr]*dacfVals[binCtr];
+			dacfErrVals[binCtr] = sqrt((sumSqDev > 0.0) ? sumSqDev : 0.0)/(numPairs - 1.0);
 			}
-		int maxSpacing = static_cast<int>(binEnd/dt);
-		double numPairs = 0.0;
 		#ifdef DEBUG_DACF
-			printf("dacf - threadNum: %d; binStart: %e\n",threadNum, binStart);
-			printf("dacf - threadNum: %d; lagVals[%d]: %e\n",threadNum, binCtr, lagVals[binCtr]);
-			printf("dacf - threadNum: %d; binEnd: %e\n",threadNum, binEnd);
+			printf("dacf - binCtr: %d; binStart: %e; numPairs: %e; dacfVals: %e; dacfErrVals: %e\n", binCtr, binEdges[binCtr], numPairs, dacfVals[binCtr], dacfErrVals[binCtr]);
 		#endif
-		// Loop through the pair arrays and add their contents if the tPair indicates to do so
-		for (int pairCtr = 0; pairCtr < (numCadences*(numCadences + 1)/2); ++pairCtr) {
-			if ((tPair[pairCtr] >= binStart) and (tPair[pairCtr] < binEnd)) {
-				dacfVals[binCtr] = dacfVals[binCtr] + maskPair[pairCtr]*yPair[pairCtr];
-				numPairs = numPairs + maskPair[pairCtr];
-				}
+		}
+	_mm_free(binHists);
+	_mm_free(binEdges);
+	return 0;
+	}
+
+static const double twoPi = 6.283185307179586476925286766559;
+static const int extirpolationOversampling = 10; // FFT grid points per output frequency
+static const int extirpolationOrder = 6; // Grid points each sample is spread over
+
+static int extirpolationLength(int numFreqs) {
+	int fftLength = 1;
+	while (fftLength < extirpolationOversampling*numFreqs) {
+		fftLength *= 2;
+		}
+	return fftLength;
+	}
+
+static DFTI_DESCRIPTOR_HANDLE extirpolationHandle(int fftLength) {
+	DFTI_DESCRIPTOR_HANDLE fftHandle;
+	DftiCreateDescriptor(&fftHandle, DFTI_DOUBLE, DFTI_COMPLEX, 1, static_cast<MKL_LONG>(fftLength));
+	DftiSetValue(fftHandle, DFTI_THREAD_LIMIT, 1);
+	DftiCommitDescriptor(fftHandle);
+	return fftHandle;
+	}
+
+static int prepareSeries(int numCadences, double *tIn, double *yIn, double *yerrIn, double *maskIn, double *tOut, double *yOut, double *wOut, double &yySum) {
+	/*!
+	Copy the unmasked cadences, with times relative to the first and weights 1/yerr^2 normalized to unit sum, and subtract the weighted mean from y. Cadences with yerr <= 0 are dropped unless no cadence has a positive error, in which case all are weighted equally. Returns the number of cadences kept; yySum is the weighted sum of the squared residuals.
+	*/
+	bool useErrors = false;
+	for (int i = 0; i < numCadences; ++i) {
+		useErrors = useErrors or ((maskIn[i] != 0.0) and (yerrIn[i] > 0.0));
+		}
+	int numKept = 0;
+	double wSum = 0.0, ywSum = 0.0;
+	for (int i = 0; i < numCadences; ++i) {
+		if ((maskIn[i] != 0.0) and ((not useErrors) or (yerrIn[i] > 0.0))) {
+			tOut[numKept] = tIn[i];
+			yOut[numKept] = yIn[i];
+			wOut[numKept] = useErrors ? 1.0/(yerrIn[i]*yerrIn[i]) : 1.0;
+			wSum += wOut[numKept];
+			ywSum += wOut[numKept]*yIn[i];
+			numKept += 1;
 			}
-		#ifdef DEBUG_DACF
-			printf("dacf - threadNum: %d; dacfVals: %e\n",threadNum, dacfVals[binCtr]);
-			printf("dacf - threadNum: %d; numPairs: %e\n",threadNum, numPairs);
-		#endif
-		if (numPairs > 0.0) {
-			dacfVals[binCtr] = dacfVals[binCtr]/numPairs;
+		}
+	yySum = 0.0;
+	if (numKept == 0) {
+		return 0;
+		}
+	double tStart = tOut[0], meanVal = ywSum/wSum;
+	for (int i = 0; i < numKept; ++i) {
+		tOut[i] -= tStart;
+		yOut[i] -= meanVal;
+		wOut[i] /= wSum;
+		yySum += wOut[i]*yOut[i]*yOut[i];
+		}
+	return numKept;
+	}
+
+static void extirpolate(int numPoints, double *x, double *reVals, double *imVals, int gridLength, complex<double> *grid) {
+	/*!
+	Spread each complex value reVals[j] + i*imVals[j] at the non-integer grid position x[j] over extirpolationOrder neighbouring grid points with Lagrange weights, so that sums of smooth functions over the grid reproduce the sums over the points (Press & Rybicki 1989).
+	*/
+	int order = extirpolationOrder, halfOrder = extirpolationOrder/2;
+	double orderFactorial = 1.0;
+	for (int j = 2; j < order; ++j) {
+		orderFactorial *= j;
+		}
+	for (int j = 0; j < numPoints; ++j) {
+		double pos = x[j];
+		int posInt = static_cast<int>(pos);
+		if (pos == static_cast<double>(posInt)) {
+			grid[posInt] += complex<double>(reVals[j], imVals[j]);
+			continue;
 			}
-		#ifdef DEBUG_DACF
-			printf("dacf - threadNum: %d; dacfVals: %e\n",threadNum, dacfVals[binCtr]);
-		#endif
-		// Now loop through again for the errors
-		for (int pairCtr = 0; pairCtr < (numCadences*(numCadences + 1)/2); ++pairCtr) {
-			if ((tPair[pairCtr] >= binStart) and (tPair[pairCtr] < binEnd)) {
-				dacfErrVals[binCtr] = dacfErrVals[binCtr] + pow(dacfVals[binCtr] - yPair[pairCtr], 2.0);
+		int lowIdx = static_cast<int>(floor(pos)) - halfOrder + 1;
+		lowIdx = (lowIdx < 0) ? 0 : ((lowIdx > gridLength - order) ? gridLength - order : lowIdx);
+		double numerator = 1.0;
+		for (int m = 0; m < order; ++m) {
+			numerator *= pos - (lowIdx + m);
+			}
+		double denominator = orderFactorial;
+		for (int m = 0; m < order; ++m) {
+			if (m > 0) {
+				denominator *= static_cast<double>(m)/static_cast<double>(m - order);
 				}
+			int idx = lowIdx + order - 1 - m;
+			double weight = numerator/(denominator*(pos - idx));
+			grid[idx] += complex<double>(weight*reVals[j], weight*imVals[j]);
 			}
-		if (numPairs > 0.0) {
-			dacfErrVals[binCtr] = dacfErrVals[binCtr]/sqrt((numPairs - 1.0)*static_cast<double>((numCadences - 1)));
+		}
+	}
+
+static void trigSums(DFTI_DESCRIPTOR_HANDLE fftHandle, int fftLength, int numPoints, double *t, double *h, double freqMin, double freqStep, int numFreqs, double *x, double *reVals, double *imVals, complex<double> *grid, double *cosSums, double *sinSums) {
+	/*!
+	cosSums[k] = sum_j h[j]*cos(2 pi f_k t[j]) and sinSums[k] likewise for f_k = freqMin + k*freqStep. The factor exp(2 pi i freqMin t[j]) is folded into the values so that the remaining phases are exp(2 pi i k freqStep t[j]), which one inverse FFT of the extirpolated grid evaluates at every k.
+	*/
+	for (int j = 0; j < numPoints; ++j) {
+		double phase = twoPi*freqMin*t[j], pos = t[j]*fftLength*freqStep;
+		reVals[j] = h[j]*cos(phase);
+		imVals[j] = h[j]*sin(phase);
+		x[j] = pos - floor(pos/fftLength)*fftLength;
+		}
+	for (int k = 0; k < fftLength; ++k) {
+		grid[k] = complex<double>(0.0, 0.0);
+		}
+	extirpolate(numPoints, x, reVals, imVals, fftLength, grid);
+	DftiComputeBackward(fftHandle, grid);
+	for (int k = 0; k < numFreqs; ++k) {
+		cosSums[k] = grid[k].real();
+		sinSums[k] = grid[k].imag();
+		}
+	}
+
+static void powerFromSums(int fitMean, double yySum, double yc, double ys, double c, double s, double cc, double ss, double cs, double &power) {
+	/*!
+	Normalized power 1 - chi^2/chi^2_0 of the weighted least-squares sinusoid (Zechmeister & Kurster 2009) from the sums over cadences of w y cos, w y sin, w cos, w sin, w cos^2, w sin^2 and w cos sin at one frequency.
+	*/
+	if (fitMean) {
+		cc -= c*c;
+		ss -= s*s;
+		cs -= c*s;
+		}
+	double det = cc*ss - cs*cs;
+	power = 0.0;
+	if ((yySum > 0.0) and (det > 1.0e-12*(cc*ss))) {
+		power = (ss*yc*yc + cc*ys*ys - 2.0*cs*yc*ys)/(yySum*det);
+		} else if ((yySum > 0.0) and (cc > 1.0e-12)) {
+		power = yc*yc/(yySum*cc);
+		}
+	}
+
+static void lombScarglePower(DFTI_DESCRIPTOR_HANDLE fftHandle, int fftLength, int numPoints, double *t, double *y, double *w, double yySum, double freqMin, double freqStep, int numFreqs, int fitMean, int bruteForce, double *powerVals) {
+	/*!
+	Periodogram of one prepared series. The direct path evaluates every sum at every frequency in O(numPoints*numFreqs). The fast path gets the sums of w y cos and w y sin at f_k, and of w cos(2x) and w sin(2x) at 2 f_k (from which w cos^2, w sin^2 and w cos sin follow), plus w cos and w sin at f_k when the mean floats, from three or four extirpolated FFTs in O(numPoints + numFreqs log numFreqs).
+	*/
+	if (bruteForce) {
+		for (int k = 0; k < numFreqs; ++k) {
+			double omega = twoPi*(freqMin + k*freqStep);
+			double yc = 0.0, ys = 0.0, c = 0.0, s = 0.0, cc = 0.0, ss = 0.0, cs = 0.0;
+			for (int j = 0; j < numPoints; ++j) {
+				double cosVal = cos(omega*t[j]), sinVal = sin(omega*t[j]);
+				yc += w[j]*y[j]*cosVal;
+				ys += w[j]*y[j]*sinVal;
+				c += w[j]*cosVal;
+				s += w[j]*sinVal;
+				cc += w[j]*cosVal*cosVal;
+				ss += w[j]*sinVal*sinVal;
+				cs += w[j]*cosVal*sinVal;
+				}
+			powerFromSums(fitMean, yySum, yc, ys, c, s, cc, ss, cs, powerVals[k]);
 			}
-		dacfErrVals[binCtr] = sqrt(dacfErrVals[binCtr]);
+		return;
+		}
+	double *x = static_cast<double*>(_mm_malloc(3*numPoints*sizeof(double), 64)), *reVals = x + numPoints, *imVals = reVals + numPoints;
+	double *wy = static_cast<double*>(_mm_malloc(numPoints*sizeof(double), 64));
+	double *sums = static_cast<double*>(_mm_malloc(6*numFreqs*sizeof(double), 64));
+	double *ycSums = sums, *ysSums = sums + numFreqs, *c2Sums = sums + 2*numFreqs, *s2Sums = sums + 3*numFreqs, *cSums = sums + 4*numFreqs, *sSums = sums + 5*numFreqs;
+	complex<double> *grid = static_cast<complex<double>*>(_mm_malloc(fftLength*sizeof(complex<double>), 64));
+	for (int j = 0; j < numPoints; ++j) {
+		wy[j] = w[j]*y[j];
+		}
+	trigSums(fftHandle, fftLength, numPoints, t, wy, freqMin, freqStep, numFreqs, x, reVals, imVals, grid, ycSums, ysSums);
+	trigSums(fftHandle, fftLength, numPoints, t, w, 2.0*freqMin, 2.0*freqStep, numFreqs, x, reVals, imVals, grid, c2Sums, s2Sums);
+	if (fitMean) {
+		trigSums(fftHandle, fftLength, numPoints, t, w, freqMin, freqStep, numFreqs, x, reVals, imVals, grid, cSums, sSums);
 		}
-	// Free the pair arrays
-	if (tPair) {
-		_mm_free(tPair);
-		tPair = nullptr;
+	for (int k = 0; k < numFreqs; ++k) {
+		double c = fitMean ? cSums[k] : 0.0, s = fitMean ? sSums[k] : 0.0;
+		// The weights sum to one, so cos^2 = (1 + cos 2x)/2 etc.
+		powerFromSums(fitMean, yySum, ycSums[k], ysSums[k], c, s, 0.5*(1.0 + c2Sums[k]), 0.5*(1.0 - c2Sums[k]), 0.5*s2Sums[k], powerVals[k]);
 		}
-	if (yPair) {
-		_mm_free(yPair);
-		yPair = nullptr;
+	_mm_free(grid);
+	_mm_free(sums);
+	_mm_free(wy);
+	_mm_free(x);
+	}
+
+int kali::lombScargle(int numCadences, double *tIn, double *yIn, double *yerrIn, double *maskIn, double freqMin, double freqStep, int numFreqs, int fitMean, int bruteForce, double *powerVals) {
+	/*!
+	Generalized Lomb-Scargle periodogram (Zechmeister & Kurster 2009) on the frequencies freqMin + k*freqStep, k < numFreqs, weighting each cadence by 1/yerr^2. With fitMean the model is a sinusoid plus a constant, otherwise the weighted mean is subtracted once and the sinusoid fitted alone. By default the trigonometric sums are evaluated with the extirpolation/FFT scheme of Press & Rybicki 1989; bruteForce selects the direct O(N*numFreqs) sums, which agree to the accuracy of the extirpolation.
+	*/
+	if ((numCadences < 1) or (numFreqs < 1) or (freqMin < 0.0) or (freqStep <= 0.0)) {
+		return -1;
+		}
+	kali::ThreadLease lease(kali::LC_TASK, kali::get_ExecutionContext()->get_maxThreads());
+	int numThreads = lease.get_numThreads();
+	double *t = static_cast<double*>(_mm_malloc(3*numCadences*sizeof(double), 64)), *y = t + numCadences, *w = y + numCadences;
+	double yySum = 0.0;
+	int numPoints = prepareSeries(numCadences, tIn, yIn, yerrIn, maskIn, t, y, w, yySum);
+	if (numPoints < 2) {
+		for (int k = 0; k < numFreqs; ++k) {
+			powerVals[k] = 0.0;
+			}
+		} else if (bruteForce) {
+		#pragma omp parallel for schedule(static) num_threads(numThreads) default(none) shared(numPoints, t, y, w, yySum, freqMin, freqStep, numFreqs, fitMean, powerVals)
+		for (int k = 0; k < numFreqs; ++k) {
+			lombScarglePower(nullptr, 0, numPoints, t, y, w, yySum, freqMin + k*freqStep, freqStep, 1, fitMean, 1, powerVals + k);
+			}
+		} else {
+		int fftLength = extirpolationLength(numFreqs);
+		DFTI_DESCRIPTOR_HANDLE fftHandle = extirpolationHandle(fftLength);
+		lombScarglePower(fftHandle, fftLength, numPoints, t, y, w, yySum, freqMin, freqStep, numFreqs, fitMean, 0, powerVals);
+		DftiFreeDescriptor(&fftHandle);
+		}
+	_mm_free(t);
+	return 0;
+	}
+
+int kali::lombScargleBatch(int numLCs, int *cadenceOffsets, double *tIn, double *yIn, double *yerrIn, double *maskIn, double freqMin, double freqStep, int numFreqs, int fitMean, int bruteForce, double *powerVals) {
+	/*!
+	Periodograms of numLCs light curves packed one after the other, light curve lcNum occupying cadences cadenceOffsets[lcNum] to cadenceOffsets[lcNum + 1] - 1, all on the frequency grid of kali::lombScargle. The power of light curve lcNum at frequency k goes to powerVals[lcNum*numFreqs + k]. The light curves are spread over the threads with a dynamic schedule; each thread keeps one FFT descriptor and one set of work arrays, sized for the longest light curve, for all the light curves it handles.
+	*/
+	if ((numLCs < 1) or (numFreqs < 1) or (freqMin < 0.0) or (freqStep <= 0.0)) {
+		return -1;
 		}
-	if (maskPair) {
-		_mm_free(maskPair);
-		maskPair = nullptr;
+	int maxCadences = 0;
+	for (int lcNum = 0; lcNum < numLCs; ++lcNum) {
+		int numCadences = cadenceOffsets[lcNum + 1] - cadenceOffsets[lcNum];
+		if (numCadences < 0) {
+			return -1;
+			}
+		maxCadences = (numCadences > maxCadences) ? numCadences : maxCadences;
 		}
+	kali::ThreadLease lease(kali::LC_TASK, kali::get_ExecutionContext()->get_maxThreads());
+	int numThreads = lease.get_numThreads();
+	int fftLength = extirpolationLength(numFreqs);
+	#pragma omp parallel num_threads(numThreads) default(none) shared(numLCs, cadenceOffsets, tIn, yIn, yerrIn, maskIn, freqMin, freqStep, numFreqs, fitMean, bruteForce, powerVals, maxCadences, fftLength)
+	{
+		DFTI_DESCRIPTOR_HANDLE fftHandle = bruteForce ? nullptr : extirpolationHandle(fftLength);
+		double *t = static_cast<double*>(_mm_malloc((3*maxCadences + 1)*sizeof(double), 64)), *y = t + maxCadences, *w = y + maxCadences;
+		#pragma omp for schedule(dynamic, 1)
+		for (int lcNum = 0; lcNum < numLCs; ++lcNum) {
+			int offset = cadenceOffsets[lcNum];
+			double yySum = 0.0;
+			int numPoints = prepareSeries(cadenceOffsets[lcNum + 1] - offset, tIn + offset, yIn + offset, yerrIn + offset, maskIn + offset, t, y, w, yySum);
+			if (numPoints < 2) {
+				for (int k = 0; k < numFreqs; ++k) {
+					powerVals[static_cast<long>(lcNum)*numFreqs + k] = 0.0;
+					}
+				} else {
+				lombScarglePower(fftHandle, fftLength, numPoints, t, y, w, yySum, freqMin, freqStep, numFreqs, fitMean, bruteForce, powerVals + static_cast<long>(lcNum)*numFreqs);
+				}
+			}
+		_mm_free(t);
+		if (fftHandle) {
+			DftiFreeDescriptor(&fftHandle);
+			}
+	}
 	return 0;
 	}
+
+static void lcMoments(int numCadences, double *yIn, double *yerrIn, double *maskIn, double *moments) {
+	/*!
+	Number of unmasked cadences and the masked mean and standard deviation of y and of yerr, as in lc._statistics.
+	*/
+	double count = 0.0, meanVal = 0.0, meanErrVal = 0.0, stdVal = 0.0, stdErrVal = 0.0;
+	for (int i = 0; i < numCadences; ++i) {
+		count += (maskIn[i] != 0.0) ? 1.0 : 0.0;
+		meanVal += maskIn[i]*yIn[i];
+		meanErrVal += maskIn[i]*yerrIn[i];
+		}
+	if (count > 0.0) {
+		meanVal /= count;
+		meanErrVal /= count;
+		for (int i = 0; i < numCadences; ++i) {
+			stdVal += maskIn[i]*(yIn[i] - meanVal)*(yIn[i] - meanVal);
+			stdErrVal += maskIn[i]*(yerrIn[i] - meanErrVal)*(yerrIn[i] - meanErrVal);
+			}
+		stdVal = sqrt(stdVal/count);
+		stdErrVal = sqrt(stdErrVal/count);
+		}
+	moments[0] = count;
+	moments[1] = meanVal;
+	moments[2] = meanErrVal;
+	moments[3] = stdVal;
+	moments[4] = stdErrVal;
+	}
+
+int kali::batchStats(int numLCs, int *cadenceOffsets, double *tIn, double *yIn, double *yerrIn, double *maskIn, int statFlags, double *momentVals, double *acvfLags, double *acvfVals, double *acvfErrVals, double *sfLags, double *sfVals, double *sfErrVals, int numSFBins, double *sfBinEdges, double *sfBinLags, double *sfBinVals, double *sfBinErrVals, double *sfBinPairs, int numDACFBins, double *dacfLags, double *dacfVals, double *dacfErrVals, double freqMin, double freqStep, int numFreqs, int fitMean, double *powerVals) {
+	/*!
+	Statistics of numLCs light curves packed one after the other, light curve lcNum occupying cadences cadenceOffsets[lcNum] to cadenceOffsets[lcNum + 1] - 1 of the concatenated arrays. statFlags is an OR of BatchStat values and only the outputs of the requested statistics are touched (the others may be nullptr):
+		STAT_MOMENTS      momentVals[lcNum*numMoments + k]: number of unmasked cadences, mean and mean error, std and std of the errors.
+		STAT_ACVF/SF      kali::acvf/kali::sf of each light curve, taken to be regular with dt = t[1] - t[0], in the cadence layout of the input.
+		STAT_SFBINNED     kali::sfBinned on the shared numSFBins + 1 edges, at sfBin*[lcNum*numSFBins + b].
+		STAT_DACF         kali::dacf on the shared lag centres dacfLags, at dacf*[lcNum*numDACFBins + b].
+		STAT_PERIODOGRAM  kali::lombScargle on freqMin + k*freqStep, at powerVals[lcNum*numFreqs + k].
+	The light curves are spread over the leased threads with a dynamic schedule and each is handled start to finish by one thread, whose nested leases in the per-object statistics are granted one thread, so there is no per-object overhead beyond the work itself. Outputs of light curves without cadences are zero. Returns -1 if the offsets or the requested grids are invalid or a requested output is missing.
+	*/
+	if ((numLCs < 1) or (statFlags <= 0) or (statFlags >= 2*STAT_PERIODOGRAM)) {
+		return -1;
+		}
+	for (int lcNum = 0; lcNum < numLCs; ++lcNum) {
+		if (cadenceOffsets[lcNum + 1] < cadenceOffsets[lcNum]) {
+			return -1;
+			}
+		}
+	if ((statFlags & STAT_MOMENTS) and (not momentVals)) {
+		return -1;
+		}
+	if ((statFlags & STAT_ACVF) and ((not acvfLags) or (not acvfVals) or (not acvfErrVals))) {
+		return -1;
+		}
+	if ((statFlags & STAT_SF) and ((not sfLags) or (not sfVals) or (not sfErrVals))) {
+		return -1;
+		}
+	if ((statFlags & STAT_SFBINNED) and ((numSFBins < 1) or (not sfBinEdges) or (not sfBinLags) or (not sfBinVals) or (not sfBinErrVals) or (not sfBinPairs))) {
+		return -1;
+		}
+	if ((statFlags & STAT_DACF) and ((numDACFBins < 1) or (not dacfLags) or (not dacfVals) or (not dacfErrVals))) {
+		return -1;
+		}
+	if ((statFlags & STAT_PERIODOGRAM) and ((numFreqs < 1) or (freqMin < 0.0) or (freqStep <= 0.0) or (not powerVals))) {
+		return -1;
+		}
+	kali::ThreadLease lease(kali::LC_TASK, kali::get_ExecutionContext()->get_maxThreads());
+	int numThreads = lease.get_numThreads();
+	int result = 0;
+	#pragma omp parallel for schedule(dynamic, 1) num_threads(numThreads) default(none) shared(numLCs, cadenceOffsets, tIn, yIn, yerrIn, maskIn, statFlags, momentVals, acvfLags, acvfVals, acvfErrVals, sfLags, sfVals, sfErrVals, numSFBins, sfBinEdges, sfBinLags, sfBinVals, sfBinErrVals, sfBinPairs, numDACFBins, dacfLags, dacfVals, dacfErrVals, freqMin, freqStep, numFreqs, fitMean, powerVals) reduction(min:result)
+	for (int lcNum = 0; lcNum < numLCs; ++lcNum) {
+		int offset = cadenceOffsets[lcNum], numCadences = cadenceOffsets[lcNum + 1] - offset;
+		double *t = tIn + offset, *y = yIn + offset, *yerr = yerrIn + offset, *mask = maskIn + offset;
+		double dt = (numCadences > 1) ? t[1] - t[0] : 0.0;
+		long sfBinOffset = static_cast<long>(lcNum)*numSFBins, dacfOffset = static_cast<long>(lcNum)*numDACFBins, powerOffset = static_cast<long>(lcNum)*numFreqs;
+		if (statFlags & STAT_MOMENTS) {
+			lcMoments(numCadences, y, yerr, mask, momentVals + static_cast<long>(lcNum)*numMoments);
+			}
+		if (numCadences < 1) {
+			for (int binCtr = 0; (statFlags & STAT_SFBINNED) and (binCtr < numSFBins); ++binCtr) {
+				sfBinLags[sfBinOffset + binCtr] = sfBinVals[sfBinOffset + binCtr] = sfBinErrVals[sfBinOffset + binCtr] = sfBinPairs[sfBinOffset + binCtr] = 0.0;
+				}
+			for (int binCtr = 0; (statFlags & STAT_DACF) and (binCtr < numDACFBins); ++binCtr) {
+				dacfVals[dacfOffset + binCtr] = dacfErrVals[dacfOffset + binCtr] = 0.0;
+				}
+			for (int freqNum = 0; (statFlags & STAT_PERIODOGRAM) and (freqNum < numFreqs); ++freqNum) {
+				powerVals[powerOffset + freqNum] = 0.0;
+				}
+			continue;
+			}
+		if (statFlags & STAT_ACVF) {
+			result = min(result, kali::acvf(numCadences, dt, t, y, y, yerr, mask, acvfLags + offset, acvfVals + offset, acvfErrVals + offset, 0));
+			}
+		if (statFlags & STAT_SF) {
+			result = min(result, kali::sf(numCadences, dt, t, y, y, yerr, mask, sfLags + offset, sfVals + offset, sfErrVals + offset, 0));
+			}
+		if (statFlags & STAT_SFBINNED) {
+			result = min(result, kali::sfBinned(numCadences, t, y, yerr, mask, numSFBins, sfBinEdges, sfBinLags + sfBinOffset, sfBinVals + sfBinOffset, sfBinErrVals + sfBinOffset, sfBinPairs + sfBinOffset));
+			}
+		if (statFlags & STAT_DACF) {
+			result = min(result, kali::dacf(numCadences, t, y, y, yerr, mask, numDACFBins, dacfLags, dacfVals + dacfOffset, dacfErrVals + dacfOffset));
+			}
+		if (statFlags & STAT_PERIODOGRAM) {
+			result = min(result, kali::lombScargle(numCadences, t, y, yerr, mask, freqMin, freqStep, numFreqs, fitMean, 0, powerVals + powerOffset));
+			}
+		}
+	return result;
+	}
+
@@ -1,36 +1,203 @@
 # distutils: language = c++
+"""Light curve statistics. The functions release the GIL while the C++ code runs and keep no state, so they may be
+called concurrently from several Python threads on different arrays."""
 import math
 import cython
 import numpy as np
 import psutil
 cimport numpy as np
 from libcpp cimport bool
+from cpython.pycapsule cimport PyCapsule_GetPointer
+import Execution_cython
 
 
-cdef extern from 'LC.hpp' namespace "kali":
-	int acvf(int numCadences, double dt, double *tIn, double *xIn, double *yIn, double *yerrIn, double *maskIn, double *lagVals, double *acvfVals, double *acvfErrvals)
-	int acf(int numCadences, double dt, double *tIn, double *xIn, double *yIn, double *yerrIn, double *maskIn, double *lagVals, double *acvfVals, double *acvfErrvals)
-	int sf(int numCadences, double dt, double *tIn, double *xIn, double *yIn, double *yerrIn, double*maskIn, double *lagVals, double *sfVals, double *sfErrVals)
-	int dacf(int numCadences, double dt, double *tIn, double *xIn, double *yIn, double *yerrIn, double *maskIn, int numBins, double *lagVals, double *acvfVals, double *acvfErrVals)
+cdef extern from 'Execution.hpp' namespace "kali":
+	cdef cppclass ExecutionContext:
+		pass
+	void attach_ExecutionContext(ExecutionContext *context)
 
+attach_ExecutionContext(<ExecutionContext*>PyCapsule_GetPointer(Execution_cython.context_capsule(), 'kali.ExecutionContext'))
 
+cdef extern from 'LC.hpp' namespace "kali" nogil:
+	int acvf(int numCadences, double dt, double *tIn, double *xIn, double *yIn, double *yerrIn, double *maskIn, double *lagVals, double *acvfVals, double *acvfErrvals, int bruteForce)
+	int acf(int numCadences, double dt, double *tIn, double *xIn, double *yIn, double *yerrIn, double *maskIn, double *lagVals, double *acvfVals, double *acvfErrvals, int bruteForce)
+	int sf(int numCadences, double dt, double *tIn, double *xIn, double *yIn, double *yerrIn, double*maskIn, double *lagVals, double *sfVals, double *sfErrVals, int bruteForce)
+	int sfBinned(int numCadences, double *tIn, double *yIn, double *yerrIn, double *maskIn, int numBins, double *binEdges, double *lagVals, double *sfVals, double *sfErrVals, double *numPairVals)
+	int dacf(int numCadences, double *tIn, double *xIn, double *yIn, double *yerrIn, double *maskIn, int numBins, double *lagVals, double *acvfVals, double *acvfErrVals)
+	int lombScargle(int numCadences, double *tIn, double *yIn, double *yerrIn, double *maskIn, double freqMin, double freqStep, int numFreqs, int fitMean, int bruteForce, double *powerVals)
+	int lombScargleBatch(int numLCs, int *cadenceOffsets, double *tIn, double *yIn, double *yerrIn, double *maskIn, double freqMin, double freqStep, int numFreqs, int fitMean, int bruteForce, double *powerVals)
+	int batchStats(int numLCs, int *cadenceOffsets, double *tIn, double *yIn, double *yerrIn, double *maskIn, int statFlags, double *momentVals, double *acvfLags, double *acvfVals, double *acvfErrVals, double *sfLags, double *sfVals, double *sfErrVals, int numSFBins, double *sfBinEdges, double *sfBinLags, double *sfBinVals, double *sfBinErrVals, double *sfBinPairs, int numDACFBins, double *dacfLags, double *dacfVals, double *dacfErrVals, double freqMin, double freqStep, int numFreqs, int fitMean, double *powerVals)
+
+cdef extern from 'Cadence.hpp' namespace "kali" nogil:
+	int maskWindows(int numCadences, double *t, double *mask, double period, double openLength, double phase)
+	int maskWeather(int numCadences, double *t, double *mask, double blockLength, double lossFraction, double persistence, unsigned int weatherSeed)
+	int maskVisits(int numCadences, double *t, double *mask, double blockLength, int visitsPerBlock, unsigned int visitSeed)
+	int maskThrusterFires(int numCadences, double *t, double *mask, double firePeriod, double fireWidth, double jitter, unsigned int fireSeed)
+	int maskRolling(int numCadences, double *t, double *mask, double seasonPeriod, int numStripes, int stripe, double backgroundFraction, unsigned int rollSeed)
+
+cdef extern from 'CrossCorr.hpp' namespace "kali" nogil:
+	int dcf(int numCadences1, double *t1, double *y1, double *yerr1, double *mask1, int numCadences2, double *t2, double *y2, double *yerr2, double *mask2, int numBins, double *lagVals, double *dcfVals, double *dcfErrVals, double *numPairVals)
+	int zdcf(int numCadences1, double *t1, double *y1, double *mask1, int numCadences2, double *t2, double *y2, double *mask2, double minLag, double maxLag, int minPairs, int maxBins, double *lagVals, double *zdcfVals, double *zdcfErrLowVals, double *zdcfErrHighVals, double *numPairVals)
+	int iccf(int numCadences1, double *t1, double *y1, double *mask1, int numCadences2, double *t2, double *y2, double *mask2, int numLags, double *lagVals, double *iccfVals)
+	int crossCorrMC(int method, int numCadences1, double *t1, double *y1, double *yerr1, double *mask1, int numCadences2, double *t2, double *y2, double *yerr2, double *mask2, int numLags, double *lagVals, int minPairs, double threshold, int numRealizations, int fluxRandomization, int subsetSelection, unsigned int mcSeed, double *peakLagVals, double *centroidLagVals, double *peakVals)
+
+
+
+@cython.boundscheck(False)
+@cython.wraparound(False)
+def compute_ACVF(int numCadences, double dt, double[::1] tIn not None, double[::1] xIn not None, double[::1] yIn not None, double[::1] yerrIn not None, double[::1] maskIn not None, double[::1] lagVals not None, double[::1] acvfVals not None, double[::1] acvfErrVals not None, bint bruteForce = False):
+	cdef int result
+	with nogil:
+		result = acvf(numCadences, dt, &tIn[0], &xIn[0], &yIn[0], &yerrIn[0], &maskIn[0], &lagVals[0], &acvfVals[0], &acvfErrVals[0], bruteForce)
+	return result
+
+@cython.boundscheck(False)
+@cython.wraparound(False)
+def compute_ACF(int numCadences, double dt, double[::1] tIn not None, double[::1] xIn not None, double[::1] yIn not None, double[::1] yerrIn not None, double[::1] maskIn not None, double[::1] lagVals not None, double[::1] acfVals not None, double[::1] acfErrVals not None, bint bruteForce = False):
+	cdef int result
+	with nogil:
+		result = acf(numCadences, dt, &tIn[0], &xIn[0], &yIn[0], &yerrIn[0], &maskIn[0], &lagVals[0], &acfVals[0], &acfErrVals[0], bruteForce)
+	return result
+
+@cython.boundscheck(False)
+@cython.wraparound(False)
+def compute_SF(int numCadences, double dt, double[::1] tIn not None, double[::1] xIn not None, double[::1] yIn not None, double[::1] yerrIn not None, double[::1] maskIn not None, double[::1] lagVals not None, double[::1] sfVals not None, double[::1] sfErrVals not None, bint bruteForce = False):
+	cdef int result
+	with nogil:
+		result = sf(numCadences, dt, &tIn[0], &xIn[0], &yIn[0], &yerrIn[0], &maskIn[0], &lagVals[0], &sfVals[0], &sfErrVals[0], bruteForce)
+	return result
+
+@cython.boundscheck(False)
+@cython.wraparound(False)
+def compute_SFBinned(double[::1] tIn not None, double[::1] yIn not None, double[::1] yerrIn not None, double[::1] maskIn not None, double[::1] binEdges not None, double[::1] lagVals not None, double[::1] sfVals not None, double[::1] sfErrVals not None, double[::1] numPairVals not None):
+	cdef int result
+	with nogil:
+		result = sfBinned(tIn.shape[0], &tIn[0], &yIn[0], &yerrIn[0], &maskIn[0], binEdges.shape[0] - 1, &binEdges[0], &lagVals[0], &sfVals[0], &sfErrVals[0], &numPairVals[0])
+	return result
+
+@cython.boundscheck(False)
+@cython.wraparound(False)
+def compute_DACF(int numCadences, double[::1] tIn not None, double[::1] xIn not None, double[::1] yIn not None, double[::1] yerrIn not None, double[::1] maskIn not None, int numBins, double[::1] lagVals not None, double[::1] dacfVals not None, double[::1] dacfErrVals not None):
+	cdef int result
+	with nogil:
+		result = dacf(numCadences, &tIn[0], &xIn[0], &yIn[0], &yerrIn[0], &maskIn[0], numBins, &lagVals[0], &dacfVals[0], &dacfErrVals[0])
+	return result
+
+@cython.boundscheck(False)
+@cython.wraparound(False)
+def compute_LombScargle(double[::1] tIn not None, double[::1] yIn not None, double[::1] yerrIn not None, double[::1] maskIn not None, double freqMin, double freqStep, double[::1] powerVals not None, bint fitMean = True, bint bruteForce = False):
+	cdef int result
+	with nogil:
+		result = lombScargle(tIn.shape[0], &tIn[0], &yIn[0], &yerrIn[0], &maskIn[0], freqMin, freqStep, powerVals.shape[0], fitMean, bruteForce, &powerVals[0])
+	return result
+
+@cython.boundscheck(False)
+@cython.wraparound(False)
+def compute_LombScargleBatch(int[::1] cadenceOffsets not None, double[::1] tIn not None, double[::1] yIn not None, double[::1] yerrIn not None, double[::1] maskIn not None, double freqMin, double freqStep, int numFreqs, double[::1] powerVals not None, bint fitMean = True, bint bruteForce = False):
+	cdef int result
+	with nogil:
+		result = lombScargleBatch(cadenceOffsets.shape[0] - 1, &cadenceOffsets[0], &tIn[0], &yIn[0], &yerrIn[0], &maskIn[0], freqMin, freqStep, numFreqs, fitMean, bruteForce, &powerVals[0])
+	return result
+
+cdef double* optional(double[::1] arr):
+	if arr is None or arr.shape[0] == 0:
+		return NULL
+	return &arr[0]
+
+@cython.boundscheck(False)
+@cython.wraparound(False)
+def compute_BatchStats(int[::1] cadenceOffsets not None, double[::1] tIn not None, double[::1] yIn not None, double[::1] yerrIn not None, double[::1] maskIn not None, int statFlags, double[::1] momentVals = None, double[::1] acvfLags = None, double[::1] acvfVals = None, double[::1] acvfErrVals = None, double[::1] sfLags = None, double[::1] sfVals = None, double[::1] sfErrVals = None, double[::1] sfBinEdges = None, double[::1] sfBinLags = None, double[::1] sfBinVals = None, double[::1] sfBinErrVals = None, double[::1] sfBinPairs = None, double[::1] dacfLags = None, double[::1] dacfVals = None, double[::1] dacfErrVals = None, double freqMin = 0.0, double freqStep = 0.0, int numFreqs = 0, double[::1] powerVals = None, bint fitMean = True):
+	cdef int result
+	cdef int numSFBins = sfBinEdges.shape[0] - 1 if sfBinEdges is not None else 0
+	cdef int numDACFBins = dacfLags.shape[0] if dacfLags is not None else 0
+	cdef double *momentPtr = optional(momentVals)
+	cdef double *acvfLagPtr = optional(acvfLags)
+	cdef double *acvfPtr = optional(acvfVals)
+	cdef double *acvfErrPtr = optional(acvfErrVals)
+	cdef double *sfLagPtr = optional(sfLags)
+	cdef double *sfPtr = optional(sfVals)
+	cdef double *sfErrPtr = optional(sfErrVals)
+	cdef double *sfBinEdgePtr = optional(sfBinEdges)
+	cdef double *sfBinLagPtr = optional(sfBinLags)
+	cdef double *sfBinPtr = optional(sfBinVals)
+	cdef double *sfBinErrPtr = optional(sfBinErrVals)
+	cdef double *sfBinPairPtr = optional(sfBinPairs)
+	cdef double *dacfLagPtr = optional(dacfLags)
+	cdef double *dacfPtr = optional(dacfVals)
+	cdef double *dacfErrPtr = optional(dacfErrVals)
+	cdef double *powerPtr = optional(powerVals)
+	with nogil:
+		result = batchStats(cadenceOffsets.shape[0] - 1, &cadenceOffsets[0], &tIn[0], &yIn[0], &yerrIn[0], &maskIn[0], statFlags, momentPtr, acvfLagPtr, acvfPtr, acvfErrPtr, sfLagPtr, sfPtr, sfErrPtr, numSFBins, sfBinEdgePtr, sfBinLagPtr, sfBinPtr, sfBinErrPtr, sfBinPairPtr, numDACFBins, dacfLagPtr, dacfPtr, dacfErrPtr, freqMin, freqStep, numFreqs, fitMean, powerPtr)
+	return result
+
+@cython.boundscheck(False)
+@cython.wraparound(False)
+def mask_Windows(double[::1] t not None, double[::1] mask not None, double period, double openLength, double phase):
+	cdef int result
+	with nogil:
+		result = maskWindows(t.shape[0], &t[0], &mask[0], period, openLength, phase)
+	return result
+
+@cython.boundscheck(False)
+@cython.wraparound(False)
+def mask_Weather(double[::1] t not None, double[::1] mask not None, double blockLength, double lossFraction, double persistence, unsigned int weatherSeed):
+	cdef int result
+	with nogil:
+		result = maskWeather(t.shape[0], &t[0], &mask[0], blockLength, lossFraction, persistence, weatherSeed)
+	return result
+
+@cython.boundscheck(False)
+@cython.wraparound(False)
+def mask_Visits(double[::1] t not None, double[::1] mask not None, double blockLength, int visitsPerBlock, unsigned int visitSeed):
+	cdef int result
+	with nogil:
+		result = maskVisits(t.shape[0], &t[0], &mask[0], blockLength, visitsPerBlock, visitSeed)
+	return result
+
+@cython.boundscheck(False)
+@cython.wraparound(False)
+def mask_ThrusterFires(double[::1] t not None, double[::1] mask not None, double firePeriod, double fireWidth, double jitter, unsigned int fireSeed):
+	cdef int result
+	with nogil:
+		result = maskThrusterFires(t.shape[0], &t[0], &mask[0], firePeriod, fireWidth, jitter, fireSeed)
+	return result
+
+@cython.boundscheck(False)
+@cython.wraparound(False)
+def mask_Rolling(double[::1] t not None, double[::1] mask not None, double seasonPeriod, int numStripes, int stripe, double backgroundFraction, unsigned int rollSeed):
+	cdef int result
+	with nogil:
+		result = maskRolling(t.shape[0], &t[0], &mask[0], seasonPeriod, numStripes, stripe, backgroundFraction, rollSeed)
+	return result
 
 @cython.boundscheck(False)
 @cython.wraparound(False)
-def compute_ACVF(numCadences, dt, np.ndarray[double, ndim=1, mode='c'] tIn not None, np.ndarray[double, ndim=1, mode='c'] xIn not None, np.ndarray[double, ndim=1, mode='c'] yIn not None, np.ndarray[double, ndim=1, mode='c'] yerrIn not None, np.ndarray[double, ndim=1, mode='c'] maskIn not None, np.ndarray[double, ndim=1, mode='c'] lagVals not None, np.ndarray[double, ndim=1, mode='c'] acvfVals not None, np.ndarray[double, ndim=1, mode='c'] acvfErrVals not None):
-	return acvf(numCadences, dt, &tIn[0], &xIn[0], &yIn[0], &yerrIn[0], &maskIn[0], &lagVals[0], &acvfVals[0], &acvfErrVals[0])
+def compute_DCF(double[::1] t1 not None, double[::1] y1 not None, double[::1] yerr1 not None, double[::1] mask1 not None, double[::1] t2 not None, double[::1] y2 not None, double[::1] yerr2 not None, double[::1] mask2 not None, double[::1] lagVals not None, double[::1] dcfVals not None, double[::1] dcfErrVals not None, double[::1] numPairVals not None):
+	cdef int result
+	with nogil:
+		result = dcf(t1.shape[0], &t1[0], &y1[0], &yerr1[0], &mask1[0], t2.shape[0], &t2[0], &y2[0], &yerr2[0], &mask2[0], lagVals.shape[0], &lagVals[0], &dcfVals[0], &dcfErrVals[0], &numPairVals[0])
+	return result
 
 @cython.boundscheck(False)
 @cython.wraparound(False)
-def compute_ACF(numCadences, dt, np.ndarray[double, ndim=1, mode='c'] tIn not None, np.ndarray[double, ndim=1, mode='c'] xIn not None, np.ndarray[double, ndim=1, mode='c'] yIn not None, np.ndarray[double, ndim=1, mode='c'] yerrIn not None, np.ndarray[double, ndim=1, mode='c'] maskIn not None, np.ndarray[double, ndim=1, mode='c'] lagVals not None, np.ndarray[double, ndim=1, mode='c'] acfVals not None, np.ndarray[double, ndim=1, mode='c'] acfErrVals not None):
-	return acf(numCadences, dt, &tIn[0], &xIn[0], &yIn[0], &yerrIn[0], &maskIn[0], &lagVals[0], &acfVals[0], &acfErrVals[0])
+def compute_ZDCF(double[::1] t1 not None, double[::1] y1 not None, double[::1] mask1 not None, double[::1] t2 not None, double[::1] y2 not None, double[::1] mask2 not None, double minLag, double maxLag, int minPairs, double[::1] lagVals not None, double[::1] zdcfVals not None, double[::1] zdcfErrLowVals not None, double[::1] zdcfErrHighVals not None, double[::1] numPairVals not None):
+	cdef int result
+	with nogil:
+		result = zdcf(t1.shape[0], &t1[0], &y1[0], &mask1[0], t2.shape[0], &t2[0], &y2[0], &mask2[0], minLag, maxLag, minPairs, lagVals.shape[0], &lagVals[0], &zdcfVals[0], &zdcfErrLowVals[0], &zdcfErrHighVals[0], &numPairVals[0])
+	return result
 
 @cython.boundscheck(False)
 @cython.wraparound(False)
-def compute_SF(numCadences, dt, np.ndarray[double, ndim=1, mode='c'] tIn not None, np.ndarray[double, ndim=1, mode='c'] xIn not None, np.ndarray[double, ndim=1, mode='c'] yIn not None, np.ndarray[double, ndim=1, mode='c'] yerrIn not None, np.ndarray[double, ndim=1, mode='c'] maskIn not None, np.ndarray[double, ndim=1, mode='c'] lagVals not None, np.ndarray[double, ndim=1, mode='c'] sfVals not None, np.ndarray[double, ndim=1, mode='c'] sfErrVals not None):
-	return sf(numCadences, dt, &tIn[0], &xIn[0], &yIn[0], &yerrIn[0], &maskIn[0], &lagVals[0], &sfVals[0], &sfErrVals[0])
+def compute_ICCF(double[::1] t1 not None, double[::1] y1 not None, double[::1] mask1 not None, double[::1] t2 not None, double[::1] y2 not None, double[::1] mask2 not None, double[::1] lagVals not None, double[::1] iccfVals not None):
+	cdef int result
+	with nogil:
+		result = iccf(t1.shape[0], &t1[0], &y1[0], &mask1[0], t2.shape[0], &t2[0], &y2[0], &mask2[0], lagVals.shape[0], &lagVals[0], &iccfVals[0])
+	return result
 
 @cython.boundscheck(False)
 @cython.wraparound(False)
-def compute_DACF(numCadences, dt, np.ndarray[double, ndim=1, mode='c'] tIn not None, np.ndarray[double, ndim=1, mode='c'] xIn not None, np.ndarray[double, ndim=1, mode='c'] yIn not None, np.ndarray[double, ndim=1, mode='c'] yerrIn not None, np.ndarray[double, ndim=1, mode='c'] maskIn not None, numBins, np.ndarray[double, ndim=1, mode='c'] lagVals not None, np.ndarray[double, ndim=1, mode='c'] dacfVals not None, np.ndarray[double, ndim=1, mode='c'] dacfErrVals not None):
-	return dacf(numCadences, dt, &tIn[0], &xIn[0], &yIn[0], &yerrIn[0], &maskIn[0], numBins, &lagVals[0], &dacfVals[0], &dacfErrVals[0])
+def compute_CrossCorrMC(int method, double[::1] t1 not None, double[::1] y1 not None, double[::1] yerr1 not None, double[::1] mask1 not None, double[::1] t2 not None, double[::1] y2 not None, double[::1] yerr2 not None, double[::1] mask2 not None, double[::1] lagVals not None, int minPairs, double threshold, bint fluxRandomization, bint subsetSelection, unsigned int mcSeed, double[::1] peakLagVals not None, double[::1] centroidLagVals not None, double[::1] peakVals not None):
+	cdef int result
+	with nogil:
+		result = crossCorrMC(method, t1.shape[0], &t1[0], &y1[0], &yerr1[0], &mask1[0], t2.shape[0], &t2[0], &y2[0], &yerr2[0], &mask2[0], lagVals.shape[0], &lagVals[0], minPairs, threshold, peakLagVals.shape[0], fluxRandomization, subsetSelection, mcSeed, &peakLagVals[0], &centroidLagVals[0], &peakVals[0])
+	return result
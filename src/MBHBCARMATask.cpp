@@ -19,6 +19,7 @@
 #include "MBHBCARMA.hpp"
 #include "MCMC.hpp"
 #include "Constants.hpp"
+#include "Execution.hpp"
 #include "MBHBCARMATask.hpp"
 
 //#define DEBUG_COMPUTELNLIKELIHOOD
@@ -33,6 +34,9 @@ kali::MBHBCARMATask::MBHBCARMATask(int pGiven, int qGiven, int numThreadsGiven,
 	q = qGiven;
 	numThreads = numThreadsGiven;
 	numBurn = numBurnGiven;
+	samplerUtilization = 0.0;
+	lnEvidence = 0.0;
+	lnEvidenceErr = 0.0;
 	Systems = new kali::MBHBCARMA[numThreads];
 	setSystemsVec = static_cast<bool*>(_mm_malloc(numThreads*sizeof(double),64));
 	ThetaVec = static_cast<double*>(_mm_malloc(numThreads*(kali::MBHBCARMATask::r + p + q + 1)*sizeof(double),64));
@@ -86,6 +90,9 @@ int kali::MBHBCARMATask::reset_MBHBCARMATask(int pGiven, int qGiven, int numBurn
 
 int kali::MBHBCARMATask::get_numBurn() {return numBurn;}
 void kali::MBHBCARMATask::set_numBurn(int numBurn) {numBurn = numBurn;}
+double kali::MBHBCARMATask::get_samplerUtilization() {return samplerUtilization;}
+double kali::MBHBCARMATask::get_lnEvidence() {return lnEvidence;}
+double kali::MBHBCARMATask::get_lnEvidenceErr() {return lnEvidenceErr;}
 
 int kali::MBHBCARMATask::check_Theta(double *Theta, int threadNum) {
 	return Systems[threadNum].checkMBHBCARMAParams(Theta);
@@ -426,6 +433,7 @@ double kali::MBHBCARMATask::get_ejectedMass(double sigmaStars, double rhoStars,
 	}
 
 int kali::MBHBCARMATask::make_BeamedLC(int numCadences, double tolIR, double startT, double fracIntrinsicVar, double fracNoiseToSignal, double *t, double *x, double *y, double *yerr, double *mask, double *lcX, double *lcP, int threadNum) {
+	kali::ThreadLease lease(kali::MBHBCARMA_TASK, 1);
 	int retVal = 0;
 	Systems[threadNum].resetState();
 	double old_dt = Systems[threadNum].get_dt();
@@ -450,6 +458,7 @@ int kali::MBHBCARMATask::make_BeamedLC(int numCadences, double tolIR, double sta
 	}
 
 int kali::MBHBCARMATask::make_IntrinsicLC(int numCadences, double tolIR, double startT, double fracIntrinsicVar, double fracNoiseToSignal, double *t, double *x, double *y, double *yerr, double *mask, double *lcX, double *lcP, unsigned int burnSeed, unsigned int distSeed, int threadNum) {
+	kali::ThreadLease lease(kali::MBHBCARMA_TASK, 1);
 	int retVal = 0;
 	Systems[threadNum].resetState();
 	double old_dt = Systems[threadNum].get_dt();
@@ -522,6 +531,7 @@ double kali::MBHBCARMATask::get_meanFlux(double fracIntrinsicVar, int threadNum)
 	}
 
 int kali::MBHBCARMATask::make_ObservedLC(int numCadences, double tolIR, double fracIntrinsicVar, double fracNoiseToSignal, double *t, double *x, double *y, double *yerr, double *mask, unsigned int burnSeed, unsigned int distSeed, unsigned int noiseSeed, int threadNum) {
+	kali::ThreadLease lease(kali::MBHBCARMA_TASK, 1);
 	int retVal = 0;
 	double old_dt = Systems[threadNum].get_dt();
 	double* burnRand = static_cast<double*>(_mm_malloc(numBurn*p*sizeof(double),64));
@@ -557,6 +567,7 @@ int kali::MBHBCARMATask::make_ObservedLC(int numCadences, double tolIR, double f
 	}
 
 int kali::MBHBCARMATask::add_ObservationNoise(int numCadences, double tolIR, double fracIntrinsicVar, double fracNoiseToSignal, double *t, double *x, double *y, double *yerr, double *mask, unsigned int noiseSeed, int threadNum) {
+	kali::ThreadLease lease(kali::MBHBCARMA_TASK, 1);
 	int retVal = 0;
 	kali::LnLikeData Data;
 	Data.numCadences = numCadences;
@@ -647,6 +658,7 @@ double kali::MBHBCARMATask::compute_LnPrior(int numCadences, double meandt, doub
 }*/
 
 double kali::MBHBCARMATask::compute_LnLikelihood(int numCadences, int cadenceNum, double tolIR, double startT, double *t, double *x, double *y, double *yerr, double *mask, double *lcX, double *lcP, double periodCenter, double periodWidth, double fluxCenter, double fluxWidth, int threadNum) {
+	kali::ThreadLease lease(kali::MBHBCARMA_TASK, 1);
 	double LnLikelihood = 0.0;
 	kali::LnLikeData Data;
 	Data.numCadences = numCadences;
@@ -681,6 +693,7 @@ double kali::MBHBCARMATask::compute_LnLikelihood(int numCadences, int cadenceNum
 
 /*
 double kali::MBHBCARMATask::update_LnLikelihood(int numCadences, int cadenceNum, double currentLnLikelihood, double tolIR, double *t, double *x, double *y, double *yerr, double *mask, double *lcX, double *lcP, int threadNum) {
+	kali::ThreadLease lease(kali::MBHBCARMA_TASK, 1);
 	double LnLikelihood = 0.0;
 	kali::LnLikeData Data;
 	Data.numCadences = numCadences;
@@ -712,6 +725,7 @@ double kali::MBHBCARMATask::update_LnLikelihood(int numCadences, int cadenceNum,
 	}
 
 double kali::MBHBCARMATask::compute_LnPosterior(int numCadences, int cadenceNum, double tolIR, double maxSigma, double minTimescale, double maxTimescale, double *t, double *x, double *y, double *yerr, double *mask, double *lcX, double *lcP, int threadNum) {
+	kali::ThreadLease lease(kali::MBHBCARMA_TASK, 1);
 	double LnPrior = 0.0, LnLikelihood = 0.0, LnPosterior = 0.0;
 	kali::LnLikeData Data;
 	Data.numCadences = numCadences;
@@ -743,6 +757,7 @@ double kali::MBHBCARMATask::compute_LnPosterior(int numCadences, int cadenceNum,
 	}
 
 double kali::MBHBCARMATask::update_LnPosterior(int numCadences, int cadenceNum, double currentLnLikelihood, double tolIR, double maxSigma, double minTimescale, double maxTimescale, double *t, double *x, double *y, double *yerr, double *mask, double *lcX, double *lcP, int threadNum) {
+	kali::ThreadLease lease(kali::MBHBCARMA_TASK, 1);
 	double LnPrior = 0.0, LnLikelihood = 0.0, LnPosterior = 0.0;
 	kali::LnLikeData Data;
 	Data.numCadences = numCadences;
@@ -782,8 +797,9 @@ void kali::MBHBCARMATask::compute_ACVF(int numLags, double *Lags, double *ACVF,
 	}
 */
 
-int kali::MBHBCARMATask::fit_MBHBCARMAModel(double dt, int numCadences, double meandt, double tolIR, double maxSigma, double minTimescale, double maxTimescale, double lowestFlux, double highestFlux, double startT, double *t, double *x, double *y, double *yerr, double *mask, int nwalkers, int nsteps, int maxEvals, double xTol, double mcmcA, unsigned int zSSeed, unsigned int walkerSeed, unsigned int moveSeed, unsigned int xSeed, double* xStart, double *Chain, double *LnPrior, double *LnLikelihood, double periodCenter, double periodWidth, double fluxCenter, double fluxWidth) {
-	omp_set_num_threads(numThreads);
+int kali::MBHBCARMATask::fit_MBHBCARMAModel(double dt, int numCadences, double meandt, double tolIR, double maxSigma, double minTimescale, double maxTimescale, double lowestFlux, double highestFlux, double startT, double *t, double *x, double *y, double *yerr, double *mask, int nwalkers, int nsteps, int maxEvals, double xTol, double mcmcA, unsigned int zSSeed, unsigned int walkerSeed, unsigned int moveSeed, unsigned int xSeed, double* xStart, double *Chain, double *LnPrior, double *LnLikelihood, double periodCenter, double periodWidth, double fluxCenter, double fluxWidth, int samplerType, int numTemps, double maxTemp) {
+	kali::ThreadLease lease(kali::MBHBCARMA_TASK, numThreads);
+	int leasedThreads = lease.get_numThreads();
 	int ndims = kali::MBHBCARMATask::r + p + q + 1;
 	int threadNum = omp_get_thread_num();
 	kali::LnLikeData Data;
@@ -817,7 +833,7 @@ int kali::MBHBCARMATask::fit_MBHBCARMAModel(double dt, int numCadences, double m
     */
 	kali::LnLikeData *ptr2Data = &Data;
 	kali::LnLikeArgs Args;
-	Args.numThreads = numThreads;
+	Args.numThreads = leasedThreads;
 	Args.Data = ptr2Data;
 	Args.Systems = nullptr;
 	void* p2Args = nullptr;
@@ -825,11 +841,11 @@ int kali::MBHBCARMATask::fit_MBHBCARMAModel(double dt, int numCadences, double m
 	p2Args = &Args;
 	double LnLikeVal = 0.0;
 	double *initPos = nullptr, *offsetArr = nullptr;
-	vector<vector<double>> xVec (numThreads, vector<double>(ndims));
+	vector<vector<double>> xVec (leasedThreads, vector<double>(ndims));
 	initPos = static_cast<double*>(_mm_malloc(nwalkers*ndims*sizeof(double),64));
-	int nthreads = numThreads;
-	nlopt::opt *optArray[numThreads];
-	for (int i = 0; i < numThreads; ++i) {
+	int nthreads = leasedThreads;
+	nlopt::opt *optArray[leasedThreads];
+	for (int i = 0; i < leasedThreads; ++i) {
 		//optArray[i] = new nlopt::opt(nlopt::LN_BOBYQA, ndims); // Fastest
 		optArray[i] = new nlopt::opt(nlopt::LN_NELDERMEAD, ndims); // Slower
 		//optArray[i] = new nlopt::opt(nlopt::LN_COBYLA, ndims); // Slowest
@@ -838,7 +854,7 @@ int kali::MBHBCARMATask::fit_MBHBCARMAModel(double dt, int numCadences, double m
 		optArray[i]->set_xtol_rel(xTol);
 		//optArray[i]->set_maxtime(60.0); // Timeout after 60 sec.
 		}
-	double *max_LnPosterior = static_cast<double*>(_mm_malloc(numThreads*sizeof(double),64));
+	double *max_LnPosterior = static_cast<double*>(_mm_malloc(leasedThreads*sizeof(double),64));
 	kali::MBHBCARMA *ptrToSystems = Systems;
 	#pragma omp parallel for default(none) shared(dt, nwalkers, ndims, optArray, initPos, xStart, t, ptrToSystems, xVec, max_LnPosterior, p2Args)
 	for (int walkerNum = 0; walkerNum < nwalkers; ++walkerNum) {
@@ -882,15 +898,12 @@ int kali::MBHBCARMATask::fit_MBHBCARMAModel(double dt, int numCadences, double m
 			initPos[walkerNum*ndims + dimNum] = xVec[threadNum][dimNum];
 			}
 		}
-	for (int i = 0; i < numThreads; ++i) {
+	for (int i = 0; i < leasedThreads; ++i) {
 		delete optArray[i];
 		}
 	_mm_free(max_LnPosterior);
-	kali::EnsembleSampler newEnsemble = kali::EnsembleSampler(ndims, nwalkers, nsteps, numThreads, mcmcA, kali::calcLnPosterior, p2Args, zSSeed, walkerSeed, moveSeed);
-	newEnsemble.runMCMC(initPos);
+	kali::runSampler<kali::FunctionPosterior>(samplerType, ndims, nwalkers, nsteps, leasedThreads, mcmcA, numTemps, maxTemp, kali::calcLnPosterior, p2Args, kali::FunctionPosterior(kali::calcLnPosterior, p2Args), nullptr, nullptr, 0, zSSeed, walkerSeed, moveSeed, initPos, Chain, LnPrior, LnLikelihood, samplerUtilization, lnEvidence, lnEvidenceErr, nullptr, nullptr, nullptr);
 	_mm_free(initPos);
-	newEnsemble.getChain(Chain);
-	newEnsemble.getChainVals(LnPrior, LnLikelihood);
 	return 0;
 	}
 
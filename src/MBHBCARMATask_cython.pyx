@@ -5,6 +5,8 @@ import numpy as np
 import psutil
 cimport numpy as np
 from libcpp cimport bool
+from cpython.pycapsule cimport PyCapsule_GetPointer
+import Execution_cython
 
 
 cdef extern from 'MBHBCARMA.hpp' namespace "kali":
@@ -13,12 +15,22 @@ cdef extern from 'MBHBCARMA.hpp' namespace "kali":
 cdef extern from 'MBHBCARMA.hpp' namespace "kali":
 	int computeAux(int ndims, int nwalkers, int nsteps, double sigmaStars, double H, double rhoStars, double *Chain, double *auxillaryChain);
 
-cdef extern from 'MBHBCARMATask.hpp' namespace "kali":
+cdef extern from 'Execution.hpp' namespace "kali":
+	cdef cppclass ExecutionContext:
+		pass
+	void attach_ExecutionContext(ExecutionContext *context)
+
+attach_ExecutionContext(<ExecutionContext*>PyCapsule_GetPointer(Execution_cython.context_capsule(), 'kali.ExecutionContext'))
+
+cdef extern from 'MBHBCARMATask.hpp' namespace "kali" nogil:
 	cdef cppclass MBHBCARMATask:
 		MBHBCARMATask(int p, int q, int numThreads, int numBurn) except+
 		int reset_MBHBCARMATask(int pGiven, int qGiven, int numBurn) except+
 		int get_numBurn()
 		void set_numBurn(int numBurn)
+		double get_samplerUtilization()
+		double get_lnEvidence()
+		double get_lnEvidenceErr()
 		int check_Theta(double *Theta, int threadNum)
 		double get_dt(int threadNum)
 		void get_Theta(double *Theta, int threadNum)
@@ -95,22 +107,36 @@ cdef extern from 'MBHBCARMATask.hpp' namespace "kali":
 
 		#void compute_ACVF(int numLags, double *Lags, double *ACVF, int threadNum)
 
-		int fit_MBHBCARMAModel(double dt, int numCadences, double meandt, double tolIR, double maxSigma, double minTimescale, double maxTimescale, double lowestFlux, double highestFlux, double startT, double *t, double *x, double *y, double *yerr, double *mask, int nwalkers, int nsteps, int maxEvals, double xTol, double mcmcA, unsigned int zSSeed, unsigned int walkerSeed, unsigned int moveSeed, unsigned int xSeed, double* xStart, double *Chain, double *LnPrior, double *LnLikelihood, double periodCenter, double periodWidth, double fluxCenter, double fluxWidth);
+		int fit_MBHBCARMAModel(double dt, int numCadences, double meandt, double tolIR, double maxSigma, double minTimescale, double maxTimescale, double lowestFlux, double highestFlux, double startT, double *t, double *x, double *y, double *yerr, double *mask, int nwalkers, int nsteps, int maxEvals, double xTol, double mcmcA, unsigned int zSSeed, unsigned int walkerSeed, unsigned int moveSeed, unsigned int xSeed, double* xStart, double *Chain, double *LnPrior, double *LnLikelihood, double periodCenter, double periodWidth, double fluxCenter, double fluxWidth, int samplerType, int numTemps, double maxTemp);
 
 		int smooth_RTS(int numCadences, int cadenceNum, double tolIR, double startT, double *t, double *x, double *y, double *yerr, double *mask, double *lcX, double *lcP, double *XSmooth, double *PSmooth, double *xSmooth, double *xerrSmooth, int threadNum)
 
 @cython.boundscheck(False)
 @cython.wraparound(False)
-def get_Sigma(rNum, pNum, qNum, np.ndarray[double, ndim=1, mode='c'] Theta not None, np.ndarray[double, ndim=1, mode='c'] Sigma not None):
+def get_Sigma(rNum, pNum, qNum, double[::1] Theta not None, double[::1] Sigma not None):
 	getSigma(rNum, pNum, qNum, &Theta[0], &Sigma[0])
 
 @cython.boundscheck(False)
 @cython.wraparound(False)
-def compute_Aux(ndims, nwalkers, nsteps, sigmaStars, H, rhoStars, np.ndarray[double, ndim=1, mode='c'] Chain not None, np.ndarray[double, ndim=1, mode='c'] auxillaryChain not None):
+def compute_Aux(ndims, nwalkers, nsteps, sigmaStars, H, rhoStars, double[::1] Chain not None, double[::1] auxillaryChain not None):
 	computeAux(ndims, nwalkers, nsteps, sigmaStars, H, rhoStars, &Chain[0], &auxillaryChain[0])
 	return 0
 
 cdef class MBHBCARMATask_cython:
+	"""Wrapper around kali::MBHBCARMATask.
+
+	The long-running methods (make_*, add_/extend_ObservationNoise, compute_/update_Ln*, compute_ACVF, fit_*, nest_*,
+	laplace_* and smooth_*) release the GIL while the C++ code runs, so Python threads can drive several task objects
+	at once, e.g. one task per worker of a concurrent.futures.ThreadPoolExecutor.
+
+	Thread safety: distinct task objects may be used concurrently from any number of threads; the threads they use
+	are drawn from the shared budget in kali.execution. A single task object is not thread safe: its systems, the
+	state set by set_System and the statistics of the last fit are shared by all of its methods, so calls on the same
+	object must be serialized by the caller. The exception is the per-system methods taking threadNum, which may run
+	concurrently on one object as long as every caller uses its own threadNum and no fit_*, nest_* or laplace_* call
+	is in progress. numpy arrays passed in must not be resized or freed by other threads during a call.
+	"""
+
 	cdef MBHBCARMATask *thisptr
 
 	def __cinit__(self, p, q, numThreads = None, numBurn = None):
@@ -128,9 +154,18 @@ cdef class MBHBCARMATask_cython:
 			numBurn = 1000000
 		self.thisptr.reset_MBHBCARMATask(p, q, numBurn)
 
+	def get_samplerUtilization(self):
+		return self.thisptr.get_samplerUtilization()
+
+	def get_lnEvidence(self):
+		return self.thisptr.get_lnEvidence()
+
+	def get_lnEvidenceErr(self):
+		return self.thisptr.get_lnEvidenceErr()
+
 	@cython.boundscheck(False)
 	@cython.wraparound(False)
-	def check_Theta(self, np.ndarray[double, ndim=1, mode='c'] Theta not None, threadNum = None):
+	def check_Theta(self, double[::1] Theta not None, threadNum = None):
 		if threadNum == None:
 			threadNum = 0
 		return self.thisptr.check_Theta(&Theta[0], threadNum)
@@ -142,14 +177,14 @@ cdef class MBHBCARMATask_cython:
 
 	@cython.boundscheck(False)
 	@cython.wraparound(False)
-	def get_Theta(self, np.ndarray[double, ndim=1, mode='c'] Theta not None, threadNum = None):
+	def get_Theta(self, double[::1] Theta not None, threadNum = None):
 		if threadNum == None:
 			threadNum = 0
 		self.thisptr.get_Theta(&Theta[0], threadNum)
 
 	@cython.boundscheck(False)
 	@cython.wraparound(False)
-	def set_System(self, dt, np.ndarray[double, ndim=1, mode='c'] Theta not None, threadNum = None):
+	def set_System(self, dt, double[::1] Theta not None, threadNum = None):
 		if threadNum == None:
 			threadNum = 0
 		return self.thisptr.set_System(dt, &Theta[0], threadNum)
@@ -161,7 +196,7 @@ cdef class MBHBCARMATask_cython:
 
 	@cython.boundscheck(False)
 	@cython.wraparound(False)
-	def get_setSystemsVec(self, np.ndarray[int, ndim=1, mode='c'] setSystems not None):
+	def get_setSystemsVec(self, int[::1] setSystems not None):
 		self.thisptr.get_setSystemsVec(&setSystems[0])
 
 	def print_System(self, threadNum = None):
@@ -171,49 +206,49 @@ cdef class MBHBCARMATask_cython:
 
 	'''@cython.boundscheck(False)
 	@cython.wraparound(False)
-	def get_A(self, dt, np.ndarray[double, ndim=1, mode='c'] Theta not None, np.ndarray[np.complex128, ndim=1, mode='c'] A not None, threadNum = None):
+	def get_A(self, dt, double[::1] Theta not None, np.ndarray[np.complex128, ndim=1, mode='c'] A not None, threadNum = None):
 		if threadNum == None:
 			threadNum = 0
 		return self.thisptr.get_A(dt, &Theta[0], &A[0], threadNum)
 
 	@cython.boundscheck(False)
 	@cython.wraparound(False)
-	def get_B(self, dt, np.ndarray[double, ndim=1, mode='c'] Theta not None, np.ndarray[np.complex128, ndim=1, mode='c'] B not None, threadNum = None):
+	def get_B(self, dt, double[::1] Theta not None, np.ndarray[np.complex128, ndim=1, mode='c'] B not None, threadNum = None):
 		if threadNum == None:
 			threadNum = 0
 		return self.thisptr.get_B(dt, &Theta[0], &B[0], threadNum)'''
 
 	@cython.boundscheck(False)
 	@cython.wraparound(False)
-	def get_Sigma(self, np.ndarray[double, ndim=1, mode='c'] Sigma not None, threadNum = None):
+	def get_Sigma(self, double[::1] Sigma not None, threadNum = None):
 		if threadNum == None:
 			threadNum = 0
 		return self.thisptr.get_Sigma(&Sigma[0], threadNum)
 
 	@cython.boundscheck(False)
 	@cython.wraparound(False)
-	def get_X(self, np.ndarray[double, ndim=1, mode='c'] newX not None, threadNum = None):
+	def get_X(self, double[::1] newX not None, threadNum = None):
 		if threadNum == None:
 			threadNum = 0
 		return self.thisptr.get_X(&newX[0], threadNum)
 
 	@cython.boundscheck(False)
 	@cython.wraparound(False)
-	def set_X(self, np.ndarray[double, ndim=1, mode='c'] newX not None, threadNum = None):
+	def set_X(self, double[::1] newX not None, threadNum = None):
 		if threadNum == None:
 			threadNum = 0
 		return self.thisptr.set_X(&newX[0], threadNum)
 
 	@cython.boundscheck(False)
 	@cython.wraparound(False)
-	def get_P(self, np.ndarray[double, ndim=1, mode='c'] newP not None, threadNum = None):
+	def get_P(self, double[::1] newP not None, threadNum = None):
 		if threadNum == None:
 			threadNum = 0
 		return self.thisptr.get_P(&newP[0], threadNum)
 
 	@cython.boundscheck(False)
 	@cython.wraparound(False)
-	def set_P(self, np.ndarray[double, ndim=1, mode='c'] newP not None, threadNum = None):
+	def set_P(self, double[::1] newP not None, threadNum = None):
 		if threadNum == None:
 			threadNum = 0
 		return self.thisptr.set_P(&newP[0], threadNum)
@@ -425,22 +460,24 @@ cdef class MBHBCARMATask_cython:
 
 	@cython.boundscheck(False)
 	@cython.wraparound(False)
-	def make_BeamedLC(self, numCadences, tolIR, startT, fracIntrinsicVar, fracNoiseToSignal, np.ndarray[double, ndim=1, mode='c'] t not None, np.ndarray[double, ndim=1, mode='c'] x not None, np.ndarray[double, ndim=1, mode='c'] y not None, np.ndarray[double, ndim=1, mode='c'] yerr not None, np.ndarray[double, ndim=1, mode='c'] mask not None, np.ndarray[double, ndim=1, mode='c'] lcX not None, np.ndarray[double, ndim=1, mode='c'] lcP not None, threadNum = None):
-		if threadNum == None:
-			threadNum = 0
-		return self.thisptr.make_BeamedLC(numCadences, tolIR, startT, fracIntrinsicVar, fracNoiseToSignal, &t[0], &x[0], &y[0], &yerr[0], &mask[0], &lcX[0], &lcP[0], threadNum)
+	def make_BeamedLC(self, int numCadences, double tolIR, double startT, double fracIntrinsicVar, double fracNoiseToSignal, double[::1] t not None, double[::1] x not None, double[::1] y not None, double[::1] yerr not None, double[::1] mask not None, double[::1] lcX not None, double[::1] lcP not None, int threadNum = 0):
+		cdef int result
+		with nogil:
+			result = self.thisptr.make_BeamedLC(numCadences, tolIR, startT, fracIntrinsicVar, fracNoiseToSignal, &t[0], &x[0], &y[0], &yerr[0], &mask[0], &lcX[0], &lcP[0], threadNum)
+		return result
 
 	@cython.boundscheck(False)
 	@cython.wraparound(False)
-	def make_IntrinsicLC(self, numCadences, tolIR, startT, fracIntrinsicVar, fracNoiseToSignal, np.ndarray[double, ndim=1, mode='c'] t not None, np.ndarray[double, ndim=1, mode='c'] x not None, np.ndarray[double, ndim=1, mode='c'] y not None, np.ndarray[double, ndim=1, mode='c'] yerr not None, np.ndarray[double, ndim=1, mode='c'] mask not None, np.ndarray[double, ndim=1, mode='c'] lcX not None, np.ndarray[double, ndim=1, mode='c'] lcP not None, burnSeed, distSeed, threadNum = None):
-		if threadNum == None:
-			threadNum = 0
-		return self.thisptr.make_IntrinsicLC(numCadences, tolIR, startT, fracIntrinsicVar, fracNoiseToSignal, &t[0], &x[0], &y[0], &yerr[0], &mask[0], &lcX[0], &lcP[0], burnSeed, distSeed, threadNum)
+	def make_IntrinsicLC(self, int numCadences, double tolIR, double startT, double fracIntrinsicVar, double fracNoiseToSignal, double[::1] t not None, double[::1] x not None, double[::1] y not None, double[::1] yerr not None, double[::1] mask not None, double[::1] lcX not None, double[::1] lcP not None, unsigned int burnSeed, unsigned int distSeed, int threadNum = 0):
+		cdef int result
+		with nogil:
+			result = self.thisptr.make_IntrinsicLC(numCadences, tolIR, startT, fracIntrinsicVar, fracNoiseToSignal, &t[0], &x[0], &y[0], &yerr[0], &mask[0], &lcX[0], &lcP[0], burnSeed, distSeed, threadNum)
+		return result
 
 	'''
 	@cython.boundscheck(False)
 	@cython.wraparound(False)
-	def extend_IntrinsicLC(self, numCadences, cadenceNum, tolIR, fracIntrinsicVar, fracNoiseToSignal, np.ndarray[double, ndim=1, mode='c'] t not None, np.ndarray[double, ndim=1, mode='c'] x not None, np.ndarray[double, ndim=1, mode='c'] y not None, np.ndarray[double, ndim=1, mode='c'] yerr not None, np.ndarray[double, ndim=1, mode='c'] mask not None, np.ndarray[double, ndim=1, mode='c'] lcX not None, np.ndarray[double, ndim=1, mode='c'] lcP not None, distSeed, noiseSeed, threadNum = None):
+	def extend_IntrinsicLC(self, numCadences, cadenceNum, tolIR, fracIntrinsicVar, fracNoiseToSignal, double[::1] t not None, double[::1] x not None, double[::1] y not None, double[::1] yerr not None, double[::1] mask not None, double[::1] lcX not None, double[::1] lcP not None, distSeed, noiseSeed, threadNum = None):
 		if threadNum == None:
 			threadNum = 0
 		return self.thisptr.extend_IntrinsicLC(numCadences, cadenceNum, tolIR, fracIntrinsicVar, fracNoiseToSignal, &t[0], &x[0], &y[0], &yerr[0], &mask[0], &lcX[0], &lcP[0], distSeed, threadNum)
@@ -456,23 +493,25 @@ cdef class MBHBCARMATask_cython:
 	'''
 	@cython.boundscheck(False)
 	@cython.wraparound(False)
-	def make_ObservedLC(self, numCadences, tolIR, fracIntrinsicVar, fracNoiseToSignal, np.ndarray[double, ndim=1, mode='c'] t not None, np.ndarray[double, ndim=1, mode='c'] x not None, np.ndarray[double, ndim=1, mode='c'] y not None, np.ndarray[double, ndim=1, mode='c'] yerr not None, np.ndarray[double, ndim=1, mode='c'] mask not None, burnSeed, distSeed, noiseSeed, threadNum = None):
-		if threadNum == None:
-			threadNum = 0
-		return self.thisptr.make_ObservedLC(numCadences, tolIR, fracIntrinsicVar, fracNoiseToSignal, &t[0], &x[0], &y[0], &yerr[0], &mask[0], burnSeed, distSeed, noiseSeed, threadNum)
+	def make_ObservedLC(self, int numCadences, double tolIR, double fracIntrinsicVar, double fracNoiseToSignal, double[::1] t not None, double[::1] x not None, double[::1] y not None, double[::1] yerr not None, double[::1] mask not None, unsigned int burnSeed, unsigned int distSeed, unsigned int noiseSeed, int threadNum = 0):
+		cdef int result
+		with nogil:
+			result = self.thisptr.make_ObservedLC(numCadences, tolIR, fracIntrinsicVar, fracNoiseToSignal, &t[0], &x[0], &y[0], &yerr[0], &mask[0], burnSeed, distSeed, noiseSeed, threadNum)
+		return result
 	'''
 
 	@cython.boundscheck(False)
 	@cython.wraparound(False)
-	def add_ObservationNoise(self, numCadences, tolIR, fracIntrinsicVar, fracNoiseToSignal, np.ndarray[double, ndim=1, mode='c'] t not None, np.ndarray[double, ndim=1, mode='c'] x not None, np.ndarray[double, ndim=1, mode='c'] y not None, np.ndarray[double, ndim=1, mode='c'] yerr not None, np.ndarray[double, ndim=1, mode='c'] mask not None, noiseSeed, threadNum = None):
-		if threadNum == None:
-			threadNum = 0
-		return self.thisptr.add_ObservationNoise(numCadences, tolIR, fracIntrinsicVar, fracNoiseToSignal, &t[0], &x[0], &y[0], &yerr[0], &mask[0], noiseSeed, threadNum)
+	def add_ObservationNoise(self, int numCadences, double tolIR, double fracIntrinsicVar, double fracNoiseToSignal, double[::1] t not None, double[::1] x not None, double[::1] y not None, double[::1] yerr not None, double[::1] mask not None, unsigned int noiseSeed, int threadNum = 0):
+		cdef int result
+		with nogil:
+			result = self.thisptr.add_ObservationNoise(numCadences, tolIR, fracIntrinsicVar, fracNoiseToSignal, &t[0], &x[0], &y[0], &yerr[0], &mask[0], noiseSeed, threadNum)
+		return result
 
 	'''
 	@cython.boundscheck(False)
 	@cython.wraparound(False)
-	def extend_ObservationNoise(self, numCadences, cadenceNum, tolIR, fracIntrinsicVar, fracNoiseToSignal, np.ndarray[double, ndim=1, mode='c'] t not None, np.ndarray[double, ndim=1, mode='c'] x not None, np.ndarray[double, ndim=1, mode='c'] y not None, np.ndarray[double, ndim=1, mode='c'] yerr not None, np.ndarray[double, ndim=1, mode='c'] mask not None, noiseSeed, threadNum = None):
+	def extend_ObservationNoise(self, numCadences, cadenceNum, tolIR, fracIntrinsicVar, fracNoiseToSignal, double[::1] t not None, double[::1] x not None, double[::1] y not None, double[::1] yerr not None, double[::1] mask not None, noiseSeed, threadNum = None):
 		if threadNum == None:
 			threadNum = 0
 		return self.thisptr.extend_ObservationNoise(numCadences, cadenceNum, tolIR, fracIntrinsicVar, fracNoiseToSignal, &t[0], &x[0], &y[0], &yerr[0], &mask[0], noiseSeed, threadNum)
@@ -480,15 +519,16 @@ cdef class MBHBCARMATask_cython:
 
 	@cython.boundscheck(False)
 	@cython.wraparound(False)
-	def compute_LnPrior(self, numCadences, meandt, tolIR, startT, maxSigma, minTimescale, maxTimescale, lowestFlux, highestflux, np.ndarray[double, ndim=1, mode='c'] t not None, np.ndarray[double, ndim=1, mode='c'] x not None, np.ndarray[double, ndim=1, mode='c'] y not None, np.ndarray[double, ndim=1, mode='c'] yerr not None, np.ndarray[double, ndim=1, mode='c'] mask not None, periodCenter, periodWidth, fluxCenter, fluxWidth, threadNum = None):
-		if threadNum == None:
-			threadNum = 0
-		return self.thisptr.compute_LnPrior(numCadences, meandt, tolIR, startT, maxSigma, minTimescale, maxTimescale, lowestFlux, highestflux, &t[0], &x[0], &y[0], &yerr[0], &mask[0], periodCenter, periodWidth, fluxCenter, fluxWidth, threadNum)
+	def compute_LnPrior(self, int numCadences, double meandt, double tolIR, double startT, double maxSigma, double minTimescale, double maxTimescale, double lowestFlux, double highestflux, double[::1] t not None, double[::1] x not None, double[::1] y not None, double[::1] yerr not None, double[::1] mask not None, double periodCenter, double periodWidth, double fluxCenter, double fluxWidth, int threadNum = 0):
+		cdef double result
+		with nogil:
+			result = self.thisptr.compute_LnPrior(numCadences, meandt, tolIR, startT, maxSigma, minTimescale, maxTimescale, lowestFlux, highestflux, &t[0], &x[0], &y[0], &yerr[0], &mask[0], periodCenter, periodWidth, fluxCenter, fluxWidth, threadNum)
+		return result
 
 	'''
 	@cython.boundscheck(False)
 	@cython.wraparound(False)
-	def update_LnPrior(self, numCadences, cadenceNum, tolIR, maxSigma, minTimescale, maxTimescale, np.ndarray[double, ndim=1, mode='c'] t not None, np.ndarray[double, ndim=1, mode='c'] x not None, np.ndarray[double, ndim=1, mode='c'] y not None, np.ndarray[double, ndim=1, mode='c'] yerr not None, np.ndarray[double, ndim=1, mode='c'] mask not None, threadNum = None):
+	def update_LnPrior(self, numCadences, cadenceNum, tolIR, maxSigma, minTimescale, maxTimescale, double[::1] t not None, double[::1] x not None, double[::1] y not None, double[::1] yerr not None, double[::1] mask not None, threadNum = None):
 		if threadNum == None:
 			threadNum = 0
 		return self.thisptr.update_LnPrior(numCadences, cadenceNum, tolIR, maxSigma, minTimescale, maxTimescale, &t[0], &x[0], &y[0], &yerr[0], &mask[0], threadNum)
@@ -496,36 +536,37 @@ cdef class MBHBCARMATask_cython:
 
 	@cython.boundscheck(False)
 	@cython.wraparound(False)
-	def compute_LnLikelihood(self, numCadences, cadenceNum, tolIR, startT, np.ndarray[double, ndim=1, mode='c'] t not None, np.ndarray[double, ndim=1, mode='c'] x not None, np.ndarray[double, ndim=1, mode='c'] y not None, np.ndarray[double, ndim=1, mode='c'] yerr not None, np.ndarray[double, ndim=1, mode='c'] mask not None, np.ndarray[double, ndim=1, mode='c'] X not None, np.ndarray[double, ndim=1, mode='c'] P not None, periodCenter, periodWidth, fluxCenter, fluxWidth, threadNum = None):
-		if threadNum == None:
-			threadNum = 0
-		return self.thisptr.compute_LnLikelihood(numCadences, cadenceNum, tolIR, startT, &t[0], &x[0], &y[0], &yerr[0], &mask[0], &X[0], &P[0], periodCenter, periodWidth, fluxCenter, fluxWidth, threadNum)
+	def compute_LnLikelihood(self, int numCadences, int cadenceNum, double tolIR, double startT, double[::1] t not None, double[::1] x not None, double[::1] y not None, double[::1] yerr not None, double[::1] mask not None, double[::1] X not None, double[::1] P not None, double periodCenter, double periodWidth, double fluxCenter, double fluxWidth, int threadNum = 0):
+		cdef double result
+		with nogil:
+			result = self.thisptr.compute_LnLikelihood(numCadences, cadenceNum, tolIR, startT, &t[0], &x[0], &y[0], &yerr[0], &mask[0], &X[0], &P[0], periodCenter, periodWidth, fluxCenter, fluxWidth, threadNum)
+		return result
 
 	'''
 	@cython.boundscheck(False)
 	@cython.wraparound(False)
-	def update_LnLikelihood(self, numCadences, cadenceNum, currentLnLikelihood, tolIR, np.ndarray[double, ndim=1, mode='c'] t not None, np.ndarray[double, ndim=1, mode='c'] x not None, np.ndarray[double, ndim=1, mode='c'] y not None, np.ndarray[double, ndim=1, mode='c'] yerr not None, np.ndarray[double, ndim=1, mode='c'] mask not None, np.ndarray[double, ndim=1, mode='c'] X not None, np.ndarray[double, ndim=1, mode='c'] P not None, threadNum = None):
+	def update_LnLikelihood(self, numCadences, cadenceNum, currentLnLikelihood, tolIR, double[::1] t not None, double[::1] x not None, double[::1] y not None, double[::1] yerr not None, double[::1] mask not None, double[::1] X not None, double[::1] P not None, threadNum = None):
 		if threadNum == None:
 			threadNum = 0
 		return self.thisptr.update_LnLikelihood(numCadences, cadenceNum, currentLnLikelihood, tolIR, &t[0], &x[0], &y[0], &yerr[0], &mask[0], &X[0], &P[0], threadNum)
 
 	@cython.boundscheck(False)
 	@cython.wraparound(False)
-	def compute_LnPosterior(self, numCadences, cadenceNum, tolIR, maxSigma, minTimescale, maxTimescale, np.ndarray[double, ndim=1, mode='c'] t not None, np.ndarray[double, ndim=1, mode='c'] x not None, np.ndarray[double, ndim=1, mode='c'] y not None, np.ndarray[double, ndim=1, mode='c'] yerr not None, np.ndarray[double, ndim=1, mode='c'] mask not None, np.ndarray[double, ndim=1, mode='c'] X not None, np.ndarray[double, ndim=1, mode='c'] P not None, threadNum = None):
+	def compute_LnPosterior(self, numCadences, cadenceNum, tolIR, maxSigma, minTimescale, maxTimescale, double[::1] t not None, double[::1] x not None, double[::1] y not None, double[::1] yerr not None, double[::1] mask not None, double[::1] X not None, double[::1] P not None, threadNum = None):
 		if threadNum == None:
 			threadNum = 0
 		return self.thisptr.compute_LnPosterior(numCadences, cadenceNum, tolIR, maxSigma, minTimescale, maxTimescale, &t[0], &x[0], &y[0], &yerr[0], &mask[0], &X[0], &P[0], threadNum)
 
 	@cython.boundscheck(False)
 	@cython.wraparound(False)
-	def update_LnPosterior(self, numCadences, cadenceNum, currentLnLikelihood, tolIR, maxSigma, minTimescale, maxTimescale, np.ndarray[double, ndim=1, mode='c'] t not None, np.ndarray[double, ndim=1, mode='c'] x not None, np.ndarray[double, ndim=1, mode='c'] y not None, np.ndarray[double, ndim=1, mode='c'] yerr not None, np.ndarray[double, ndim=1, mode='c'] mask not None, np.ndarray[double, ndim=1, mode='c'] X not None, np.ndarray[double, ndim=1, mode='c'] P not None, threadNum = None):
+	def update_LnPosterior(self, numCadences, cadenceNum, currentLnLikelihood, tolIR, maxSigma, minTimescale, maxTimescale, double[::1] t not None, double[::1] x not None, double[::1] y not None, double[::1] yerr not None, double[::1] mask not None, double[::1] X not None, double[::1] P not None, threadNum = None):
 		if threadNum == None:
 			threadNum = 0
 		return self.thisptr.update_LnPosterior(numCadences, cadenceNum, currentLnLikelihood, tolIR, maxSigma, minTimescale, maxTimescale, &t[0], &x[0], &y[0], &yerr[0], &mask[0], &X[0], &P[0], threadNum)
 
 	@cython.boundscheck(False)
 	@cython.wraparound(False)
-	def compute_ACVF(self, numLags, np.ndarray[double, ndim=1, mode='c'] Lags not None, np.ndarray[double, ndim=1, mode='c'] ACVF not None, threadNum = None):
+	def compute_ACVF(self, numLags, double[::1] Lags not None, double[::1] ACVF not None, threadNum = None):
 		if threadNum == None:
 			threadNum = 0
 		self.thisptr.compute_ACVF(numLags, &Lags[0], &ACVF[0], threadNum)
@@ -533,12 +574,16 @@ cdef class MBHBCARMATask_cython:
 
 	@cython.boundscheck(False)
 	@cython.wraparound(False)
-	def fit_CARMAModel(self, dt, numCadences, meandt, tolIR, maxSigma, minTimescale, maxTimescale, lowestFlux, highestFlux, startT, np.ndarray[double, ndim=1, mode='c'] t not None, np.ndarray[double, ndim=1, mode='c'] x not None, np.ndarray[double, ndim=1, mode='c'] y not None, np.ndarray[double, ndim=1, mode='c'] yerr not None, np.ndarray[double, ndim=1, mode='c'] mask not None, nwalkers, nsteps, maxEvals, xTol, mcmcA, zSSeed, walkerSeed, moveSeed, xSeed, np.ndarray[double, ndim=1, mode='c'] xStart not None, np.ndarray[double, ndim=1, mode='c'] Chain not None, np.ndarray[double, ndim=1, mode='c'] LnPrior not None, np.ndarray[double, ndim=1, mode='c'] LnLikelihood not None, periodCenter, periodWidth, fluxCenter, fluxWidth):
-		return self.thisptr.fit_MBHBCARMAModel(dt, numCadences, meandt, tolIR, maxSigma, minTimescale, maxTimescale, lowestFlux, highestFlux, startT, &t[0], &x[0], &y[0], &yerr[0], &mask[0], nwalkers, nsteps, maxEvals, xTol, mcmcA, zSSeed, walkerSeed, moveSeed, xSeed, &xStart[0], &Chain[0], &LnPrior[0], &LnLikelihood[0], periodCenter, periodWidth, fluxCenter, fluxWidth)
+	def fit_CARMAModel(self, double dt, int numCadences, double meandt, double tolIR, double maxSigma, double minTimescale, double maxTimescale, double lowestFlux, double highestFlux, double startT, double[::1] t not None, double[::1] x not None, double[::1] y not None, double[::1] yerr not None, double[::1] mask not None, int nwalkers, int nsteps, int maxEvals, double xTol, double mcmcA, unsigned int zSSeed, unsigned int walkerSeed, unsigned int moveSeed, unsigned int xSeed, double[::1] xStart not None, double[::1] Chain not None, double[::1] LnPrior not None, double[::1] LnLikelihood not None, double periodCenter, double periodWidth, double fluxCenter, double fluxWidth, int samplerType = 0, int numTemps = 1, double maxTemp = 1.0):
+		cdef int result
+		with nogil:
+			result = self.thisptr.fit_MBHBCARMAModel(dt, numCadences, meandt, tolIR, maxSigma, minTimescale, maxTimescale, lowestFlux, highestFlux, startT, &t[0], &x[0], &y[0], &yerr[0], &mask[0], nwalkers, nsteps, maxEvals, xTol, mcmcA, zSSeed, walkerSeed, moveSeed, xSeed, &xStart[0], &Chain[0], &LnPrior[0], &LnLikelihood[0], periodCenter, periodWidth, fluxCenter, fluxWidth, samplerType, numTemps, maxTemp)
+		return result
 
 	@cython.boundscheck(False)
 	@cython.wraparound(False)
-	def smooth_RTS(self, numCadences, cadenceNum, tolIR, startT, np.ndarray[double, ndim=1, mode='c'] t not None, np.ndarray[double, ndim=1, mode='c'] x not None, np.ndarray[double, ndim=1, mode='c'] y not None, np.ndarray[double, ndim=1, mode='c'] yerr not None, np.ndarray[double, ndim=1, mode='c'] mask not None, np.ndarray[double, ndim=1, mode='c'] X not None, np.ndarray[double, ndim=1, mode='c'] P not None, np.ndarray[double, ndim=1, mode='c'] XSmooth not None, np.ndarray[double, ndim=1, mode='c'] PSmooth not None, np.ndarray[double, ndim=1, mode='c'] xSmooth not None, np.ndarray[double, ndim=1, mode='c'] xerrSmooth not None, threadNum = None):
-		if threadNum == None:
-			threadNum = 0
-		return self.thisptr.smooth_RTS(numCadences, cadenceNum, tolIR, startT, &t[0], &x[0], &y[0], &yerr[0], &mask[0], &X[0], &P[0], &XSmooth[0], &PSmooth[0], &xSmooth[0], &xerrSmooth[0], threadNum)
+	def smooth_RTS(self, int numCadences, int cadenceNum, double tolIR, double startT, double[::1] t not None, double[::1] x not None, double[::1] y not None, double[::1] yerr not None, double[::1] mask not None, double[::1] X not None, double[::1] P not None, double[::1] XSmooth not None, double[::1] PSmooth not None, double[::1] xSmooth not None, double[::1] xerrSmooth not None, int threadNum = 0):
+		cdef int result
+		with nogil:
+			result = self.thisptr.smooth_RTS(numCadences, cadenceNum, tolIR, startT, &t[0], &x[0], &y[0], &yerr[0], &mask[0], &X[0], &P[0], &XSmooth[0], &PSmooth[0], &xSmooth[0], &xerrSmooth[0], threadNum)
+		return result
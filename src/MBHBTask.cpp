@@ -19,6 +19,7 @@
 #include "MBHB.hpp"
 #include "MCMC.hpp"
 #include "Constants.hpp"
+#include "Execution.hpp"
 #include "MBHBTask.hpp"
 
 //#define DEBUG_COMPUTELNLIKELIHOOD
@@ -31,6 +32,9 @@ int lenTheta = 8;
 
 kali::MBHBTask::MBHBTask(int numThreadsGiven) {
 	numThreads = numThreadsGiven;
+	samplerUtilization = 0.0;
+	lnEvidence = 0.0;
+	lnEvidenceErr = 0.0;
 	Systems = new kali::MBHB[numThreads];
 	setSystemsVec = static_cast<bool*>(_mm_malloc(numThreads*sizeof(double),64));
 	ThetaVec = static_cast<double*>(_mm_malloc(numThreads*lenTheta*sizeof(double),64)); // We fix alpha1 and alpha2
@@ -55,6 +59,10 @@ kali::MBHBTask::~MBHBTask() {
 	delete[] Systems;
 	}
 
+double kali::MBHBTask::get_samplerUtilization() {return samplerUtilization;}
+double kali::MBHBTask::get_lnEvidence() {return lnEvidence;}
+double kali::MBHBTask::get_lnEvidenceErr() {return lnEvidenceErr;}
+
 int kali::MBHBTask::check_Theta(double *Theta, int threadNum) {
 	return Systems[threadNum].checkMBHBParams(Theta);
 	}
@@ -272,6 +280,7 @@ double kali::MBHBTask::get_ejectedMass(double sigmaStars, double rhoStars, doubl
 	}
 
 int kali::MBHBTask::make_IntrinsicLC(int numCadences, double dt, double fracNoiseToSignal, double *t, double *x, double *y, double *yerr, double *mask, int threadNum) {
+	kali::ThreadLease lease(kali::MBHB_TASK, 1);
 	kali::LnLikeData Data;
 	Data.numCadences = numCadences;
 	Data.dt = dt;
@@ -286,6 +295,7 @@ int kali::MBHBTask::make_IntrinsicLC(int numCadences, double dt, double fracNois
 	}
 
 int kali::MBHBTask::add_ObservationNoise(int numCadences, double dt, double fracNoiseToSignal, double *t, double *x, double *y, double *yerr, double *mask, unsigned int noiseSeed, int threadNum) {
+	kali::ThreadLease lease(kali::MBHB_TASK, 1);
 	kali::LnLikeData Data;
 	Data.numCadences = numCadences;
 	Data.dt = dt;
@@ -331,6 +341,7 @@ double kali::MBHBTask::compute_LnPrior(int numCadences, double dt, double startT
 	}
 
 double kali::MBHBTask::compute_LnLikelihood(int numCadences, double dt, int cadenceNum, double *t, double *x, double *y, double *yerr, double *mask, int threadNum) {
+	kali::ThreadLease lease(kali::MBHB_TASK, 1);
 	double LnLikelihood = 0.0;
 	kali::LnLikeData Data;
 	Data.numCadences = numCadences;
@@ -350,11 +361,12 @@ double kali::MBHBTask::compute_LnLikelihood(int numCadences, double dt, int cade
 	return LnLikelihood;
 	}
 
-int kali::MBHBTask::fit_MBHBModel(int numCadences, double dt, double startT, double lowestFlux, double highestFlux, double *t, double *x, double *y, double *yerr, double *mask, int nwalkers, int nsteps, int maxEvals, double xTol, double mcmcA, unsigned int zSSeed, unsigned int walkerSeed, unsigned int moveSeed, unsigned int xSeed, double* xStart, double *Chain, double *LnPrior, double *LnLikelihood, double periodCenter, double periodWidth, double fluxCenter, double fluxWidth) {
+int kali::MBHBTask::fit_MBHBModel(int numCadences, double dt, double startT, double lowestFlux, double highestFlux, double *t, double *x, double *y, double *yerr, double *mask, int nwalkers, int nsteps, int maxEvals, double xTol, double mcmcA, unsigned int zSSeed, unsigned int walkerSeed, unsigned int moveSeed, unsigned int xSeed, double* xStart, double *Chain, double *LnPrior, double *LnLikelihood, double periodCenter, double periodWidth, double fluxCenter, double fluxWidth, int samplerType, int numTemps, double maxTemp) {
 	#ifdef DEBUG_FIT_MBHBMODEL
 		printf("numThreads: %d\n",numThreads);
 	#endif
-	omp_set_num_threads(numThreads);
+	kali::ThreadLease lease(kali::MBHB_TASK, numThreads);
+	int leasedThreads = lease.get_numThreads();
 	int ndims = lenTheta;
 	int threadNum = omp_get_thread_num();
 	kali::LnLikeData Data;
@@ -374,7 +386,7 @@ int kali::MBHBTask::fit_MBHBModel(int numCadences, double dt, double startT, dou
     Data.fluxWidth = fluxWidth;
 	kali::LnLikeData *ptr2Data = &Data;
 	kali::LnLikeArgs Args;
-	Args.numThreads = numThreads;
+	Args.numThreads = leasedThreads;
 	Args.Data = ptr2Data;
 	Args.Systems = nullptr;
 	void* p2Args = nullptr;
@@ -382,11 +394,11 @@ int kali::MBHBTask::fit_MBHBModel(int numCadences, double dt, double startT, dou
 	p2Args = &Args;
 	double LnLikeVal = 0.0;
 	double *initPos = nullptr, *offsetArr = nullptr;
-	vector<vector<double>> xVec (numThreads, vector<double>(ndims));
+	vector<vector<double>> xVec (leasedThreads, vector<double>(ndims));
 	initPos = static_cast<double*>(_mm_malloc(nwalkers*ndims*sizeof(double),64));
-	int nthreads = numThreads;
-	nlopt::opt *optArray[numThreads];
-	for (int i = 0; i < numThreads; ++i) {
+	int nthreads = leasedThreads;
+	nlopt::opt *optArray[leasedThreads];
+	for (int i = 0; i < leasedThreads; ++i) {
 		//optArray[i] = new nlopt::opt(nlopt::LN_BOBYQA, ndims); // Fastest
 		optArray[i] = new nlopt::opt(nlopt::LN_NELDERMEAD, ndims); // Slower
 		//optArray[i] = new nlopt::opt(nlopt::LN_COBYLA, ndims); // Slowest
@@ -395,7 +407,7 @@ int kali::MBHBTask::fit_MBHBModel(int numCadences, double dt, double startT, dou
 		optArray[i]->set_xtol_rel(xTol);
 		//optArray[i]->set_maxtime(60.0); // Timeout after 60 sec.
 		}
-	double *max_LnPosterior = static_cast<double*>(_mm_malloc(numThreads*sizeof(double),64));
+	double *max_LnPosterior = static_cast<double*>(_mm_malloc(leasedThreads*sizeof(double),64));
 	kali::MBHB *ptrToSystems = Systems;
 	#pragma omp parallel for default(none) shared(nwalkers, ndims, optArray, initPos, xStart, t, ptrToSystems, xVec, max_LnPosterior, p2Args)
 	for (int walkerNum = 0; walkerNum < nwalkers; ++walkerNum) {
@@ -439,18 +451,100 @@ int kali::MBHBTask::fit_MBHBModel(int numCadences, double dt, double startT, dou
 			initPos[walkerNum*ndims + dimNum] = xVec[threadNum][dimNum];
 			}
 		}
-	for (int i = 0; i < numThreads; ++i) {
+	for (int i = 0; i < leasedThreads; ++i) {
 		delete optArray[i];
 		}
 	_mm_free(max_LnPosterior);
-	kali::EnsembleSampler newEnsemble = kali::EnsembleSampler(ndims, nwalkers, nsteps, numThreads, mcmcA, kali::calcLnPosterior, p2Args, zSSeed, walkerSeed, moveSeed);
-	newEnsemble.runMCMC(initPos);
+	kali::runSampler<kali::FunctionPosterior>(samplerType, ndims, nwalkers, nsteps, leasedThreads, mcmcA, numTemps, maxTemp, kali::calcLnPosterior, p2Args, kali::FunctionPosterior(kali::calcLnPosterior, p2Args), nullptr, nullptr, 0, zSSeed, walkerSeed, moveSeed, initPos, Chain, LnPrior, LnLikelihood, samplerUtilization, lnEvidence, lnEvidenceErr, nullptr, nullptr, nullptr);
 	_mm_free(initPos);
-	newEnsemble.getChain(Chain);
-	newEnsemble.getChainVals(LnPrior, LnLikelihood);
 	return 0;
 	}
 
+int kali::MBHBTask::laplace_MBHBModel(int numLCs, int *cadenceOffsets, double *dt, double *startT, double *lowestFlux, double *highestFlux, double *t, double *x, double *y, double *yerr, double *mask, double *periodCenter, double *periodWidth, double *fluxCenter, double *fluxWidth, int numStarts, double *xStart, int maxEvals, double xTol, double *MAP, double *Cov, double *LnPosteriorMAP, double *LnLaplace, int *Status) {
+	/*!
+	Laplace-approximation fit of numLCs packed light curves, parallel over light curves; see CARMATask::laplace_CARMAModel for the layout of the inputs and outputs. The scalar arguments of fit_MBHBModel are given per light curve.
+	*/
+	kali::ThreadLease lease(kali::MBHB_TASK, numThreads);
+	int leasedThreads = lease.get_numThreads();
+	int ndims = lenTheta;
+	int nthreads = leasedThreads;
+	vector<kali::LnLikeData> DataVec(leasedThreads);
+	vector<kali::LnLikeArgs> ArgsVec(leasedThreads);
+	nlopt::opt *optArray[leasedThreads];
+	for (int i = 0; i < leasedThreads; ++i) {
+		ArgsVec[i].numThreads = leasedThreads;
+		ArgsVec[i].Systems = Systems;
+		ArgsVec[i].Data = &DataVec[i];
+		optArray[i] = new nlopt::opt(nlopt::LN_NELDERMEAD, ndims);
+		optArray[i]->set_max_objective(kali::calcLnPosterior, &ArgsVec[i]);
+		optArray[i]->set_maxeval(maxEvals);
+		optArray[i]->set_xtol_rel(xTol);
+		}
+	int numSuccess = 0;
+	double noPosterior = -kali::infiniteVal;
+	#pragma omp parallel for schedule(dynamic) default(none) shared(numLCs, cadenceOffsets, dt, startT, lowestFlux, highestFlux, t, x, y, yerr, mask, periodCenter, periodWidth, fluxCenter, fluxWidth, numStarts, xStart, ndims, DataVec, ArgsVec, optArray, noPosterior, MAP, Cov, LnPosteriorMAP, LnLaplace, Status) reduction(+:numSuccess) num_threads(nthreads)
+	for (int lcNum = 0; lcNum < numLCs; ++lcNum) {
+		int threadNum = omp_get_thread_num();
+		int offset = cadenceOffsets[lcNum];
+		kali::LnLikeData &Data = DataVec[threadNum];
+		Data.numCadences = cadenceOffsets[lcNum + 1] - offset;
+		Data.dt = dt[lcNum];
+		Data.startT = startT[lcNum];
+		Data.t = &t[offset];
+		Data.x = &x[offset];
+		Data.y = &y[offset];
+		Data.yerr = &yerr[offset];
+		Data.mask = &mask[offset];
+		Data.lowestFlux = lowestFlux[lcNum];
+		Data.highestFlux = highestFlux[lcNum];
+		Data.periodCenter = periodCenter[lcNum];
+		Data.periodWidth = periodWidth[lcNum];
+		Data.fluxCenter = fluxCenter[lcNum];
+		Data.fluxWidth = fluxWidth[lcNum];
+		vector<double> xVec(ndims), xBest(ndims);
+		double bestLnPosterior = noPosterior;
+		for (int startNum = 0; startNum < numStarts; ++startNum) {
+			double *start = &xStart[(startNum + lcNum*numStarts)*ndims];
+			if (Systems[threadNum].checkMBHBParams(start) != 1) {
+				continue;
+				}
+			set_System(start, threadNum);
+			xVec.assign(start, start + ndims);
+			double maxLnPosterior = noPosterior;
+			try {
+				optArray[threadNum]->optimize(xVec, maxLnPosterior);
+				} catch (std::exception &e) {
+				/*!
+				nlopt reports roundoff-limited and similar early stops by throwing; xVec and maxLnPosterior still hold the best point found.
+				*/
+				}
+			if (maxLnPosterior > bestLnPosterior) {
+				bestLnPosterior = maxLnPosterior;
+				xBest = xVec;
+				}
+			}
+		for (int dimNum = 0; dimNum < ndims; ++dimNum) {
+			MAP[dimNum + lcNum*ndims] = xBest[dimNum];
+			}
+		if (bestLnPosterior == noPosterior) {
+			for (int i = 0; i < ndims*ndims; ++i) {
+				Cov[i + lcNum*ndims*ndims] = 0.0;
+				}
+			LnPosteriorMAP[lcNum] = noPosterior;
+			LnLaplace[lcNum] = noPosterior;
+			Status[lcNum] = -2;
+			} else {
+			long numEvals = 0;
+			Status[lcNum] = kali::laplaceApproximation(ndims, &MAP[lcNum*ndims], kali::calcLnPosterior, &ArgsVec[threadNum], &Cov[lcNum*ndims*ndims], LnPosteriorMAP[lcNum], LnLaplace[lcNum], numEvals);
+			numSuccess += (Status[lcNum] == 0) ? 1 : 0;
+			}
+		}
+	for (int i = 0; i < leasedThreads; ++i) {
+		delete optArray[i];
+		}
+	return numSuccess;
+	}
+
 int kali::MBHBTask::smooth_Lightcurve(int numCadences, double *t, double *xSmooth, int threadNum) {
     kali::LnLikeData Data;
 	Data.numCadences = numCadences;
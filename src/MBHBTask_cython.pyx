@@ -5,6 +5,8 @@ import numpy as np
 import psutil
 cimport numpy as np
 from libcpp cimport bool
+from cpython.pycapsule cimport PyCapsule_GetPointer
+import Execution_cython
 
 cdef double pi = 3.1415926535897932384626433832795028841971693993751058209749445923078164062862089986280348253421170679
 cdef double Parsec = 3.0857e16
@@ -21,9 +23,19 @@ cdef double r2d(double radianVal):
 cdef extern from 'MBHB.hpp' namespace "kali":
 	int computeAux(int ndims, int nwalkers, int nsteps, double sigmaStars, double H, double rhoStars, double *Chain, double *auxillaryChain);
 
-cdef extern from 'MBHBTask.hpp' namespace "kali":
+cdef extern from 'Execution.hpp' namespace "kali":
+	cdef cppclass ExecutionContext:
+		pass
+	void attach_ExecutionContext(ExecutionContext *context)
+
+attach_ExecutionContext(<ExecutionContext*>PyCapsule_GetPointer(Execution_cython.context_capsule(), 'kali.ExecutionContext'))
+
+cdef extern from 'MBHBTask.hpp' namespace "kali" nogil:
 	cdef cppclass MBHBTask:
 		MBHBTask(int numThreads) except+
+		double get_samplerUtilization()
+		double get_lnEvidence()
+		double get_lnEvidenceErr()
 		int check_Theta(double *Theta, int threadNum);
 		void get_Theta(double *Theta, int threadNum);
 		int set_System(double *Theta, int threadNum);
@@ -76,16 +88,31 @@ cdef extern from 'MBHBTask.hpp' namespace "kali":
 		int add_ObservationNoise(int numCadences, double dt, double fracNoiseToSignal, double *t, double *x, double *y, double *yerr, double *mask, unsigned int noiseSeed, int threadNum);
 		double compute_LnPrior(int numCadences, double dt, double startT, double lowestFlux, double highestFlux, double *t, double *x, double *y, double *yerr, double *mask, double periodCenter, double periodWidth, double fluxCenter, double fluxWidth, int threadNum);
 		double compute_LnLikelihood(int numCadences, double dt, int cadenceNum, double *t, double *x, double *y, double *yerr, double *mask, int threadNum);
-		int fit_MBHBModel(int numCadences, double dt, double startT, double lowestFlux, double highestFlux, double *t, double *x, double *y, double *yerr, double *mask, int nwalkers, int nsteps, int maxEvals, double xTol, double mcmcA, unsigned int zSSeed, unsigned int walkerSeed, unsigned int moveSeed, unsigned int xSeed, double* xStart, double *Chain, double *LnPrior, double *LnLikelihood, double periodCenter, double periodWidth, double fluxCenter, double fluxWidth);
+		int fit_MBHBModel(int numCadences, double dt, double startT, double lowestFlux, double highestFlux, double *t, double *x, double *y, double *yerr, double *mask, int nwalkers, int nsteps, int maxEvals, double xTol, double mcmcA, unsigned int zSSeed, unsigned int walkerSeed, unsigned int moveSeed, unsigned int xSeed, double* xStart, double *Chain, double *LnPrior, double *LnLikelihood, double periodCenter, double periodWidth, double fluxCenter, double fluxWidth, int samplerType, int numTemps, double maxTemp);
+		int laplace_MBHBModel(int numLCs, int *cadenceOffsets, double *dt, double *startT, double *lowestFlux, double *highestFlux, double *t, double *x, double *y, double *yerr, double *mask, double *periodCenter, double *periodWidth, double *fluxCenter, double *fluxWidth, int numStarts, double *xStart, int maxEvals, double xTol, double *MAP, double *Cov, double *LnPosteriorMAP, double *LnLaplace, int *Status);
 		int smooth_Lightcurve(int numCadences, double *t, double *xSmooth, int threadNum);
 
 @cython.boundscheck(False)
 @cython.wraparound(False)
-def compute_Aux(ndims, nwalkers, nsteps, sigmaStars, H, rhoStars, np.ndarray[double, ndim=1, mode='c'] Chain not None, np.ndarray[double, ndim=1, mode='c'] auxillaryChain not None):
+def compute_Aux(ndims, nwalkers, nsteps, sigmaStars, H, rhoStars, double[::1] Chain not None, double[::1] auxillaryChain not None):
 	computeAux(ndims, nwalkers, nsteps, sigmaStars, H, rhoStars, &Chain[0], &auxillaryChain[0])
 	return 0
 
 cdef class MBHBTask_cython:
+	"""Wrapper around kali::MBHBTask.
+
+	The long-running methods (make_*, add_/extend_ObservationNoise, compute_/update_Ln*, compute_ACVF, fit_*, nest_*,
+	laplace_* and smooth_*) release the GIL while the C++ code runs, so Python threads can drive several task objects
+	at once, e.g. one task per worker of a concurrent.futures.ThreadPoolExecutor.
+
+	Thread safety: distinct task objects may be used concurrently from any number of threads; the threads they use
+	are drawn from the shared budget in kali.execution. A single task object is not thread safe: its systems, the
+	state set by set_System and the statistics of the last fit are shared by all of its methods, so calls on the same
+	object must be serialized by the caller. The exception is the per-system methods taking threadNum, which may run
+	concurrently on one object as long as every caller uses its own threadNum and no fit_*, nest_* or laplace_* call
+	is in progress. numpy arrays passed in must not be resized or freed by other threads during a call.
+	"""
+
 	cdef MBHBTask *thisptr
 
 	def __cinit__(self, numThreads = None):
@@ -96,30 +123,39 @@ cdef class MBHBTask_cython:
 	def __dealloc__(self):
 		del self.thisptr
 
+	def get_samplerUtilization(self):
+		return self.thisptr.get_samplerUtilization()
+
+	def get_lnEvidence(self):
+		return self.thisptr.get_lnEvidence()
+
+	def get_lnEvidenceErr(self):
+		return self.thisptr.get_lnEvidenceErr()
+
 	@cython.boundscheck(False)
 	@cython.wraparound(False)
-	def check_Theta(self, np.ndarray[double, ndim=1, mode='c'] Theta not None, threadNum = None):
+	def check_Theta(self, double[::1] Theta not None, threadNum = None):
 		if threadNum == None:
 			threadNum = 0
 		return self.thisptr.check_Theta(&Theta[0], threadNum)
 
 	@cython.boundscheck(False)
 	@cython.wraparound(False)
-	def get_Theta(self, np.ndarray[double, ndim=1, mode='c'] Theta not None, threadNum = None):
+	def get_Theta(self, double[::1] Theta not None, threadNum = None):
 		if threadNum == None:
 			threadNum = 0
 		self.thisptr.get_Theta(&Theta[0], threadNum)
 
 	@cython.boundscheck(False)
 	@cython.wraparound(False)
-	def set_System(self, np.ndarray[double, ndim=1, mode='c'] Theta not None, threadNum = None):
+	def set_System(self, double[::1] Theta not None, threadNum = None):
 		if threadNum == None:
 			threadNum = 0
 		return self.thisptr.set_System(&Theta[0], threadNum)
 
 	@cython.boundscheck(False)
 	@cython.wraparound(False)
-	def get_setSystemsVec(self, np.ndarray[int, ndim=1, mode='c'] setSystems not None):
+	def get_setSystemsVec(self, int[::1] setSystems not None):
 		self.thisptr.get_setSystemsVec(&setSystems[0])
 
 	def print_System(self, threadNum = None):
@@ -334,40 +370,57 @@ cdef class MBHBTask_cython:
 
 	@cython.boundscheck(False)
 	@cython.wraparound(False)
-	def make_IntrinsicLC(self, numCadences, dt, fracNoiseToSignal, np.ndarray[double, ndim=1, mode='c'] t not None, np.ndarray[double, ndim=1, mode='c'] x not None, np.ndarray[double, ndim=1, mode='c'] y not None, np.ndarray[double, ndim=1, mode='c'] yerr not None, np.ndarray[double, ndim=1, mode='c'] mask not None, threadNum = None):
-		if threadNum == None:
-			threadNum = 0
-		return self.thisptr.make_IntrinsicLC(numCadences, dt, fracNoiseToSignal, &t[0], &x[0], &y[0], &yerr[0], &mask[0], threadNum)
+	def make_IntrinsicLC(self, int numCadences, double dt, double fracNoiseToSignal, double[::1] t not None, double[::1] x not None, double[::1] y not None, double[::1] yerr not None, double[::1] mask not None, int threadNum = 0):
+		cdef int result
+		with nogil:
+			result = self.thisptr.make_IntrinsicLC(numCadences, dt, fracNoiseToSignal, &t[0], &x[0], &y[0], &yerr[0], &mask[0], threadNum)
+		return result
 
 	@cython.boundscheck(False)
 	@cython.wraparound(False)
-	def add_ObservationNoise(self, numCadences, dt, fracNoiseToSignal, np.ndarray[double, ndim=1, mode='c'] t not None, np.ndarray[double, ndim=1, mode='c'] x not None, np.ndarray[double, ndim=1, mode='c'] y not None, np.ndarray[double, ndim=1, mode='c'] yerr not None, np.ndarray[double, ndim=1, mode='c'] mask not None, noiseSeed, threadNum = None):
-		if threadNum == None:
-			threadNum = 0
-		return self.thisptr.add_ObservationNoise(numCadences, dt, fracNoiseToSignal, &t[0], &x[0], &y[0], &yerr[0], &mask[0], noiseSeed, threadNum)
+	def add_ObservationNoise(self, int numCadences, double dt, double fracNoiseToSignal, double[::1] t not None, double[::1] x not None, double[::1] y not None, double[::1] yerr not None, double[::1] mask not None, unsigned int noiseSeed, int threadNum = 0):
+		cdef int result
+		with nogil:
+			result = self.thisptr.add_ObservationNoise(numCadences, dt, fracNoiseToSignal, &t[0], &x[0], &y[0], &yerr[0], &mask[0], noiseSeed, threadNum)
+		return result
 
 	@cython.boundscheck(False)
 	@cython.wraparound(False)
-	def compute_LnPrior(self, numCadences, dt, startT, lowestFlux, highestFlux, np.ndarray[double, ndim=1, mode='c'] t not None, np.ndarray[double, ndim=1, mode='c'] x not None, np.ndarray[double, ndim=1, mode='c'] y not None, np.ndarray[double, ndim=1, mode='c'] yerr not None, np.ndarray[double, ndim=1, mode='c'] mask not None, periodCenter, periodWidth, fluxCenter, fluxWidth, threadNum = None):
-		if threadNum == None:
-			threadNum = 0
-		return self.thisptr.compute_LnPrior(numCadences, dt, startT, lowestFlux, highestFlux, &t[0], &x[0], &y[0], &yerr[0], &mask[0], periodCenter, periodWidth, fluxCenter, fluxWidth, threadNum)
+	def compute_LnPrior(self, int numCadences, double dt, double startT, double lowestFlux, double highestFlux, double[::1] t not None, double[::1] x not None, double[::1] y not None, double[::1] yerr not None, double[::1] mask not None, double periodCenter, double periodWidth, double fluxCenter, double fluxWidth, int threadNum = 0):
+		cdef double result
+		with nogil:
+			result = self.thisptr.compute_LnPrior(numCadences, dt, startT, lowestFlux, highestFlux, &t[0], &x[0], &y[0], &yerr[0], &mask[0], periodCenter, periodWidth, fluxCenter, fluxWidth, threadNum)
+		return result
 
 	@cython.boundscheck(False)
 	@cython.wraparound(False)
-	def compute_LnLikelihood(self, numCadences, dt, cadenceNum, np.ndarray[double, ndim=1, mode='c'] t not None, np.ndarray[double, ndim=1, mode='c'] x not None, np.ndarray[double, ndim=1, mode='c'] y not None, np.ndarray[double, ndim=1, mode='c'] yerr not None, np.ndarray[double, ndim=1, mode='c'] mask not None, threadNum = None):
-		if threadNum == None:
-			threadNum = 0
-		return self.thisptr.compute_LnLikelihood(numCadences, dt, cadenceNum, &t[0], &x[0], &y[0], &yerr[0], &mask[0], threadNum)
+	def compute_LnLikelihood(self, int numCadences, double dt, int cadenceNum, double[::1] t not None, double[::1] x not None, double[::1] y not None, double[::1] yerr not None, double[::1] mask not None, int threadNum = 0):
+		cdef double result
+		with nogil:
+			result = self.thisptr.compute_LnLikelihood(numCadences, dt, cadenceNum, &t[0], &x[0], &y[0], &yerr[0], &mask[0], threadNum)
+		return result
 
 	@cython.boundscheck(False)
 	@cython.wraparound(False)
-	def fit_MBHBModel(self, numCadences, dt, startT, lowestFlux, highestFlux, np.ndarray[double, ndim=1, mode='c'] t not None, np.ndarray[double, ndim=1, mode='c'] x not None, np.ndarray[double, ndim=1, mode='c'] y not None, np.ndarray[double, ndim=1, mode='c'] yerr not None, np.ndarray[double, ndim=1, mode='c'] mask not None, nwalkers, nsteps, maxEvals, xTol, mcmcA, zSSeed, walkerSeed, moveSeed, xSeed, np.ndarray[double, ndim=1, mode='c'] xStart not None, np.ndarray[double, ndim=1, mode='c'] Chain not None, np.ndarray[double, ndim=1, mode='c'] LnPrior not None, np.ndarray[double, ndim=1, mode='c'] LnLikelihood not None, periodCenter, periodWidth, fluxCenter, fluxWidth):
-		return self.thisptr.fit_MBHBModel(numCadences, dt, startT, lowestFlux, highestFlux, &t[0], &x[0], &y[0], &yerr[0], &mask[0], nwalkers, nsteps, maxEvals, xTol, mcmcA, zSSeed, walkerSeed, moveSeed, xSeed, &xStart[0], &Chain[0], &LnPrior[0], &LnLikelihood[0], periodCenter, periodWidth, fluxCenter, fluxWidth)
+	def fit_MBHBModel(self, int numCadences, double dt, double startT, double lowestFlux, double highestFlux, double[::1] t not None, double[::1] x not None, double[::1] y not None, double[::1] yerr not None, double[::1] mask not None, int nwalkers, int nsteps, int maxEvals, double xTol, double mcmcA, unsigned int zSSeed, unsigned int walkerSeed, unsigned int moveSeed, unsigned int xSeed, double[::1] xStart not None, double[::1] Chain not None, double[::1] LnPrior not None, double[::1] LnLikelihood not None, double periodCenter, double periodWidth, double fluxCenter, double fluxWidth, int samplerType = 0, int numTemps = 1, double maxTemp = 1.0):
+		cdef int result
+		with nogil:
+			result = self.thisptr.fit_MBHBModel(numCadences, dt, startT, lowestFlux, highestFlux, &t[0], &x[0], &y[0], &yerr[0], &mask[0], nwalkers, nsteps, maxEvals, xTol, mcmcA, zSSeed, walkerSeed, moveSeed, xSeed, &xStart[0], &Chain[0], &LnPrior[0], &LnLikelihood[0], periodCenter, periodWidth, fluxCenter, fluxWidth, samplerType, numTemps, maxTemp)
+		return result
 
 	@cython.boundscheck(False)
 	@cython.wraparound(False)
-	def smooth_Lightcurve(self, numCadences, np.ndarray[double, ndim=1, mode='c'] t not None, np.ndarray[double, ndim=1, mode='c'] xSmooth not None, threadNum = None):
-		if threadNum == None:
-			threadNum = 0
-		return self.thisptr.smooth_Lightcurve(numCadences, &t[0], &xSmooth[0], threadNum)
+	def laplace_MBHBModel(self, int[::1] cadenceOffsets not None, double[::1] dt not None, double[::1] startT not None, double[::1] lowestFlux not None, double[::1] highestFlux not None, double[::1] t not None, double[::1] x not None, double[::1] y not None, double[::1] yerr not None, double[::1] mask not None, double[::1] periodCenter not None, double[::1] periodWidth not None, double[::1] fluxCenter not None, double[::1] fluxWidth not None, int numStarts, double[::1] xStart not None, int maxEvals, double xTol, double[::1] MAP not None, double[::1] Cov not None, double[::1] LnPosteriorMAP not None, double[::1] LnLaplace not None, int[::1] Status not None):
+		cdef int numLCs = cadenceOffsets.shape[0] - 1
+		cdef int result
+		with nogil:
+			result = self.thisptr.laplace_MBHBModel(numLCs, &cadenceOffsets[0], &dt[0], &startT[0], &lowestFlux[0], &highestFlux[0], &t[0], &x[0], &y[0], &yerr[0], &mask[0], &periodCenter[0], &periodWidth[0], &fluxCenter[0], &fluxWidth[0], numStarts, &xStart[0], maxEvals, xTol, &MAP[0], &Cov[0], &LnPosteriorMAP[0], &LnLaplace[0], &Status[0])
+		return result
+
+	@cython.boundscheck(False)
+	@cython.wraparound(False)
+	def smooth_Lightcurve(self, int numCadences, double[::1] t not None, double[::1] xSmooth not None, int threadNum = 0):
+		cdef int result
+		with nogil:
+			result = self.thisptr.smooth_Lightcurve(numCadences, &t[0], &xSmooth[0], threadNum)
+		return result
@@ -12,6 +12,7 @@
 #include <mkl.h>
 #include <mkl_types.h>
 #include <algorithm>
+#include <vector>
 #include <omp.h>
 #include <string>
 #include <fstream>
@@ -38,21 +39,34 @@
 
 using namespace std;
 
-kali::EnsembleSampler::EnsembleSampler(int ndims, int nwalkers, int nsteps, int nthreads, double a, double (*func)(double* x, void* funcArgs, double &LnPriorVal, double &LnLikelihoodVal), void* funcArgs, unsigned int zSeed, unsigned int bernoulliSeed, unsigned int walkerSeed) {
+kali::FunctionPosterior::FunctionPosterior(double (*func)(double* x, void* funcArgs, double &LnPriorVal, double &LnLikelihoodVal), void* funcArgs) {
+	Func = func;
+	FuncArgs = funcArgs;
+	}
+
+kali::FunctionPosterior::Evaluator kali::FunctionPosterior::evaluator(int) {
+	return Evaluator(Func, FuncArgs);
+	}
+
+kali::FunctionPosterior::Evaluator::Evaluator(double (*func)(double* x, void* funcArgs, double &LnPriorVal, double &LnLikelihoodVal), void* funcArgs) {
+	Func = func;
+	FuncArgs = funcArgs;
+	}
+
+double kali::FunctionPosterior::Evaluator::operator()(double *x, double &LnPriorVal, double &LnLikelihoodVal) {
+	return Func(x, FuncArgs, LnPriorVal, LnLikelihoodVal);
+	}
+
+kali::EnsembleSampler::EnsembleSampler(int ndims, int nwalkers, int nsteps, int nthreads, double a, double (*func)(double* x, void* funcArgs, double &LnPriorVal, double &LnLikelihoodVal), void* funcArgs, unsigned int zSeed, unsigned int bernoulliSeed, unsigned int walkerSeed) : kali::BasicEnsembleSampler<kali::FunctionPosterior>(ndims, nwalkers, nsteps, nthreads, a, kali::FunctionPosterior(func, funcArgs), zSeed, bernoulliSeed, walkerSeed) {
 	#ifdef DEBUG_CTORENSEMBLESAMPLER
 	printf("EnsembleSampler - Constructing obj at %p!\n",this);
 	#endif
+	}
 
-	/*!
-	First, we make sure we have an even number of walkers. If not, we (silently!) increase the number of walkers by 1. Later, we will add code to make sure we have atleast twice the number of walkers as we have dimensions.
-	*/
-	/*if (nwalkers%2 == 1) {
-		nwalkers += 1;
-		}*/
-
-	/*if ((nwalkers/2)%nthreads != 0) {
-		nwalkers += 2*(nthreads-((nwalkers/2)%nthreads));
-		}*/
+kali::AsyncEnsembleSampler::AsyncEnsembleSampler(int ndims, int nwalkers, int nsteps, int nthreads, double a, double (*func)(double* x, void* funcArgs, double &LnPriorVal, double &LnLikelihoodVal), void* funcArgs, unsigned int zSeed, unsigned int bernoulliSeed, unsigned int walkerSeed) {
+	#ifdef DEBUG_CTORENSEMBLESAMPLER
+	printf("AsyncEnsembleSampler - Constructing obj at %p!\n",this);
+	#endif
 
 	numDims = ndims;
 	numWalkers = nwalkers;
@@ -66,88 +80,300 @@ kali::EnsembleSampler::EnsembleSampler(int ndims, int nwalkers, int nsteps, int
 	FuncArgs = funcArgs;
 
 	/*!
-	We will store the MCMC result in Chain. Chain is laid out as follows - for each step, we store each dimension of each walker. Chain[dimNum + walkerNum*numDims + stepNum*numDims*numWalkers] contains the value of dimension dimNum of walker walkerNum at step stepNum. We calculate the size of the Chain required, sizeChain = numDims*numWalkers*numSteps, and then allocate space to hold Chain.
+	Chain, LnPrior and LnLike are laid out exactly as in EnsembleSampler, i.e. Chain[dimNum + walkerNum*numDims + stepNum*numDims*numWalkers].
 	*/
 	int sizeChain = numDims*numWalkers*numSteps;
-	int sizeStep = numDims*numWalkers;
-	int sizeHalfStep = numDims*numWalkers/2;
-	int halfNumWalkers = numWalkers/2;
 	int numChoices = numWalkers*numSteps;
 
 	Chain = static_cast<double*>(_mm_malloc(sizeChain*sizeof(double),64));
-
-	/*!
-	We need numZs = numWalkers*numSteps stretch factors, Z, to move numWalkers walkers over numSteps steps. After allocating the space required to hold Z, we use the vdRngBeta function from the Intel MKL VSL to populate Z. To use vdRngBeta, we create a VSL_BRNG_SFMT19937 basic random stream and then run vdRngBeta with p = 0.5, q = 1.0, a = 1/a, Beta = (a^2-1.0)/a.
-	*/
-
-	Zs = static_cast<double*>(_mm_malloc(numChoices*sizeof(double),64));
-	WalkerChoice = static_cast<int*>(_mm_malloc(numChoices*sizeof(int),64));
-	MoveYesNo = static_cast<int*>(_mm_malloc(numChoices*sizeof(int),64));
-    LnPrior = static_cast<double*>(_mm_malloc(numChoices*sizeof(double),64));
-    LnLike = static_cast<double*>(_mm_malloc(numChoices*sizeof(double),64));
+	LnPrior = static_cast<double*>(_mm_malloc(numChoices*sizeof(double),64));
+	LnLike = static_cast<double*>(_mm_malloc(numChoices*sizeof(double),64));
+	ownsOutput = true;
 
 	for (int choiceNum = 0; choiceNum < numChoices; choiceNum++) {
-		Zs[choiceNum] = 0.0;
-		WalkerChoice[choiceNum] = 0;
-		MoveYesNo[choiceNum] = 0;
-        LnPrior[choiceNum] = 0.0;
+		LnPrior[choiceNum] = 0.0;
 		LnLike[choiceNum] = 0.0;
 		}
 
-	VSLStreamStatePtr ZStream, WalkerStream;
+	WallTime = 0.0;
+	BusyTime = static_cast<double*>(_mm_malloc(numThreads*sizeof(double),64));
+	for (int threadNum = 0; threadNum < numThreads; ++threadNum) {
+		BusyTime[threadNum] = 0.0;
+		}
+	}
+
+kali::AsyncEnsembleSampler::~AsyncEnsembleSampler() {
+	#ifdef DEBUG_DTORENSEMBLESAMPLER
+	printf("~AsyncEnsembleSampler - Freeing memory at %p!\n",this);
+	#endif
+
+	if (ownsOutput) {
+		_mm_free(Chain);
+		_mm_free(LnPrior);
+		_mm_free(LnLike);
+		}
+	Chain = nullptr;
+	LnPrior = nullptr;
+	LnLike = nullptr;
+
+	if (BusyTime) {
+		_mm_free(BusyTime);
+		BusyTime = nullptr;
+		}
+	}
+
+void kali::AsyncEnsembleSampler::runMCMC(double* initPos) {
+	/*!
+	The stretch move of walker k in half-ensemble 0 at step s only needs the position of k at step s-1 and the position of the single complementary walker it picked from half-ensemble 1 at step s-1. Likewise walker k in half-ensemble 1 at step s only needs its own position at step s-1 and that of the walker it picked from half-ensemble 0 at step s. Rather than waiting for the whole half-ensemble to finish, every move is issued as an OpenMP task that depends on exactly those two positions. A walker is therefore moved as soon as the complementary walker it needs is available.
+
+	All the randomness is drawn by the single thread that issues the tasks, one half-ensemble at a time and in the order of the moves, from three VSL_BRNG_SFMT19937 streams seeded with ZSeed, WalkerSeed and BernoulliSeed: the stretch factor Z, the complementary walker and the uniform deviate of the acceptance test. Each task receives its Z and deviate by value, so only O(nwalkers) numbers are held at a time. Because the complementary walker for half-ensemble 1 is taken from the already updated half-ensemble 0 and the random numbers do not depend on which thread runs a task, the chain produced is identical to running the two half-ensemble Goodman & Weare update serially, independent of how the tasks are scheduled. The scheme is therefore exactly as valid as the serial stretch move.
+	*/
+	#ifdef DEBUG_RUNMCMC
+	printf("AsyncEnsembleSampler::runMCMC - Starting runMCMC...\n");
+	#endif
+
+	int nsteps = numSteps;
+	int nwalkers = numWalkers;
+	int ndims = numDims;
+	int nthreads = numThreads;
+	int sizeStep = numDims*numWalkers;
+	int halfNumWalkers = numWalkers/2;
+
+	double a = A;
+	double *p2Chain = &Chain[0], *p2LnPrior = &LnPrior[0], *p2LnLike = &LnLike[0];
+	VSLStreamStatePtr ZStream, WalkerStream, UStream;
 	vslNewStream(&ZStream, VSL_BRNG_SFMT19937, ZSeed);
 	vslNewStream(&WalkerStream, VSL_BRNG_SFMT19937, WalkerSeed);
-	vdRngBeta(VSL_RNG_METHOD_BETA_CJA_ACCURATE, ZStream, numChoices, Zs, 0.5, 1.0, 1.0/A, (pow(A,2.0)-1.0)/A);
-	viRngUniform(VSL_RNG_METHOD_UNIFORM_STD, WalkerStream, numChoices, WalkerChoice, 0, halfNumWalkers);
+	vslNewStream(&UStream, VSL_BRNG_SFMT19937, BernoulliSeed);
+	vector<double> stepZs(halfNumWalkers), stepUs(halfNumWalkers);
+	vector<int> stepChoice(halfNumWalkers);
+	double (*p2Func)(double* x, void* FuncArgs, double &LnPriorVal, double &LnLikelihoodVal) = Func;
+	void* p2FuncArgs = FuncArgs;
+	double *p2BusyTime = &BusyTime[0];
+	double startTime = omp_get_wtime();
+
+	#pragma omp parallel for default(none) shared(nwalkers,ndims,p2Chain,p2LnPrior,p2LnLike,p2Func,p2FuncArgs,p2BusyTime,initPos) num_threads(nthreads)
+	for (int walkerNum = 0; walkerNum < nwalkers; walkerNum++) {
+		int threadNum = omp_get_thread_num();
+		for (int dimNum = 0; dimNum < ndims; dimNum++) {
+			p2Chain[dimNum + walkerNum*ndims] = initPos[dimNum + walkerNum*ndims];
+			}
+		double funcStart = omp_get_wtime();
+		p2Func(&p2Chain[walkerNum*ndims], p2FuncArgs, p2LnPrior[walkerNum], p2LnLike[walkerNum]);
+		p2BusyTime[threadNum] += omp_get_wtime() - funcStart;
+		}
+
+	#pragma omp parallel default(none) shared(nsteps,nwalkers,ndims,sizeStep,halfNumWalkers,log2OfE,a,p2Chain,p2LnPrior,p2LnLike,ZStream,WalkerStream,UStream,stepZs,stepUs,stepChoice,p2Func,p2FuncArgs,p2BusyTime) num_threads(nthreads)
+	{
+	#pragma omp single
+	{
+	for (int stepNum = 1; stepNum < nsteps; stepNum++) {
+		for (int subSetNum = 0; subSetNum < 2; subSetNum++) {
+			vdRngUniform(VSL_RNG_METHOD_UNIFORM_STD, ZStream, halfNumWalkers, &stepZs[0], 0.0, 1.0);
+			viRngUniform(VSL_RNG_METHOD_UNIFORM_STD, WalkerStream, halfNumWalkers, &stepChoice[0], 0, halfNumWalkers);
+			vdRngUniform(VSL_RNG_METHOD_UNIFORM_STD, UStream, halfNumWalkers, &stepUs[0], 0.0, 1.0);
+			for (int walkerNum = 0; walkerNum < halfNumWalkers; walkerNum++) {
+
+				/*!
+				The dependency on the first coordinate of a walker position stands in for the whole position since every position is written by exactly one task.
+				*/
+				double Z = pow((a - 1.0)*stepZs[walkerNum] + 1.0, 2.0)/a;
+				double U = stepUs[walkerNum];
+				int currWalkerNum = subSetNum*halfNumWalkers + walkerNum;
+				int compWalkerNum = ((subSetNum+1)%2)*halfNumWalkers + stepChoice[walkerNum];
+				int compStepNum = stepNum - 1 + subSetNum;
+				double *currWalkerOldPos = &p2Chain[(stepNum-1)*sizeStep + currWalkerNum*ndims];
+				double *compWalkerOldPos = &p2Chain[compStepNum*sizeStep + compWalkerNum*ndims];
+				double *currWalkerNewPos = &p2Chain[stepNum*sizeStep + currWalkerNum*ndims];
+
+				#pragma omp task default(none) firstprivate(stepNum,Z,U,currWalkerNum,currWalkerOldPos,compWalkerOldPos,currWalkerNewPos) shared(nwalkers,ndims,log2OfE,p2LnPrior,p2LnLike,p2Func,p2FuncArgs,p2BusyTime) depend(in: currWalkerOldPos[0], compWalkerOldPos[0]) depend(out: currWalkerNewPos[0])
+				{
+				int threadNum = omp_get_thread_num();
+				double newLnPrior = 0.0, newLnLike = 0.0, pAccept = 0.0;
+
+				for (int dimNum = 0; dimNum < ndims; dimNum++) {
+					currWalkerNewPos[dimNum] = compWalkerOldPos[dimNum] + Z*(currWalkerOldPos[dimNum] - compWalkerOldPos[dimNum]);
+					}
+
+				double funcStart = omp_get_wtime();
+				double newLnPost = p2Func(currWalkerNewPos, p2FuncArgs, newLnPrior, newLnLike);
+				p2BusyTime[threadNum] += omp_get_wtime() - funcStart;
+				double oldLnPrior = p2LnPrior[currWalkerNum + (stepNum-1)*nwalkers];
+				double oldLnLike = p2LnLike[currWalkerNum + (stepNum-1)*nwalkers];
+				double oldLnPost = oldLnPrior + oldLnLike;
+
+				if ((oldLnPost != -HUGE_VAL) and (newLnPost != -HUGE_VAL)) {
+					pAccept = exp(min(0.0, (ndims-1)*(log2(Z)/log2OfE) + newLnPost - oldLnPost));
+					} else if ((oldLnPost == -HUGE_VAL) and (newLnPost != -HUGE_VAL)) {
+					pAccept = 1.0;
+					} else {
+					pAccept = 0.0;
+					}
+
+				if (U < pAccept) {
+					p2LnPrior[currWalkerNum + stepNum*nwalkers] = newLnPrior;
+					p2LnLike[currWalkerNum + stepNum*nwalkers] = newLnLike;
+					} else {
+					p2LnPrior[currWalkerNum + stepNum*nwalkers] = oldLnPrior;
+					p2LnLike[currWalkerNum + stepNum*nwalkers] = oldLnLike;
+					for (int dimNum = 0; dimNum < ndims; dimNum++) {
+						currWalkerNewPos[dimNum] = currWalkerOldPos[dimNum];
+						}
+					}
+				}
+				}
+			}
+		}
+	}
+	}
+
 	vslDeleteStream(&ZStream);
 	vslDeleteStream(&WalkerStream);
+	vslDeleteStream(&UStream);
+	WallTime = omp_get_wtime() - startTime;
+	}
 
+void kali::AsyncEnsembleSampler::setOutput(double *ChainPtr, double *LnPriorPtr, double *LnLikePtr) {
 	/*!
-	If the preprocessor macro WRITE_ZS is set in MCMC.cpp, we write the Zs out.
+	Write the chain and its LnPrior and LnLike values straight into caller-owned buffers, see BasicEnsembleSampler::setOutput.
 	*/
-	#ifdef WRITE_ZS
-	string ZSPath = "/home/exarkun/Desktop/Zs.dat";
-	ofstream ZSFile;
-	ZSFile.open(ZSPath);
-	ZSFile.precision(16);
-	for (int i = 0; i < numChoices-1; i++) {
-		ZSFile << noshowpos << scientific << Zs[i] << endl;
-		}
-	ZSFile << noshowpos << scientific << Zs[numChoices-1];
-	ZSFile.close();
+	if (ownsOutput) {
+		_mm_free(Chain);
+		_mm_free(LnPrior);
+		_mm_free(LnLike);
+		ownsOutput = false;
+		}
+	Chain = ChainPtr;
+	LnPrior = LnPriorPtr;
+	LnLike = LnLikePtr;
+	}
+
+void kali::AsyncEnsembleSampler::getChain(double *ChainPtr) {
+	if (ChainPtr == Chain) {
+		return;
+		}
+	int sizeChain = numDims*numWalkers*numSteps;
+	double* Ptr2Chain = &Chain[0];
+	#pragma omp parallel for simd default(none) shared(sizeChain, ChainPtr, Ptr2Chain)
+	for (int i = 0; i < sizeChain; ++i) {
+		ChainPtr[i] = Ptr2Chain[i];
+		}
+	}
+
+void kali::AsyncEnsembleSampler::getChainVals(double *LnPriorPtr, double *LnLikePtr) {
+	if ((LnPriorPtr == LnPrior) and (LnLikePtr == LnLike)) {
+		return;
+		}
+	int sizeChain = numWalkers*numSteps;
+	double* Ptr2LnPrior = &LnPrior[0];
+	double* Ptr2LnLike = &LnLike[0];
+	#pragma omp parallel for simd default(none) shared(sizeChain, LnPriorPtr, LnLikePtr, Ptr2LnPrior, Ptr2LnLike)
+	for (int i = 0; i < sizeChain; ++i) {
+		LnPriorPtr[i] = Ptr2LnPrior[i];
+		LnLikePtr[i] = Ptr2LnLike[i];
+		}
+	}
+
+double kali::AsyncEnsembleSampler::getUtilization() {
+	double totalBusy = 0.0;
+	for (int threadNum = 0; threadNum < numThreads; ++threadNum) {
+		totalBusy += BusyTime[threadNum];
+		}
+	if (WallTime > 0.0) {
+		return totalBusy/(numThreads*WallTime);
+		} else {
+		return 0.0;
+		}
+	}
+
+kali::PTEnsembleSampler::PTEnsembleSampler(int ndims, int nwalkers, int ntemps, int nsteps, int nthreads, double a, double maxTemp, double (*func)(double* x, void* funcArgs, double &LnPriorVal, double &LnLikelihoodVal), void* funcArgs, unsigned int zSeed, unsigned int bernoulliSeed, unsigned int walkerSeed) {
+	#ifdef DEBUG_CTORENSEMBLESAMPLER
+	printf("PTEnsembleSampler - Constructing obj at %p!\n",this);
 	#endif
 
+	numDims = ndims;
+	numWalkers = nwalkers;
+	numTemps = ntemps;
+	numSteps = nsteps;
+	numThreads = nthreads;
+	A = a;
+	MaxTemp = maxTemp;
+	ZSeed = zSeed;
+	WalkerSeed = walkerSeed;
+	BernoulliSeed = bernoulliSeed;
+	Func = func;
+	FuncArgs = funcArgs;
+
 	/*!
-	If the preprocessor macro WRITE_WALKERS is set in MCMC.cpp, we write the WalkerChoices out.
+	The temperature ladder is adapted during the first half of the run (the same half that the fit routines discard as burn-in) and frozen afterwards so that the second half samples from fixed tempered posteriors.
 	*/
-	#ifdef WRITE_WALKERS
-	string WalkersPath = "/home/exarkun/Desktop/Walkers.dat";
-	ofstream WalkersFile;
-	WalkersFile.open(WalkersPath);
-	WalkersFile.precision(16);
-	for (int i = 0; i < numChoices-1; i++) {
-		WalkersFile << noshowpos << scientific << WalkerChoice[i] << endl;
-		}
-	WalkersFile << noshowpos << scientific << WalkerChoice[numChoices-1];
-	WalkersFile.close();
-	#endif
+	numAdaptSteps = numSteps/2;
 
 	/*!
-	We will have to pick 1 walker from the complimentary ensemble to move each walker from the current ensemble. We allocate an array, walkerChoice, to hold the indices of the random walkers picked from the complimentary ensemble. We also initialize a random stream that we shall later use to pick our walkers. We will have to make a decision about whether to move the current walker or not. We allocate moveYesNo to hold the result of the decision. We also initialize a random stream that we shall later use to make our choices.
+	Only the beta = 1 ensemble is stored in Chain, LnPrior and LnLike, using exactly the same layout as EnsembleSampler. The current position of every walker at every temperature is held in Pos[dimNum + walkerNum*numDims + tempNum*numDims*numWalkers] with PosLnPrior and PosLnLike indexed by walkerNum + tempNum*numWalkers. Temperature 0 is the coldest (beta = 1).
 	*/
+	int sizeChain = numDims*numWalkers*numSteps;
+	int numChoices = numWalkers*numSteps;
+	int sizeTempered = numDims*numWalkers*numTemps;
+	int numTempered = numWalkers*numTemps;
+
+	Chain = static_cast<double*>(_mm_malloc(sizeChain*sizeof(double),64));
+	LnPrior = static_cast<double*>(_mm_malloc(numChoices*sizeof(double),64));
+	LnLike = static_cast<double*>(_mm_malloc(numChoices*sizeof(double),64));
+	Pos = static_cast<double*>(_mm_malloc(sizeTempered*sizeof(double),64));
+	PosLnPrior = static_cast<double*>(_mm_malloc(numTempered*sizeof(double),64));
+	PosLnLike = static_cast<double*>(_mm_malloc(numTempered*sizeof(double),64));
 
 	/*!
-	We will store the log likelihoods in an array called LnLike. This way we do not have to re-compute the LnLike multiple times for the same point. LnLike[walkerNum + stepNum*numWalkers] holds the LnLike of walker walkerNum at step stepNum.
+	Betas[tempNum + stepNum*numTemps] and MeanLnLike[tempNum + stepNum*numTemps] record the ladder and the walker averaged log likelihood at each temperature after every step. These are all that is required for thermodynamic integration.
 	*/
+	Betas = static_cast<double*>(_mm_malloc(numTemps*numSteps*sizeof(double),64));
+	MeanLnLike = static_cast<double*>(_mm_malloc(numTemps*numSteps*sizeof(double),64));
+
+	/*!
+	The random numbers needed for a single step are drawn at the start of that step into Zs, Us, WalkerChoice (one per walker per temperature) and SwapUs, SwapOffset (for the exchanges between adjacent temperatures).
+	*/
+	Zs = static_cast<double*>(_mm_malloc(numTempered*sizeof(double),64));
+	Us = static_cast<double*>(_mm_malloc(numTempered*sizeof(double),64));
+	WalkerChoice = static_cast<int*>(_mm_malloc(numTempered*sizeof(int),64));
+	SwapUs = static_cast<double*>(_mm_malloc(numTempered*sizeof(double),64));
+	SwapOffset = static_cast<int*>(_mm_malloc(numTemps*sizeof(int),64));
+	SwapsProposed = static_cast<long*>(_mm_malloc(numTemps*sizeof(long),64));
+	SwapsAccepted = static_cast<long*>(_mm_malloc(numTemps*sizeof(long),64));
+
+	for (int choiceNum = 0; choiceNum < numChoices; choiceNum++) {
+		LnPrior[choiceNum] = 0.0;
+		LnLike[choiceNum] = 0.0;
+		}
+	for (int tempNum = 0; tempNum < numTemps; ++tempNum) {
+		SwapsProposed[tempNum] = 0;
+		SwapsAccepted[tempNum] = 0;
+		}
 
 	/*!
-	We will use numThreads number of pointers to access the old and new positions of the current walker(s) and the old position of the complimentary walker.
+	The initial ladder is geometrically spaced in temperature between 1 and MaxTemp.
 	*/
+	for (int stepNum = 0; stepNum < numSteps; ++stepNum) {
+		for (int tempNum = 0; tempNum < numTemps; ++tempNum) {
+			if (numTemps > 1) {
+				Betas[tempNum + stepNum*numTemps] = pow(MaxTemp, -static_cast<double>(tempNum)/static_cast<double>(numTemps - 1));
+				} else {
+				Betas[tempNum + stepNum*numTemps] = 1.0;
+				}
+			MeanLnLike[tempNum + stepNum*numTemps] = 0.0;
+			}
+		}
+
+	WallTime = 0.0;
+	BusyTime = static_cast<double*>(_mm_malloc(numThreads*sizeof(double),64));
+	for (int threadNum = 0; threadNum < numThreads; ++threadNum) {
+		BusyTime[threadNum] = 0.0;
+		}
 	}
 
-kali::EnsembleSampler::~EnsembleSampler() {
+kali::PTEnsembleSampler::~PTEnsembleSampler() {
 	#ifdef DEBUG_DTORENSEMBLESAMPLER
-	printf("~EnsembleSampler - Freeing memory at %p!\n",this);
+	printf("~PTEnsembleSampler - Freeing memory at %p!\n",this);
 	#endif
 
 	if (Chain) {
@@ -155,345 +381,914 @@ kali::EnsembleSampler::~EnsembleSampler() {
 		Chain = nullptr;
 		}
 
+	if (LnPrior) {
+		_mm_free(LnPrior);
+		LnPrior = nullptr;
+		}
+
+	if (LnLike) {
+		_mm_free(LnLike);
+		LnLike = nullptr;
+		}
+
+	if (Pos) {
+		_mm_free(Pos);
+		Pos = nullptr;
+		}
+
+	if (PosLnPrior) {
+		_mm_free(PosLnPrior);
+		PosLnPrior = nullptr;
+		}
+
+	if (PosLnLike) {
+		_mm_free(PosLnLike);
+		PosLnLike = nullptr;
+		}
+
+	if (Betas) {
+		_mm_free(Betas);
+		Betas = nullptr;
+		}
+
+	if (MeanLnLike) {
+		_mm_free(MeanLnLike);
+		MeanLnLike = nullptr;
+		}
+
 	if (Zs) {
 		_mm_free(Zs);
 		Zs = nullptr;
 		}
 
+	if (Us) {
+		_mm_free(Us);
+		Us = nullptr;
+		}
+
 	if (WalkerChoice) {
 		_mm_free(WalkerChoice);
 		WalkerChoice = nullptr;
 		}
 
-	if (MoveYesNo) {
-		_mm_free(MoveYesNo);
-		MoveYesNo = nullptr;
+	if (SwapUs) {
+		_mm_free(SwapUs);
+		SwapUs = nullptr;
 		}
 
-    if (LnPrior) {
-    	_mm_free(LnPrior);
-    	LnPrior = nullptr;
-    	}
+	if (SwapOffset) {
+		_mm_free(SwapOffset);
+		SwapOffset = nullptr;
+		}
 
-	if (LnLike) {
-		_mm_free(LnLike);
-		LnLike = nullptr;
+	if (SwapsProposed) {
+		_mm_free(SwapsProposed);
+		SwapsProposed = nullptr;
+		}
+
+	if (SwapsAccepted) {
+		_mm_free(SwapsAccepted);
+		SwapsAccepted = nullptr;
+		}
+
+	if (BusyTime) {
+		_mm_free(BusyTime);
+		BusyTime = nullptr;
 		}
 	}
 
-void kali::EnsembleSampler::runMCMC(double* initPos) {
+void kali::PTEnsembleSampler::adaptLadder(int stepNum, double *swapFrac) {
+	/*!
+	Ladder adaptation follows Vousden, Farr & Mandel (2016). With T_i = 1/beta_i and S_i = log(T_i - T_{i-1}), each interior temperature is moved by dS_i = kappa(t)*(A_i - A_{i+1}) where A_i is the fraction of accepted swaps between temperatures i-1 and i at this step. This drives the ladder towards equal swap acceptance between all adjacent pairs. The coldest (T = 1) and hottest (T = MaxTemp) temperatures are held fixed and kappa(t) decays so that the adaptation vanishes over time.
+	*/
+	if (numTemps < 3) {
+		return;
+		}
+	double adaptLag = 1000.0, adaptTime = 100.0;
+	double kappa = (1.0/adaptTime)*(adaptLag/(stepNum + adaptLag));
+	double *currBetas = &Betas[stepNum*numTemps];
+	double prevT = 1.0/currBetas[0], newT = 1.0/currBetas[0];
+	double hottestT = min(MaxTemp, 1.0/currBetas[numTemps - 1]);
+	for (int tempNum = 1; tempNum < numTemps - 1; ++tempNum) {
+		double currT = 1.0/currBetas[tempNum], nextT = 1.0/currBetas[tempNum + 1];
+		double deltaT = (currT - prevT)*exp(kappa*(swapFrac[tempNum] - swapFrac[tempNum + 1]));
+		prevT = currT;
+		/*!
+		Keep the ladder monotone and below MaxTemp: each rung stays between its already updated colder neighbour and the current position of its hotter neighbour.
+		*/
+		newT = max(newT, min(newT + deltaT, min(nextT, hottestT)));
+		currBetas[tempNum] = 1.0/newT;
+		}
+	}
 
+void kali::PTEnsembleSampler::runMCMC(double* initPos) {
 	/*!
-	We begin by computing the LnLike values for our initial walker positions.
+	Each step consists of a full two half-ensemble stretch move at every temperature followed by one round of exchanges between adjacent temperatures. The tempered target at inverse temperature beta is LnPrior + beta*LnLike. The stretch moves of all the temperatures in a given half-ensemble are independent of each other, so they are distributed over the threads as a single (tempNum, walkerNum) loop.
 	*/
 	#ifdef DEBUG_RUNMCMC
-	printf("runMCMC - Starting runMCMC...\n");
-	printf("runMCMC - Setting initial positions of walkers.\n");
+	printf("PTEnsembleSampler::runMCMC - Starting runMCMC...\n");
 	#endif
 
-	int nsteps = numSteps;
 	int nwalkers = numWalkers;
+	int ntemps = numTemps;
 	int ndims = numDims;
 	int nthreads = numThreads;
-
-	#ifdef DEBUG_RUNMCMC
-	printf("runMCMC - nsteps: %d\n",nsteps);
-	printf("runMCMC - nwalkers: %d\n",nwalkers);
-	printf("runMCMC - ndims: %d\n",ndims);
-	printf("runMCMC - nthreads: %d\n",nthreads);
-	#endif
-
-	#ifdef DEBUG_RUNMCMC
-	printf("runMCMC - numSteps: %d\n",numSteps);
-	printf("runMCMC - numWalkers: %d\n",numWalkers);
-	printf("runMCMC - numDims: %d\n",numDims);
-	printf("runMCMC - numThreads: %d\n",numThreads);
-	#endif
-
-	int sizeChain = numDims*numWalkers*numSteps;
 	int sizeStep = numDims*numWalkers;
-	int sizeHalfStep = numDims*numWalkers/2;
 	int halfNumWalkers = numWalkers/2;
-	int numChoices = numWalkers*numSteps;
-
-	#ifdef DEBUG_RUNMCMC
-	printf("runMCMC - sizeChain: %d\n",sizeChain);
-	printf("runMCMC - sizeStep: %d\n",sizeStep);
-	printf("runMCMC - sizeHalfStep: %d\n",sizeHalfStep);
-	printf("runMCMC - halfNumWalkers: %d\n",halfNumWalkers);
-	printf("runMCMC - numChoices: %d\n",numChoices);
-	#endif
-
-	double *p2Chain = &Chain[0], *p2LnPrior = &LnPrior[0], *p2LnLike = &LnLike[0], *p2Zs = &Zs[0];
-	int *p2WalkerChoice = &WalkerChoice[0], *p2MoveYesNo = &MoveYesNo[0];
+	int numTempered = numWalkers*numTemps;
 
+	double *p2Pos = &Pos[0], *p2PosLnPrior = &PosLnPrior[0], *p2PosLnLike = &PosLnLike[0];
+	double *p2Zs = &Zs[0], *p2Us = &Us[0];
+	int *p2WalkerChoice = &WalkerChoice[0];
 	double (*p2Func)(double* x, void* FuncArgs, double &LnPriorVal, double &LnLikelihoodVal) = Func;
 	void* p2FuncArgs = FuncArgs;
+	double *p2BusyTime = &BusyTime[0];
+	double startTime = omp_get_wtime();
 
-	#ifdef DEBUG_RUNMCMC_DEEP
-	int threadNum = omp_get_thread_num();
-	for (int walkerNum = 0; walkerNum < numWalkers; walkerNum++) {
-		printf("runMCMC - Thread: %d; walkerNum: %d\n",threadNum,walkerNum);
-		printf("runMCMC - Thread: %d; initPos: %f\n",threadNum,initPos[walkerNum*numDims]);
-		fflush(0);
-		}
-	#endif
-
-	#pragma omp parallel for default(none) shared(nwalkers,ndims,nthreads,sizeChain,sizeStep,sizeHalfStep,halfNumWalkers,p2Chain,p2LnPrior,p2LnLike,p2Func,p2FuncArgs,initPos)
+	/*!
+	Every temperature starts from the supplied walker positions. The posterior is therefore evaluated once per walker and copied across the ladder.
+	*/
+	#pragma omp parallel for default(none) shared(nwalkers,ndims,p2Pos,p2PosLnPrior,p2PosLnLike,p2Func,p2FuncArgs,p2BusyTime,initPos) num_threads(nthreads)
 	for (int walkerNum = 0; walkerNum < nwalkers; walkerNum++) {
-
-		#ifdef DEBUG_RUNMCMC_OMP
-		printf("numThreads: %d\n",numThreads);
-		printf("omp_num_threads(): %d\n",omp_get_num_threads());
-		printf("omp_get_thread_num(): %d\n",omp_get_thread_num());
-		fflush(0);
-		#endif
-
-		double *currWalkerNewPos = nullptr;
 		int threadNum = omp_get_thread_num();
-
-		#ifdef DEBUG_RUNMCMC
-		printf("runMCMC - Thread: %d; Walker: %d\n", threadNum, walkerNum);
-		#endif
-
 		for (int dimNum = 0; dimNum < ndims; dimNum++) {
-			p2Chain[dimNum + walkerNum*ndims] = initPos[dimNum + walkerNum*ndims];
-
-			#ifdef DEBUG_RUNMCMC_DEEP
-			printf("runMCMC - Thread: %d; Walker: %d; Dim: %d; Val: %f\n", threadNum, walkerNum,dimNum,p2Chain[dimNum + walkerNum*ndims]);
-			#endif
+			p2Pos[dimNum + walkerNum*ndims] = initPos[dimNum + walkerNum*ndims];
 			}
-
-		currWalkerNewPos = &p2Chain[walkerNum*ndims];
-
-		#ifdef DEBUG_RUNMCMC_DEEP
-		printf("runMCMC - Thread: %d; walkerNum: %d\n",threadNum,walkerNum);
-		printf("runMCMC - Thread: %d; currWalkerNewPos: %f\n",threadNum,currWalkerNewPos[0]);
-		fflush(0);
-		#endif
-
-		double LnPostVal = p2Func(currWalkerNewPos, p2FuncArgs, p2LnPrior[walkerNum], p2LnLike[walkerNum]);
-
-		#ifdef DEBUG_RUNMCMC
-        printf("runMCMC - Thread: %d; LnPrior[%d]: %f\n",threadNum,walkerNum,p2LnPrior[walkerNum]);
-		printf("runMCMC - Thread: %d;  LnLike[%d]: %f\n",threadNum,walkerNum,p2LnLike[walkerNum]);
-		printf("\n");
-		#endif
+		double funcStart = omp_get_wtime();
+		p2Func(&p2Pos[walkerNum*ndims], p2FuncArgs, p2PosLnPrior[walkerNum], p2PosLnLike[walkerNum]);
+		p2BusyTime[threadNum] += omp_get_wtime() - funcStart;
 		}
-
-	#ifdef DEBUG_RUNMCMC
-	printf("\n");
-	#endif
-
-	double *currSubSetOld = nullptr, *compSubSetOld = nullptr, *currSubSetNew = nullptr;
-	unsigned int bernoulliSeed = BernoulliSeed;
-
-	#ifdef DEBUG_RUNMCMC
-	printf("runMCMC - Setting Bernoulli Stream...\n");
-	#endif
-
-	VSLStreamStatePtr* BernoulliStream = (VSLStreamStatePtr*)_mm_malloc(nthreads*sizeof(VSLStreamStatePtr),64);
-	//vslNewStream(&BernoulliStream[0],VSL_BRNG_MCG59,BernoulliSeed);
-	//vslNewStream(&BernoulliStream[0],VSL_BRNG_WH,BernoulliSeed);
-	#pragma omp parallel for default(none) shared(nthreads,BernoulliStream,bernoulliSeed,halfNumWalkers)
-	for (int threadNum = 0; threadNum < nthreads; threadNum++) {
-		vslNewStream(&BernoulliStream[threadNum], VSL_BRNG_SFMT19937, bernoulliSeed);
-		//vslNewStream(&BernoulliStream[walkerNum], VSL_BRNG_WH, BernoulliSeed);
-		//vslCopyStream(&BernoulliStream[threadNum],BernoulliStream[0]);
-		vslSkipAheadStream(BernoulliStream[threadNum], threadNum*(halfNumWalkers/nthreads));
-		//vslLeapfrogStream(BernoulliStream[threadNum],threadNum,nthreads);
+	for (int tempNum = 1; tempNum < numTemps; ++tempNum) {
+		for (int walkerNum = 0; walkerNum < numWalkers; ++walkerNum) {
+			for (int dimNum = 0; dimNum < numDims; ++dimNum) {
+				Pos[dimNum + walkerNum*numDims + tempNum*sizeStep] = Pos[dimNum + walkerNum*numDims];
+				}
+			PosLnPrior[walkerNum + tempNum*numWalkers] = PosLnPrior[walkerNum];
+			PosLnLike[walkerNum + tempNum*numWalkers] = PosLnLike[walkerNum];
+			}
 		}
 
-	#ifdef DEBUG_RUNMCMC
-	printf("runMCMC - Starting MCMC...\n");
-	#endif
-
-	/*! We first run a loop over all the steps. Recall that the 0th step is the starting step and we don't want to do anything for that step. As before, k keeps track of the current step.
-	*/
-	for (int stepNum = 1; stepNum < numSteps; stepNum++) {
+	VSLStreamStatePtr ZStream, WalkerStream, UStream;
+	vslNewStream(&ZStream, VSL_BRNG_SFMT19937, ZSeed);
+	vslNewStream(&WalkerStream, VSL_BRNG_SFMT19937, WalkerSeed);
+	vslNewStream(&UStream, VSL_BRNG_SFMT19937, BernoulliSeed);
+	double *swapFrac = static_cast<double*>(_mm_malloc(numTemps*sizeof(double),64));
+	vector<double> newPosVec(numThreads*numDims, 0.0);
+	double *p2NewPos = &newPosVec[0];
 
-		/*! To enable parallelization, we split our walkers into two subsets indexed by 0 and 1. We will move all the walkers in the current subset, currSubSet, based on randomly chosen walkers in the complimentary subset, compSubSet. We index the subsets using l.
-		*/
-		for (int subSetNum = 0; subSetNum < 2; subSetNum++) {
+	for (int stepNum = 0; stepNum < numSteps; stepNum++) {
 
-			/*! We set currSubSet to point to the current subset and set compSubSet to point to the complimentary subset.
-			If subSetNum = 0, we want 1*sizeHalfStep.
-			If subSetNum = 1, we want 0*sizeHalfStep.
-			Use ((l+1)%2).
-			*/
+		if (stepNum > 0) {
+			double *p2Betas = &Betas[(stepNum - 1)*numTemps];
 
-			currSubSetOld = &Chain[(stepNum-1)*sizeStep + subSetNum*sizeHalfStep];
-			compSubSetOld = &Chain[(stepNum-1)*sizeStep + ((subSetNum+1)%2)*sizeHalfStep];
-			currSubSetNew = &Chain[stepNum*sizeStep + subSetNum*sizeHalfStep];
+			vdRngUniform(VSL_RNG_METHOD_UNIFORM_STD, ZStream, numTempered, Zs, 0.0, 1.0);
+			for (int choiceNum = 0; choiceNum < numTempered; choiceNum++) {
+				Zs[choiceNum] = pow((A - 1.0)*Zs[choiceNum] + 1.0, 2.0)/A;
+				}
+			viRngUniform(VSL_RNG_METHOD_UNIFORM_STD, WalkerStream, numTempered, WalkerChoice, 0, halfNumWalkers);
+			vdRngUniform(VSL_RNG_METHOD_UNIFORM_STD, UStream, numTempered, Us, 0.0, 1.0);
 
 			/*!
-			Move over walkers in current sub-chain
+			Walkers are updated in place. While half-ensemble subSetNum is being moved, the complementary half-ensemble is only read, so the update of half-ensemble 1 sees the already updated half-ensemble 0, as in the serial Goodman & Weare algorithm.
 			*/
-			#pragma omp parallel for default(none) shared(stepNum,subSetNum,log2OfE,nwalkers,ndims,nthreads,sizeChain,sizeStep,sizeHalfStep,halfNumWalkers,p2Chain,p2LnPrior,p2LnLike,p2Func,p2FuncArgs,currSubSetOld,compSubSetOld,currSubSetNew,p2Zs,p2WalkerChoice,p2MoveYesNo,BernoulliStream)// num_threads(numThreads)
-			for (int walkerNum = 0; walkerNum < halfNumWalkers; walkerNum++) {
-
-				#ifdef DEBUG_RUNMCMC_OMP
-				printf("numThreads: %d\n",numThreads);
-				printf("omp_num_threads(): %d\n",omp_get_num_threads());
-				printf("omp_get_thread_num(): %d\n",omp_get_thread_num());
-				fflush(0);
-				#endif
-
-				int threadNum = omp_get_thread_num();
-				double newLnPost = 0.0, oldLnPost = 0.0, pAccept = 0.0;
-                double newLnPrior = 0.0, newLnLike = 0.0, oldLnPrior = 0.0, oldLnLike = 0.0;
-				double *compWalkerOldPos = nullptr, *currWalkerOldPos = nullptr, *currWalkerNewPos = nullptr;
-
-				/*!
-				First we get the old position of the current walker.
-				*/
-				currWalkerOldPos = &currSubSetOld[walkerNum*ndims];
-				//printf("stepNum: %d; walkerNum: %d; threadNum: %d; Address of currWalkerOldPos: %p\n",stepNum,walkerNum,threadNum,currWalkerOldPos);
-
-				#ifdef DEBUG_RUNMCMC
-				printf("runMCMC - threadNum: %d; stepNum: %d; currWalkerNum: %d; Index: %d\n",threadNum,stepNum,walkerNum+halfNumWalkers*subSetNum,(stepNum-1)*numWalkers + subSetNum*halfNumWalkers + walkerNum);
-				printf("runMCMC - threadNum: %d; stepNum: %d; currWalkerNum: %d; Old Location: ",threadNum,stepNum,walkerNum+halfNumWalkers*subSetNum);
-				for (int i = 0; i < numDims; i++) {
-					printf("%f ",currWalkerOldPos[i]);
+			for (int subSetNum = 0; subSetNum < 2; subSetNum++) {
+				#pragma omp parallel for collapse(2) default(none) shared(subSetNum,ntemps,halfNumWalkers,nwalkers,ndims,sizeStep,log2OfE,p2Betas,p2Pos,p2PosLnPrior,p2PosLnLike,p2Zs,p2Us,p2WalkerChoice,p2Func,p2FuncArgs,p2BusyTime,p2NewPos) num_threads(nthreads)
+				for (int tempNum = 0; tempNum < ntemps; tempNum++) {
+					for (int walkerNum = 0; walkerNum < halfNumWalkers; walkerNum++) {
+						int threadNum = omp_get_thread_num();
+						int currWalkerNum = subSetNum*halfNumWalkers + walkerNum;
+						int moveNum = currWalkerNum + tempNum*nwalkers;
+						int compWalkerNum = ((subSetNum+1)%2)*halfNumWalkers + p2WalkerChoice[moveNum];
+						double *currWalkerPos = &p2Pos[currWalkerNum*ndims + tempNum*sizeStep];
+						double *compWalkerPos = &p2Pos[compWalkerNum*ndims + tempNum*sizeStep];
+						double beta = p2Betas[tempNum], Z = p2Zs[moveNum];
+						double newLnPrior = 0.0, newLnLike = 0.0, pAccept = 0.0;
+						double *newPos = &p2NewPos[threadNum*ndims];
+
+						for (int dimNum = 0; dimNum < ndims; dimNum++) {
+							newPos[dimNum] = compWalkerPos[dimNum] + Z*(currWalkerPos[dimNum] - compWalkerPos[dimNum]);
+							}
+
+						double funcStart = omp_get_wtime();
+						p2Func(newPos, p2FuncArgs, newLnPrior, newLnLike);
+						p2BusyTime[threadNum] += omp_get_wtime() - funcStart;
+						double newLnPost = newLnPrior + beta*newLnLike;
+						double oldLnPost = p2PosLnPrior[moveNum] + beta*p2PosLnLike[moveNum];
+
+						if ((oldLnPost != -HUGE_VAL) and (newLnPost != -HUGE_VAL)) {
+							pAccept = exp(min(0.0, (ndims-1)*(log2(Z)/log2OfE) + newLnPost - oldLnPost));
+							} else if ((oldLnPost == -HUGE_VAL) and (newLnPost != -HUGE_VAL)) {
+							pAccept = 1.0;
+							} else {
+							pAccept = 0.0;
+							}
+
+						if (p2Us[moveNum] < pAccept) {
+							for (int dimNum = 0; dimNum < ndims; dimNum++) {
+								currWalkerPos[dimNum] = newPos[dimNum];
+								}
+							p2PosLnPrior[moveNum] = newLnPrior;
+							p2PosLnLike[moveNum] = newLnLike;
+							}
+						}
 					}
-				printf("\n");
-				#endif
-
-				/*!
-				Pick walker from complimentary ensemble and get the old position of that walker.
-				*/
-
-				compWalkerOldPos = &compSubSetOld[p2WalkerChoice[(stepNum-1)*nwalkers + subSetNum*halfNumWalkers + walkerNum]*ndims];
+				}
 
-				#ifdef DEBUG_RUNMCMC
-				printf("runMCMC - threadNum: %d; stepNum: %d; compWalkerNum: %d; Old Location: ",threadNum,stepNum,p2WalkerChoice[(stepNum-1)*numWalkers + subSetNum*halfNumWalkers + walkerNum]+halfNumWalkers*((subSetNum+1)%2));
-				for (int i = 0; i < numDims; i++) {
-					printf("%f ",compWalkerOldPos[i]);
+			/*!
+			Exchanges are proposed between every pair of adjacent temperatures, hottest pair first. Walker k at temperature tempNum is paired with walker (k + SwapOffset[tempNum])%numWalkers at temperature tempNum - 1; a random cyclic shift keeps the pairing a bijection that does not depend on the state. The swap is accepted with probability min(1, exp((beta_{i-1} - beta_i)*(LnLike_i - LnLike_{i-1}))).
+			*/
+			if (numTemps > 1) {
+				vdRngUniform(VSL_RNG_METHOD_UNIFORM_STD, UStream, numTempered, SwapUs, 0.0, 1.0);
+				viRngUniform(VSL_RNG_METHOD_UNIFORM_STD, WalkerStream, numTemps, SwapOffset, 0, numWalkers);
+				}
+			swapFrac[0] = 0.0;
+			for (int tempNum = numTemps - 1; tempNum > 0; --tempNum) {
+				int numAccepted = 0;
+				double dBeta = p2Betas[tempNum - 1] - p2Betas[tempNum];
+				for (int walkerNum = 0; walkerNum < numWalkers; ++walkerNum) {
+					int hotNum = walkerNum + tempNum*numWalkers;
+					int coldNum = (walkerNum + SwapOffset[tempNum])%numWalkers + (tempNum - 1)*numWalkers;
+					double lnSwap = dBeta*(PosLnLike[hotNum] - PosLnLike[coldNum]);
+					if (log(SwapUs[hotNum]) < lnSwap) {
+						double *hotPos = &Pos[hotNum*numDims], *coldPos = &Pos[coldNum*numDims];
+						for (int dimNum = 0; dimNum < numDims; ++dimNum) {
+							std::swap(hotPos[dimNum], coldPos[dimNum]);
+							}
+						std::swap(PosLnPrior[hotNum], PosLnPrior[coldNum]);
+						std::swap(PosLnLike[hotNum], PosLnLike[coldNum]);
+						numAccepted += 1;
+						}
 					}
-				printf("\n");
-				#endif
-
-				/*!
-				Now we get the location of the new position of the current walker.
-				*/
-				currWalkerNewPos = &currSubSetNew[walkerNum*ndims];
+				SwapsProposed[tempNum] += numWalkers;
+				SwapsAccepted[tempNum] += numAccepted;
+				swapFrac[tempNum] = static_cast<double>(numAccepted)/static_cast<double>(numWalkers);
+				}
 
-				/*!
-				Calculate the (tentative) new location to walk to.
-				*/
-				#ifdef DEBUG_RUNMCMC
-				printf("runMCMC - threadNum: %d; stepNum: %d; currWalkerNum: %d; Z: %f\n",threadNum,stepNum,walkerNum+halfNumWalkers*subSetNum,Zs[(stepNum-1)*numWalkers + subSetNum*halfNumWalkers + walkerNum]);
-				#endif
+			/*!
+			Betas[tempNum + stepNum*numTemps] holds the ladder to be used for step stepNum + 1. Once adaptation stops it is simply carried forward.
+			*/
+			for (int tempNum = 0; tempNum < numTemps; ++tempNum) {
+				Betas[tempNum + stepNum*numTemps] = p2Betas[tempNum];
+				}
+			if (stepNum < numAdaptSteps) {
+				adaptLadder(stepNum, swapFrac);
+				}
+			}
 
-				for (int dimNum = 0; dimNum < ndims; dimNum++) {
-					currWalkerNewPos[dimNum] = compWalkerOldPos[dimNum] + p2Zs[(stepNum-1)*nwalkers + subSetNum*halfNumWalkers + walkerNum]*(currWalkerOldPos[dimNum] - compWalkerOldPos[dimNum]);
-					}
+		/*!
+		Record the beta = 1 ensemble and the walker averaged log likelihood at every temperature.
+		*/
+		for (int walkerNum = 0; walkerNum < numWalkers; ++walkerNum) {
+			for (int dimNum = 0; dimNum < numDims; ++dimNum) {
+				Chain[dimNum + walkerNum*numDims + stepNum*sizeStep] = Pos[dimNum + walkerNum*numDims];
+				}
+			LnPrior[walkerNum + stepNum*numWalkers] = PosLnPrior[walkerNum];
+			LnLike[walkerNum + stepNum*numWalkers] = PosLnLike[walkerNum];
+			}
+		for (int tempNum = 0; tempNum < numTemps; ++tempNum) {
+			double sumLnLike = 0.0;
+			for (int walkerNum = 0; walkerNum < numWalkers; ++walkerNum) {
+				sumLnLike += PosLnLike[walkerNum + tempNum*numWalkers];
+				}
+			MeanLnLike[tempNum + stepNum*numTemps] = sumLnLike/numWalkers;
+			}
+		}
 
-				#ifdef DEBUG_RUNMCMC
-				printf("runMCMC - threadNum: %d; stepNum: %d; currWalkerNum: %d; New Location: ",threadNum,stepNum,walkerNum+halfNumWalkers*subSetNum);
-				for (int i = 0; i < ndims; i++) {
-					printf("%f ",currWalkerNewPos[i]);
-					}
-				printf("\n");
-				#endif
+	_mm_free(swapFrac);
+	vslDeleteStream(&ZStream);
+	vslDeleteStream(&WalkerStream);
+	vslDeleteStream(&UStream);
+	WallTime = omp_get_wtime() - startTime;
+	}
 
-				/*!
-				Now compute the logLike at the new location and fetch the LnLike at the old location.
-				*/
-				newLnPost = p2Func(currWalkerNewPos, p2FuncArgs, newLnPrior, newLnLike);
-                oldLnPrior = p2LnPrior[walkerNum + subSetNum*halfNumWalkers + (stepNum-1)*nwalkers];
-				oldLnLike = p2LnLike[walkerNum + subSetNum*halfNumWalkers + (stepNum-1)*nwalkers];
-                oldLnPost = oldLnPrior + oldLnLike;
-				//oldLnPost = p2Func(currWalkerOldPos, p2FuncArgs);
+void kali::PTEnsembleSampler::getChain(double *ChainPtr) {
+	int sizeChain = numDims*numWalkers*numSteps;
+	double* Ptr2Chain = &Chain[0];
+	#pragma omp parallel for simd default(none) shared(sizeChain, ChainPtr, Ptr2Chain)
+	for (int i = 0; i < sizeChain; ++i) {
+		ChainPtr[i] = Ptr2Chain[i];
+		}
+	}
 
-				#ifdef DEBUG_RUNMCMC
-				printf("runMCMC - threadNum: %d; stepNum: %d; currWalkerNum: %d; Old LnLike: %f\n",threadNum,stepNum,walkerNum+halfNumWalkers*subSetNum,oldLnPost);
-				printf("runMCMC - threadNum: %d; stepNum: %d; currWalkerNum: %d; New LnLike: %f\n",threadNum,stepNum,walkerNum+halfNumWalkers*subSetNum,newLnPost);
-				#endif
+void kali::PTEnsembleSampler::getChainVals(double *LnPriorPtr, double *LnLikePtr) {
+	int sizeChain = numWalkers*numSteps;
+	double* Ptr2LnPrior = &LnPrior[0];
+	double* Ptr2LnLike = &LnLike[0];
+	#pragma omp parallel for simd default(none) shared(sizeChain, LnPriorPtr, LnLikePtr, Ptr2LnPrior, Ptr2LnLike)
+	for (int i = 0; i < sizeChain; ++i) {
+		LnPriorPtr[i] = Ptr2LnPrior[i];
+		LnLikePtr[i] = Ptr2LnLike[i];
+		}
+	}
 
-				/*!
-				Calculate likelihood of accepting proposal. If both log likelihoods are non-neg infinity, calculate it. If the new likelihood is
-				*/
-				if ((oldLnPost != -HUGE_VAL) and (newLnPost != -HUGE_VAL)) {
-					pAccept = exp(min(0.0, (ndims-1)*(log2(p2Zs[(stepNum-1)*nwalkers + subSetNum*halfNumWalkers + walkerNum])/log2OfE) + newLnPost - oldLnPost));
-					} else if ((oldLnPost == -HUGE_VAL) and (newLnPost != -HUGE_VAL)) {
-					pAccept = 1.0;
-					} else if ((oldLnPost != -HUGE_VAL) and (newLnPost == -HUGE_VAL)) {
-					pAccept = 0.0;
-					} else if ((oldLnPost == -HUGE_VAL) and (newLnPost == -HUGE_VAL)) {
-					pAccept = 0.0;
-					}
+void kali::PTEnsembleSampler::getBetas(double *BetasPtr) {
+	for (int i = 0; i < numTemps*numSteps; ++i) {
+		BetasPtr[i] = Betas[i];
+		}
+	}
 
-				#ifdef DEBUG_RUNMCMC
-				printf("runMCMC - threadNum: %d; stepNum: %d;  currWalkerNum: %d; pAccept: %f\n",threadNum,stepNum,walkerNum+halfNumWalkers*subSetNum,pAccept);
-				#endif
+void kali::PTEnsembleSampler::getMeanLnLike(double *MeanLnLikePtr) {
+	for (int i = 0; i < numTemps*numSteps; ++i) {
+		MeanLnLikePtr[i] = MeanLnLike[i];
+		}
+	}
 
-				/*!
-				Actually do a coin toss to test the proposal.
-				*/
-				viRngBernoulli(VSL_RNG_METHOD_BERNOULLI_ICDF, BernoulliStream[threadNum], 1, &p2MoveYesNo[(stepNum-1)*nwalkers + subSetNum*halfNumWalkers + walkerNum], pAccept);
+void kali::PTEnsembleSampler::getSwapAcceptance(double *SwapAcceptancePtr) {
+	/*!
+	SwapAcceptancePtr[tempNum - 1] is the fraction of accepted exchanges between temperatures tempNum - 1 and tempNum.
+	*/
+	for (int tempNum = 1; tempNum < numTemps; ++tempNum) {
+		if (SwapsProposed[tempNum] > 0) {
+			SwapAcceptancePtr[tempNum - 1] = static_cast<double>(SwapsAccepted[tempNum])/static_cast<double>(SwapsProposed[tempNum]);
+			} else {
+			SwapAcceptancePtr[tempNum - 1] = 0.0;
+			}
+		}
+	}
 
+double kali::PTEnsembleSampler::getLnEvidence(double &LnEvidenceErr) {
+	/*!
+	Thermodynamic integration: ln Z = int_0^1 <LnLike>_beta dbeta. <LnLike>_beta is averaged over the walkers and over the steps after the ladder was frozen. The integral is evaluated with the trapezoidal rule, extending the hottest value to beta = 0. The error estimate is the difference to the same integral using only every other temperature, plus the error of taking <LnLike> flat over [0, beta_min]. <LnLike>_beta increases with beta, so the flat extension overestimates that segment; its error is taken to be beta_min^2/2 times the slope of <LnLike> between the two hottest temperatures, i.e. the difference to extending linearly instead.
+	*/
+	int firstStep = min(max(numAdaptSteps, 1), numSteps - 1);
+	int numAvg = numSteps - firstStep;
+	vector<double> betaVals(numTemps + 1, 0.0), meanVals(numTemps + 1, 0.0);
+	for (int tempNum = 0; tempNum < numTemps; ++tempNum) {
+		betaVals[tempNum] = Betas[tempNum + (numSteps - 1)*numTemps];
+		for (int stepNum = firstStep; stepNum < numSteps; ++stepNum) {
+			meanVals[tempNum] += MeanLnLike[tempNum + stepNum*numTemps];
+			}
+		meanVals[tempNum] /= numAvg;
+		}
+	betaVals[numTemps] = 0.0;
+	meanVals[numTemps] = meanVals[numTemps - 1];
 
-				#ifdef DEBUG_RUNMCMC
-				printf("runMCMC - threadNum: %d; stepNum: %d;  currWalkerNum: %d; moveYesNo: %d\n",threadNum,stepNum,walkerNum+halfNumWalkers*subSetNum,p2MoveYesNo[(stepNum-1)*nwalkers + subSetNum*halfNumWalkers + walkerNum]);
-				#endif
+	double lnZ = 0.0, lnZCoarse = 0.0;
+	for (int tempNum = 0; tempNum < numTemps; ++tempNum) {
+		lnZ += 0.5*(betaVals[tempNum] - betaVals[tempNum + 1])*(meanVals[tempNum] + meanVals[tempNum + 1]);
+		}
+	int prevNum = 0;
+	for (int tempNum = 2; tempNum < numTemps + 2; tempNum += 2) {
+		int currNum = min(tempNum, numTemps);
+		lnZCoarse += 0.5*(betaVals[prevNum] - betaVals[currNum])*(meanVals[prevNum] + meanVals[currNum]);
+		prevNum = currNum;
+		}
+	if (prevNum != numTemps) {
+		lnZCoarse += 0.5*(betaVals[prevNum] - betaVals[numTemps])*(meanVals[prevNum] + meanVals[numTemps]);
+		}
+	double tailErr = 0.0;
+	if ((numTemps > 1) and (betaVals[numTemps - 2] > betaVals[numTemps - 1])) {
+		double slope = (meanVals[numTemps - 2] - meanVals[numTemps - 1])/(betaVals[numTemps - 2] - betaVals[numTemps - 1]);
+		tailErr = 0.5*betaVals[numTemps - 1]*betaVals[numTemps - 1]*fabs(slope);
+		}
+	LnEvidenceErr = fabs(lnZ - lnZCoarse) + tailErr;
+	return lnZ;
+	}
 
-				/*!
-				Check the result of the coin toss. Based on the result, either move the walker, or leave it alone. Write out the LnLike to the correct location.
-				*/
-				if (p2MoveYesNo[(stepNum-1)*nwalkers + subSetNum*halfNumWalkers + walkerNum] == 1) { // Record the new LnLike as the LnLike for this walker. He has already moved so do nothing to his position.
-                    p2LnPrior[walkerNum + subSetNum*halfNumWalkers + stepNum*nwalkers] = newLnPrior;
-					p2LnLike[walkerNum + subSetNum*halfNumWalkers + stepNum*nwalkers] = newLnLike;
-					} else { // Record the old LnLike as the LnLike for this walker. Move the walker's position back.
-                    p2LnPrior[walkerNum + subSetNum*halfNumWalkers + stepNum*nwalkers] = oldLnPrior;
-                    p2LnLike[walkerNum + subSetNum*halfNumWalkers + stepNum*nwalkers] = oldLnLike;
-					for (int dimNum = 0; dimNum < ndims; dimNum++) {
-						currWalkerNewPos[dimNum] = currWalkerOldPos[dimNum];
-						}
-					}
+double kali::PTEnsembleSampler::getUtilization() {
+	double totalBusy = 0.0;
+	for (int threadNum = 0; threadNum < numThreads; ++threadNum) {
+		totalBusy += BusyTime[threadNum];
+		}
+	if (WallTime > 0.0) {
+		return totalBusy/(numThreads*WallTime);
+		} else {
+		return 0.0;
+		}
+	}
 
-				#ifdef DEBUG_RUNMCMC
-				printf("runMCMC - threadNum: %d; stepNum: %d; currWalkerNum: %d; New Location: ",threadNum,stepNum,walkerNum+halfNumWalkers*subSetNum);
-				for (int i = 0; i < numDims; i++) {
-					printf("%f ",currWalkerNewPos[i]);
-					}
-				printf("\n");
-				printf("\n");
-				#endif
+/*!
+Everything the No-U-Turn tree recursion needs to know about the chain it is extending.
+*/
+struct NUTSTreeState {
+	vector<double> Theta, R, Grad;
+	double LnPrior, LnLike, LnPost;
+	};
+
+struct NUTSContext {
+	kali::NUTSSampler *Sampler;
+	int NumDims;
+	bool Dense;
+	double *InvMetric;
+	VSLStreamStatePtr Stream;
+	long NumEvals;
+	int NumDivergent;
+	};
+
+static double nutsKinetic(NUTSContext &ctx, const vector<double> &r) {
+	double kinetic = 0.0;
+	if (ctx.Dense) {
+		for (int i = 0; i < ctx.NumDims; ++i) {
+			double vel = 0.0;
+			for (int j = 0; j < ctx.NumDims; ++j) {
+				vel += ctx.InvMetric[j + i*ctx.NumDims]*r[j];
+				}
+			kinetic += r[i]*vel;
+			}
+		} else {
+		for (int i = 0; i < ctx.NumDims; ++i) {
+			kinetic += ctx.InvMetric[i + i*ctx.NumDims]*r[i]*r[i];
+			}
+		}
+	return 0.5*kinetic;
+	}
 
+static void nutsVelocity(NUTSContext &ctx, const vector<double> &r, vector<double> &vel) {
+	for (int i = 0; i < ctx.NumDims; ++i) {
+		if (ctx.Dense) {
+			vel[i] = 0.0;
+			for (int j = 0; j < ctx.NumDims; ++j) {
+				vel[i] += ctx.InvMetric[j + i*ctx.NumDims]*r[j];
 				}
+			} else {
+			vel[i] = ctx.InvMetric[i + i*ctx.NumDims]*r[i];
 			}
+		}
+	}
+
+static void nutsLeapfrog(NUTSContext &ctx, NUTSTreeState &state, double eps) {
+	vector<double> vel(ctx.NumDims);
+	for (int i = 0; i < ctx.NumDims; ++i) {
+		state.R[i] += 0.5*eps*state.Grad[i];
+		}
+	nutsVelocity(ctx, state.R, vel);
+	for (int i = 0; i < ctx.NumDims; ++i) {
+		state.Theta[i] += eps*vel[i];
+		}
+	state.LnPost = ctx.Sampler->evalGrad(&state.Theta[0], ctx.InvMetric, state.LnPrior, state.LnLike, &state.Grad[0], ctx.NumEvals);
+	for (int i = 0; i < ctx.NumDims; ++i) {
+		state.R[i] += 0.5*eps*state.Grad[i];
+		}
+	}
+
+static bool nutsNoUTurn(NUTSContext &ctx, const NUTSTreeState &minus, const NUTSTreeState &plus) {
+	vector<double> velMinus(ctx.NumDims), velPlus(ctx.NumDims);
+	nutsVelocity(ctx, minus.R, velMinus);
+	nutsVelocity(ctx, plus.R, velPlus);
+	double dotMinus = 0.0, dotPlus = 0.0;
+	for (int i = 0; i < ctx.NumDims; ++i) {
+		double dTheta = plus.Theta[i] - minus.Theta[i];
+		dotMinus += dTheta*velMinus[i];
+		dotPlus += dTheta*velPlus[i];
+		}
+	return (dotMinus >= 0.0) and (dotPlus >= 0.0);
+	}
 
-		#pragma omp parallel for default(none) shared(nthreads,BernoulliStream,bernoulliSeed,halfNumWalkers)
-		for (int threadNum = 0; threadNum < nthreads; threadNum++) {
-			vslSkipAheadStream(BernoulliStream[threadNum], (nthreads-1)*(halfNumWalkers/nthreads));
+/*!
+Algorithm 6 of Hoffman & Gelman (2014), written in terms of log densities. On entry minus and plus must both hold the state the subtree grows from. On return they hold the leftmost and rightmost states of the subtree, proposal the state sampled uniformly from the valid states of the subtree.
+*/
+static void nutsBuildTree(NUTSContext &ctx, NUTSTreeState &minus, NUTSTreeState &plus, NUTSTreeState &proposal, double logU, int direction, int depth, double eps, double joint0, int &numValid, bool &keepGoing, double &sumAlpha, int &numAlpha) {
+	double maxDeltaH = 1000.0;
+	if (depth == 0) {
+		NUTSTreeState &edge = (direction == -1) ? minus : plus;
+		nutsLeapfrog(ctx, edge, direction*eps);
+		double joint = edge.LnPost - nutsKinetic(ctx, edge.R);
+		if (not std::isfinite(joint)) {
+			joint = -HUGE_VAL;
 			}
+		numValid = (logU <= joint) ? 1 : 0;
+		keepGoing = (logU < joint + maxDeltaH);
+		if (not keepGoing) {
+			ctx.NumDivergent += 1;
+			}
+		sumAlpha = (joint == -HUGE_VAL) ? 0.0 : min(1.0, exp(joint - joint0));
+		numAlpha = 1;
+		if (direction == -1) {
+			plus = minus;
+			} else {
+			minus = plus;
+			}
+		proposal = edge;
+		return;
+		}
 
+	nutsBuildTree(ctx, minus, plus, proposal, logU, direction, depth - 1, eps, joint0, numValid, keepGoing, sumAlpha, numAlpha);
+	if (keepGoing) {
+		NUTSTreeState outerMinus = (direction == -1) ? minus : plus;
+		NUTSTreeState outerPlus = outerMinus, outerProposal;
+		int outerValid = 0, outerNumAlpha = 0;
+		bool outerKeepGoing = true;
+		double outerSumAlpha = 0.0, u = 0.0;
+		nutsBuildTree(ctx, outerMinus, outerPlus, outerProposal, logU, direction, depth - 1, eps, joint0, outerValid, outerKeepGoing, outerSumAlpha, outerNumAlpha);
+		if (direction == -1) {
+			minus = outerMinus;
+			} else {
+			plus = outerPlus;
+			}
+		vdRngUniform(VSL_RNG_METHOD_UNIFORM_STD, ctx.Stream, 1, &u, 0.0, 1.0);
+		if ((numValid + outerValid > 0) and (u*(numValid + outerValid) < outerValid)) {
+			proposal = outerProposal;
+			}
+		sumAlpha += outerSumAlpha;
+		numAlpha += outerNumAlpha;
+		keepGoing = outerKeepGoing and nutsNoUTurn(ctx, minus, plus);
+		numValid += outerValid;
 		}
+	}
 
-	#ifdef WRITE_MOVES
-	string ChoicesPath = "/home/exarkun/Desktop/Choices.dat";
-	ofstream ChoicesFile;
-	ChoicesFile.open(ChoicesPath);
-	ChoicesFile.precision(16);
-	for (int i = 0; i < numChoices-1; i++) {
-		ChoicesFile << noshowpos << scientific << MoveYesNo[i] << endl;
+kali::NUTSSampler::NUTSSampler(int ndims, int nchains, int nsteps, int nthreads, double targetAccept, bool dense, double (*func)(double* x, void* funcArgs, double &LnPriorVal, double &LnLikelihoodVal), void* funcArgs, unsigned int seed) : NUTSSampler(ndims, nchains, nsteps, nthreads, targetAccept, dense, func, nullptr, funcArgs, seed) {}
+
+kali::NUTSSampler::NUTSSampler(int ndims, int nchains, int nsteps, int nthreads, double targetAccept, bool dense, double (*func)(double* x, void* funcArgs, double &LnPriorVal, double &LnLikelihoodVal), double (*gradFunc)(double* x, void* funcArgs, double &LnPriorVal, double &LnLikelihoodVal, double *GradLnPosterior), void* funcArgs, unsigned int seed) {
+	#ifdef DEBUG_CTORENSEMBLESAMPLER
+	printf("NUTSSampler - Constructing obj at %p!\n",this);
+	#endif
+
+	numDims = ndims;
+	numChains = nchains;
+	numSteps = nsteps;
+	numThreads = nthreads;
+	TargetAccept = targetAccept;
+	denseMass = dense;
+	Func = func;
+	GradFunc = gradFunc;
+	FuncArgs = funcArgs;
+	Seed = seed;
+	maxTreeDepth = 10;
+
+	/*!
+	As with the ensemble samplers, the first half of the run is treated as warm-up: the step size and the mass matrix of every chain are adapted there and frozen for the second half.
+	*/
+	numAdaptSteps = numSteps/2;
+
+	/*!
+	Chain, LnPrior and LnLike use the same layout as EnsembleSampler with chains in place of walkers, i.e. Chain[dimNum + chainNum*numDims + stepNum*numDims*numChains]. InvMetric[i + j*numDims + chainNum*numDims*numDims] is the inverse mass matrix of chain chainNum; only the diagonal is used unless dense is set.
+	*/
+	int sizeChain = numDims*numChains*numSteps;
+	int numChoices = numChains*numSteps;
+	Chain = static_cast<double*>(_mm_malloc(sizeChain*sizeof(double),64));
+	LnPrior = static_cast<double*>(_mm_malloc(numChoices*sizeof(double),64));
+	LnLike = static_cast<double*>(_mm_malloc(numChoices*sizeof(double),64));
+	AcceptStat = static_cast<double*>(_mm_malloc(numChoices*sizeof(double),64));
+	TreeDepth = static_cast<int*>(_mm_malloc(numChoices*sizeof(int),64));
+	StepSizes = static_cast<double*>(_mm_malloc(numChains*sizeof(double),64));
+	InvMetric = static_cast<double*>(_mm_malloc(numDims*numDims*numChains*sizeof(double),64));
+	NumDivergent = static_cast<int*>(_mm_malloc(numChains*sizeof(int),64));
+	NumEvals = static_cast<long*>(_mm_malloc(numChains*sizeof(long),64));
+
+	for (int choiceNum = 0; choiceNum < numChoices; choiceNum++) {
+		LnPrior[choiceNum] = 0.0;
+		LnLike[choiceNum] = 0.0;
+		AcceptStat[choiceNum] = 0.0;
+		TreeDepth[choiceNum] = 0;
+		}
+	for (int i = 0; i < numDims*numDims*numChains; ++i) {
+		InvMetric[i] = 0.0;
+		}
+	for (int chainNum = 0; chainNum < numChains; ++chainNum) {
+		StepSizes[chainNum] = 0.0;
+		NumDivergent[chainNum] = 0;
+		NumEvals[chainNum] = 0;
+		}
+
+	WallTime = 0.0;
+	BusyTime = static_cast<double*>(_mm_malloc(numThreads*sizeof(double),64));
+	for (int threadNum = 0; threadNum < numThreads; ++threadNum) {
+		BusyTime[threadNum] = 0.0;
 		}
-	ChoicesFile << noshowpos << scientific << MoveYesNo[numChoices-1];
-	ChoicesFile.close();
+	}
+
+kali::NUTSSampler::~NUTSSampler() {
+	#ifdef DEBUG_DTORENSEMBLESAMPLER
+	printf("~NUTSSampler - Freeing memory at %p!\n",this);
 	#endif
 
-	for (int threadNum = 0; threadNum < nthreads; threadNum++) {
-		vslDeleteStream(&BernoulliStream[threadNum]);
+	if (Chain) {
+		_mm_free(Chain);
+		Chain = nullptr;
+		}
+
+	if (LnPrior) {
+		_mm_free(LnPrior);
+		LnPrior = nullptr;
+		}
+
+	if (LnLike) {
+		_mm_free(LnLike);
+		LnLike = nullptr;
+		}
+
+	if (AcceptStat) {
+		_mm_free(AcceptStat);
+		AcceptStat = nullptr;
+		}
+
+	if (TreeDepth) {
+		_mm_free(TreeDepth);
+		TreeDepth = nullptr;
+		}
+
+	if (StepSizes) {
+		_mm_free(StepSizes);
+		StepSizes = nullptr;
+		}
+
+	if (InvMetric) {
+		_mm_free(InvMetric);
+		InvMetric = nullptr;
+		}
+
+	if (NumDivergent) {
+		_mm_free(NumDivergent);
+		NumDivergent = nullptr;
+		}
+
+	if (NumEvals) {
+		_mm_free(NumEvals);
+		NumEvals = nullptr;
+		}
+
+	if (BusyTime) {
+		_mm_free(BusyTime);
+		BusyTime = nullptr;
 		}
-	_mm_free(BernoulliStream);
 	}
 
-void kali::EnsembleSampler::getChain(double *ChainPtr) {
-	int nsteps = numSteps;
-	int nwalkers = numWalkers;
+double kali::NUTSSampler::evalGrad(double *x, double *invMetric, double &LnPriorVal, double &LnLikelihoodVal, double *GradLnPosterior, long &numEvals) {
+	/*!
+	If no gradient callback was supplied, the gradient is estimated by central differences. The step in each dimension is a small fraction of the current posterior width along that dimension as given by the diagonal of the inverse mass matrix, so it follows the scale of each parameter (e.g. the binary period in days and the semi-major axes in parsec) as the metric adapts. If one side of the difference leaves the support of the prior, a one-sided difference is used instead.
+	*/
+	int threadNum = omp_get_thread_num();
+	double funcStart = omp_get_wtime();
+	double lnPost = 0.0;
+	if (GradFunc) {
+		lnPost = GradFunc(x, FuncArgs, LnPriorVal, LnLikelihoodVal, GradLnPosterior);
+		numEvals += 1;
+		} else {
+		double lnPriorDummy = 0.0, lnLikeDummy = 0.0;
+		lnPost = Func(x, FuncArgs, LnPriorVal, LnLikelihoodVal);
+		numEvals += 1;
+		for (int dimNum = 0; dimNum < numDims; ++dimNum) {
+			double xOrig = x[dimNum];
+			double h = 1.0e-3*sqrt(invMetric[dimNum + dimNum*numDims]);
+			if (not (h > 0.0)) {
+				h = 1.0e-6*max(fabs(xOrig), 1.0);
+				}
+			x[dimNum] = xOrig + h;
+			double lnPostPlus = Func(x, FuncArgs, lnPriorDummy, lnLikeDummy);
+			x[dimNum] = xOrig - h;
+			double lnPostMinus = Func(x, FuncArgs, lnPriorDummy, lnLikeDummy);
+			x[dimNum] = xOrig;
+			numEvals += 2;
+			bool plusOK = std::isfinite(lnPostPlus), minusOK = std::isfinite(lnPostMinus);
+			if (plusOK and minusOK) {
+				GradLnPosterior[dimNum] = (lnPostPlus - lnPostMinus)/(2.0*h);
+				} else if (plusOK and std::isfinite(lnPost)) {
+				GradLnPosterior[dimNum] = (lnPostPlus - lnPost)/h;
+				} else if (minusOK and std::isfinite(lnPost)) {
+				GradLnPosterior[dimNum] = (lnPost - lnPostMinus)/h;
+				} else {
+				GradLnPosterior[dimNum] = 0.0;
+				}
+			}
+		}
+	BusyTime[threadNum] += omp_get_wtime() - funcStart;
+	return lnPost;
+	}
+
+void kali::NUTSSampler::runMCMC(double* initPos) {
+	/*!
+	Every chain is an independent No-U-Turn sampler (Hoffman & Gelman 2014, Algorithm 6) with its own VSL_BRNG_MT2203 stream, so chains are distributed over the threads with no communication between them. During warm-up the step size is tuned by dual averaging towards TargetAccept. The inverse mass matrix is the (diagonal or dense) sample covariance of the chain over the middle half of the warm-up, after which dual averaging is restarted.
+	*/
 	int ndims = numDims;
-	int sizeChain = numDims*numWalkers*numSteps;
+	int nchains = numChains;
+	int nthreads = numThreads;
+	int sizeStep = numDims*numChains;
+	double startTime = omp_get_wtime();
+
+	/*!
+	The initial inverse mass matrix is diagonal. Its entries are the variance of the initial positions across chains or, if the chains all start from the same point, (1% of the initial value)^2.
+	*/
+	for (int dimNum = 0; dimNum < numDims; ++dimNum) {
+		double mean = 0.0, var = 0.0, absMean = 0.0;
+		for (int chainNum = 0; chainNum < numChains; ++chainNum) {
+			mean += initPos[dimNum + chainNum*numDims];
+			absMean += fabs(initPos[dimNum + chainNum*numDims]);
+			}
+		mean /= numChains;
+		absMean /= numChains;
+		for (int chainNum = 0; chainNum < numChains; ++chainNum) {
+			var += pow(initPos[dimNum + chainNum*numDims] - mean, 2.0);
+			}
+		var = (numChains > 1) ? var/(numChains - 1) : 0.0;
+		if (not (var > 0.0)) {
+			var = (absMean > 0.0) ? pow(1.0e-2*absMean, 2.0) : 1.0e-4;
+			}
+		for (int chainNum = 0; chainNum < numChains; ++chainNum) {
+			InvMetric[dimNum + dimNum*numDims + chainNum*numDims*numDims] = var;
+			}
+		}
+
+	#pragma omp parallel for schedule(dynamic) default(none) shared(ndims,nchains,sizeStep,initPos) num_threads(nthreads)
+	for (int chainNum = 0; chainNum < nchains; ++chainNum) {
+		NUTSContext ctx;
+		ctx.Sampler = this;
+		ctx.NumDims = ndims;
+		ctx.Dense = denseMass;
+		ctx.InvMetric = &InvMetric[chainNum*ndims*ndims];
+		ctx.NumEvals = 0;
+		ctx.NumDivergent = 0;
+		vslNewStream(&ctx.Stream, VSL_BRNG_MT2203 + (chainNum%6024), Seed + chainNum/6024);
+
+		NUTSTreeState curr;
+		curr.Theta.assign(&initPos[chainNum*ndims], &initPos[chainNum*ndims] + ndims);
+		curr.R.assign(ndims, 0.0);
+		curr.Grad.assign(ndims, 0.0);
+		curr.LnPost = evalGrad(&curr.Theta[0], ctx.InvMetric, curr.LnPrior, curr.LnLike, &curr.Grad[0], ctx.NumEvals);
+		for (int dimNum = 0; dimNum < ndims; ++dimNum) {
+			Chain[dimNum + chainNum*ndims] = curr.Theta[dimNum];
+			}
+		LnPrior[chainNum] = curr.LnPrior;
+		LnLike[chainNum] = curr.LnLike;
+
+		vector<double> z(ndims), cholFactor(ndims*ndims, 0.0);
+		auto drawMomentum = [&](vector<double> &r) {
+			vdRngGaussian(VSL_RNG_METHOD_GAUSSIAN_ICDF, ctx.Stream, ndims, &z[0], 0.0, 1.0);
+			if (ctx.Dense) {
+				/*!
+				With InvMetric = L L^T, r = L^{-T} z has covariance InvMetric^{-1}, the mass matrix.
+				*/
+				for (int i = ndims - 1; i >= 0; --i) {
+					double sum = z[i];
+					for (int j = i + 1; j < ndims; ++j) {
+						sum -= cholFactor[i + j*ndims]*r[j];
+						}
+					r[i] = sum/cholFactor[i + i*ndims];
+					}
+				} else {
+				for (int i = 0; i < ndims; ++i) {
+					r[i] = z[i]/sqrt(ctx.InvMetric[i + i*ndims]);
+					}
+				}
+			};
+		auto updateCholesky = [&]() {
+			for (int i = 0; i < ndims; ++i) {
+				for (int j = 0; j < ndims; ++j) {
+					cholFactor[j + i*ndims] = (j <= i) ? ctx.InvMetric[j + i*ndims] : 0.0;
+					}
+				}
+			if (LAPACKE_dpotrf(LAPACK_ROW_MAJOR, 'L', ndims, &cholFactor[0], ndims) != 0) {
+				return false;
+				}
+			for (int i = 0; i < ndims; ++i) {
+				for (int j = i + 1; j < ndims; ++j) {
+					cholFactor[j + i*ndims] = 0.0;
+					}
+				}
+			return true;
+			};
+		if (ctx.Dense) {
+			updateCholesky();
+			}
+
+		/*!
+		Find a reasonable first step size (Hoffman & Gelman 2014, Algorithm 4).
+		*/
+		double eps = 1.0;
+		{
+		NUTSTreeState trial = curr;
+		drawMomentum(trial.R);
+		double joint0 = curr.LnPost - nutsKinetic(ctx, trial.R);
+		NUTSTreeState probe = trial;
+		nutsLeapfrog(ctx, probe, eps);
+		double logRatio = probe.LnPost - nutsKinetic(ctx, probe.R) - joint0;
+		int dir = (logRatio > log(0.5)) ? 1 : -1;
+		for (int iter = 0; (iter < 100) and (dir*logRatio > -dir*log(2.0)); ++iter) {
+			eps *= pow(2.0, dir);
+			probe = trial;
+			nutsLeapfrog(ctx, probe, eps);
+			logRatio = probe.LnPost - nutsKinetic(ctx, probe.R) - joint0;
+			}
+		}
+
+		double mu = log(10.0*eps), logEpsBar = 0.0, hBar = 0.0;
+		double gamma = 0.05, t0 = 10.0, kappa = 0.75;
+		int adaptIter = 0;
+		int windowStart = numAdaptSteps/4, windowEnd = (3*numAdaptSteps)/4;
+		vector<double> windowMean(ndims, 0.0), windowCov(ndims*ndims, 0.0);
+		int windowCount = 0;
+
+		for (int stepNum = 1; stepNum < numSteps; ++stepNum) {
+			NUTSTreeState minus = curr, plus, proposal;
+			drawMomentum(minus.R);
+			plus = minus;
+			proposal = curr;
+			double joint0 = curr.LnPost - nutsKinetic(ctx, minus.R);
+			double expDraw = 0.0, u = 0.0;
+			vdRngExponential(VSL_RNG_METHOD_EXPONENTIAL_ICDF, ctx.Stream, 1, &expDraw, 0.0, 1.0);
+			double logU = joint0 - expDraw;
+			int depth = 0, numValid = 1;
+			bool keepGoing = true;
+			double sumAlpha = 0.0;
+			int numAlpha = 0;
+			while (keepGoing and (depth < maxTreeDepth)) {
+				int direction = 0;
+				vdRngUniform(VSL_RNG_METHOD_UNIFORM_STD, ctx.Stream, 1, &u, 0.0, 1.0);
+				direction = (u < 0.5) ? -1 : 1;
+				NUTSTreeState treeMinus = (direction == -1) ? minus : plus;
+				NUTSTreeState treePlus = treeMinus, subProposal;
+				int subValid = 0, subNumAlpha = 0;
+				bool subKeepGoing = true;
+				double subSumAlpha = 0.0;
+				nutsBuildTree(ctx, treeMinus, treePlus, subProposal, logU, direction, depth, eps, joint0, subValid, subKeepGoing, subSumAlpha, subNumAlpha);
+				if (direction == -1) {
+					minus = treeMinus;
+					} else {
+					plus = treePlus;
+					}
+				if (subKeepGoing) {
+					vdRngUniform(VSL_RNG_METHOD_UNIFORM_STD, ctx.Stream, 1, &u, 0.0, 1.0);
+					if (u*numValid < subValid) {
+						proposal = subProposal;
+						}
+					}
+				numValid += subValid;
+				sumAlpha += subSumAlpha;
+				numAlpha += subNumAlpha;
+				keepGoing = subKeepGoing and nutsNoUTurn(ctx, minus, plus);
+				depth += 1;
+				}
+			curr.Theta = proposal.Theta;
+			curr.Grad = proposal.Grad;
+			curr.LnPrior = proposal.LnPrior;
+			curr.LnLike = proposal.LnLike;
+			curr.LnPost = proposal.LnPost;
+			double acceptStat = (numAlpha > 0) ? sumAlpha/numAlpha : 0.0;
+
+			if (stepNum <= numAdaptSteps) {
+				adaptIter += 1;
+				double w = 1.0/(adaptIter + t0);
+				hBar = (1.0 - w)*hBar + w*(TargetAccept - acceptStat);
+				double logEps = mu - sqrt(static_cast<double>(adaptIter))/gamma*hBar;
+				double decay = pow(static_cast<double>(adaptIter), -kappa);
+				logEpsBar = decay*logEps + (1.0 - decay)*logEpsBar;
+				eps = exp(logEps);
+				if ((stepNum >= windowStart) and (stepNum < windowEnd)) {
+					windowCount += 1;
+					for (int i = 0; i < ndims; ++i) {
+						double delta = curr.Theta[i] - windowMean[i];
+						windowMean[i] += delta/windowCount;
+						for (int j = 0; j < ndims; ++j) {
+							windowCov[j + i*ndims] += delta*(curr.Theta[j] - windowMean[j]);
+							}
+						}
+					}
+				if ((stepNum == windowEnd) and (windowCount > 2)) {
+					/*!
+					Replace the inverse mass matrix by the regularized window covariance. The dense estimate is shrunk towards its own diagonal and falls back to the diagonal if it is not positive definite.
+					*/
+					double shrink = 5.0/(windowCount + 5.0);
+					vector<double> oldInvMetric(ctx.InvMetric, ctx.InvMetric + ndims*ndims);
+					for (int i = 0; i < ndims; ++i) {
+						for (int j = 0; j < ndims; ++j) {
+							double cov = windowCov[j + i*ndims]/(windowCount - 1);
+							if (i == j) {
+								ctx.InvMetric[j + i*ndims] = (cov > 0.0) ? cov : oldInvMetric[j + i*ndims];
+								} else {
+								ctx.InvMetric[j + i*ndims] = ctx.Dense ? (1.0 - shrink)*cov : 0.0;
+								}
+							}
+						}
+					if (ctx.Dense and (not updateCholesky())) {
+						for (int i = 0; i < ndims; ++i) {
+							for (int j = 0; j < ndims; ++j) {
+								if (i != j) {
+									ctx.InvMetric[j + i*ndims] = 0.0;
+									}
+								}
+							}
+						updateCholesky();
+						}
+					curr.LnPost = evalGrad(&curr.Theta[0], ctx.InvMetric, curr.LnPrior, curr.LnLike, &curr.Grad[0], ctx.NumEvals);
+					mu = log(10.0*eps);
+					hBar = 0.0;
+					logEpsBar = 0.0;
+					adaptIter = 0;
+					}
+				if ((stepNum == numAdaptSteps) and (adaptIter > 0)) {
+					eps = exp(logEpsBar);
+					}
+				}
+
+			for (int dimNum = 0; dimNum < ndims; ++dimNum) {
+				Chain[dimNum + chainNum*ndims + stepNum*sizeStep] = curr.Theta[dimNum];
+				}
+			LnPrior[chainNum + stepNum*nchains] = curr.LnPrior;
+			LnLike[chainNum + stepNum*nchains] = curr.LnLike;
+			AcceptStat[chainNum + stepNum*nchains] = acceptStat;
+			TreeDepth[chainNum + stepNum*nchains] = depth;
+			}
+
+		StepSizes[chainNum] = eps;
+		NumEvals[chainNum] = ctx.NumEvals;
+		NumDivergent[chainNum] = ctx.NumDivergent;
+		vslDeleteStream(&ctx.Stream);
+		}
+
+	WallTime = omp_get_wtime() - startTime;
+	}
+
+void kali::NUTSSampler::getChain(double *ChainPtr) {
+	int sizeChain = numDims*numChains*numSteps;
 	double* Ptr2Chain = &Chain[0];
 	#pragma omp parallel for simd default(none) shared(sizeChain, ChainPtr, Ptr2Chain)
 	for (int i = 0; i < sizeChain; ++i) {
@@ -501,16 +1296,539 @@ void kali::EnsembleSampler::getChain(double *ChainPtr) {
 		}
 	}
 
-void kali::EnsembleSampler::getChainVals(double *LnPriorPtr, double *LnLikePtr) {
-	int nsteps = numSteps;
-	int nwalkers = numWalkers;
-	int ndims = numDims;
-	int sizeChain = numWalkers*numSteps;
-    double* Ptr2LnPrior = &LnPrior[0];
+void kali::NUTSSampler::getChainVals(double *LnPriorPtr, double *LnLikePtr) {
+	int sizeChain = numChains*numSteps;
+	double* Ptr2LnPrior = &LnPrior[0];
 	double* Ptr2LnLike = &LnLike[0];
 	#pragma omp parallel for simd default(none) shared(sizeChain, LnPriorPtr, LnLikePtr, Ptr2LnPrior, Ptr2LnLike)
 	for (int i = 0; i < sizeChain; ++i) {
-        LnPriorPtr[i] = Ptr2LnPrior[i];
-        LnLikePtr[i] = Ptr2LnLike[i];
+		LnPriorPtr[i] = Ptr2LnPrior[i];
+		LnLikePtr[i] = Ptr2LnLike[i];
+		}
+	}
+
+void kali::NUTSSampler::getStepSizes(double *StepSizesPtr) {
+	for (int chainNum = 0; chainNum < numChains; ++chainNum) {
+		StepSizesPtr[chainNum] = StepSizes[chainNum];
+		}
+	}
+
+void kali::NUTSSampler::getDiagnostics(double *AcceptStatPtr, int *TreeDepthPtr, int *NumDivergentPtr) {
+	for (int i = 0; i < numChains*numSteps; ++i) {
+		AcceptStatPtr[i] = AcceptStat[i];
+		TreeDepthPtr[i] = TreeDepth[i];
+		}
+	for (int chainNum = 0; chainNum < numChains; ++chainNum) {
+		NumDivergentPtr[chainNum] = NumDivergent[chainNum];
+		}
+	}
+
+long kali::NUTSSampler::getNumEvals() {
+	long totalEvals = 0;
+	for (int chainNum = 0; chainNum < numChains; ++chainNum) {
+		totalEvals += NumEvals[chainNum];
+		}
+	return totalEvals;
+	}
+
+double kali::NUTSSampler::getUtilization() {
+	double totalBusy = 0.0;
+	for (int threadNum = 0; threadNum < numThreads; ++threadNum) {
+		totalBusy += BusyTime[threadNum];
+		}
+	if (WallTime > 0.0) {
+		return totalBusy/(numThreads*WallTime);
+		} else {
+		return 0.0;
+		}
+	}
+
+kali::NestedSampler::NestedSampler(int ndims, int nlive, int nthreads, double lnZTol, int maxiter, double (*func)(double* x, void* funcArgs, double &LnPriorVal, double &LnLikelihoodVal), void* funcArgs, unsigned int seed) {
+	numDims = ndims;
+	numLive = nlive;
+	numThreads = nthreads;
+	LnZTol = lnZTol;
+	maxIter = maxiter;
+	numRepeats = 2*ndims;
+	Func = func;
+	FuncArgs = funcArgs;
+	Seed = seed;
+	LnEvidence = -kali::infiniteVal;
+	LnEvidenceErr = 0.0;
+	Information = 0.0;
+	NumEvals = 0;
+	Converged = false;
+	LiveTheta.assign(numLive*numDims, 0.0);
+	LiveLnPrior.assign(numLive, -kali::infiniteVal);
+	LiveLnLike.assign(numLive, -kali::infiniteVal);
+	}
+
+bool kali::NestedSampler::computeScale(const double *thetas, int numPoints, double *cholFactor) {
+	/*!
+	Slice directions are drawn in the frame whitened by the covariance of the live points, so that the sampler follows the shape of the constrained region as it contracts. cholFactor receives the row-major lower Cholesky factor of that covariance. If the covariance is singular the off-diagonal terms are dropped and false is returned.
+	*/
+	vector<double> mean(numDims, 0.0);
+	for (int pointNum = 0; pointNum < numPoints; ++pointNum) {
+		for (int dimNum = 0; dimNum < numDims; ++dimNum) {
+			mean[dimNum] += thetas[dimNum + pointNum*numDims];
+			}
+		}
+	for (int dimNum = 0; dimNum < numDims; ++dimNum) {
+		mean[dimNum] /= numPoints;
+		}
+	for (int i = 0; i < numDims; ++i) {
+		for (int j = 0; j < numDims; ++j) {
+			double cov = 0.0;
+			for (int pointNum = 0; pointNum < numPoints; ++pointNum) {
+				cov += (thetas[i + pointNum*numDims] - mean[i])*(thetas[j + pointNum*numDims] - mean[j]);
+				}
+			cholFactor[j + i*numDims] = (j <= i) ? cov/max(numPoints - 1, 1) : 0.0;
+			}
+		if (not (cholFactor[i + i*numDims] > 0.0)) {
+			cholFactor[i + i*numDims] = (fabs(mean[i]) > 0.0) ? pow(1.0e-1*fabs(mean[i]), 2.0) : 1.0e-2;
+			}
+		}
+	if (LAPACKE_dpotrf(LAPACK_ROW_MAJOR, 'L', numDims, cholFactor, numDims) == 0) {
+		return true;
+		}
+	for (int i = 0; i < numDims; ++i) {
+		for (int j = 0; j < numDims; ++j) {
+			if (i != j) {
+				cholFactor[j + i*numDims] = 0.0;
+				} else {
+				double var = 0.0;
+				for (int pointNum = 0; pointNum < numPoints; ++pointNum) {
+					var += pow(thetas[i + pointNum*numDims] - mean[i], 2.0);
+					}
+				var /= max(numPoints - 1, 1);
+				if (not (var > 0.0)) {
+					var = (fabs(mean[i]) > 0.0) ? pow(1.0e-1*fabs(mean[i]), 2.0) : 1.0e-2;
+					}
+				cholFactor[j + i*numDims] = sqrt(var);
+				}
+			}
+		}
+	return false;
+	}
+
+int kali::NestedSampler::sliceStep(double *x, double &lnPriorVal, double &lnLikeVal, double lnLikeMin, const double *cholFactor, void *stream, long &numEvals) {
+	/*!
+	One slice-sampling update (Neal 2003) of the prior restricted to LnLikelihood > lnLikeMin, along a random direction in the whitened frame. The initial bracket has unit width in that frame and is stepped out and then shrunk. Returns the number of bracket shrinkages, which is a cheap diagnostic of how well the scale matches the constrained region.
+	*/
+	VSLStreamStatePtr Stream = static_cast<VSLStreamStatePtr>(stream);
+	vector<double> dir(numDims), z(numDims), trial(numDims);
+	vdRngGaussian(VSL_RNG_METHOD_GAUSSIAN_ICDF, Stream, numDims, &z[0], 0.0, 1.0);
+	double norm = 0.0;
+	for (int dimNum = 0; dimNum < numDims; ++dimNum) {
+		norm += z[dimNum]*z[dimNum];
+		}
+	norm = sqrt(norm);
+	for (int i = 0; i < numDims; ++i) {
+		dir[i] = 0.0;
+		for (int j = 0; j <= i; ++j) {
+			dir[i] += cholFactor[j + i*numDims]*z[j]/norm;
+			}
+		}
+
+	double expDraw = 0.0, u = 0.0;
+	vdRngExponential(VSL_RNG_METHOD_EXPONENTIAL_ICDF, Stream, 1, &expDraw, 0.0, 1.0);
+	double lnPriorSlice = lnPriorVal - expDraw;
+	double trialLnPrior = 0.0, trialLnLike = 0.0;
+	auto inside = [&](double s) {
+		for (int dimNum = 0; dimNum < numDims; ++dimNum) {
+			trial[dimNum] = x[dimNum] + s*dir[dimNum];
+			}
+		Func(&trial[0], FuncArgs, trialLnPrior, trialLnLike);
+		numEvals += 1;
+		return (trialLnPrior > lnPriorSlice) and (trialLnLike > lnLikeMin);
+		};
+
+	vdRngUniform(VSL_RNG_METHOD_UNIFORM_STD, Stream, 1, &u, 0.0, 1.0);
+	double left = -u, right = 1.0 - u;
+	int maxStepOut = 50;
+	for (int stepNum = 0; (stepNum < maxStepOut) and inside(left); ++stepNum) {
+		left -= 1.0;
+		}
+	for (int stepNum = 0; (stepNum < maxStepOut) and inside(right); ++stepNum) {
+		right += 1.0;
+		}
+
+	int numShrink = 0;
+	while (true) {
+		vdRngUniform(VSL_RNG_METHOD_UNIFORM_STD, Stream, 1, &u, 0.0, 1.0);
+		double s = left + u*(right - left);
+		if (inside(s)) {
+			for (int dimNum = 0; dimNum < numDims; ++dimNum) {
+				x[dimNum] = trial[dimNum];
+				}
+			lnPriorVal = trialLnPrior;
+			lnLikeVal = trialLnLike;
+			break;
+			}
+		numShrink += 1;
+		if (s < 0.0) {
+			left = s;
+			} else {
+			right = s;
+			}
+		if ((right - left) < 1.0e-12) {
+			break;
+			}
+		}
+	return numShrink;
+	}
+
+int kali::NestedSampler::runNestedSampling(double *initPos, int numInit) {
+	/*!
+	Nested sampling (Skilling 2006) with constrained slice sampling for the replacement of live points.
+
+	The numInit points in initPos must lie inside the support of the prior. The live set is filled by cycling through them and then relaxed towards the prior by a few sweeps of unconstrained slice sampling, so that initPos only has to be valid, not prior distributed. The evidence is therefore relative to the prior normalized over its support.
+
+	Each iteration removes the k = min(numThreads, numLive/2) lowest-likelihood live points together. Removing the worst of n points shrinks the enclosed prior mass by exp(-1/n) on average, so the k removed points are credited with shrinkage factors for n = numLive, numLive - 1, ..., numLive - k + 1. All k are then replaced in parallel, each by slice sampling from a randomly chosen surviving live point under the constraint set by the highest of the removed likelihoods. Every replacement slot owns a VSL_BRNG_MT2203 stream, so a run is reproducible for a given seed and thread count.
+
+	Sampling stops once the largest possible contribution of the live points, max(LnLike) + ln(X), changes ln(Z) by less than LnZTol, or once no further batch fits within maxIter removed points, so at most maxIter + numLive samples are returned. Only the first case counts as converged; getConverged reports which one ended the run. The remaining live points are then added with equal shares of the last prior mass. The error on ln(Z) is sqrt(H/numLive), with H the information.
+
+	Returns 0 on success and -1 if one of the starting points is outside the support of the prior.
+	*/
+	int ndims = numDims;
+	int nlive = numLive;
+	int numBatch = max(1, min(numThreads, numLive/2));
+	Converged = false;
+	int nthreads = numThreads;
+
+	vector<VSLStreamStatePtr> Streams(numBatch);
+	for (int slotNum = 0; slotNum < numBatch; ++slotNum) {
+		vslNewStream(&Streams[slotNum], VSL_BRNG_MT2203 + (slotNum%6024), Seed + slotNum/6024);
+		}
+	vector<long> slotEvals(numBatch, 0);
+
+	int badStart = 0;
+	for (int liveNum = 0; liveNum < numLive; ++liveNum) {
+		int initNum = liveNum%numInit;
+		for (int dimNum = 0; dimNum < numDims; ++dimNum) {
+			LiveTheta[dimNum + liveNum*numDims] = initPos[dimNum + initNum*numDims];
+			}
+		}
+	#pragma omp parallel for schedule(dynamic) default(none) shared(nlive,ndims,slotEvals) reduction(+:badStart) num_threads(nthreads)
+	for (int liveNum = 0; liveNum < nlive; ++liveNum) {
+		long evals = 0;
+		Func(&LiveTheta[liveNum*ndims], FuncArgs, LiveLnPrior[liveNum], LiveLnLike[liveNum]);
+		evals += 1;
+		if (not (std::isfinite(LiveLnPrior[liveNum]) and std::isfinite(LiveLnLike[liveNum]))) {
+			badStart += 1;
+			}
+		#pragma omp atomic
+		slotEvals[0] += evals;
+		}
+	if (badStart > 0) {
+		for (int slotNum = 0; slotNum < numBatch; ++slotNum) {
+			vslDeleteStream(&Streams[slotNum]);
+			}
+		NumEvals = slotEvals[0];
+		return -1;
+		}
+
+	/*!
+	Relax the live set towards the prior. Each sweep refreshes every live point with numRepeats unconstrained slice updates and then rescales the slice directions from the new live set.
+	*/
+	vector<double> cholFactor(numDims*numDims, 0.0);
+	int numPriorSweeps = 10;
+	double noConstraint = -kali::infiniteVal;
+	for (int sweepNum = 0; sweepNum < numPriorSweeps; ++sweepNum) {
+		computeScale(&LiveTheta[0], numLive, &cholFactor[0]);
+		#pragma omp parallel for schedule(static) default(none) shared(nlive,ndims,Streams,cholFactor,slotEvals,numBatch,noConstraint) num_threads(nthreads)
+		for (int slotNum = 0; slotNum < numBatch; ++slotNum) {
+			for (int liveNum = slotNum; liveNum < nlive; liveNum += numBatch) {
+				for (int repeatNum = 0; repeatNum < numRepeats; ++repeatNum) {
+					sliceStep(&LiveTheta[liveNum*ndims], LiveLnPrior[liveNum], LiveLnLike[liveNum], noConstraint, &cholFactor[0], Streams[slotNum], slotEvals[slotNum]);
+					}
+				}
+			}
+		}
+
+	DeadTheta.clear();
+	DeadLnPrior.clear();
+	DeadLnLike.clear();
+	DeadLnWeight.clear();
+	vector<double> deadLnVol;
+	double lnZ = -kali::infiniteVal, H = 0.0, lnX = 0.0;
+	int numDead = 0;
+	vector<int> order(numLive);
+	vector<int> startIdx(numBatch);
+	vector<double> newTheta(numBatch*numDims), newLnPrior(numBatch), newLnLike(numBatch);
+
+	auto addPoint = [&](const double *theta, double lnPriorVal, double lnLikeVal, double lnW) {
+		/*!
+		Accumulate Z and the information H (Skilling 2006, eq. 20) from a point carrying prior mass exp(lnW).
+		*/
+		double lnWL = lnW + lnLikeVal;
+		double lnZNew = (lnZ > lnWL) ? lnZ + log1p(exp(lnWL - lnZ)) : lnWL + log1p(exp(lnZ - lnWL));
+		double HNew = exp(lnWL - lnZNew)*lnLikeVal - lnZNew;
+		if (std::isfinite(lnZ)) {
+			HNew += exp(lnZ - lnZNew)*(H + lnZ);
+			}
+		H = HNew;
+		lnZ = lnZNew;
+		DeadTheta.insert(DeadTheta.end(), theta, theta + numDims);
+		DeadLnPrior.push_back(lnPriorVal);
+		DeadLnLike.push_back(lnLikeVal);
+		deadLnVol.push_back(lnW);
+		};
+
+	while (numDead + numBatch <= maxIter) {
+		for (int liveNum = 0; liveNum < numLive; ++liveNum) {
+			order[liveNum] = liveNum;
+			}
+		partial_sort(order.begin(), order.begin() + numBatch, order.end(), [&](int a, int b) {return LiveLnLike[a] < LiveLnLike[b];});
+
+		double maxLnLike = *max_element(LiveLnLike.begin(), LiveLnLike.end());
+		if (std::isfinite(lnZ)) {
+			double lnZRemain = maxLnLike + lnX;
+			double lnZTotal = (lnZ > lnZRemain) ? lnZ + log1p(exp(lnZRemain - lnZ)) : lnZRemain + log1p(exp(lnZ - lnZRemain));
+			if (lnZTotal - lnZ < LnZTol) {
+				Converged = true;
+				break;
+				}
+			}
+
+		for (int removeNum = 0; removeNum < numBatch; ++removeNum) {
+			int liveNum = order[removeNum];
+			double lnXNew = lnX - 1.0/(numLive - removeNum);
+			double lnW = lnX + log1p(-exp(lnXNew - lnX));
+			addPoint(&LiveTheta[liveNum*numDims], LiveLnPrior[liveNum], LiveLnLike[liveNum], lnW);
+			lnX = lnXNew;
+			numDead += 1;
+			}
+		double lnLikeMin = LiveLnLike[order[numBatch - 1]];
+
+		/*!
+		Choose the starting survivors serially so that the draw does not depend on thread scheduling, then replace the removed points in parallel.
+		*/
+		for (int slotNum = 0; slotNum < numBatch; ++slotNum) {
+			int survivorNum = 0;
+			viRngUniform(VSL_RNG_METHOD_UNIFORM_STD, Streams[slotNum], 1, &survivorNum, numBatch, numLive);
+			startIdx[slotNum] = order[survivorNum];
+			}
+		if (numDead%numLive < numBatch) {
+			computeScale(&LiveTheta[0], numLive, &cholFactor[0]);
+			}
+		#pragma omp parallel for schedule(static) default(none) shared(ndims,numBatch,Streams,cholFactor,slotEvals,startIdx,newTheta,newLnPrior,newLnLike,lnLikeMin) num_threads(nthreads)
+		for (int slotNum = 0; slotNum < numBatch; ++slotNum) {
+			int liveNum = startIdx[slotNum];
+			for (int dimNum = 0; dimNum < ndims; ++dimNum) {
+				newTheta[dimNum + slotNum*ndims] = LiveTheta[dimNum + liveNum*ndims];
+				}
+			newLnPrior[slotNum] = LiveLnPrior[liveNum];
+			newLnLike[slotNum] = LiveLnLike[liveNum];
+			for (int repeatNum = 0; repeatNum < numRepeats; ++repeatNum) {
+				sliceStep(&newTheta[slotNum*ndims], newLnPrior[slotNum], newLnLike[slotNum], lnLikeMin, &cholFactor[0], Streams[slotNum], slotEvals[slotNum]);
+				}
+			}
+		for (int slotNum = 0; slotNum < numBatch; ++slotNum) {
+			int liveNum = order[slotNum];
+			for (int dimNum = 0; dimNum < numDims; ++dimNum) {
+				LiveTheta[dimNum + liveNum*numDims] = newTheta[dimNum + slotNum*numDims];
+				}
+			LiveLnPrior[liveNum] = newLnPrior[slotNum];
+			LiveLnLike[liveNum] = newLnLike[slotNum];
+			}
+		}
+
+	double lnWLive = lnX - log(static_cast<double>(numLive));
+	for (int liveNum = 0; liveNum < numLive; ++liveNum) {
+		addPoint(&LiveTheta[liveNum*numDims], LiveLnPrior[liveNum], LiveLnLike[liveNum], lnWLive);
+		}
+
+	LnEvidence = lnZ;
+	Information = H;
+	LnEvidenceErr = sqrt(max(H, 0.0)/numLive);
+	DeadLnWeight.resize(DeadLnLike.size());
+	for (size_t sampleNum = 0; sampleNum < DeadLnLike.size(); ++sampleNum) {
+		DeadLnWeight[sampleNum] = deadLnVol[sampleNum] + DeadLnLike[sampleNum] - lnZ;
+		}
+
+	NumEvals = 0;
+	for (int slotNum = 0; slotNum < numBatch; ++slotNum) {
+		NumEvals += slotEvals[slotNum];
+		vslDeleteStream(&Streams[slotNum]);
+		}
+	#ifdef DEBUG_RUNMCMC
+	printf("runNestedSampling - lnZ: %e +/- %e; H: %e; numSamples: %d; numEvals: %ld\n", LnEvidence, LnEvidenceErr, Information, getNumSamples(), NumEvals);
+	#endif
+	return 0;
+	}
+
+int kali::NestedSampler::getNumSamples() {
+	return static_cast<int>(DeadLnLike.size());
+	}
+
+void kali::NestedSampler::getSamples(double *SamplesPtr, double *LnPriorPtr, double *LnLikePtr, double *LnWeightPtr) {
+	int numSamples = getNumSamples();
+	for (int sampleNum = 0; sampleNum < numSamples; ++sampleNum) {
+		for (int dimNum = 0; dimNum < numDims; ++dimNum) {
+			SamplesPtr[dimNum + sampleNum*numDims] = DeadTheta[dimNum + sampleNum*numDims];
+			}
+		LnPriorPtr[sampleNum] = DeadLnPrior[sampleNum];
+		LnLikePtr[sampleNum] = DeadLnLike[sampleNum];
+		LnWeightPtr[sampleNum] = DeadLnWeight[sampleNum];
+		}
+	}
+
+double kali::NestedSampler::getLnEvidence(double &lnEvidenceErr) {
+	lnEvidenceErr = LnEvidenceErr;
+	return LnEvidence;
+	}
+
+double kali::NestedSampler::getInformation() {
+	return Information;
+	}
+
+long kali::NestedSampler::getNumEvals() {
+	return NumEvals;
+	}
+
+bool kali::NestedSampler::getConverged() {
+	return Converged;
+	}
+
+int kali::laplaceApproximation(int ndims, double *xMAP, double (*func)(double* x, void* funcArgs, double &LnPriorVal, double &LnLikelihoodVal), void* funcArgs, double *Cov, double &LnPosteriorMAP, double &LnLaplace, long &numEvals) {
+	vector<double> x(xMAP, xMAP + ndims), h(ndims), negHessian(ndims*ndims, 0.0);
+	double lnPriorVal = 0.0, lnLikeVal = 0.0;
+	for (int i = 0; i < ndims*ndims; ++i) {
+		Cov[i] = 0.0;
+		}
+	LnPosteriorMAP = func(&x[0], funcArgs, lnPriorVal, lnLikeVal);
+	LnLaplace = -kali::infiniteVal;
+	numEvals = 1;
+	if (not isfinite(LnPosteriorMAP)) {
+		return -1;
+		}
+
+	/*!
+	evalShifted returns the log posterior at xMAP + si h_i e_i + sj h_j e_j.
+	*/
+	auto evalShifted = [&](int i, double si, int j, double sj) -> double {
+		x[i] += si*h[i];
+		x[j] += sj*h[j];
+		double val = func(&x[0], funcArgs, lnPriorVal, lnLikeVal);
+		x[i] = xMAP[i];
+		x[j] = xMAP[j];
+		numEvals += 1;
+		return val;
+		};
+
+	bool finiteStencil = false;
+	double relStep = 1.0e-4;
+	for (int attempt = 0; (attempt < 4) and (not finiteStencil); ++attempt, relStep *= 0.1) {
+		finiteStencil = true;
+		for (int i = 0; i < ndims; ++i) {
+			h[i] = relStep*max(fabs(xMAP[i]), 1.0e-8);
+			}
+		for (int i = 0; (i < ndims) and finiteStencil; ++i) {
+			double fPlus = evalShifted(i, 1.0, i, 0.0), fMinus = evalShifted(i, -1.0, i, 0.0);
+			negHessian[i + i*ndims] = -(fPlus - 2.0*LnPosteriorMAP + fMinus)/(h[i]*h[i]);
+			finiteStencil = isfinite(negHessian[i + i*ndims]);
+			for (int j = 0; (j < i) and finiteStencil; ++j) {
+				double fPP = evalShifted(i, 1.0, j, 1.0), fPM = evalShifted(i, 1.0, j, -1.0);
+				double fMP = evalShifted(i, -1.0, j, 1.0), fMM = evalShifted(i, -1.0, j, -1.0);
+				negHessian[j + i*ndims] = -(fPP - fPM - fMP + fMM)/(4.0*h[i]*h[j]);
+				negHessian[i + j*ndims] = negHessian[j + i*ndims];
+				finiteStencil = isfinite(negHessian[j + i*ndims]);
+				}
+			}
+		}
+	if (not finiteStencil) {
+		return -1;
+		}
+
+	/*!
+	Invert the negative Hessian through its Cholesky factor, whose diagonal also gives ln det Cov = -2 sum ln L_ii.
+	*/
+	if (LAPACKE_dpotrf(LAPACK_ROW_MAJOR, 'L', ndims, &negHessian[0], ndims) != 0) {
+		return -1;
+		}
+	double lnDetCov = 0.0;
+	for (int i = 0; i < ndims; ++i) {
+		lnDetCov -= 2.0*log(negHessian[i + i*ndims]);
+		}
+	if (LAPACKE_dpotri(LAPACK_ROW_MAJOR, 'L', ndims, &negHessian[0], ndims) != 0) {
+		return -1;
+		}
+	for (int i = 0; i < ndims; ++i) {
+		for (int j = 0; j <= i; ++j) {
+			Cov[j + i*ndims] = negHessian[j + i*ndims];
+			Cov[i + j*ndims] = negHessian[j + i*ndims];
+			}
+		}
+	LnLaplace = LnPosteriorMAP + 0.5*ndims*log(kali::twoPi) + 0.5*lnDetCov;
+	return 0;
+	}
+
+double kali::calcGaussianLnPosterior(double *x, void *funcArgs, double &LnPriorVal, double &LnLikelihoodVal) {
+	kali::GaussianTarget *target = static_cast<kali::GaussianTarget*>(funcArgs);
+	LnPriorVal = 0.0;
+	LnLikelihoodVal = 0.0;
+	for (int dimNum = 0; dimNum < target->numDims; ++dimNum) {
+		if ((x[dimNum] < target->Lower[dimNum]) or (x[dimNum] > target->Upper[dimNum])) {
+			LnPriorVal = -HUGE_VAL;
+			LnLikelihoodVal = 0.0;
+			return -HUGE_VAL;
+			}
+		double z = (x[dimNum] - target->Mu[dimNum])/target->Sigma[dimNum];
+		LnPriorVal -= log(target->Upper[dimNum] - target->Lower[dimNum]);
+		LnLikelihoodVal -= 0.5*z*z + log(target->Sigma[dimNum]) + 0.5*log(2.0*kali::pi);
+		}
+	return LnPriorVal + LnLikelihoodVal;
+	}
+
+kali::GaussianPosterior::GaussianPosterior(kali::GaussianTarget *target, int nthreads) {
+	Target = target;
+	numThreads = nthreads;
+	}
+
+kali::GaussianPosterior::Evaluator kali::GaussianPosterior::evaluator(int) {
+	return Evaluator(Target);
+	}
+
+void kali::GaussianPosterior::evaluateBatch(int numPoints, double *x, double *LnPriorVals, double *LnLikelihoodVals, double *LnPosteriorVals) {
+	kali::GaussianTarget *target = Target;
+	int ndims = Target->numDims;
+	#pragma omp parallel for default(none) shared(numPoints,ndims,target,x,LnPriorVals,LnLikelihoodVals,LnPosteriorVals) num_threads(numThreads)
+	for (int pointNum = 0; pointNum < numPoints; ++pointNum) {
+		LnPosteriorVals[pointNum] = kali::calcGaussianLnPosterior(&x[pointNum*ndims], target, LnPriorVals[pointNum], LnLikelihoodVals[pointNum]);
+		}
+	}
+
+kali::GaussianPosterior::Evaluator::Evaluator(kali::GaussianTarget *target) {
+	Target = target;
+	}
+
+double kali::GaussianPosterior::Evaluator::operator()(double *x, double &LnPriorVal, double &LnLikelihoodVal) {
+	return kali::calcGaussianLnPosterior(x, Target, LnPriorVal, LnLikelihoodVal);
+	}
+
+int kali::sampleGaussianTarget(int samplerType, int batched, int ndims, double *mu, double *sigma, double *lower, double *upper, int nwalkers, int ntemps, int nsteps, int nthreads, double a, double maxTemp, unsigned int zSeed, unsigned int walkerSeed, unsigned int moveSeed, double *initPos, double *Chain, double *LnPrior, double *LnLikelihood, double *LnEvidence) {
+	kali::GaussianTarget target = {ndims, mu, sigma, lower, upper};
+	LnEvidence[0] = 0.0;
+	LnEvidence[1] = 0.0;
+	if (samplerType == kali::PT_ENSEMBLE_SAMPLER) {
+		kali::PTEnsembleSampler newEnsemble(ndims, nwalkers, ntemps, nsteps, nthreads, a, maxTemp, kali::calcGaussianLnPosterior, &target, zSeed, walkerSeed, moveSeed);
+		newEnsemble.runMCMC(initPos);
+		newEnsemble.getChain(Chain);
+		newEnsemble.getChainVals(LnPrior, LnLikelihood);
+		LnEvidence[0] = newEnsemble.getLnEvidence(LnEvidence[1]);
+		} else if ((samplerType == kali::ENSEMBLE_SAMPLER) and batched) {
+		kali::BasicEnsembleSampler<kali::GaussianPosterior> newEnsemble(ndims, nwalkers, nsteps, nthreads, a, kali::GaussianPosterior(&target, nthreads), zSeed, walkerSeed, moveSeed);
+		newEnsemble.runMCMC(initPos);
+		newEnsemble.getChain(Chain);
+		newEnsemble.getChainVals(LnPrior, LnLikelihood);
+		} else if (samplerType == kali::ENSEMBLE_SAMPLER) {
+		kali::EnsembleSampler newEnsemble(ndims, nwalkers, nsteps, nthreads, a, kali::calcGaussianLnPosterior, &target, zSeed, walkerSeed, moveSeed);
+		newEnsemble.runMCMC(initPos);
+		newEnsemble.getChain(Chain);
+		newEnsemble.getChainVals(LnPrior, LnLikelihood);
+		} else {
+		return -1;
 		}
+	return 0;
 	}
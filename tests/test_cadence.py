@@ -0,0 +1,77 @@
+import numpy as np
+import unittest
+import sys
+
+try:
+    import kali.cadence
+    import kali.carma
+except ImportError:
+    print 'Cannot import kali.cadence! kali is not setup. Setup kali by sourcing bin/setup.sh'
+    sys.exit(1)
+
+CADENCESEED = 472938471
+BURNSEED = 731647386
+DISTSEED = 219038190
+NOISESEED = 87238923
+
+
+class TestPatterns(unittest.TestCase):
+    def setUp(self):
+        self.duration = 4.0*kali.cadence.DaysInYear
+        self.dt = 0.01
+
+    def test_seasons(self):
+        c = kali.cadence.cadence(self.duration, self.dt).seasons(120.0).nights(0.25)
+        fraction = c.numObserved/float(c.numCadences)
+        self.assertTrue(abs(fraction - (120.0/kali.cadence.DaysInYear)*0.25) < 0.01)
+        offsets = np.mod(c.tObserved, kali.cadence.DaysInYear)
+        self.assertTrue(np.all(offsets < 120.0))
+        self.assertTrue(np.all(np.mod(c.tObserved, 1.0) < 0.25))
+        self.assertRaises(ValueError, c.windows, 1.0, 2.0)
+
+    def test_weather(self):
+        lossFraction = 0.3
+        c = kali.cadence.cadence(self.duration, self.dt).weather(lossFraction, persistence=0.5, seed=CADENCESEED)
+        nights = np.floor(c.t).astype(int)
+        nightKept = np.array([c.mask[nights == night][0] for night in np.unique(nights)])
+        for night in np.unique(nights):
+            self.assertEqual(np.ptp(c.mask[nights == night]), 0.0)
+        self.assertTrue(abs(1.0 - np.mean(nightKept) - lossFraction) < 0.1)
+        same = kali.cadence.cadence(self.duration, self.dt).weather(lossFraction, persistence=0.5,
+                                                                    seed=CADENCESEED)
+        self.assertTrue(np.array_equal(c.mask, same.mask))
+
+    def test_visits(self):
+        c = kali.cadence.cadence(self.duration, self.dt).nights(0.3).visits(2, seed=CADENCESEED)
+        counts = np.bincount(np.floor(c.tObserved).astype(int))
+        self.assertTrue(np.all(counts == 2))
+
+    def test_k2(self):
+        c = kali.cadence.k2(seed=CADENCESEED)
+        numFires = int(80.0/kali.cadence.K2ThrusterPeriod)
+        self.assertTrue(numFires - 1 <= c.numCadences - c.numObserved <= 2*(numFires + 1))
+
+    def test_rolling(self):
+        c = kali.cadence.cadence(self.duration, self.dt).rolling(2, 1, 0.25, seed=CADENCESEED)
+        seasons = np.floor(c.t/kali.cadence.DaysInYear).astype(int)
+        self.assertTrue(np.all(c.mask[seasons%2 == 1] == 1.0))
+        self.assertTrue(abs(np.mean(c.mask[seasons%2 == 0]) - 0.25) < 0.01)
+
+    def test_batch(self):
+        cadences = [kali.cadence.sdss(duration=1000.0, seed=CADENCESEED + lcNum) for lcNum in range(3)]
+        cadences.append(kali.cadence.lsst(duration=2.0*kali.cadence.DaysInYear, seed=CADENCESEED))
+        cadenceOffsets, t, mask = kali.cadence.catalog(cadences)
+        self.assertEqual(cadenceOffsets[-1], sum(c.numObserved for c in cadences))
+        Theta = kali.carma.coeffs(1, 0, np.array([-1.0/62.0, 1.0]))
+        Thetas = np.array([Theta for c in cadences])
+        task = kali.carma.CARMATask(1, 0, nthreads=2, nburn=1000)
+        x, y, yerr, status = task.simulateBatch(Thetas, cadenceOffsets, t, mask=mask,
+                                                burnSeeds=BURNSEED + np.arange(4),
+                                                distSeeds=DISTSEED + np.arange(4),
+                                                noiseSeeds=NOISESEED + np.arange(4))
+        self.assertTrue(np.all(status == 0))
+        self.assertTrue(np.all(np.isfinite(y)))
+
+
+if __name__ == "__main__":
+    unittest.main()
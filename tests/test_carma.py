@@ -5,6 +5,9 @@ import unittest
 import random
 import psutil
 import sys
+import os
+import tempfile
+import warnings
 import pdb
 
 import matplotlib.pyplot as plt
@@ -12,6 +15,7 @@ import matplotlib.cm as colormap
 
 try:
     import kali.carma
+    import kali.util.buffers
 except ImportError:
     print 'Cannot import kali.carma! kali is not setup. Setup kali by sourcing bin/setup.sh'
     sys.exit(1)
@@ -26,6 +30,7 @@ ZSSEED = 384789247
 WALKERSEED = 738472981
 MOVESEED = 131343786
 XSEED = 2348713647
+STARTSEED = 1846302917
 
 
 @unittest.skip('for now')
@@ -259,5 +264,546 @@ class TestFitCARMA21(unittest.TestCase):
         self.run_test(N2S)
 
 
+class TestAsyncSampler(unittest.TestCase):
+    def setUp(self):
+        self.p = 3
+        self.q = 1
+        self.nWalkers = 25*psutil.cpu_count(logical=True)
+        self.nSteps = 100
+        self.dt = 0.01
+        self.T = 500.0
+        self.newTask = kali.carma.CARMATask(self.p, self.q, nwalkers=self.nWalkers, nsteps=self.nSteps)
+
+    def tearDown(self):
+        del self.newTask
+
+    def test_utilization(self):
+        Rho = np.array([-1.0/1.5, -1.0/62.0, -1.0/140.0, -1.0/0.1725, 1.0])
+        Theta = kali.carma.coeffs(self.p, self.q, Rho)
+        self.newTask.set(self.dt, Theta)
+        newLC = self.newTask.simulate(duration=self.T, fracNoiseToSignal=1.0e-3,
+                                      burnSeed=BURNSEED, distSeed=DISTSEED)
+        self.newTask.observe(newLC, noiseSeed=NOISESEED)
+        self.newTask.fit(newLC, zSSeed=ZSSEED, walkerSeed=WALKERSEED, moveSeed=MOVESEED, xSeed=XSEED)
+        syncUtilization = self.newTask.samplerUtilization
+        self.newTask.fit(newLC, zSSeed=ZSSEED, walkerSeed=WALKERSEED, moveSeed=MOVESEED, xSeed=XSEED,
+                         sampler='async')
+        asyncUtilization = self.newTask.samplerUtilization
+        self.assertTrue(0.0 < syncUtilization <= 1.0)
+        self.assertTrue(0.0 < asyncUtilization <= 1.0)
+        # Without the half-ensemble barriers no thread idles while the slowest walker of a half-step finishes.
+        self.assertGreaterEqual(asyncUtilization, syncUtilization)
+        self.assertTrue(np.all(np.isfinite(self.newTask.LnPosterior)))
+        self.assertRaises(ValueError, self.newTask.fit, newLC, sampler='bogus')
+        self.assertRaises(ValueError, self.newTask.fit, newLC, sampler='async', moves={'de': 1.0})
+        self.assertRaises(ValueError, self.newTask.fit, newLC, sampler='nuts', surrogateBin=10)
+
+    def test_posteriorAgreement(self):
+        nSteps = 400
+        newTask = kali.carma.CARMATask(1, 0, nwalkers=self.nWalkers, nsteps=nSteps)
+        Rho = np.array([-1.0/62.0, 1.0])
+        newTask.set(0.1, kali.carma.coeffs(1, 0, Rho))
+        newLC = newTask.simulate(duration=1000.0, fracNoiseToSignal=1.0e-3, burnSeed=BURNSEED, distSeed=DISTSEED)
+        newTask.observe(newLC, noiseSeed=NOISESEED)
+        moments = dict()
+        for sampler in ['ensemble', 'async']:
+            newTask.fit(newLC, zSSeed=ZSSEED, walkerSeed=WALKERSEED, moveSeed=MOVESEED, xSeed=XSEED,
+                        sampler=sampler)
+            samples = np.copy(newTask.Chain[:, :, nSteps/2:]).reshape(2, -1)
+            moments[sampler] = (np.mean(samples, axis=1), np.std(samples, axis=1))
+        print 'Posterior mean (sync, async):', moments['ensemble'][0], moments['async'][0]
+        print 'Posterior std (sync, async):', moments['ensemble'][1], moments['async'][1]
+        for paramNum in range(2):
+            syncMean, syncStd = moments['ensemble'][0][paramNum], moments['ensemble'][1][paramNum]
+            asyncMean, asyncStd = moments['async'][0][paramNum], moments['async'][1][paramNum]
+            self.assertTrue(math.fabs(syncMean - asyncMean) < 0.5*max(syncStd, asyncStd))
+            self.assertTrue(0.7 < asyncStd/syncStd < 1.0/0.7)
+
+
+class TestNUTSSampler(unittest.TestCase):
+    def setUp(self):
+        self.p = 1
+        self.q = 0
+        self.nChains = psutil.cpu_count(logical=True)
+        self.nSteps = 400
+        self.dt = 0.1
+        self.T = 1000.0
+        self.newTask = kali.carma.CARMATask(self.p, self.q, nwalkers=self.nChains, nsteps=self.nSteps)
+
+    def tearDown(self):
+        del self.newTask
+
+    def run_test(self, sampler):
+        builtInTAR1 = 62.0
+        builtInAmp = 1.0
+        Rho = np.array([-1.0/builtInTAR1, builtInAmp])
+        Theta = kali.carma.coeffs(self.p, self.q, Rho)
+        self.newTask.set(self.dt, Theta)
+        newLC = self.newTask.simulate(duration=self.T, fracNoiseToSignal=1.0e-3,
+                                      burnSeed=BURNSEED, distSeed=DISTSEED)
+        self.newTask.observe(newLC, noiseSeed=NOISESEED)
+        self.newTask.fit(newLC, zSSeed=ZSSEED, walkerSeed=WALKERSEED, moveSeed=MOVESEED, xSeed=XSEED,
+                         sampler=sampler)
+        recoveredTAR1Median = np.median(self.newTask.timescaleChain[0, :, self.nSteps/2:])
+        recoveredTAR1Std = np.std(self.newTask.timescaleChain[0, :, self.nSteps/2:])
+        print '%e %e'%(math.fabs(builtInTAR1 - recoveredTAR1Median), 5.0*recoveredTAR1Std)
+        self.assertTrue(math.fabs(builtInTAR1 - recoveredTAR1Median) < 5.0*recoveredTAR1Std)
+
+    def test_diagonal(self):
+        self.run_test('nuts')
+
+    def test_dense(self):
+        self.run_test('nuts_dense')
+
+
+class TestNestedSampler(unittest.TestCase):
+    def setUp(self):
+        self.p = 1
+        self.q = 0
+        self.dt = 0.1
+        self.T = 1000.0
+        self.newTask = kali.carma.CARMATask(self.p, self.q)
+
+    def tearDown(self):
+        del self.newTask
+
+    def test_nest(self):
+        builtInTAR1 = 62.0
+        builtInAmp = 1.0
+        Rho = np.array([-1.0/builtInTAR1, builtInAmp])
+        Theta = kali.carma.coeffs(self.p, self.q, Rho)
+        self.newTask.set(self.dt, Theta)
+        newLC = self.newTask.simulate(duration=self.T, fracNoiseToSignal=1.0e-3,
+                                      burnSeed=BURNSEED, distSeed=DISTSEED)
+        self.newTask.observe(newLC, noiseSeed=NOISESEED)
+        lnZ, lnZErr = self.newTask.nest(newLC, nlive=100, nestSeed=ZSSEED)
+        self.assertTrue(np.isfinite(lnZ))
+        self.assertTrue(lnZErr > 0.0)
+        weights = np.exp(self.newTask.nestLnWeight)
+        self.assertAlmostEqual(np.sum(weights), 1.0, places=6)
+        meanA1 = np.sum(weights*self.newTask.nestSamples[0, :])
+        stdA1 = math.sqrt(np.sum(weights*(self.newTask.nestSamples[0, :] - meanA1)**2))
+        print '%e %e'%(math.fabs(Theta[0] - meanA1), 5.0*stdA1)
+        self.assertTrue(math.fabs(Theta[0] - meanA1) < 5.0*stdA1)
+        self.assertTrue(self.newTask.nestConverged)
+
+    def test_notConverged(self):
+        builtInTAR1 = 62.0
+        builtInAmp = 1.0
+        Rho = np.array([-1.0/builtInTAR1, builtInAmp])
+        Theta = kali.carma.coeffs(self.p, self.q, Rho)
+        self.newTask.set(self.dt, Theta)
+        newLC = self.newTask.simulate(duration=self.T, fracNoiseToSignal=1.0e-3,
+                                      burnSeed=BURNSEED, distSeed=DISTSEED)
+        self.newTask.observe(newLC, noiseSeed=NOISESEED)
+        with warnings.catch_warnings(record=True) as caught:
+            warnings.simplefilter('always')
+            self.newTask.nest(newLC, nlive=100, maxiter=10, nestSeed=ZSSEED)
+        self.assertFalse(self.newTask.nestConverged)
+        self.assertTrue(any(issubclass(w.category, RuntimeWarning) for w in caught))
+
+
+class TestMoveMixture(unittest.TestCase):
+    def setUp(self):
+        self.p = 1
+        self.q = 0
+        self.nWalkers = 25*psutil.cpu_count(logical=True)
+        self.nSteps = 400
+        self.dt = 0.1
+        self.T = 1000.0
+        self.newTask = kali.carma.CARMATask(self.p, self.q, nwalkers=self.nWalkers, nsteps=self.nSteps)
+
+    def tearDown(self):
+        del self.newTask
+
+    def test_mixture(self):
+        builtInTAR1 = 62.0
+        builtInAmp = 1.0
+        Rho = np.array([-1.0/builtInTAR1, builtInAmp])
+        Theta = kali.carma.coeffs(self.p, self.q, Rho)
+        self.newTask.set(self.dt, Theta)
+        newLC = self.newTask.simulate(duration=self.T, fracNoiseToSignal=1.0e-3,
+                                      burnSeed=BURNSEED, distSeed=DISTSEED)
+        self.newTask.observe(newLC, noiseSeed=NOISESEED)
+        self.newTask.fit(newLC, zSSeed=ZSSEED, walkerSeed=WALKERSEED, moveSeed=MOVESEED, xSeed=XSEED,
+                         moves={'stretch': 1.0, 'de': 1.0, 'snooker': 1.0, 'kde': 1.0})
+        recoveredTAR1Median = np.median(self.newTask.timescaleChain[0, :, self.nSteps/2:])
+        recoveredTAR1Std = np.std(self.newTask.timescaleChain[0, :, self.nSteps/2:])
+        print '%e %e'%(math.fabs(builtInTAR1 - recoveredTAR1Median), 5.0*recoveredTAR1Std)
+        self.assertTrue(math.fabs(builtInTAR1 - recoveredTAR1Median) < 5.0*recoveredTAR1Std)
+        weights = self.newTask.moveWeights
+        acceptance = self.newTask.moveAcceptance
+        print weights, acceptance
+        self.assertAlmostEqual(sum(weights.values()), 1.0, places=6)
+        for move in acceptance:
+            self.assertTrue(0.0 < acceptance[move] < 1.0)
+        self.assertRaises(ValueError, self.newTask.fit, newLC, moves={'bogus': 1.0})
+
+
+class TestDelayedAcceptance(unittest.TestCase):
+    def setUp(self):
+        self.p = 1
+        self.q = 0
+        self.nWalkers = 25*psutil.cpu_count(logical=True)
+        self.nSteps = 400
+        self.dt = 0.1
+        self.T = 1000.0
+        self.newTask = kali.carma.CARMATask(self.p, self.q, nwalkers=self.nWalkers, nsteps=self.nSteps)
+
+    def tearDown(self):
+        del self.newTask
+
+    def test_surrogate(self):
+        builtInTAR1 = 62.0
+        builtInAmp = 1.0
+        Rho = np.array([-1.0/builtInTAR1, builtInAmp])
+        Theta = kali.carma.coeffs(self.p, self.q, Rho)
+        self.newTask.set(self.dt, Theta)
+        newLC = self.newTask.simulate(duration=self.T, fracNoiseToSignal=1.0e-3,
+                                      burnSeed=BURNSEED, distSeed=DISTSEED)
+        self.newTask.observe(newLC, noiseSeed=NOISESEED)
+        self.newTask.fit(newLC, zSSeed=ZSSEED, walkerSeed=WALKERSEED, moveSeed=MOVESEED, xSeed=XSEED,
+                         surrogateBin=10)
+        recoveredTAR1Median = np.median(self.newTask.timescaleChain[0, :, self.nSteps/2:])
+        recoveredTAR1Std = np.std(self.newTask.timescaleChain[0, :, self.nSteps/2:])
+        print '%e %e'%(math.fabs(builtInTAR1 - recoveredTAR1Median), 5.0*recoveredTAR1Std)
+        self.assertTrue(math.fabs(builtInTAR1 - recoveredTAR1Median) < 5.0*recoveredTAR1Std)
+        print 'Evaluations (surrogate, exact): %d %d'%(self.newTask.numSurrogateEvals, self.newTask.numExactEvals)
+        self.assertEqual(self.newTask.numSurrogateEvals, self.nWalkers*self.nSteps)
+        self.assertTrue(self.nWalkers <= self.newTask.numExactEvals < self.newTask.numSurrogateEvals)
+        self.assertTrue(np.all(np.isfinite(self.newTask.LnPosterior)))
+
+
+class TestModeInitialization(unittest.TestCase):
+    def setUp(self):
+        self.p = 1
+        self.q = 0
+        self.nWalkers = 25*psutil.cpu_count(logical=True)
+        self.nSteps = 200
+        self.dt = 0.1
+        self.T = 1000.0
+        self.newTask = kali.carma.CARMATask(self.p, self.q, nwalkers=self.nWalkers, nsteps=self.nSteps)
+
+    def tearDown(self):
+        del self.newTask
+
+    def test_optStarts(self):
+        builtInTAR1 = 62.0
+        builtInAmp = 1.0
+        Rho = np.array([-1.0/builtInTAR1, builtInAmp])
+        Theta = kali.carma.coeffs(self.p, self.q, Rho)
+        self.newTask.set(self.dt, Theta)
+        newLC = self.newTask.simulate(duration=self.T, fracNoiseToSignal=1.0e-3,
+                                      burnSeed=BURNSEED, distSeed=DISTSEED)
+        self.newTask.observe(newLC, noiseSeed=NOISESEED)
+        self.newTask.fit(newLC, zSSeed=ZSSEED, walkerSeed=WALKERSEED, moveSeed=MOVESEED, xSeed=XSEED,
+                         Bp=False, optStarts=0)
+        perWalkerEvals = self.newTask.numOptimizerEvals
+        self.newTask.fit(newLC, zSSeed=ZSSEED, walkerSeed=WALKERSEED, moveSeed=MOVESEED, xSeed=XSEED,
+                         Bp=False, optStarts=4)
+        modeEvals = self.newTask.numOptimizerEvals
+        print 'Optimizer evaluations (per walker, modes): %d %d; modes: %d'%(perWalkerEvals, modeEvals,
+                                                                           self.newTask.numModes)
+        self.assertTrue(0 < modeEvals < perWalkerEvals)
+        self.assertTrue(1 <= self.newTask.numModes <= 4)
+        self.assertTrue(np.all(np.isfinite(self.newTask.LnPosterior)))
+        recoveredTAR1Median = np.median(self.newTask.timescaleChain[0, :, self.nSteps/2:])
+        recoveredTAR1Std = np.std(self.newTask.timescaleChain[0, :, self.nSteps/2:])
+        print '%e %e'%(math.fabs(builtInTAR1 - recoveredTAR1Median), 5.0*recoveredTAR1Std)
+        self.assertTrue(math.fabs(builtInTAR1 - recoveredTAR1Median) < 5.0*recoveredTAR1Std)
+
+
+class TestLaplace(unittest.TestCase):
+    def setUp(self):
+        self.p = 1
+        self.q = 0
+        self.numLCs = 4
+        self.dt = 0.1
+        self.T = 1000.0
+        self.newTask = kali.carma.CARMATask(self.p, self.q)
+
+    def tearDown(self):
+        del self.newTask
+
+    def test_laplace(self):
+        builtInTAR1 = 62.0
+        builtInAmp = 1.0
+        Rho = np.array([-1.0/builtInTAR1, builtInAmp])
+        Theta = kali.carma.coeffs(self.p, self.q, Rho)
+        self.newTask.set(self.dt, Theta)
+        lcs = list()
+        for lcNum in range(self.numLCs):
+            newLC = self.newTask.simulate(duration=self.T, fracNoiseToSignal=1.0e-3,
+                                          burnSeed=BURNSEED + lcNum, distSeed=DISTSEED + lcNum)
+            self.newTask.observe(newLC, noiseSeed=NOISESEED + lcNum)
+            lcs.append(newLC)
+        MAP, Cov, lnLaplace, status = self.newTask.laplace(lcs, numStarts=4)
+        self.assertEqual(MAP.shape, (self.numLCs, self.p + self.q + 1))
+        self.assertEqual(Cov.shape, (self.numLCs, self.p + self.q + 1, self.p + self.q + 1))
+        for lcNum in range(self.numLCs):
+            self.assertEqual(status[lcNum], 0)
+            self.assertTrue(np.isfinite(lnLaplace[lcNum]))
+            self.assertTrue(np.all(np.linalg.eigvalsh(Cov[lcNum]) > 0.0))
+            stdA1 = math.sqrt(Cov[lcNum, 0, 0])
+            self.assertTrue(math.fabs(Theta[0] - MAP[lcNum, 0]) < 5.0*stdA1)
+
+
+class TestOrderSearch(unittest.TestCase):
+    def setUp(self):
+        self.p = 1
+        self.q = 0
+        self.dt = 0.1
+        self.T = 1000.0
+        self.newTask = kali.carma.CARMATask(self.p, self.q)
+
+    def tearDown(self):
+        del self.newTask
+
+    def test_search(self):
+        Rho = np.array([-1.0/62.0, 1.0])
+        Theta = kali.carma.coeffs(self.p, self.q, Rho)
+        self.newTask.set(self.dt, Theta)
+        newLC = self.newTask.simulate(duration=self.T, fracNoiseToSignal=1.0e-3,
+                                      burnSeed=BURNSEED, distSeed=DISTSEED)
+        self.newTask.observe(newLC, noiseSeed=NOISESEED)
+        newLC.mask[2000:2500] = 0.0
+        search = kali.carma.orderSearch(newLC, pMin=1, pMax=2, numCandidates=2, startSeed=STARTSEED,
+                                        nthreads=4, doFit=False)
+        self.assertEqual(search['orders'], [(1, 0), (2, 0), (2, 1)])
+        self.assertEqual(search['status'][0], 0)
+        self.assertEqual(search['MAP'][2].shape, (4,))
+        self.assertEqual(search['Cov'][2].shape, (4, 4))
+        self.assertTrue(0 < len(search['candidates']) <= 2)
+        # The BIC penalizes the extra parameters of the higher orders, so the simulated order ranks first.
+        self.assertEqual(search['candidates'][0], (1, 0))
+        self.assertEqual(search['tasks'], dict())
+        stdA1 = math.sqrt(search['Cov'][0][0, 0])
+        self.assertTrue(math.fabs(Theta[0] - search['MAP'][0][0]) < 5.0*stdA1)
+        # Independent of the number of threads and, up to rounding, of collapsing the masked run.
+        serial = kali.carma.orderSearch(newLC, pMin=1, pMax=2, startSeed=STARTSEED, nthreads=1, doFit=False)
+        self.assertTrue(np.array_equal(serial['BIC'], search['BIC']))
+        unskipped = kali.carma.orderSearch(newLC, pMin=1, pMax=1, startSeed=STARTSEED, minGapRun=0, doFit=False)
+        self.assertTrue(math.fabs(unskipped['lnPosteriorMAP'][0] - search['lnPosteriorMAP'][0]) < 1.0e-2)
+        fitted = kali.carma.orderSearch(newLC, pMin=1, pMax=2, numCandidates=1, startSeed=STARTSEED,
+                                        nwalkers=50, nsteps=100, zSSeed=ZSSEED, walkerSeed=WALKERSEED,
+                                        moveSeed=MOVESEED, xSeed=XSEED)
+        self.assertEqual(sorted(fitted['tasks'].keys()), sorted(fitted['candidates']))
+        for task in fitted['tasks'].values():
+            self.assertTrue(np.all(np.isfinite(task.LnPosterior)))
+
+
+class TestWarmStart(unittest.TestCase):
+    def setUp(self):
+        self.p = 1
+        self.q = 0
+        self.nWalkers = 50
+        self.nSteps = 100
+        self.dt = 0.1
+        self.T = 200.0
+        self.newTask = kali.carma.CARMATask(self.p, self.q, nwalkers=self.nWalkers, nsteps=self.nSteps)
+
+    def tearDown(self):
+        del self.newTask
+
+    def test_warmStart(self):
+        Rho = np.array([-1.0/62.0, 1.0])
+        Theta = kali.carma.coeffs(self.p, self.q, Rho)
+        self.newTask.set(self.dt, Theta)
+        newLC = self.newTask.simulate(duration=self.T, fracNoiseToSignal=1.0e-3,
+                                      burnSeed=BURNSEED, distSeed=DISTSEED)
+        self.newTask.observe(newLC, noiseSeed=NOISESEED)
+        self.newTask.fit(newLC, zSSeed=ZSSEED, walkerSeed=WALKERSEED, moveSeed=MOVESEED, xSeed=XSEED)
+        self.assertEqual(self.newTask.burnSteps, self.nSteps//2)
+        ensemble = self.newTask.ensemble
+        self.assertEqual(ensemble['Theta'].shape, (self.p + self.q + 1, self.nWalkers))
+        self.assertTrue(np.array_equal(ensemble['Theta'], self.newTask.Chain[:, :, -1]))
+        fileName = os.path.join(tempfile.mkdtemp(), 'ensemble.npz')
+        self.newTask.saveEnsemble(fileName)
+        # An unstable walker is restarted inside the prior.
+        stored = dict(ensemble)
+        stored['Theta'] = np.copy(ensemble['Theta'])
+        stored['Theta'][0, 0] = -1.0
+        warmTask = kali.carma.CARMATask(self.p, self.q, nwalkers=self.nWalkers, nsteps=self.nSteps)
+        for warmStart in [self.newTask, fileName, stored]:
+            warmTask.fit(newLC, zSSeed=ZSSEED, walkerSeed=WALKERSEED, moveSeed=MOVESEED, xSeed=XSEED,
+                         warmStart=warmStart)
+            self.assertEqual(warmTask.burnSteps, self.nSteps//10)
+            self.assertEqual(warmTask.numOptimizerEvals, 0)
+            self.assertTrue(np.all(np.isfinite(warmTask.LnPosterior)))
+            stdA1 = np.std(warmTask.Chain[0, :, warmTask.burnSteps:])
+            self.assertTrue(math.fabs(np.mean(warmTask.Chain[0, :, warmTask.burnSteps:]) - Theta[0]) < 5.0*stdA1)
+        wrongTask = kali.carma.CARMATask(2, 0, nwalkers=self.nWalkers, nsteps=self.nSteps)
+        self.assertRaises(ValueError, wrongTask.fit, newLC, warmStart=self.newTask)
+
+
+class TestSimulateBatch(unittest.TestCase):
+    def setUp(self):
+        self.p = 2
+        self.q = 1
+        self.dt = 0.1
+        self.nBurn = 1000
+        self.newTask = kali.carma.CARMATask(self.p, self.q, nthreads=4, nburn=self.nBurn)
+
+    def tearDown(self):
+        del self.newTask
+
+    def test_batch(self):
+        Thetas = np.array([kali.carma.coeffs(self.p, self.q, np.array([-1.0/62.0, -1.0/3.0, -1.0/8.0, 1.0])),
+                           kali.carma.coeffs(self.p, self.q, np.array([-1.0/20.0, -1.0/5.0, -1.0/2.0, 0.5])),
+                           np.array([-1.0, 1.0, 1.0, 1.0]),
+                           kali.carma.coeffs(self.p, self.q, np.array([-1.0/40.0, -1.0/4.0, -1.0/9.0, 2.0]))])
+        numCadences = [1000, 1500, 100, 800]
+        cadenceOffsets = np.concatenate(([0], np.cumsum(numCadences)))
+        t = np.concatenate([self.dt*np.arange(n) for n in numCadences])
+        burnSeeds = BURNSEED + np.arange(4)
+        distSeeds = DISTSEED + np.arange(4)
+        noiseSeeds = NOISESEED + np.arange(4)
+        x, y, yerr, status = self.newTask.simulateBatch(Thetas, cadenceOffsets, t, burnSeeds=burnSeeds,
+                                                        distSeeds=distSeeds, noiseSeeds=noiseSeeds)
+        self.assertEqual(list(status), [0, 0, -1, 0])
+        self.assertTrue(np.all(x[cadenceOffsets[2]:cadenceOffsets[3]] == 0.0))
+        for lcNum in [0, 1, 3]:
+            self.newTask.set(self.dt, Thetas[lcNum])
+            newLC = self.newTask.simulate(duration=numCadences[lcNum]*self.dt, burnSeed=burnSeeds[lcNum],
+                                          distSeed=distSeeds[lcNum])
+            self.newTask.observe(newLC, noiseSeed=noiseSeeds[lcNum])
+            first, last = cadenceOffsets[lcNum], cadenceOffsets[lcNum + 1]
+            self.assertTrue(np.allclose(x[first:last], newLC.x, rtol=1.0e-8, atol=1.0e-12))
+            self.assertTrue(np.allclose(y[first:last], newLC.y, rtol=1.0e-8, atol=1.0e-12))
+            self.assertTrue(np.allclose(yerr[first:last], newLC.yerr, rtol=1.0e-8, atol=1.0e-12))
+        # The batch runs on scratch systems and leaves the task's own Theta alone.
+        self.newTask.simulateBatch(Thetas, cadenceOffsets, t, burnSeeds=burnSeeds, distSeeds=distSeeds,
+                                   noiseSeeds=noiseSeeds)
+        self.assertTrue(np.array_equal(self.newTask.Theta(), Thetas[3]))
+        self.assertEqual(self.newTask.dt(), self.dt)
+        fileName = os.path.join(tempfile.mkdtemp(), 'catalog.npy')
+        self.newTask.simulateBatch(Thetas, cadenceOffsets, t, burnSeeds=burnSeeds, distSeeds=distSeeds,
+                                   noiseSeeds=noiseSeeds, fileName=fileName, chunkSize=3)
+        stored = np.load(fileName, mmap_mode='r')
+        self.assertTrue(np.array_equal(stored[0], x))
+        self.assertTrue(np.array_equal(stored[1], y))
+        self.assertTrue(np.array_equal(stored[2], yerr))
+
+
+class TestRNGVersion(unittest.TestCase):
+    def setUp(self):
+        self.p = 2
+        self.q = 1
+        self.dt = 0.1
+        self.T = 500.0
+        self.newTask = kali.carma.CARMATask(self.p, self.q, nthreads=2, nburn=1000)
+        Rho = np.array([-1.0/62.0, -1.0/3.0, -1.0/8.0, 1.0])
+        self.newTask.set(self.dt, kali.carma.coeffs(self.p, self.q, Rho))
+
+    def tearDown(self):
+        del self.newTask
+
+    def simulate(self, tIn=None):
+        if tIn is None:
+            newLC = self.newTask.simulate(duration=self.T, burnSeed=BURNSEED, distSeed=DISTSEED)
+        else:
+            newLC = self.newTask.simulate(tIn=tIn, burnSeed=BURNSEED, distSeed=DISTSEED)
+        self.newTask.observe(newLC, noiseSeed=NOISESEED)
+        return newLC
+
+    def test_versions(self):
+        self.assertEqual(self.newTask.rngVersion, 1)
+        self.assertRaises(ValueError, setattr, self.newTask, 'rngVersion', 3)
+        self.assertEqual(self.newTask.rngVersion, 1)
+        tIn = np.concatenate((self.dt*np.arange(2000), 250.0 + 0.25*np.arange(1000)))
+        oldLC = self.simulate()
+        oldGapLC = self.simulate(tIn)
+        self.newTask.rngVersion = 2
+        newLC = self.simulate()
+        newGapLC = self.simulate(tIn)
+        self.assertTrue(np.array_equal(newLC.x, self.simulate().x))
+        for old, new in [(oldLC, newLC), (oldGapLC, newGapLC)]:
+            self.assertTrue(np.allclose(new.x, old.x, rtol=1.0e-6, atol=1.0e-10))
+            self.assertTrue(np.allclose(new.y, old.y, rtol=1.0e-6, atol=1.0e-10))
+            self.assertTrue(np.allclose(new.yerr, old.yerr, rtol=1.0e-10, atol=0.0))
+        self.newTask.rngVersion = 1
+        self.assertTrue(np.array_equal(oldLC.x, self.simulate().x))
+
+
+class TestCirculant(unittest.TestCase):
+    def setUp(self):
+        self.p = 2
+        self.q = 1
+        self.dt = 1.0
+        self.numCadences = 4000
+        self.numRealizations = 20
+        self.newTask = kali.carma.CARMATask(self.p, self.q, nthreads=2, nburn=10000)
+        Rho = np.array([-1.0/62.0, -1.0/3.0, -1.0/8.0, 1.0])
+        self.newTask.set(self.dt, kali.carma.coeffs(self.p, self.q, Rho))
+
+    def tearDown(self):
+        del self.newTask
+
+    def meanACVF(self, method, maxLag):
+        acvf = np.zeros(maxLag + 1)
+        for realizationNum in range(self.numRealizations):
+            newLC = self.newTask.simulate(duration=self.numCadences*self.dt, burnSeed=BURNSEED + realizationNum,
+                                          distSeed=DISTSEED + realizationNum, method=method)
+            for lag in range(maxLag + 1):
+                acvf[lag] += np.mean(newLC.x[:self.numCadences - lag]*newLC.x[lag:])
+        return acvf/self.numRealizations
+
+    def test_acvf(self):
+        maxLag = 40
+        lags, trueACVF = self.newTask.acvf(start=0.0, stop=maxLag*self.dt, num=maxLag + 1)
+        circulantACVF = self.meanACVF('circulant', maxLag)
+        kalmanACVF = self.meanACVF('kalman', maxLag)
+        self.assertTrue(np.all(np.abs(circulantACVF - trueACVF) < 0.1*trueACVF[0]))
+        self.assertTrue(np.all(np.abs(kalmanACVF - trueACVF) < 0.1*trueACVF[0]))
+        self.assertTrue(np.all(np.abs(circulantACVF - kalmanACVF) < 0.15*trueACVF[0]))
+
+    def test_reproducible(self):
+        firstLC = self.newTask.simulate(duration=1000.0, distSeed=DISTSEED, method='circulant')
+        secondLC = self.newTask.simulate(duration=1000.0, distSeed=DISTSEED, method='circulant')
+        self.assertTrue(np.array_equal(firstLC.x, secondLC.x))
+        self.assertRaises(ValueError, self.newTask.extend, firstLC, duration=100.0, distSeed=DISTSEED)
+        tIn = np.sort(np.random.RandomState(DISTSEED).uniform(0.0, 100.0, 200))
+        self.assertRaises(ValueError, self.newTask.simulate, tIn=tIn, distSeed=DISTSEED, method='circulant')
+
+
+class TestZeroCopy(unittest.TestCase):
+    def setUp(self):
+        self.p = 1
+        self.q = 0
+        self.nWalkers = 50
+        self.nSteps = 100
+        self.dt = 0.1
+        self.T = 200.0
+        self.newTask = kali.carma.CARMATask(self.p, self.q, nwalkers=self.nWalkers, nsteps=self.nSteps)
+
+    def tearDown(self):
+        del self.newTask
+
+    def test_copies(self):
+        Rho = np.array([-1.0/62.0, 1.0])
+        Theta = kali.carma.coeffs(self.p, self.q, Rho)
+        self.newTask.set(self.dt, Theta)
+        newLC = self.newTask.simulate(duration=self.T, fracNoiseToSignal=1.0e-3,
+                                      burnSeed=BURNSEED, distSeed=DISTSEED)
+        self.newTask.observe(newLC, noiseSeed=NOISESEED)
+        self.newTask.logLikelihood(newLC)
+        self.newTask.laplace([newLC, newLC])
+        chainAddress = self.newTask._Chain.ctypes.data
+        kali.util.buffers.resetCounts()
+        for fitNum in range(2):
+            self.newTask.fit(newLC, zSSeed=ZSSEED, walkerSeed=WALKERSEED, moveSeed=MOVESEED, xSeed=XSEED)
+            self.newTask.logLikelihood(newLC)
+            self.newTask.laplace([newLC, newLC])
+        counts = kali.util.buffers.counts()
+        self.assertEqual(counts['copies'], 0)
+        self.assertEqual(counts['allocations'], 0)
+        self.assertEqual(self.newTask._Chain.ctypes.data, chainAddress)
+        self.assertTrue(np.shares_memory(self.newTask.Chain, self.newTask._Chain))
+        self.assertTrue(np.all(np.isfinite(self.newTask.LnPosterior)))
+        self.assertTrue(kali.util.buffers.require(newLC.t) is newLC.t)
+        kali.util.buffers.require(newLC.t[::2])
+        self.assertEqual(kali.util.buffers.counts()['copies'], 1)
+
+
 if __name__ == "__main__":
     unittest.main()
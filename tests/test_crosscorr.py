@@ -0,0 +1,70 @@
+import numpy as np
+import unittest
+import sys
+
+try:
+    import kali.crosscorr
+except ImportError:
+    print 'Cannot import kali.crosscorr! kali is not setup. Setup kali by sourcing bin/setup.sh'
+    sys.exit(1)
+
+SIGNALSEED = 748291037
+MCSEED = 120938475
+
+
+class series(object):
+    def __init__(self, t, y, yerr, mask):
+        self.t, self.y, self.yerr, self.mask = t, y, yerr, mask
+
+
+class TestLagRecovery(unittest.TestCase):
+    def setUp(self):
+        rs = np.random.RandomState(SIGNALSEED)
+        self.lag = 10.0
+        fineT = 0.05*np.arange(20000)
+        fineY = np.zeros(fineT.shape[0])
+        for i in range(1, fineT.shape[0]):
+            fineY[i] = 0.995*fineY[i - 1] + 0.1*rs.normal()
+        t1 = np.sort(rs.uniform(100.0, 700.0, size=300))
+        t2 = np.sort(rs.uniform(100.0, 700.0, size=250))
+        y1 = 10.0 + np.interp(t1, fineT, fineY) + 0.02*rs.normal(size=t1.shape[0])
+        y2 = 20.0 + 2.0*np.interp(t2 - self.lag, fineT, fineY) + 0.02*rs.normal(size=t2.shape[0])
+        self.lc1 = series(t1, y1, 0.02*np.ones(t1.shape[0]), (rs.uniform(size=t1.shape[0]) < 0.9).astype(np.float64))
+        self.lc2 = series(t2, y2, 0.02*np.ones(t2.shape[0]), (rs.uniform(size=t2.shape[0]) < 0.9).astype(np.float64))
+        self.lags = np.linspace(-30.0, 30.0, 61)
+
+    def test_dcf(self):
+        dcfVals, dcfErrs, numPairs = kali.crosscorr.dcf(self.lc1, self.lc2, self.lags)
+        keep1, keep2 = self.lc1.mask != 0.0, self.lc2.mask != 0.0
+        t1, y1, t2, y2 = self.lc1.t[keep1], self.lc1.y[keep1], self.lc2.t[keep2], self.lc2.y[keep2]
+        lagGrid = t2[np.newaxis, :] - t1[:, np.newaxis]
+        self.assertEqual(np.sum(numPairs), np.sum((lagGrid >= -30.5) & (lagGrid < 30.5)))
+        self.assertTrue(abs(self.lags[np.nanargmax(dcfVals)] - self.lag) <= 1.0)
+
+    def test_iccf(self):
+        iccfVals = kali.crosscorr.iccf(self.lc1, self.lc2, self.lags)
+        self.assertTrue(abs(self.lags[np.argmax(iccfVals)] - self.lag) <= 1.0)
+        swapped = kali.crosscorr.iccf(self.lc2, self.lc1, -self.lags)
+        self.assertTrue(np.allclose(iccfVals, swapped))
+
+    def test_zdcf(self):
+        lags, zdcfVals, errLow, errHigh, numPairs = kali.crosscorr.zdcf(self.lc1, self.lc2, -30.0, 30.0)
+        self.assertTrue(np.all(numPairs == 11))
+        self.assertTrue(np.all(np.diff(lags) >= 0.0))
+        self.assertTrue(np.all(errLow[np.isfinite(errLow)] >= 0.0))
+        self.assertTrue(abs(lags[np.nanargmax(zdcfVals)] - self.lag) < 2.0)
+
+    def test_lagErrors(self):
+        for method in ['dcf', 'zdcf', 'iccf']:
+            peakLags, centroidLags, peakVals = kali.crosscorr.lagErrors(self.lc1, self.lc2, self.lags, method=method,
+                                                                        numRealizations=200, seed=MCSEED)
+            same = kali.crosscorr.lagErrors(self.lc1, self.lc2, self.lags, method=method, numRealizations=200,
+                                            seed=MCSEED)
+            self.assertTrue(np.array_equal(centroidLags, same[1]))
+            print method, np.nanmean(centroidLags), np.nanstd(centroidLags)
+            self.assertTrue(abs(np.nanmedian(centroidLags) - self.lag) < 2.0)
+        self.assertRaises(ValueError, kali.crosscorr.lagErrors, self.lc1, self.lc2, self.lags, method='bogus')
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,110 @@
+import math
+import numpy as np
+import unittest
+import sys
+import threading
+
+try:
+    import kali.carma
+    import kali.execution
+except ImportError:
+    print 'Cannot import kali.carma! kali is not setup. Setup kali by sourcing bin/setup.sh'
+    sys.exit(1)
+
+BURNSEED = 731647386
+DISTSEED = 219038190
+NOISESEED = 87238923
+ZSSEED = 384789247
+WALKERSEED = 738472981
+MOVESEED = 131343786
+XSEED = 2348713647
+
+
+class TestExecutionContext(unittest.TestCase):
+    def setUp(self):
+        self.p = 1
+        self.q = 0
+        self.nThreads = 4
+        self.nWalkers = 50
+        self.nSteps = 100
+        self.dt = 0.1
+        self.T = 200.0
+        self.oldMaxThreads = kali.execution.maxThreads()
+        self.newTask = kali.carma.CARMATask(self.p, self.q, nthreads=self.nThreads, nwalkers=self.nWalkers,
+                                            nsteps=self.nSteps)
+
+    def tearDown(self):
+        kali.execution.setTaskLimit('carma', None)
+        kali.execution.setMaxThreads(self.oldMaxThreads)
+        del self.newTask
+
+    def test_taskLimit(self):
+        Rho = np.array([-1.0/62.0, 1.0])
+        Theta = kali.carma.coeffs(self.p, self.q, Rho)
+        self.newTask.set(self.dt, Theta)
+        newLC = self.newTask.simulate(duration=self.T, fracNoiseToSignal=1.0e-3,
+                                      burnSeed=BURNSEED, distSeed=DISTSEED)
+        self.newTask.observe(newLC, noiseSeed=NOISESEED)
+        kali.execution.setMaxThreads(self.nThreads)
+        kali.execution.setTaskLimit('carma', 2)
+        self.assertEqual(kali.execution.taskLimit('carma'), 2)
+        self.assertRaises(ValueError, kali.execution.setTaskLimit, 'bogus', 1)
+        kali.execution.resetStats()
+        self.newTask.fit(newLC, zSSeed=ZSSEED, walkerSeed=WALKERSEED, moveSeed=MOVESEED, xSeed=XSEED)
+        stats = kali.execution.stats()
+        print stats
+        self.assertEqual(kali.execution.activeThreads(), 0)
+        self.assertEqual(stats['carma']['leases'], 1)
+        self.assertEqual(stats['carma']['clipped'], 1)
+        self.assertEqual(stats['carma']['peakThreads'], 2)
+        self.assertEqual(stats['mbhb']['leases'], 0)
+        self.assertTrue(0.0 < stats['utilization'] <= 1.0)
+        self.assertTrue(np.all(np.isfinite(self.newTask.LnPosterior)))
+
+
+class TestConcurrentFits(unittest.TestCase):
+    def setUp(self):
+        self.p = 1
+        self.q = 0
+        self.numTasks = 2
+        self.nWalkers = 50
+        self.nSteps = 100
+        self.dt = 0.1
+        self.T = 200.0
+        self.oldMaxThreads = kali.execution.maxThreads()
+        kali.execution.setMaxThreads(2*self.numTasks)
+        self.tasks = [kali.carma.CARMATask(self.p, self.q, nthreads=2, nwalkers=self.nWalkers, nsteps=self.nSteps)
+                      for taskNum in range(self.numTasks)]
+
+    def tearDown(self):
+        kali.execution.setMaxThreads(self.oldMaxThreads)
+        del self.tasks
+
+    def test_threads(self):
+        Rho = np.array([-1.0/62.0, 1.0])
+        Theta = kali.carma.coeffs(self.p, self.q, Rho)
+        lcs = list()
+        for taskNum, task in enumerate(self.tasks):
+            task.set(self.dt, Theta)
+            newLC = task.simulate(duration=self.T, fracNoiseToSignal=1.0e-3,
+                                  burnSeed=BURNSEED + taskNum, distSeed=DISTSEED + taskNum)
+            task.observe(newLC, noiseSeed=NOISESEED + taskNum)
+            lcs.append(newLC)
+
+        def fit(taskNum):
+            self.tasks[taskNum].fit(lcs[taskNum], zSSeed=ZSSEED, walkerSeed=WALKERSEED, moveSeed=MOVESEED,
+                                    xSeed=XSEED)
+        fit(0)
+        serialChain = np.copy(self.tasks[0].Chain)
+        threads = [threading.Thread(target=fit, args=(taskNum,)) for taskNum in range(self.numTasks)]
+        for thread in threads:
+            thread.start()
+        for thread in threads:
+            thread.join()
+        self.assertTrue(np.array_equal(serialChain, self.tasks[0].Chain))
+        for task in self.tasks:
+            self.assertTrue(np.all(np.isfinite(task.LnPosterior)))
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,240 @@
+import numpy as np
+import unittest
+import sys
+
+try:
+    import kali.carma
+    import kali.lc
+    import LCTools_cython
+except ImportError:
+    print 'Cannot import kali.carma! kali is not setup. Setup kali by sourcing bin/setup.sh'
+    sys.exit(1)
+
+BURNSEED = 731647386
+DISTSEED = 219038190
+NOISESEED = 87238923
+MASKSEED = 561093284
+DACFSEED = 903481723
+LSSEED = 310928475
+SFSEED = 584736291
+BATCHSEED = 148203957
+
+
+class TestFFTEstimators(unittest.TestCase):
+    def setUp(self):
+        self.p = 2
+        self.q = 1
+        self.dt = 0.5
+        self.T = 1000.0
+        newTask = kali.carma.CARMATask(self.p, self.q, nthreads=2, nburn=1000)
+        Rho = np.array([-1.0/62.0, -1.0/3.0, -1.0/8.0, 1.0])
+        newTask.set(self.dt, kali.carma.coeffs(self.p, self.q, Rho))
+        self.newLC = newTask.simulate(duration=self.T, burnSeed=BURNSEED, distSeed=DISTSEED)
+        newTask.observe(self.newLC, noiseSeed=NOISESEED)
+        keep = np.random.RandomState(MASKSEED).uniform(size=self.newLC.numCadences) < 0.7
+        keep[400:700] = False
+        self.newLC.mask[:] = keep.astype(np.float64)
+
+    def tearDown(self):
+        del self.newLC
+
+    def compare(self, name):
+        n = self.newLC.numCadences
+        lags, fftVals, fftErrs = np.zeros(n), np.zeros(n), np.zeros(n)
+        bruteLags, bruteVals, bruteErrs = np.zeros(n), np.zeros(n), np.zeros(n)
+        func = getattr(LCTools_cython, name)
+        args = (n, self.dt, self.newLC.t, self.newLC.x, self.newLC.y, self.newLC.yerr, self.newLC.mask)
+        func(*(args + (lags, fftVals, fftErrs)))
+        func(*(args + (bruteLags, bruteVals, bruteErrs, True)))
+        self.assertTrue(np.allclose(lags, bruteLags))
+        finite = np.isfinite(bruteVals) & np.isfinite(bruteErrs)
+        self.assertTrue(np.array_equal(finite, np.isfinite(fftVals) & np.isfinite(fftErrs)))
+        fftVals, fftErrs, bruteVals, bruteErrs = fftVals[finite], fftErrs[finite], bruteVals[finite], bruteErrs[finite]
+        scale = np.max(np.abs(bruteVals))
+        errScale = np.max(np.abs(bruteErrs))
+        print name, np.max(np.abs(fftVals - bruteVals))/scale, np.max(np.abs(fftErrs - bruteErrs))/errScale
+        self.assertTrue(np.all(np.abs(fftVals - bruteVals) < 1.0e-9*scale))
+        self.assertTrue(np.all(np.abs(fftErrs - bruteErrs) < 1.0e-9*errScale))
+
+    def test_acvf(self):
+        self.compare('compute_ACVF')
+
+    def test_acf(self):
+        self.compare('compute_ACF')
+
+    def test_sf(self):
+        self.compare('compute_SF')
+
+    def test_lc(self):
+        lags, sf, sferr = self.newLC.sf()
+        bruteLags, bruteSF, bruteSFErr = self.newLC.sf(bruteForce=True)
+        self.assertTrue(np.allclose(sf, bruteSF, rtol=1.0e-8, atol=1.0e-12*np.max(bruteSF)))
+
+
+class TestDACF(unittest.TestCase):
+    def setUp(self):
+        rs = np.random.RandomState(DACFSEED)
+        self.n = 400
+        self.t = np.require(np.sort(rs.uniform(0.0, 500.0, size=self.n)), requirements=['C', 'A', 'W'])
+        self.y = np.cumsum(rs.normal(size=self.n))
+        self.yerr = 0.1*np.ones(self.n)
+        self.mask = (rs.uniform(size=self.n) < 0.8).astype(np.float64)
+
+    def test_pairs(self):
+        numBins = 40
+        lags = np.require(np.linspace(0.0, self.t[-1] - self.t[0], numBins), requirements=['C', 'A', 'W'])
+        vals, errs = np.zeros(numBins), np.zeros(numBins)
+        LCTools_cython.compute_DACF(self.n, self.t, self.y, self.y, self.yerr, self.mask, numBins, lags, vals, errs)
+        keep = self.mask != 0.0
+        meanVal = np.mean(self.y[keep])
+        denom = np.mean((self.y[keep] - meanVal)**2) - np.mean(self.yerr[keep])**2
+        first, second = np.triu_indices(self.n)
+        pairs = keep[first] & keep[second]
+        first, second = first[pairs], second[pairs]
+        udcf = (self.y[first] - meanVal)*(self.y[second] - meanVal)/denom
+        edges = np.concatenate(([0.0], 0.5*(lags[1:] + lags[:-1])))
+        bins = np.searchsorted(edges, self.t[second] - self.t[first], side='right') - 1
+        for binNum in range(numBins):
+            binVals = udcf[bins == binNum]
+            if binVals.shape[0] > 1:
+                self.assertTrue(np.isclose(vals[binNum], np.mean(binVals), rtol=1.0e-9, atol=1.0e-12))
+                self.assertTrue(np.isclose(errs[binNum], np.sqrt(np.sum((binVals - np.mean(binVals))**2))/(
+                    binVals.shape[0] - 1), rtol=1.0e-7, atol=1.0e-12))
+
+
+class TestSFBinned(unittest.TestCase):
+    def setUp(self):
+        rs = np.random.RandomState(SFSEED)
+        self.n = 1500
+        self.t = np.sort(51000.0 + 3000.0*rs.uniform(size=self.n)*rs.uniform(size=self.n))
+        self.yerr = 0.02 + 0.05*rs.uniform(size=self.n)
+        self.y = 17.0 + np.cumsum(0.1*rs.normal(size=self.n)) + self.yerr*rs.normal(size=self.n)
+        self.mask = (rs.uniform(size=self.n) < 0.85).astype(np.float64)
+
+    def test_pairs(self):
+        binEdges = np.logspace(-2.0, 3.5, 31)
+        lagVals, sfVals, sfErrVals, numPairVals = [np.zeros(30) for i in range(4)]
+        LCTools_cython.compute_SFBinned(self.t, self.y, self.yerr, self.mask, binEdges, lagVals, sfVals, sfErrVals,
+                                        numPairVals)
+        keep = self.mask != 0.0
+        t, y, yerr = self.t[keep], self.y[keep], self.yerr[keep]
+        first, second = np.triu_indices(t.shape[0], 1)
+        lags = t[second] - t[first]
+        vals = (y[second] - y[first])**2 - yerr[first]**2 - yerr[second]**2
+        bins = np.searchsorted(binEdges, lags, side='right') - 1
+        for binNum in range(30):
+            binVals = vals[bins == binNum]
+            self.assertEqual(numPairVals[binNum], binVals.shape[0])
+            if binVals.shape[0] > 1:
+                self.assertTrue(np.isclose(sfVals[binNum], np.mean(binVals), rtol=1.0e-9, atol=1.0e-12))
+                self.assertTrue(np.isclose(sfErrVals[binNum], np.std(binVals, ddof=1)/np.sqrt(binVals.shape[0]),
+                                           rtol=1.0e-7))
+                self.assertTrue(np.isclose(lagVals[binNum], np.mean(lags[bins == binNum]), rtol=1.0e-9))
+        badEdges = binEdges[::-1].copy()
+        self.assertEqual(LCTools_cython.compute_SFBinned(self.t, self.y, self.yerr, self.mask, badEdges, lagVals,
+                                                         sfVals, sfErrVals, numPairVals), -1)
+
+
+class TestLombScargle(unittest.TestCase):
+    def setUp(self):
+        rs = np.random.RandomState(LSSEED)
+        self.n = 400
+        self.period = 37.0
+        self.t = np.sort(55000.0 + 1500.0*rs.uniform(size=self.n))
+        self.yerr = 0.05 + 0.2*rs.uniform(size=self.n)
+        self.y = 3.0 + 0.3*np.sin(2.0*np.pi*self.t/self.period + 1.0) + self.yerr*rs.normal(size=self.n)
+        self.mask = (rs.uniform(size=self.n) < 0.9).astype(np.float64)
+        self.grid = kali.lc.frequencyGrid(1500.0, 1500.0/self.n)
+
+    def test_leastSquares(self):
+        keep = self.mask != 0.0
+        t, y, w = self.t[keep], self.y[keep], 1.0/self.yerr[keep]**2
+        w /= np.sum(w)
+        y = y - np.dot(w, y)
+        freqs = self.grid[0] + self.grid[1]*np.arange(0, self.grid[2], 97)
+        for fitMean in [True, False]:
+            for freq in freqs:
+                columns = [np.cos(2.0*np.pi*freq*t), np.sin(2.0*np.pi*freq*t)]
+                if fitMean:
+                    columns.append(np.ones(t.shape[0]))
+                design = np.vstack(columns).T
+                beta = np.linalg.lstsq(design*np.sqrt(w)[:, np.newaxis], y*np.sqrt(w), rcond=None)[0]
+                resid = y - np.dot(design, beta)
+                expected = 1.0 - np.dot(w, resid*resid)/np.dot(w, y*y)
+                freqs1, power = kali.lc.lombScargle(self.t, self.y, self.yerr, self.mask, freq, 1.0, 1, fitMean=fitMean,
+                                                    bruteForce=True)
+                self.assertTrue(abs(power[0] - expected) < 1.0e-10)
+
+    def test_fast(self):
+        for fitMean in [True, False]:
+            freqs, fast = kali.lc.lombScargle(self.t, self.y, self.yerr, self.mask, *self.grid, fitMean=fitMean)
+            freqs, brute = kali.lc.lombScargle(self.t, self.y, self.yerr, self.mask, *self.grid, fitMean=fitMean,
+                                               bruteForce=True)
+            print 'fitMean', fitMean, np.max(np.abs(fast - brute))
+            self.assertTrue(np.max(np.abs(fast - brute)) < 1.0e-4)
+            self.assertTrue(abs(1.0/freqs[np.argmax(fast)] - self.period) < 0.5)
+
+    def test_batch(self):
+        lengths = [self.n, self.n - 50, self.n - 100]
+        cadenceOffsets = np.concatenate(([0], np.cumsum(lengths))).astype(np.intc)
+        t, y, yerr, mask = [np.concatenate([arr[:length] for length in lengths])
+                            for arr in (self.t, self.y, self.yerr, self.mask)]
+        freqs, power = kali.lc.lombScargleBatch(cadenceOffsets, t, y, yerr, mask, *self.grid)
+        self.assertEqual(power.shape, (len(lengths), self.grid[2]))
+        for lcNum, length in enumerate(lengths):
+            freqs, single = kali.lc.lombScargle(self.t[:length], self.y[:length], self.yerr[:length],
+                                                self.mask[:length], *self.grid)
+            self.assertTrue(np.array_equal(power[lcNum], single))
+
+
+class TestBatchStats(unittest.TestCase):
+    def setUp(self):
+        rs = np.random.RandomState(BATCHSEED)
+        self.lengths = [300, 0, 250, 180]
+        self.cadenceOffsets = np.concatenate(([0], np.cumsum(self.lengths))).astype(np.intc)
+        self.t = np.concatenate([np.sort(1000.0*rs.uniform(size=n)) for n in self.lengths])
+        self.yerr = 0.05 + 0.1*rs.uniform(size=self.t.shape[0])
+        self.y = 10.0 + np.concatenate([np.cumsum(rs.normal(size=n)) for n in self.lengths])
+        self.mask = (rs.uniform(size=self.t.shape[0]) < 0.8).astype(np.float64)
+        self.sfBinEdges = np.logspace(0.0, 3.0, 16)
+        self.dacfLags = np.linspace(0.0, 500.0, 11)
+        self.grid = kali.lc.frequencyGrid(1000.0, 4.0)
+
+    def test_perObject(self):
+        results = kali.lc.batchStats(self.cadenceOffsets, self.t, self.y, self.yerr, self.mask,
+                                     stats=('moments', 'acvf', 'sfBinned', 'dacf', 'periodogram'),
+                                     sfBinEdges=self.sfBinEdges, dacfLags=self.dacfLags, freqGrid=self.grid)
+        for lcNum, n in enumerate(self.lengths):
+            start, stop = self.cadenceOffsets[lcNum], self.cadenceOffsets[lcNum + 1]
+            t, y, yerr, mask = [np.require(arr[start:stop], requirements=['C', 'A', 'W'])
+                                for arr in (self.t, self.y, self.yerr, self.mask)]
+            keep = mask != 0.0
+            self.assertEqual(results['numObserved'][lcNum], np.count_nonzero(keep))
+            if n == 0:
+                self.assertTrue(np.all(results['periodogram'][1][lcNum] == 0.0))
+                continue
+            self.assertTrue(np.isclose(results['mean'][lcNum], np.mean(y[keep]), rtol=1.0e-12))
+            self.assertTrue(np.isclose(results['std'][lcNum], np.std(y[keep]), rtol=1.0e-10))
+            self.assertTrue(np.isclose(results['meanerr'][lcNum], np.mean(yerr[keep]), rtol=1.0e-12))
+            lagVals, acvfVals, acvfErrVals = np.zeros(n), np.zeros(n), np.zeros(n)
+            LCTools_cython.compute_ACVF(n, t[1] - t[0], t, y, y, yerr, mask, lagVals, acvfVals, acvfErrVals)
+            self.assertTrue(np.allclose(results['acvf'][1][start:stop], acvfVals, rtol=1.0e-10, atol=1.0e-12))
+            sfLags, sfVals, sfErrVals, numPairs = [np.zeros(15) for i in range(4)]
+            LCTools_cython.compute_SFBinned(t, y, yerr, mask, self.sfBinEdges, sfLags, sfVals, sfErrVals, numPairs)
+            self.assertTrue(np.array_equal(results['sfBinned'][3][lcNum], numPairs))
+            self.assertTrue(np.allclose(results['sfBinned'][1][lcNum], sfVals, rtol=1.0e-10, atol=1.0e-12))
+            dacfVals, dacfErrVals = np.zeros(11), np.zeros(11)
+            LCTools_cython.compute_DACF(n, t, y, y, yerr, mask, 11, self.dacfLags, dacfVals, dacfErrVals)
+            self.assertTrue(np.allclose(results['dacf'][0][lcNum], dacfVals, rtol=1.0e-10, atol=1.0e-12))
+            freqs, power = kali.lc.lombScargle(t, y, yerr, mask, *self.grid)
+            self.assertTrue(np.array_equal(results['periodogram'][1][lcNum], power))
+
+    def test_invalid(self):
+        badOffsets = self.cadenceOffsets[::-1].copy()
+        self.assertRaises(ValueError, kali.lc.batchStats, badOffsets, self.t, self.y, self.yerr, self.mask)
+        self.assertRaises(ValueError, kali.lc.batchStats, self.cadenceOffsets, self.t, self.y, self.yerr, self.mask,
+                          stats=('dacf',))
+
+
+if __name__ == "__main__":
+    unittest.main()
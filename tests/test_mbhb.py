@@ -471,5 +471,14 @@ class TestFit(unittest.TestCase):
 
             pdb.set_trace()
 
+    def test_fitPT(self):
+        ntFit = kali.mbhb.MBHBTask(nsteps=self.nsteps/4)
+        ntFit.fit(self.nl1, zSSeed=ZSSEED, walkerSeed=WALKERSEED, moveSeed=MOVESEED, xSeed=XSEED,
+                  sampler='pt', ntemps=8, maxTemp=1.0e3)
+        self.assertTrue(np.all(np.isfinite(ntFit.LnPosterior)))
+        self.assertTrue(np.isfinite(ntFit.lnEvidence))
+        self.assertGreaterEqual(ntFit.lnEvidenceErr, 0.0)
+        self.assertLessEqual(ntFit.lnEvidence, np.max(ntFit.LnLikelihood))
+
 if __name__ == "__main__":
     unittest.main()
@@ -0,0 +1,84 @@
+import math
+import numpy as np
+import unittest
+import sys
+
+try:
+    import kali.carma
+    import CARMATask_cython
+except ImportError:
+    print 'Cannot import kali.carma! kali is not setup. Setup kali by sourcing bin/setup.sh'
+    sys.exit(1)
+
+ZSSEED = 384789247
+WALKERSEED = 738472981
+MOVESEED = 131343786
+STARTSEED = 1846302917
+
+ENSEMBLE_SAMPLER = 0
+PT_ENSEMBLE_SAMPLER = 2
+
+
+class TestGaussianTarget(unittest.TestCase):
+    def setUp(self):
+        self.mu = np.array([0.3, -0.5])
+        self.sigma = np.array([0.5, 1.0])
+        self.lower = np.array([-5.0, -5.0])
+        self.upper = np.array([5.0, 5.0])
+        self.nWalkers = 40
+        self.nThreads = 4
+        rs = np.random.RandomState(STARTSEED)
+        self.initPos = rs.uniform(-5.0, 5.0, size=self.mu.shape[0]*self.nWalkers)
+
+    def lnEvidence(self):
+        lnZ = 0.0
+        for mu, sigma, lower, upper in zip(self.mu, self.sigma, self.lower, self.upper):
+            mass = 0.5*(math.erf((upper - mu)/(sigma*math.sqrt(2.0))) -
+                        math.erf((lower - mu)/(sigma*math.sqrt(2.0))))
+            lnZ += math.log(mass/(upper - lower))
+        return lnZ
+
+    def sample(self, samplerType, nSteps, nTemps=1, maxTemp=1.0, batched=False, nThreads=None):
+        if nThreads is None:
+            nThreads = self.nThreads
+        Chain = np.zeros(self.mu.shape[0]*self.nWalkers*nSteps)
+        LnPrior, LnLikelihood = np.zeros(self.nWalkers*nSteps), np.zeros(self.nWalkers*nSteps)
+        LnEvidence = np.zeros(2)
+        self.assertEqual(CARMATask_cython.sample_GaussianTarget(
+            samplerType, batched, self.mu, self.sigma, self.lower, self.upper, self.nWalkers, nTemps, nSteps,
+            nThreads, 2.0, maxTemp, ZSSEED, WALKERSEED, MOVESEED, np.copy(self.initPos), Chain, LnPrior,
+            LnLikelihood, LnEvidence), 0)
+        return Chain.reshape((nSteps, self.nWalkers, self.mu.shape[0])), LnPrior, LnLikelihood, LnEvidence
+
+    def test_ptEvidence(self):
+        nSteps = 2000
+        Chain, LnPrior, LnLikelihood, LnEvidence = self.sample(PT_ENSEMBLE_SAMPLER, nSteps, nTemps=20,
+                                                               maxTemp=1.0e4)
+        print 'lnZ: %f +/- %f (analytic %f)'%(LnEvidence[0], LnEvidence[1], self.lnEvidence())
+        self.assertTrue(0.0 < LnEvidence[1] < 0.5)
+        self.assertTrue(math.fabs(LnEvidence[0] - self.lnEvidence()) < 3.0*LnEvidence[1])
+        samples = Chain[nSteps/2:].reshape((-1, self.mu.shape[0]))
+        self.assertTrue(np.all(np.fabs(np.mean(samples, axis=0) - self.mu) < 0.2*self.sigma))
+        self.assertTrue(np.all(np.fabs(np.std(samples, axis=0)/self.sigma - 1.0) < 0.2))
+
+    def test_batchedPolicy(self):
+        nSteps = 200
+        Chain, LnPrior, LnLikelihood, LnEvidence = self.sample(ENSEMBLE_SAMPLER, nSteps)
+        batchChain, batchLnPrior, batchLnLikelihood, LnEvidence = self.sample(ENSEMBLE_SAMPLER, nSteps, batched=True)
+        self.assertTrue(np.array_equal(Chain, batchChain))
+        self.assertTrue(np.array_equal(LnPrior, batchLnPrior))
+        self.assertTrue(np.array_equal(LnLikelihood, batchLnLikelihood))
+        self.assertGreater(np.unique(Chain[-1, :, 0]).shape[0], 1)
+
+    def test_threadIndependence(self):
+        nSteps = 200
+        Chain, LnPrior, LnLikelihood, LnEvidence = self.sample(ENSEMBLE_SAMPLER, nSteps, nThreads=1)
+        for nThreads in [3, self.nThreads]:
+            threadChain, threadLnPrior, threadLnLikelihood, LnEvidence = self.sample(ENSEMBLE_SAMPLER, nSteps,
+                                                                                     nThreads=nThreads)
+            self.assertTrue(np.array_equal(Chain, threadChain))
+            self.assertTrue(np.array_equal(LnLikelihood, threadLnLikelihood))
+
+
+if __name__ == "__main__":
+    unittest.main()